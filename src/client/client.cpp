@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <cstdio>
+
 #include "../assert.hpp"
 #include "../game_constants.hpp"
 #include "../i_drawers_factory.hpp"
@@ -13,6 +16,7 @@
 #include "../sound/sound_engine.hpp"
 #include "../sound/sound_id.hpp"
 #include "cutscene_player.hpp"
+#include "demo.hpp"
 #include "i_hud_drawer.hpp"
 #include "i_map_drawer.hpp"
 #include "i_minimap_drawer.hpp"
@@ -65,6 +69,8 @@ Client::Client(
 	CommandsMapPtr commands= std::make_shared<CommandsMap>();
 	commands->emplace( "fullmap", std::bind( &Client::FullMap, this ) );
 	commands->emplace( "pos", std::bind( &Client::PrintPlayerPos, this ) );
+	commands->emplace( "record", std::bind( &Client::RecordDemoCommand, this, std::placeholders::_1 ) );
+	commands->emplace( "stop", std::bind( &Client::StopDemoRecordingCommand, this ) );
 	commands_= std::move( commands );
 	commands_processor.RegisterCommands(commands_);
 
@@ -177,6 +183,15 @@ void Client::Load( const SaveLoadBuffer& buffer, unsigned int& buffer_pos )
 
 void Client::SetConnection( IConnectionPtr connection )
 {
+	if( demo_recorder_ != nullptr )
+	{
+		demo_recorder_->StopRecording();
+		demo_recorder_= nullptr;
+		Log::Info( "Demo recording finished" );
+	}
+	if( demo_player_ != nullptr && demo_player_ != connection )
+		demo_player_= nullptr;
+
 	if( connection == nullptr )
 	{
 		connection_info_= nullptr;
@@ -184,6 +199,19 @@ void Client::SetConnection( IConnectionPtr connection )
 	}
 	else
 	{
+		if( !demo_to_record_file_name_.empty() && demo_player_ == nullptr )
+		{
+			demo_recorder_= std::make_shared<DemoRecordingConnection>( connection, demo_to_record_file_name_.c_str() );
+			if( demo_recorder_->IsRecording() )
+			{
+				Log::Info( "Recording demo \"", demo_to_record_file_name_, "\"" );
+				connection= demo_recorder_;
+			}
+			else
+				demo_recorder_= nullptr;
+			demo_to_record_file_name_.clear();
+		}
+
 		connection_info_.reset( new ConnectionInfo( connection ) );
 		TransmitPlayerName();
 	}
@@ -197,6 +225,27 @@ bool Client::Disconnected() const
 	return connection_info_->connection->Disconnected();
 }
 
+bool Client::PlayTimedemo( const char* const file_name )
+{
+	const std::shared_ptr<DemoPlaybackConnection> demo_player= std::make_shared<DemoPlaybackConnection>( file_name );
+	if( !demo_player->IsValid() )
+		return false;
+
+	Log::Info( "Playing timedemo \"", file_name, "\"" );
+
+	demo_player_= demo_player;
+	SetConnection( demo_player );
+
+	timedemo_prev_frame_time_= Time::FromSeconds(0);
+	timedemo_frames_durations_ms_.clear();
+	return true;
+}
+
+bool Client::PlayingDemo() const
+{
+	return demo_player_ != nullptr;
+}
+
 bool Client::PlayingCutscene() const
 {
 	if( cutscene_player_ == nullptr )
@@ -276,8 +325,21 @@ void Client::Loop( const InputState& input_state, const bool paused )
 		pause_start_time_= Time::FromSeconds(0);
 	}
 
+	if( demo_player_ != nullptr )
+	{
+		// Frame duration is time between loops - it includes drawing of previous frame.
+		if( timedemo_prev_frame_time_ != Time::FromSeconds(0) )
+			timedemo_frames_durations_ms_.push_back( ( current_real_time - timedemo_prev_frame_time_ ).ToSeconds() * 1000.0f );
+		timedemo_prev_frame_time_= current_real_time;
+
+		if( !demo_player_->NextFrame() )
+			FinishTimedemo();
+	}
+
 	const Time prev_tick_time= current_tick_time_;
 	current_tick_time_= current_real_time - accumulated_pauses_time_;
+	if( demo_player_ != nullptr )
+		current_tick_time_= Time::FromInternalRepresentation( demo_player_->CurrentFrame().time );
 	const float tick_dt_s= ( current_tick_time_ - prev_tick_time ).ToSeconds();
 
 	if( connection_info_ != nullptr )
@@ -315,6 +377,11 @@ void Client::Loop( const InputState& input_state, const bool paused )
 
 	camera_controller_.Tick( input_state.keyboard );
 
+	if( demo_player_ != nullptr )
+		camera_controller_.SetAngles( demo_player_->CurrentFrame().view_angle_z, demo_player_->CurrentFrame().view_angle_x );
+	if( demo_recorder_ != nullptr )
+		demo_recorder_->EndFrame( current_tick_time_, camera_controller_.GetViewAngleZ(), camera_controller_.GetViewAngleX() );
+
 	if( sound_engine_ != nullptr )
 	{
 		sound_engine_->SetHeadPosition(
@@ -367,6 +434,7 @@ void Client::Loop( const InputState& input_state, const bool paused )
 			message.view_dir_angle_z = AngleToMessageAngle( camera_controller_.GetViewAngleZ() );
 			message.shoot_pressed    = input_state.mouse[ static_cast<unsigned int>( SystemEvent::MouseKeyEvent::Button::Left ) ];
 			message.color            = settings_.GetOrSetInt( SettingsKeys::player_color );
+			message.acknowledged_state_id= server_state_.state_id;
 			connection_info_->messages_sender.SendUnreliableMessage( message );
 		}
 
@@ -602,7 +670,7 @@ void Client::operator()( const Messages::MapChange& message )
 	}
 
 	show_progress( 0.5 );
-	map_state_.reset( new MapState( map_data, game_resources_, Time::CurrentTime() ) );
+	map_state_.reset( new MapState( map_data, game_resources_, demo_player_ != nullptr ? current_tick_time_ : Time::CurrentTime() ) );
 	minimap_state_.reset( new MinimapState( map_data ) );
 
 	if( loaded_minimap_state_ != nullptr &&
@@ -622,8 +690,8 @@ void Client::operator()( const Messages::MapChange& message )
 
 	show_progress( 1.0f );
 
-	// Try load cutscene.
-	if( message.need_play_cutscene )
+	// Try load cutscene. Skip it in demos.
+	if( message.need_play_cutscene && demo_player_ == nullptr )
 	{
 		cutscene_player_.reset(
 			new CutscenePlayer(
@@ -668,6 +736,68 @@ void Client::operator()( const Messages::TextMessage& message )
 	}
 }
 
+void Client::RecordDemoCommand( const CommandsArguments& args )
+{
+	if( args.empty() )
+	{
+		Log::Info( "Expected demo file name" );
+		return;
+	}
+
+	demo_to_record_file_name_= args.front();
+	Log::Info( "Demo \"", demo_to_record_file_name_, "\" will be recorded since next connection" );
+}
+
+void Client::StopDemoRecordingCommand()
+{
+	demo_to_record_file_name_.clear();
+
+	if( demo_recorder_ == nullptr )
+	{
+		Log::Info( "Not recording a demo" );
+		return;
+	}
+
+	// Recorder stays in connection, but does not write data anymore.
+	demo_recorder_->StopRecording();
+	demo_recorder_= nullptr;
+	Log::Info( "Demo recording finished" );
+}
+
+void Client::FinishTimedemo()
+{
+	demo_player_= nullptr;
+
+	std::vector<float>& durations= timedemo_frames_durations_ms_;
+	if( durations.empty() )
+	{
+		Log::User( "timedemo: no frames" );
+		return;
+	}
+
+	float total_ms= 0.0f;
+	for( const float duration : durations )
+		total_ms+= duration;
+
+	std::sort( durations.begin(), durations.end() );
+	const float p99_ms= durations[ std::min( durations.size() - 1u, durations.size() * 99u / 100u ) ];
+
+	char str[256];
+	std::snprintf(
+		str, sizeof(str),
+		"timedemo: %u frames, %.2f s, %.1f fps; frame time avg %.2f ms, min %.2f ms, p99 %.2f ms, max %.2f ms",
+		static_cast<unsigned int>( durations.size() ),
+		total_ms / 1000.0f,
+		float( durations.size() ) * 1000.0f / total_ms,
+		total_ms / float( durations.size() ),
+		durations.front(),
+		p99_ms,
+		durations.back() );
+	Log::User( str );
+
+	durations.clear();
+}
+
 void Client::StopMap()
 {
 	if( current_map_data_ != nullptr && sound_engine_ != nullptr )
@@ -40,6 +40,11 @@ public:
 	bool Disconnected() const;
 	bool PlayingCutscene() const;
 
+	// Replay demo as fast as possible and print frame time statistics at end.
+	// Returns false, if demo can not be loaded.
+	bool PlayTimedemo( const char* file_name );
+	bool PlayingDemo() const;
+
 	void ProcessEvents( const SystemEvents& events );
 
 	void Loop( const InputState& input_state, bool paused );
@@ -87,6 +92,9 @@ private:
 	void CorrectPlayerName();
 	void FullMap();
 	void PrintPlayerPos();
+	void RecordDemoCommand( const CommandsArguments& args );
+	void StopDemoRecordingCommand();
+	void FinishTimedemo();
 private:
 	Settings& settings_;
 	const GameResourcesConstPtr game_resources_;
@@ -98,6 +106,13 @@ private:
 
 	std::unique_ptr<ConnectionInfo> connection_info_;
 
+	// Recording starts with next connection, because demo must contain all messages since connection.
+	std::string demo_to_record_file_name_;
+	std::shared_ptr<DemoRecordingConnection> demo_recorder_;
+	std::shared_ptr<DemoPlaybackConnection> demo_player_;
+	Time timedemo_prev_frame_time_= Time::FromSeconds(0); // Real time
+	std::vector<float> timedemo_frames_durations_ms_;
+
 	std::string player_name_;
 
 	// Client uses real time minus pauses accumulated time.
@@ -0,0 +1,267 @@
+#include <algorithm>
+#include <cstring>
+
+#include "../common/files.hpp"
+using namespace ChasmReverse;
+
+#include "../log.hpp"
+
+#include "demo.hpp"
+
+namespace PanzerChasm
+{
+
+const char DemoHeader::c_expected_id[8]= "PanChDm"; // PanzerChasmDemo
+
+DemoRecordingConnection::DemoRecordingConnection( const IConnectionPtr& connection, const char* const file_name )
+	: connection_(connection)
+{
+	PC_ASSERT( connection_ != nullptr );
+
+	file_= std::fopen( file_name, "wb" );
+	if( file_ == nullptr )
+	{
+		Log::Warning( "Can not open demo file \"", file_name, "\"" );
+		return;
+	}
+
+	DemoHeader header;
+	std::memcpy( header.id, DemoHeader::c_expected_id, sizeof(header.id) );
+	header.version= DemoHeader::c_expected_version;
+	FileWrite( file_, &header, sizeof(header) );
+}
+
+DemoRecordingConnection::~DemoRecordingConnection()
+{
+	StopRecording();
+}
+
+bool DemoRecordingConnection::IsRecording() const
+{
+	return file_ != nullptr;
+}
+
+void DemoRecordingConnection::EndFrame( const Time time, const float view_angle_z, const float view_angle_x )
+{
+	if( file_ == nullptr )
+		return;
+
+	DemoFrameHeader frame_header;
+	frame_header.time= time.GetInternalRepresentation();
+	frame_header.view_angle_z= view_angle_z;
+	frame_header.view_angle_x= view_angle_x;
+	frame_header.reliable_data_size= static_cast<unsigned int>( reliable_data_.size() );
+	frame_header.unreliable_data_size= static_cast<unsigned int>( unreliable_data_.size() );
+
+	FileWrite( file_, &frame_header, sizeof(frame_header) );
+	FileWrite( file_, reliable_data_.data(), frame_header.reliable_data_size );
+	FileWrite( file_, unreliable_data_.data(), frame_header.unreliable_data_size );
+
+	reliable_data_.clear();
+	unreliable_data_.clear();
+}
+
+void DemoRecordingConnection::StopRecording()
+{
+	if( file_ == nullptr )
+		return;
+
+	std::fclose( file_ );
+	file_= nullptr;
+
+	reliable_data_.clear();
+	unreliable_data_.clear();
+}
+
+void DemoRecordingConnection::SendReliablePacket( const void* const data, const unsigned int data_size )
+{
+	connection_->SendReliablePacket( data, data_size );
+}
+
+void DemoRecordingConnection::SendUnreliablePacket( const void* const data, const unsigned int data_size )
+{
+	connection_->SendUnreliablePacket( data, data_size );
+}
+
+unsigned int DemoRecordingConnection::ReadRealiableData( void* const out_data, const unsigned int buffer_size )
+{
+	const unsigned int bytes_read= connection_->ReadRealiableData( out_data, buffer_size );
+	if( file_ != nullptr )
+	{
+		const unsigned char* const bytes= static_cast<const unsigned char*>(out_data);
+		reliable_data_.insert( reliable_data_.end(), bytes, bytes + bytes_read );
+	}
+	return bytes_read;
+}
+
+unsigned int DemoRecordingConnection::ReadUnrealiableData( void* const out_data, const unsigned int buffer_size )
+{
+	const unsigned int bytes_read= connection_->ReadUnrealiableData( out_data, buffer_size );
+	if( file_ != nullptr )
+	{
+		const unsigned char* const bytes= static_cast<const unsigned char*>(out_data);
+		unreliable_data_.insert( unreliable_data_.end(), bytes, bytes + bytes_read );
+	}
+	return bytes_read;
+}
+
+void DemoRecordingConnection::Disconnect()
+{
+	connection_->Disconnect();
+}
+
+bool DemoRecordingConnection::Disconnected()
+{
+	return connection_->Disconnected();
+}
+
+std::string DemoRecordingConnection::GetConnectionInfo()
+{
+	return connection_->GetConnectionInfo();
+}
+
+DemoPlaybackConnection::DemoPlaybackConnection( const char* const file_name )
+	: file_name_(file_name)
+{
+	std::memset( &current_frame_, 0, sizeof(current_frame_) );
+
+	std::FILE* const file= std::fopen( file_name, "rb" );
+	if( file == nullptr )
+	{
+		Log::Warning( "Can not open demo file \"", file_name, "\"" );
+		return;
+	}
+
+	std::fseek( file, 0, SEEK_END );
+	const unsigned int file_size= std::ftell( file );
+	std::fseek( file, 0, SEEK_SET );
+
+	data_.resize( file_size );
+	FileRead( file, data_.data(), file_size );
+	std::fclose( file );
+
+	if( file_size < sizeof(DemoHeader) )
+	{
+		Log::Warning( "Demo file \"", file_name, "\" is too small" );
+		return;
+	}
+
+	DemoHeader header;
+	std::memcpy( &header, data_.data(), sizeof(DemoHeader) );
+	if( std::memcmp( header.id, DemoHeader::c_expected_id, sizeof(header.id) ) != 0 )
+	{
+		Log::Warning( "File \"", file_name, "\" is not a demo" );
+		return;
+	}
+	if( header.version != DemoHeader::c_expected_version )
+	{
+		Log::Warning( "Demo \"", file_name, "\" has unsupported version ", header.version );
+		return;
+	}
+
+	next_frame_offset_= sizeof(DemoHeader);
+	valid_= true;
+}
+
+DemoPlaybackConnection::~DemoPlaybackConnection()
+{}
+
+bool DemoPlaybackConnection::IsValid() const
+{
+	return valid_;
+}
+
+bool DemoPlaybackConnection::NextFrame()
+{
+	if( !valid_ || disconnected_ )
+		return false;
+
+	const unsigned int data_size= static_cast<unsigned int>( data_.size() );
+	if( data_size - next_frame_offset_ < sizeof(DemoFrameHeader) )
+	{
+		disconnected_= true;
+		return false;
+	}
+
+	std::memcpy( &current_frame_, data_.data() + next_frame_offset_, sizeof(DemoFrameHeader) );
+	current_frame_data_offset_= next_frame_offset_ + sizeof(DemoFrameHeader);
+
+	const unsigned int frame_data_size= current_frame_.reliable_data_size + current_frame_.unreliable_data_size;
+	if( frame_data_size > data_size - current_frame_data_offset_ )
+	{
+		Log::Warning( "Demo \"", file_name_, "\" is truncated" );
+		disconnected_= true;
+		return false;
+	}
+
+	next_frame_offset_= current_frame_data_offset_ + frame_data_size;
+	reliable_data_pos_= 0u;
+	unreliable_data_pos_= 0u;
+	return true;
+}
+
+const DemoFrameHeader& DemoPlaybackConnection::CurrentFrame() const
+{
+	return current_frame_;
+}
+
+void DemoPlaybackConnection::SendReliablePacket( const void* const data, const unsigned int data_size )
+{
+	PC_UNUSED(data);
+	PC_UNUSED(data_size);
+}
+
+void DemoPlaybackConnection::SendUnreliablePacket( const void* const data, const unsigned int data_size )
+{
+	PC_UNUSED(data);
+	PC_UNUSED(data_size);
+}
+
+unsigned int DemoPlaybackConnection::ReadRealiableData( void* const out_data, const unsigned int buffer_size )
+{
+	return
+		ReadFrameData(
+			out_data, buffer_size,
+			current_frame_data_offset_, current_frame_.reliable_data_size,
+			reliable_data_pos_ );
+}
+
+unsigned int DemoPlaybackConnection::ReadUnrealiableData( void* const out_data, const unsigned int buffer_size )
+{
+	return
+		ReadFrameData(
+			out_data, buffer_size,
+			current_frame_data_offset_ + current_frame_.reliable_data_size, current_frame_.unreliable_data_size,
+			unreliable_data_pos_ );
+}
+
+void DemoPlaybackConnection::Disconnect()
+{
+	disconnected_= true;
+}
+
+bool DemoPlaybackConnection::Disconnected()
+{
+	return disconnected_;
+}
+
+std::string DemoPlaybackConnection::GetConnectionInfo()
+{
+	return "demo " + file_name_;
+}
+
+unsigned int DemoPlaybackConnection::ReadFrameData(
+	void* const out_data, const unsigned int buffer_size,
+	const unsigned int data_offset, const unsigned int data_size,
+	unsigned int& pos )
+{
+	if( disconnected_ )
+		return 0u;
+
+	const unsigned int bytes_to_read= std::min( buffer_size, data_size - pos );
+	std::memcpy( out_data, data_.data() + data_offset + pos, bytes_to_read );
+	pos+= bytes_to_read;
+	return bytes_to_read;
+}
+
+} // namespace PanzerChasm
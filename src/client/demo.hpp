@@ -0,0 +1,114 @@
+#pragma once
+#include <cstdio>
+#include <vector>
+
+#include "../assert.hpp"
+#include "../fwd.hpp"
+#include "../i_connection.hpp"
+#include "../time.hpp"
+
+namespace PanzerChasm
+{
+
+// Demo file contains stream of server messages, received by client.
+// Stream is splitted into frames - one frame for each client loop.
+// Each frame also contains client time and camera angles, because camera is not controlled by server.
+
+struct DemoHeader
+{
+	static const char c_expected_id[8];
+	static constexpr unsigned int c_expected_version= 2u; // Change each time, when format or net protocol changed.
+
+	char id[8]; // must be equal to c_expected_id
+	unsigned int version;
+};
+
+SIZE_ASSERT( DemoHeader, 12u );
+
+struct DemoFrameHeader
+{
+	int64_t time; // Internal representation of client time.
+	float view_angle_z, view_angle_x;
+	unsigned int reliable_data_size;
+	unsigned int unreliable_data_size;
+};
+
+SIZE_ASSERT( DemoFrameHeader, 24u );
+
+// Connection wrapper. Passes all data through and writes received data into demo file.
+class DemoRecordingConnection final : public IConnection
+{
+public:
+	DemoRecordingConnection( const IConnectionPtr& connection, const char* file_name );
+	virtual ~DemoRecordingConnection() override;
+
+	bool IsRecording() const;
+
+	// Write data, received since previous call.
+	void EndFrame( Time time, float view_angle_z, float view_angle_x );
+	// Close file. Connection continues to work after this.
+	void StopRecording();
+
+public: // IConnection
+	virtual void SendReliablePacket( const void* data, unsigned int data_size ) override;
+	virtual void SendUnreliablePacket( const void* data, unsigned int data_size ) override;
+
+	virtual unsigned int ReadRealiableData( void* out_data, unsigned int buffer_size ) override;
+	virtual unsigned int ReadUnrealiableData( void* out_data, unsigned int buffer_size ) override;
+
+	virtual void Disconnect() override;
+	virtual bool Disconnected() override;
+
+	virtual std::string GetConnectionInfo() override;
+
+private:
+	const IConnectionPtr connection_;
+	std::FILE* file_= nullptr;
+
+	std::vector<unsigned char> reliable_data_;
+	std::vector<unsigned char> unreliable_data_;
+};
+
+// Connection, which returns data from demo file. Data, sent by client, is dropped.
+class DemoPlaybackConnection final : public IConnection
+{
+public:
+	explicit DemoPlaybackConnection( const char* file_name );
+	virtual ~DemoPlaybackConnection() override;
+
+	// Returns false, if file not found or has invalid format.
+	bool IsValid() const;
+
+	// Returns false at end of demo. After that connection is disconnected.
+	bool NextFrame();
+	const DemoFrameHeader& CurrentFrame() const;
+
+public: // IConnection
+	virtual void SendReliablePacket( const void* data, unsigned int data_size ) override;
+	virtual void SendUnreliablePacket( const void* data, unsigned int data_size ) override;
+
+	virtual unsigned int ReadRealiableData( void* out_data, unsigned int buffer_size ) override;
+	virtual unsigned int ReadUnrealiableData( void* out_data, unsigned int buffer_size ) override;
+
+	virtual void Disconnect() override;
+	virtual bool Disconnected() override;
+
+	virtual std::string GetConnectionInfo() override;
+
+private:
+	unsigned int ReadFrameData( void* out_data, unsigned int buffer_size, unsigned int data_offset, unsigned int data_size, unsigned int& pos );
+
+private:
+	const std::string file_name_;
+	std::vector<unsigned char> data_;
+	bool valid_= false;
+	bool disconnected_= false;
+
+	unsigned int next_frame_offset_= 0u;
+	DemoFrameHeader current_frame_;
+	unsigned int current_frame_data_offset_= 0u;
+	unsigned int reliable_data_pos_= 0u;
+	unsigned int unreliable_data_pos_= 0u;
+};
+
+} // namespace PanzerChasm
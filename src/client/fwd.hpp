@@ -13,4 +13,7 @@ class MapBSPTree;
 class CutscenePlayer;
 class MovementController;
 
+class DemoRecordingConnection;
+class DemoPlaybackConnection;
+
 } // namespace PanzerChasm
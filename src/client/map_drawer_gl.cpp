@@ -431,6 +431,7 @@ void MapDrawerGL::SetMap( const MapDataConstPtr& map_data )
 		return;
 
 	map_light_.SetMap( map_data );
+	shadows_lights_grid_.SetMap( *map_data );
 
 	current_map_data_= map_data;
 
@@ -520,6 +521,8 @@ void MapDrawerGL::Draw(
 
 	if( settings_.GetOrSetBool( SettingsKeys::shadows, true ) )
 	{
+		shadows_lights_grid_.UpdateDynamicLights( map_state );
+
 		r_OGLStateManager::UpdateState( g_shadows_gl_state );
 		DrawMapModelsShadows( map_state, view_matrix, view_clip_planes );
 		DrawItemsShadows( map_state, view_matrix, view_clip_planes );
@@ -2314,7 +2317,7 @@ void MapDrawerGL::DrawMapModelsShadows(
 			continue;
 
 		m_Vec3 light_pos;
-		if( !GetNearestLightSourcePos( static_model.pos, *current_map_data_, map_state, false, light_pos ) )
+		if( !shadows_lights_grid_.GetNearestLightSourcePos( static_model.pos, false, light_pos ) )
 			continue;
 
 		const ModelGeometry& model_geometry= models_geometry_[ static_model.model_id ];
@@ -2373,7 +2376,7 @@ void MapDrawerGL::DrawItemsShadows(
 			continue;
 
 		m_Vec3 light_pos;
-		if( !GetNearestLightSourcePos( item.pos, *current_map_data_, map_state, true, light_pos ) )
+		if( !shadows_lights_grid_.GetNearestLightSourcePos( item.pos, true, light_pos ) )
 			continue;
 
 		const ModelGeometry& model_geometry= items_geometry_[ item.item_id ];
@@ -2433,7 +2436,7 @@ void MapDrawerGL::DrawMonstersShadows(
 			continue;
 
 		m_Vec3 light_pos;
-		if( !GetNearestLightSourcePos( monster.pos, *current_map_data_, map_state, true, light_pos ) )
+		if( !shadows_lights_grid_.GetNearestLightSourcePos( monster.pos, true, light_pos ) )
 			continue;
 
 		// TODO - monsters cast shadows allways?
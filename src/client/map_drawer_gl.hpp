@@ -10,6 +10,7 @@
 #include "i_map_drawer.hpp"
 #include "fwd.hpp"
 #include "map_state.hpp"
+#include "shadows_lights_grid.hpp"
 #include "opengl_renderer/animations_buffer.hpp"
 #include "opengl_renderer/map_light.hpp"
 
@@ -263,6 +264,7 @@ private:
 	r_GLSLProgram fullscreen_blend_shader_;
 
 	MapLight map_light_;
+	ShadowsLightsGrid shadows_lights_grid_;
 
 	// Reuse vector (do not create new vector each frame).
 	std::vector<const MapState::SpriteEffect*> sorted_sprites_;
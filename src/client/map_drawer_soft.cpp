@@ -1,116 +1,313 @@
+#include <algorithm>
 #include <cstring>
+#include <limits>
 
 #include "../assert.hpp"
 #include "../game_constants.hpp"
 #include "../log.hpp"
 #include "../map_loader.hpp"
 #include "../math_utils.hpp"
+#include "../profiler.hpp"
 #include "../settings.hpp"
 #include "../shared_settings_keys.hpp"
+#include "../time.hpp"
 #include "map_drawers_common.hpp"
 #include "software_renderer/map_bsp_tree.hpp"
 #include "software_renderer/map_bsp_tree.inl"
 #include "software_renderer/rasterizer.inl"
+#include "software_renderer/texture_mips.hpp"
 
 #include "map_drawer_soft.hpp"
 
 namespace PanzerChasm
 {
 
-static void BuildMip(
-	const uint32_t* const in_data, const unsigned int in_size_x, const unsigned int in_size_y,
-	uint32_t* const out_data )
+// Scales of viewport for dynamic resolution. Level 0 is full resolution.
+static const float g_resolution_scales[]= { 1.0f, 0.875f, 0.75f, 0.625f, 0.5f };
+static constexpr unsigned int g_resolution_scale_levels= sizeof(g_resolution_scales) / sizeof(g_resolution_scales[0]);
+// Wait some frames after scale change, because first frames after change are slower (surfaces cache refill).
+static constexpr unsigned int g_frames_between_resolution_scale_changes= 20u;
+
+static fixed16_t ScaleLightmapLight( const unsigned char lightmap_value )
 {
-	const unsigned int out_size_x= in_size_x >> 1u;
-	const unsigned int out_size_y= in_size_y >> 1u;
-	for( unsigned int y= 0u; y < out_size_y; y++ )
-	for( unsigned int x= 0u; x < out_size_x; x++ )
-	{
-		uint32_t pixels[4];
-		const unsigned int src_x= x << 1u;
-		const unsigned int src_y= y << 1u;
-		pixels[0]= in_data[ src_x +        src_y        * in_size_x ];
-		pixels[1]= in_data[ src_x + 1u +   src_y        * in_size_x ];
-		pixels[2]= in_data[ src_x + 1u + ( src_y + 1u ) * in_size_x ];
-		pixels[3]= in_data[ src_x +      ( src_y + 1u ) * in_size_x ];
+	// Overbright constant must be equal to same constant in shader. See shaders/constants.glsl.
+	static constexpr float c_overbright= 1.3f;
+	static constexpr fixed16_t scale= static_cast<fixed16_t>( ( c_overbright * 65536.0f ) / 255.0f );
 
-		unsigned char components[4];
-		for( unsigned int c= 0u; c < 4u; c++ )
+	return lightmap_value * scale;
+}
+
+// Select mip, using texels per pixel ratio for longest polygon edge.
+static unsigned int SelectPolygonMip(
+	const RasterizerVertex* const vertices, const unsigned int vertex_count,
+	const unsigned int mip_count )
+{
+	unsigned int longest_edge_index= 0u;
+	fixed8_t longest_edge_squre_length= 1;
+	for( unsigned int i= 0u; i < vertex_count; i++ )
+	{
+		const unsigned int prev_i= i == 0u ? (vertex_count - 1u) : (i - 1u);
+		const fixed16_t dx= vertices[i].x - vertices[prev_i].x;
+		const fixed16_t dy= vertices[i].y - vertices[prev_i].y;
+		const fixed8_t square_length= FixedMul<16+8>( dx, dx ) + FixedMul<16+8>( dy, dy );
+		if( square_length > longest_edge_squre_length )
 		{
-			components[c]= (
-				reinterpret_cast<const unsigned char*>(&pixels[0])[c] +
-				reinterpret_cast<const unsigned char*>(&pixels[1])[c] +
-				reinterpret_cast<const unsigned char*>(&pixels[2])[c] +
-				reinterpret_cast<const unsigned char*>(&pixels[3])[c] ) >> 2u;
+			longest_edge_squre_length= square_length;
+			longest_edge_index= i;
 		}
-		std::memcpy( &out_data[ x + y * out_size_x ], components, sizeof(uint32_t) );
 	}
+
+	const unsigned int prev_v= longest_edge_index == 0u ? (vertex_count - 1u) : (longest_edge_index - 1u);
+	const fixed16_t du= vertices[longest_edge_index].u - vertices[prev_v].u;
+	const fixed16_t dv= vertices[longest_edge_index].v - vertices[prev_v].v;
+	const fixed8_t square_tc_delta= FixedMul<16+8>( du, du ) + FixedMul<16+8>( dv, dv );
+	const int d_tc_d_len_square = square_tc_delta / longest_edge_squre_length;
+
+	unsigned int mip;
+	if( d_tc_d_len_square < 1 * 1 )
+		mip= 0u;
+	else if( d_tc_d_len_square < 2 * 2 )
+		mip= 1u;
+	else if( d_tc_d_len_square < 4 * 4 )
+		mip= 2u;
+	else
+		mip= 3u;
+
+	return std::min( mip, mip_count - 1u );
+}
+
+// Builds quad, facing to camera. Vertical quads are rotated only around z axis.
+static void BuildSpriteBillboard(
+	const m_Vec3& pos,
+	const m_Vec3& vec_to_sprite,
+	const float half_size_x,
+	const float half_size_z,
+	const bool vertical,
+	m_Vec3* const out_vertices )
+{
+	// Build basis directly, without angles and matrices.
+	const float xy_length= vec_to_sprite.xy().Length();
+	m_Vec3 right( 0.0f, -1.0f, 0.0f );
+	if( xy_length > 0.0f )
+	{
+		const float xy_length_inv= 1.0f / xy_length;
+		right.x=  vec_to_sprite.y * xy_length_inv;
+		right.y= -vec_to_sprite.x * xy_length_inv;
+	}
+
+	m_Vec3 up( 0.0f, 0.0f, 1.0f );
+	const float length= vec_to_sprite.Length();
+	if( !vertical && length > 0.0f )
+	{
+		// up = cross( right, dir ).
+		const m_Vec3 dir= vec_to_sprite * ( 1.0f / length );
+		up.x=  right.y * dir.z;
+		up.y= -right.x * dir.z;
+		up.z=  right.x * dir.y - right.y * dir.x;
+	}
+
+	right= right * half_size_x;
+	up= up * half_size_z;
+	out_vertices[0]= pos - right - up;
+	out_vertices[1]= pos + right - up;
+	out_vertices[2]= pos + right + up;
+	out_vertices[3]= pos - right + up;
 }
 
-static void BuildMipAlphaCorrected(
-	const uint32_t* const in_data, const unsigned int in_size_x, const unsigned int in_size_y,
-	uint32_t* const out_data )
+static void SetPolygonMipTexture(
+	Rasterizer& rasterizer,
+	const TexturesStore::Texture& texture, const unsigned int frame,
+	RasterizerVertex* const vertices, const unsigned int vertex_count )
 {
-	const unsigned int out_size_x= in_size_x >> 1u;
-	const unsigned int out_size_y= in_size_y >> 1u;
-	for( unsigned int y= 0u; y < out_size_y; y++ )
-	for( unsigned int x= 0u; x < out_size_x; x++ )
-	{
-		uint32_t pixels[4];
-		const unsigned int src_x= x << 1u;
-		const unsigned int src_y= y << 1u;
-		pixels[0]= in_data[ src_x +        src_y        * in_size_x ];
-		pixels[1]= in_data[ src_x + 1u +   src_y        * in_size_x ];
-		pixels[2]= in_data[ src_x + 1u + ( src_y + 1u ) * in_size_x ];
-		pixels[3]= in_data[ src_x +      ( src_y + 1u ) * in_size_x ];
-
-		// Calculate avg color, except for pixels with full alpha (=0)
-		unsigned int components_sum[4]= { 0u, 0u, 0u, 0u };
-		unsigned int nonalpha_pixels= 0u;
-		for( unsigned int p= 0u; p < 4u; p++ )
+	const unsigned int mip= SelectPolygonMip( vertices, vertex_count, texture.mip_count );
+	if( mip > 0u )
+	{
+		for( unsigned int i= 0u; i < vertex_count; i++ )
 		{
-			if( (pixels[p] & Rasterizer::c_alpha_mask) != 0u )
-			{
-				nonalpha_pixels++;
-				for( unsigned int c= 0u; c < 3u; c++ )
-					components_sum[c]+= reinterpret_cast<const unsigned char*>(&pixels[p])[c];
-			} // else - full alpha
-			components_sum[3]+= reinterpret_cast<const unsigned char*>(&pixels[p])[3];
+			vertices[i].u >>= mip;
+			vertices[i].v >>= mip;
 		}
-		unsigned char components[4];
-		if( nonalpha_pixels > 0u )
+	}
+
+	rasterizer.SetTexture(
+		texture.size[0] >> mip, texture.size[1] >> mip,
+		texture.GetFrame( frame, mip ) );
+}
+
+// Paletted sprites have no mips.
+static void SetPalettedSpriteTexture(
+	Rasterizer& rasterizer,
+	const ObjSprite& sprite, const unsigned int frame,
+	const uint32_t* const lit_palettes )
+{
+	rasterizer.SetTexture(
+		sprite.size[0], sprite.size[1],
+		sprite.data.data() + sprite.size[0] * sprite.size[1] * frame,
+		lit_palettes );
+}
+
+template<Rasterizer::TextureFormat texture_format>
+static Rasterizer::ConvexPolygonDrawFunc GetSpriteDrawFunc( const bool lighting )
+{
+	if( lighting )
+		return
+			&Rasterizer::DrawTexturedConvexPolygonSpanCorrected<
+				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
+				Rasterizer::AlphaTest::Yes,
+				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
+				Rasterizer::Lighting::Yes, Rasterizer::Blending::Yes, texture_format>;
+	else
+		return
+			&Rasterizer::DrawTexturedConvexPolygonSpanCorrected<
+				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
+				Rasterizer::AlphaTest::Yes,
+				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
+				Rasterizer::Lighting::No, Rasterizer::Blending::Yes, texture_format>;
+}
+
+template<Rasterizer::TextureFormat texture_format>
+static void SelectModelDrawFuncs(
+	const bool transparent,
+	const bool force_transparent_nontransparent_polygons,
+	const bool affine,
+	Rasterizer::TriangleDrawFunc& out_draw_func,
+	Rasterizer::TriangleDrawFunc& out_alpha_draw_func )
+{
+	if( affine )
+	{
+		if( transparent )
 		{
-			for( unsigned int c= 0u; c < 3u; c++ )
-				components[c]= components_sum[c] / nonalpha_pixels;
+			out_draw_func= &Rasterizer::DrawAffineTexturedTriangle<
+				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
+				Rasterizer::AlphaTest::No,
+				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
+				Rasterizer::Lighting::Yes, Rasterizer::Blending::Yes, texture_format>;
+			out_alpha_draw_func= &Rasterizer::DrawAffineTexturedTriangle<
+				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
+				Rasterizer::AlphaTest::Yes,
+				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
+				Rasterizer::Lighting::Yes, Rasterizer::Blending::Yes, texture_format>;
 		}
 		else
 		{
-			for( unsigned int c= 0u; c < 3u; c++ )
-				components[c]= 0u;
+			out_draw_func= &Rasterizer::DrawAffineTexturedTriangle<
+				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
+				Rasterizer::AlphaTest::No,
+				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
+				Rasterizer::Lighting::Yes, Rasterizer::Blending::No, texture_format>;
+			out_alpha_draw_func= &Rasterizer::DrawAffineTexturedTriangle<
+				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
+				Rasterizer::AlphaTest::Yes,
+				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
+				Rasterizer::Lighting::Yes, Rasterizer::Blending::No, texture_format>;
 		}
-		components[3]= components_sum[3] >> 2u;
-
-		std::memcpy( &out_data[ x + y * out_size_x ], components, sizeof(uint32_t) );
+	}
+	else if( transparent || force_transparent_nontransparent_polygons )
+	{
+		out_draw_func=
+			&Rasterizer::DrawTexturedTriangleSpanCorrected<
+				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::No,
+				Rasterizer::AlphaTest::No,
+				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
+				Rasterizer::Lighting::Yes, Rasterizer::Blending::Yes, Rasterizer::DepthHack::No, texture_format>;
+		out_alpha_draw_func=
+			&Rasterizer::DrawTexturedTriangleSpanCorrected<
+				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
+				Rasterizer::AlphaTest::Yes,
+				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
+				Rasterizer::Lighting::Yes, Rasterizer::Blending::Yes, Rasterizer::DepthHack::No, texture_format>;
+	}
+	else
+	{
+		out_draw_func=
+			&Rasterizer::DrawTexturedTriangleSpanCorrected<
+				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
+				Rasterizer::AlphaTest::No,
+				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
+				Rasterizer::Lighting::Yes, Rasterizer::Blending::No, Rasterizer::DepthHack::No, texture_format>;
+		out_alpha_draw_func=
+			&Rasterizer::DrawTexturedTriangleSpanCorrected<
+				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
+				Rasterizer::AlphaTest::Yes,
+				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
+				Rasterizer::Lighting::Yes, Rasterizer::Blending::No, Rasterizer::DepthHack::No, texture_format>;
 	}
 }
 
-static void MakeBinaryAlpha( uint32_t* const pixels, const unsigned int pixel_count )
+template<Rasterizer::TextureFormat texture_format>
+static void SelectWeaponDrawFuncs(
+	const bool invisible,
+	Rasterizer::TriangleDrawFunc& out_draw_func,
+	Rasterizer::TriangleDrawFunc& out_alpha_draw_func )
 {
-	for( unsigned int i= 0u; i < pixel_count; i++ )
+	if( invisible )
+	{
+		out_draw_func=
+			&Rasterizer::DrawTexturedTriangleSpanCorrected<
+				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
+				Rasterizer::AlphaTest::No,
+				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
+				Rasterizer::Lighting::Yes, Rasterizer::Blending::Yes, Rasterizer::DepthHack::Yes, texture_format>;
+		out_alpha_draw_func=
+			&Rasterizer::DrawTexturedTriangleSpanCorrected<
+				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
+				Rasterizer::AlphaTest::Yes,
+				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
+				Rasterizer::Lighting::Yes, Rasterizer::Blending::Yes, Rasterizer::DepthHack::Yes, texture_format>;
+	}
+	else
 	{
-		// TODO - calibrate alpha edge.
-		if( ( pixels[i] & Rasterizer::c_alpha_mask ) < Rasterizer::c_alpha_mask / 3u )
-			pixels[i]&= ~Rasterizer::c_alpha_mask;
+		out_draw_func=
+			&Rasterizer::DrawTexturedTriangleSpanCorrected<
+				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
+				Rasterizer::AlphaTest::No,
+				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
+				Rasterizer::Lighting::Yes, Rasterizer::Blending::No, Rasterizer::DepthHack::Yes, texture_format>;
+		out_alpha_draw_func=
+			&Rasterizer::DrawTexturedTriangleSpanCorrected<
+				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
+				Rasterizer::AlphaTest::Yes,
+				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
+				Rasterizer::Lighting::Yes, Rasterizer::Blending::No, Rasterizer::DepthHack::Yes, texture_format>;
 	}
 }
 
-static fixed16_t ScaleLightmapLight( const unsigned char lightmap_value )
+template<Rasterizer::TextureFormat texture_format>
+static void SelectItemIconDrawFuncs(
+	const bool transparent,
+	Rasterizer::TriangleDrawFunc& out_draw_func,
+	Rasterizer::TriangleDrawFunc& out_alpha_draw_func )
 {
-	// Overbright constant must be equal to same constant in shader. See shaders/constants.glsl.
-	static constexpr float c_overbright= 1.3f;
-	static constexpr fixed16_t scale= static_cast<fixed16_t>( ( c_overbright * 65536.0f ) / 255.0f );
-
-	return lightmap_value * scale;
+	if( transparent )
+	{
+		out_draw_func=
+			&Rasterizer::DrawTexturedTriangleSpanCorrected<
+				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
+				Rasterizer::AlphaTest::No,
+				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
+				Rasterizer::Lighting::No, Rasterizer::Blending::Yes, Rasterizer::DepthHack::Yes, texture_format>;
+		out_alpha_draw_func=
+			&Rasterizer::DrawTexturedTriangleSpanCorrected<
+				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
+				Rasterizer::AlphaTest::Yes,
+				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
+				Rasterizer::Lighting::No, Rasterizer::Blending::Yes, Rasterizer::DepthHack::Yes, texture_format>;
+	}
+	else
+	{
+		out_draw_func=
+			&Rasterizer::DrawTexturedTriangleSpanCorrected<
+				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
+				Rasterizer::AlphaTest::Yes,
+				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
+				Rasterizer::Lighting::No, Rasterizer::Blending::No, Rasterizer::DepthHack::Yes, texture_format>;
+		out_alpha_draw_func=
+			&Rasterizer::DrawTexturedTriangleSpanCorrected<
+				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
+				Rasterizer::AlphaTest::Yes,
+				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
+				Rasterizer::Lighting::No, Rasterizer::Blending::No, Rasterizer::DepthHack::Yes, texture_format>;
+	}
 }
 
 MapDrawerSoft::MapDrawerSoft(
@@ -120,58 +317,34 @@ MapDrawerSoft::MapDrawerSoft(
 	: settings_(settings)
 	, game_resources_( game_resources )
 	, rendering_context_( rendering_context )
+	, textures_store_( *rendering_context.textures_store )
 	, screen_transform_x_( 0.5f * float( rendering_context_.viewport_size.Width () ) )
 	, screen_transform_y_( 0.5f * float( rendering_context_.viewport_size.Height() ) )
-	, rasterizer_(
+	, full_rasterizer_(
 		rendering_context.viewport_size.Width(), rendering_context.viewport_size.Height(),
 		rendering_context.row_pixels, rendering_context.window_surface_data )
+	, rasterizer_( &full_rasterizer_ )
 	, surfaces_cache_( rendering_context_.viewport_size )
+	, scaled_viewport_size_( rendering_context_.viewport_size )
 {
 	PC_ASSERT( game_resources_ != nullptr );
 
 	sky_texture_.file_name[0]= '\0';
 
-	LoadModelsGroup( game_resources_->items_models, items_models_ );
-	LoadModelsGroup( game_resources_->rockets_models, rockets_models_ );
-	LoadModelsGroup( game_resources_->gibs_models, gibs_models_ );
-	LoadModelsGroup( game_resources_->weapons_models, weapons_models_ );
-	LoadModelsGroup( game_resources_->monsters_models, monsters_models_ );
-
-	// Load effects sprites.
-
-	const PaletteTransformed& palette= *rendering_context_.palette_transformed;
-
-	sprite_effects_textures_.resize( game_resources_->effects_sprites.size() );
-	for( unsigned int i= 0u; i < sprite_effects_textures_.size(); i++ )
-	{
-		const ObjSprite& in_sprite= game_resources_->effects_sprites[i];
-		SpriteTexture& out_sprite_texture= sprite_effects_textures_[i];
-
-		out_sprite_texture.size[0]= in_sprite.size[0];
-		out_sprite_texture.size[1]= in_sprite.size[1];
-		out_sprite_texture.size[2]= in_sprite.frame_count;
-
-		const unsigned int pixel_count= in_sprite.size[0] * in_sprite.size[1] * in_sprite.frame_count;
-		out_sprite_texture.data.resize( pixel_count );
-		for( unsigned int j= 0u; j < pixel_count; j++ )
-			out_sprite_texture.data[j]= palette[in_sprite.data[j]];
+	{ // Lit palettes for paletted models textures. Color #0 of models is transparent.
+		PaletteTransformed models_palette= *rendering_context_.palette_transformed;
+		models_palette[0]&= ~Rasterizer::c_alpha_mask;
+		models_lit_palettes_.resize( Rasterizer::c_lit_palettes_size );
+		Rasterizer::BuildLitPalettes( models_palette.data(), models_lit_palettes_.data() );
 	}
-
-	bmp_objects_sprites_.resize( game_resources_->bmp_objects_sprites.size() );
-	for( unsigned int i= 0u; i < bmp_objects_sprites_.size(); i++ )
-	{
-		const ObjSprite& in_sprite= game_resources_->bmp_objects_sprites[i];
-		SpriteTexture& out_sprite_texture= bmp_objects_sprites_[i];
-
-		out_sprite_texture.size[0]= in_sprite.size[0];
-		out_sprite_texture.size[1]= in_sprite.size[1];
-		out_sprite_texture.size[2]= in_sprite.frame_count;
-
-		const unsigned int pixel_count= in_sprite.size[0] * in_sprite.size[1] * in_sprite.frame_count;
-		out_sprite_texture.data.resize( pixel_count );
-		for( unsigned int j= 0u; j < pixel_count; j++ )
-			out_sprite_texture.data[j]= palette[in_sprite.data[j]];
+	{ // Lit palettes for paletted sprites. Transparent color of sprites already has zero alpha.
+		sprites_lit_palettes_.resize( Rasterizer::c_lit_palettes_size );
+		Rasterizer::BuildLitPalettes( rendering_context_.palette_transformed->data(), sprites_lit_palettes_.data() );
 	}
+
+	use_paletted_textures_= settings_.GetOrSetBool( "r_paletted_textures", false );
+	LoadModelsTextures();
+	LoadSpritesTextures();
 }
 
 MapDrawerSoft::~MapDrawerSoft()
@@ -189,6 +362,7 @@ void MapDrawerSoft::SetMap( const MapDataConstPtr& map_data )
 	surfaces_cache_.Clear();
 
 	map_bsp_tree_.reset( new MapBSPTree( map_data ) );
+	shadows_lights_grid_.SetMap( *map_data );
 
 	LoadModelsGroup( map_data->models, map_models_ );
 	LoadWallsTextures( *map_data );
@@ -204,20 +378,7 @@ void MapDrawerSoft::SetMap( const MapDataConstPtr& map_data )
 		char sky_texture_file_path[ MapData::c_max_file_path_size ];
 		std::snprintf( sky_texture_file_path, sizeof(sky_texture_file_path), "COMMON/%s", current_map_data_->sky_texture_name );
 
-		const Vfs::FileContent sky_texture_data= game_resources_->vfs->ReadFile( sky_texture_file_path );
-		const CelTextureHeader& cel_header= *reinterpret_cast<const CelTextureHeader*>( sky_texture_data.data() );
-
-		const unsigned int sky_pixel_count= cel_header.size[0] * cel_header.size[1];
-		sky_texture_.data.resize( sky_pixel_count );
-
-		const PaletteTransformed& palette= *rendering_context_.palette_transformed;
-		const unsigned char* const src= sky_texture_data.data() + sizeof(CelTextureHeader);
-
-		for( unsigned int i= 0u; i < sky_pixel_count; i++ )
-			sky_texture_.data[i]= palette[src[i]];
-
-		sky_texture_.size[0]= cel_header.size[0];
-		sky_texture_.size[1]= cel_header.size[1];
+		sky_texture_.texture= textures_store_.GetCelTexture( *game_resources_->vfs, sky_texture_file_path );
 	}
 }
 
@@ -228,13 +389,23 @@ void MapDrawerSoft::Draw(
 	const ViewClipPlanes& view_clip_planes,
 	const EntityId player_monster_id )
 {
+	PC_PROFILER_ZONE( "MapDrawerSoft::Draw" );
+
 	PC_UNUSED( player_monster_id );
 
 	if( current_map_data_ == nullptr )
 		return;
 
-	rasterizer_.ClearDepthBuffer();
-	rasterizer_.ClearOcclusionBuffer();
+	const Time draw_start_time= Time::CurrentTime();
+
+	UpdateResolutionScale();
+	UpdateTexturesMode();
+	UpdateLightTablesMode();
+
+	use_spans_buffer_= settings_.GetOrSetBool( "r_spans_buffer", false );
+
+	rasterizer_->ClearDepthBuffer();
+	rasterizer_->ClearOcclusionBuffer();
 
 	m_Mat4 cam_shift_mat, cam_mat, screen_flip_mat;
 	cam_shift_mat.Translate( -camera_position );
@@ -244,15 +415,19 @@ void MapDrawerSoft::Draw(
 	// Draw objects front to back with occlusion test.
 	// Occlusion test uses walls, floors/ceilings, sky.
 	DrawWalls( map_state, cam_mat, camera_position.xy(), view_clip_planes );
-	DrawFloorsAndCeilings( cam_mat, view_clip_planes );
+	DrawFloorsAndCeilings( cam_mat, camera_position.xy(), view_clip_planes );
 	DrawSky( cam_mat, camera_position, view_clip_planes );
 
-	rasterizer_.BuildDepthBufferHierarchy();
+	{
+		PC_PROFILER_ZONE( "Depth hierarchy" );
+		rasterizer_->BuildDepthBufferHierarchy();
+	}
 
 	// Draw regular polygons of models, than transparent
 	for( unsigned int t= 0u; t < 2u; t++ )
 	{
 		const bool transparent= t == 1u;
+		PC_PROFILER_ZONE( transparent ? "Transparent models" : "Models" );
 
 		for( const MapState::StaticModel& static_model : map_state.GetStaticModels() )
 		{
@@ -335,7 +510,7 @@ void MapDrawerSoft::Draw(
 
 		for( const MapState::Gib& gib : map_state.GetGibs() )
 		{
-			if( gib.gib_id >= gibs_models_.models.size() )
+			if( gib.gib_id >= gibs_models_.textures.size() )
 				continue;
 
 			m_Mat4 rotate_max_x, rotate_mat_z;
@@ -407,6 +582,10 @@ void MapDrawerSoft::Draw(
 	// Shadows.
 	if( settings_.GetOrSetBool( SettingsKeys::shadows, true ) )
 	{
+		PC_PROFILER_ZONE( "Shadows" );
+
+		shadows_lights_grid_.UpdateDynamicLights( map_state );
+
 		for( const MapState::StaticModel& static_model : map_state.GetStaticModels() )
 		{
 			if( static_model.model_id >= current_map_data_->models_description.size() ||
@@ -418,7 +597,7 @@ void MapDrawerSoft::Draw(
 				continue;
 
 			m_Vec3 light_pos;
-			if( !GetNearestLightSourcePos( static_model.pos, *current_map_data_, map_state, false, light_pos ) )
+			if( !shadows_lights_grid_.GetNearestLightSourcePos( static_model.pos, false, light_pos ) )
 				continue;
 
 			m_Mat4 rotate_mat;
@@ -444,7 +623,7 @@ void MapDrawerSoft::Draw(
 				continue;
 
 			m_Vec3 light_pos;
-			if( !GetNearestLightSourcePos( item.pos, *current_map_data_, map_state, true, light_pos ) )
+			if( !shadows_lights_grid_.GetNearestLightSourcePos( item.pos, true, light_pos ) )
 				continue;
 
 			m_Mat4 rotate_mat;
@@ -470,7 +649,7 @@ void MapDrawerSoft::Draw(
 				continue;
 
 			m_Vec3 light_pos;
-			if( !GetNearestLightSourcePos( monster.pos, *current_map_data_, map_state, true, light_pos ) )
+			if( !shadows_lights_grid_.GetNearestLightSourcePos( monster.pos, true, light_pos ) )
 				continue;
 
 			const unsigned int frame=
@@ -496,9 +675,13 @@ void MapDrawerSoft::Draw(
 	DrawBMPObjectsSprites( map_state, cam_mat, camera_position, view_clip_planes );
 
 	if( settings_.GetOrSetBool( "r_debug_draw_depth_hierarchy", false ) )
-		rasterizer_.DebugDrawDepthHierarchy( static_cast<unsigned int>(map_state.GetSpritesFrame()) / 16u );
+		rasterizer_->DebugDrawDepthHierarchy( static_cast<unsigned int>(map_state.GetSpritesFrame()) / 16u );
 	if( settings_.GetOrSetBool( "r_debug_draw_occlusion_buffer", false ) )
-		rasterizer_.DebugDrawOcclusionBuffer( static_cast<unsigned int>(map_state.GetSpritesFrame()) / 32u );
+		rasterizer_->DebugDrawOcclusionBuffer( static_cast<unsigned int>(map_state.GetSpritesFrame()) / 32u );
+
+	// Smooth draw time, because it is noisy.
+	const float draw_time_ms= ( Time::CurrentTime() - draw_start_time ).ToSeconds() * 1000.0f;
+	average_draw_time_ms_= average_draw_time_ms_ * 0.875f + draw_time_ms * 0.125f;
 }
 
 void MapDrawerSoft::DrawWeapon(
@@ -531,10 +714,16 @@ void MapDrawerSoft::DrawWeapon(
 
 	const unsigned int first_animation_vertex= model.animations_vertices.size() / model.frame_count * frame;
 
-	const ModelsGroup::ModelEntry& model_entry= weapons_models_.models[ weapon_state.CurrentWeaponIndex() ];
-	rasterizer_.SetTexture(
-		model_entry.texture_size[0], model_entry.texture_size[1],
-		weapons_models_.textures_data.data() + model_entry.texture_data_offset );
+	if( use_paletted_textures_ )
+		rasterizer_->SetTexture(
+			model.texture_size[0], model.texture_size[1],
+			model.texture_data.data(),
+			models_lit_palettes_.data() );
+	else
+	{
+		const TexturesStore::Texture& texture= *weapons_models_.textures[ weapon_state.CurrentWeaponIndex() ];
+		rasterizer_->SetTexture( texture.size[0], texture.size[1], texture.data.data() );
+	}
 
 	{ // Set light.
 		fixed16_t light= g_fixed16_one;
@@ -543,40 +732,14 @@ void MapDrawerSoft::DrawWeapon(
 		if( lightmap_x < MapData::c_lightmap_size && lightmap_y < MapData::c_lightmap_size )
 				light= ScaleLightmapLight( current_map_data_->lightmap[ lightmap_x + lightmap_y * MapData::c_lightmap_size ] );
 
-		rasterizer_.SetLight( light );
+		rasterizer_->SetLight( light );
 	}
 
 	Rasterizer::TriangleDrawFunc draw_func, alpha_draw_func;
-	if( invisible )
-	{
-		draw_func=
-			&Rasterizer::DrawTexturedTriangleSpanCorrected<
-				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
-				Rasterizer::AlphaTest::No,
-				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
-				Rasterizer::Lighting::Yes, Rasterizer::Blending::Yes, Rasterizer::DepthHack::Yes>;
-		alpha_draw_func=
-			&Rasterizer::DrawTexturedTriangleSpanCorrected<
-				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
-				Rasterizer::AlphaTest::Yes,
-				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
-				Rasterizer::Lighting::Yes, Rasterizer::Blending::Yes, Rasterizer::DepthHack::Yes>;
-	}
+	if( use_paletted_textures_ )
+		SelectWeaponDrawFuncs<Rasterizer::TextureFormat::Paletted>( invisible, draw_func, alpha_draw_func );
 	else
-	{
-		draw_func=
-			&Rasterizer::DrawTexturedTriangleSpanCorrected<
-				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
-				Rasterizer::AlphaTest::No,
-				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
-				Rasterizer::Lighting::Yes, Rasterizer::Blending::No, Rasterizer::DepthHack::Yes>;
-		alpha_draw_func=
-			&Rasterizer::DrawTexturedTriangleSpanCorrected<
-				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
-				Rasterizer::AlphaTest::Yes,
-				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
-				Rasterizer::Lighting::Yes, Rasterizer::Blending::No, Rasterizer::DepthHack::Yes>;
-	}
+		SelectWeaponDrawFuncs<Rasterizer::TextureFormat::RGBA>( invisible, draw_func, alpha_draw_func );
 
 	for( unsigned int t= 0u; t < model.regular_triangles_indeces.size(); t+= 3u )
 	{
@@ -637,7 +800,7 @@ void MapDrawerSoft::DrawWeapon(
 		{
 			traingle_vertices[1]= verties_projected[ i + 1u ];
 			traingle_vertices[2]= verties_projected[ i + 2u ];
-			(rasterizer_.*triangle_func)( traingle_vertices );
+			(rasterizer_->*triangle_func)( traingle_vertices );
 		}
 	} // for model triangles
 }
@@ -666,10 +829,20 @@ void MapDrawerSoft::DrawActiveItemIcon(
 	view_mat= rotate_mat * shift_mat * proj_mat;
 
 	const Model& model= game_resources_->items_models[ icon_item_id ];
-	const ModelsGroup::ModelEntry& model_entry= items_models_.models[ icon_item_id ];
-	rasterizer_.SetTexture(
-		model_entry.texture_size[0], model_entry.texture_size[1],
-		items_models_.textures_data.data() + model_entry.texture_data_offset );
+	if( use_paletted_textures_ )
+	{
+		// Icons are not lit, so, use palette for full light.
+		rasterizer_->SetLight( g_fixed16_one );
+		rasterizer_->SetTexture(
+			model.texture_size[0], model.texture_size[1],
+			model.texture_data.data(),
+			models_lit_palettes_.data() );
+	}
+	else
+	{
+		const TexturesStore::Texture& texture= *items_models_.textures[ icon_item_id ];
+		rasterizer_->SetTexture( texture.size[0], texture.size[1], texture.data.data() );
+	}
 
 	const unsigned int frame_number=
 		static_cast<unsigned int>(map_state.GetSpritesFrame()) %
@@ -679,36 +852,10 @@ void MapDrawerSoft::DrawActiveItemIcon(
 	for( unsigned int transparent= 0u; transparent < 2u; ++transparent )
 	{
 		Rasterizer::TriangleDrawFunc draw_func, alpha_draw_func;
-		if( transparent == 1u )
-		{
-			draw_func=
-				&Rasterizer::DrawTexturedTriangleSpanCorrected<
-					Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
-					Rasterizer::AlphaTest::No,
-					Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
-					Rasterizer::Lighting::No, Rasterizer::Blending::Yes, Rasterizer::DepthHack::Yes>;
-			alpha_draw_func=
-				&Rasterizer::DrawTexturedTriangleSpanCorrected<
-					Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
-					Rasterizer::AlphaTest::Yes,
-					Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
-					Rasterizer::Lighting::No, Rasterizer::Blending::Yes, Rasterizer::DepthHack::Yes>;
-		}
+		if( use_paletted_textures_ )
+			SelectItemIconDrawFuncs<Rasterizer::TextureFormat::Paletted>( transparent == 1u, draw_func, alpha_draw_func );
 		else
-		{
-			draw_func=
-				&Rasterizer::DrawTexturedTriangleSpanCorrected<
-					Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
-					Rasterizer::AlphaTest::Yes,
-					Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
-					Rasterizer::Lighting::No, Rasterizer::Blending::No, Rasterizer::DepthHack::Yes>;
-			alpha_draw_func=
-				&Rasterizer::DrawTexturedTriangleSpanCorrected<
-					Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
-					Rasterizer::AlphaTest::Yes,
-					Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
-					Rasterizer::Lighting::No, Rasterizer::Blending::No, Rasterizer::DepthHack::Yes>;
-		}
+			SelectItemIconDrawFuncs<Rasterizer::TextureFormat::RGBA>( transparent == 1u, draw_func, alpha_draw_func );
 
 		const std::vector<unsigned short>& indeces=
 			transparent == 1u ? model.transparent_triangles_indeces : model.regular_triangles_indeces;
@@ -742,9 +889,9 @@ void MapDrawerSoft::DrawActiveItemIcon(
 
 			const bool triangle_needs_alpha_test= model.vertices[ indeces[t] ].alpha_test_mask != 0u;
 			if( triangle_needs_alpha_test )
-				(rasterizer_.*alpha_draw_func)( verties_projected );
+				(rasterizer_->*alpha_draw_func)( verties_projected );
 			else
-				(rasterizer_.*draw_func)( verties_projected );
+				(rasterizer_->*draw_func)( verties_projected );
 		} // for model triangles
 	} // for transparent and nontransparent
 }
@@ -768,7 +915,14 @@ void MapDrawerSoft::DoFullscreenPostprocess( const MapState& map_state )
 		}
 
 		blend_alpha_i= std::max( 0, std::min( 255, static_cast<int>( std::round( blend_alpha * 255.0f ) ) ) );
-		rasterizer_.DrawFullscreenBlend( blend_color_i, blend_alpha_i );
+		rasterizer_->DrawFullscreenBlend( blend_color_i, blend_alpha_i );
+	}
+
+	// Scaled frame is finished. Put it into window surface before HUD drawing.
+	if( rasterizer_ != &full_rasterizer_ )
+	{
+		UpscaleScaledViewport();
+		UseFullRasterizer();
 	}
 }
 
@@ -781,7 +935,15 @@ void MapDrawerSoft::DrawMapRelatedModels(
 	if( current_map_data_ == nullptr )
 		return;
 
-	rasterizer_.ClearDepthBuffer();
+	UpdateTexturesMode();
+	UpdateLightTablesMode();
+
+	// Map related models are drawn without postprocessing, so, draw them directly into window surface.
+	// Map frame may be drawn into scaled viewport without postprocessing (in cutscenes) - put it into window surface first.
+	if( rasterizer_ != &full_rasterizer_ )
+		UpscaleScaledViewport();
+	UseFullRasterizer();
+	rasterizer_->ClearDepthBuffer();
 
 	m_Mat4 cam_shift_mat, cam_mat, screen_flip_mat;
 	cam_shift_mat.Translate( -camera_position );
@@ -812,37 +974,67 @@ void MapDrawerSoft::DrawMapRelatedModels(
 	}
 }
 
-void MapDrawerSoft::LoadModelsGroup( const std::vector<Model>& models, ModelsGroup& out_group )
+void MapDrawerSoft::UpdateTexturesMode()
 {
-	const PaletteTransformed& palette= *rendering_context_.palette_transformed;
+	const bool use_paletted_textures= settings_.GetOrSetBool( "r_paletted_textures", false );
+	if( use_paletted_textures == use_paletted_textures_ )
+		return;
+
+	use_paletted_textures_= use_paletted_textures;
+	LoadModelsTextures();
+	LoadSpritesTextures();
+}
 
-	unsigned int texel_count= 0u;
-	for( const Model& model : models )
-		texel_count+= model.texture_data.size();
+void MapDrawerSoft::UpdateLightTablesMode()
+{
+	const bool use_light_tables= settings_.GetOrSetBool( "r_light_tables", false );
+	full_rasterizer_.SetUseLightTables( use_light_tables );
+	if( scaled_rasterizer_ != nullptr )
+		scaled_rasterizer_->SetUseLightTables( use_light_tables );
+}
 
-	out_group.textures_data.resize( texel_count );
-	out_group.models.resize( models.size() );
+void MapDrawerSoft::LoadModelsTextures()
+{
+	LoadModelsGroup( game_resources_->items_models, items_models_ );
+	LoadModelsGroup( game_resources_->rockets_models, rockets_models_ );
+	LoadModelsGroup( game_resources_->gibs_models, gibs_models_ );
+	LoadModelsGroup( game_resources_->weapons_models, weapons_models_ );
+	LoadModelsGroup( game_resources_->monsters_models, monsters_models_ );
+	if( current_map_data_ != nullptr )
+		LoadModelsGroup( current_map_data_->models, map_models_ );
+}
 
-	unsigned int texture_data_offset= 0u;
-	for( unsigned int m= 0u; m < out_group.models.size(); m++ )
+void MapDrawerSoft::LoadModelsGroup( const std::vector<Model>& models, ModelsGroup& out_group )
+{
+	// Request new textures before releasing old, because some textures of new group may be same.
+	// In paletted mode release RGBA textures - models are drawn directly from models data.
+	std::vector<TexturesStore::TexturePtr> textures( models.size() );
+	if( !use_paletted_textures_ )
 	{
-		const Model& in_model= models[m];
-		ModelsGroup::ModelEntry& model_entry= out_group.models[m];
-
-		model_entry.texture_size[0]= in_model.texture_size[0];
-		model_entry.texture_size[1]= in_model.texture_size[1];
-		model_entry.texture_data_offset= texture_data_offset;
+		for( unsigned int m= 0u; m < models.size(); m++ )
+			textures[m]= textures_store_.GetModelTexture( models[m] );
+	}
 
-		for( unsigned int t= 0u; t < in_model.texture_data.size(); t++ )
-		{
-			const unsigned char color_index= in_model.texture_data[t];
-			uint32_t color= palette[ color_index ];
-			if( color_index == 0u ) color&= ~Rasterizer::c_alpha_mask; // For models color #0 is transparent.
-			out_group.textures_data[ texture_data_offset + t ]= color;
-		}
+	out_group.textures.swap( textures );
+}
 
-		texture_data_offset+= in_model.texture_data.size();
+void MapDrawerSoft::LoadSpritesTextures()
+{
+	// In paletted mode sprites are drawn directly from sprites data.
+	if( use_paletted_textures_ )
+	{
+		sprite_effects_textures_.clear();
+		bmp_objects_sprites_.clear();
+		return;
 	}
+
+	sprite_effects_textures_.resize( game_resources_->effects_sprites.size() );
+	for( unsigned int i= 0u; i < sprite_effects_textures_.size(); i++ )
+		sprite_effects_textures_[i]= textures_store_.GetSpriteTexture( game_resources_->effects_sprites[i] );
+
+	bmp_objects_sprites_.resize( game_resources_->bmp_objects_sprites.size() );
+	for( unsigned int i= 0u; i < bmp_objects_sprites_.size(); i++ )
+		bmp_objects_sprites_[i]= textures_store_.GetSpriteTexture( game_resources_->bmp_objects_sprites[i] );
 }
 
 void MapDrawerSoft::LoadWallsTextures( const MapData& map_data )
@@ -1003,90 +1195,281 @@ void MapDrawerSoft::LoadWalls( const MapData& map_data )
 		setup_wall( map_data.dynamic_walls[i], dynamic_walls_[i] );
 }
 
-MapDrawerSoft::TextureView MapDrawerSoft::GetPlayerTexture( const unsigned char color )
+const TexturesStore::Texture& MapDrawerSoft::GetPlayerTexture( const unsigned char color )
 {
-	// Should be done after monsters loading.
-	PC_ASSERT( !monsters_models_.models.empty() );
-
 	const unsigned char color_corrected= color % GameConstants::player_colors_count;
 
-	// Default texture (unshifted).
-	if( color_corrected == 0u )
-	{
-		TextureView result;
-		const ModelsGroup::ModelEntry& model_entry= monsters_models_.models.front();
-		result.size[0]= model_entry.texture_size[0];
-		result.size[1]= model_entry.texture_size[1];
-		result.data= monsters_models_.textures_data.data() + model_entry.texture_data_offset;
-		return result;
-	}
-
+	// Player texture is needed even in paletted mode, so, keep default (unshifted) texture here too.
 	if( player_textures_.size() <= color_corrected )
 		player_textures_.resize( color_corrected + 1u );
 
-	PlayerTexture& texture= player_textures_[ color_corrected ];
-	if( texture.data.empty() )
+	TexturesStore::TexturePtr& texture= player_textures_[ color_corrected ];
+	if( texture == nullptr )
 	{
-		// Generate new texture and save it.
-		const Model& model= game_resources_->monsters_models.front();
-		const unsigned int pixel_count= model.texture_data.size();
+		texture=
+			textures_store_.GetModelTexture(
+				game_resources_->monsters_models.front(),
+				GameConstants::player_colors_shifts[ color_corrected ] );
+	}
 
-		// TODO - maybe cache buffers?
-		std::vector<unsigned char> data_shifted( pixel_count );
-		texture.data.resize( pixel_count );
+	return *texture;
+}
 
-		ColorShift(
-			14 * 16u, 14 * 16u + 16u,
-			GameConstants::player_colors_shifts[ color_corrected ],
-			pixel_count,
-			model.texture_data.data(),
-			data_shifted.data() );
+void MapDrawerSoft::UpdateResolutionScale()
+{
+	if( !settings_.GetOrSetBool( "r_dynamic_resolution", false ) )
+	{
+		if( resolution_scale_level_ != 0u )
+			SetResolutionScaleLevel( 0u );
+		UseFullRasterizer();
+		return;
+	}
 
-		const PaletteTransformed& palette= *rendering_context_.palette_transformed;
-		for( unsigned int i= 0u; i < pixel_count; i++ )
-			texture.data[i]= palette[ data_shifted[i] ];
+	// Target time only for map drawing, other frame work needs some time too.
+	const float target_draw_time_ms= std::max( 1.0f, settings_.GetOrSetFloat( "r_dynamic_resolution_target_ms", 12.0f ) );
 
-		texture.size[0]= model.texture_size[0];
-		texture.size[1]= model.texture_size[1];
+	frames_since_resolution_scale_change_++;
+	if( frames_since_resolution_scale_change_ >= g_frames_between_resolution_scale_changes )
+	{
+		// Use hysteresis - increase resolution only if frame is much faster, than needed.
+		// Time is proportional to pixel count approximately, so, compare with squared scale ratio.
+		if( average_draw_time_ms_ > target_draw_time_ms && resolution_scale_level_ + 1u < g_resolution_scale_levels )
+			SetResolutionScaleLevel( resolution_scale_level_ + 1u );
+		else if( resolution_scale_level_ > 0u )
+		{
+			const float scale_ratio= g_resolution_scales[ resolution_scale_level_ - 1u ] / g_resolution_scales[ resolution_scale_level_ ];
+			if( average_draw_time_ms_ * scale_ratio * scale_ratio < target_draw_time_ms * 0.8f )
+				SetResolutionScaleLevel( resolution_scale_level_ - 1u );
+		}
 	}
 
-	TextureView result;
-	result.size[0]= texture.size[0];
-	result.size[1]= texture.size[1];
-	result.data= texture.data.data();
-	return result;
+	if( scaled_rasterizer_ != nullptr )
+	{
+		rasterizer_= scaled_rasterizer_.get();
+		screen_transform_x_= 0.5f * float( scaled_viewport_size_.Width () );
+		screen_transform_y_= 0.5f * float( scaled_viewport_size_.Height() );
+	}
+	else
+		UseFullRasterizer();
 }
 
-void MapDrawerSoft::LoadFloorsAndCeilings( const MapData& map_data )
+void MapDrawerSoft::SetResolutionScaleLevel( const unsigned int level )
 {
-	map_floors_and_ceilings_.clear();
+	PC_ASSERT( level < g_resolution_scale_levels );
 
-	for( unsigned int i= 0u; i < 2u; i++ )
-	{
-		( i == 0u ? first_floor_ : first_ceiling_ )= map_floors_and_ceilings_.size();
+	resolution_scale_level_= level;
+	frames_since_resolution_scale_change_= 0u;
 
-		const unsigned char* const src= i == 0u ? map_data.floor_textures : map_data.ceiling_textures;
+	UseFullRasterizer();
+
+	if( level == 0u )
+	{
+		scaled_rasterizer_.reset();
+		scaled_color_buffer_.clear();
+		scaled_viewport_size_= rendering_context_.viewport_size;
+		return;
+	}
+
+	const float scale= g_resolution_scales[ level ];
+	scaled_viewport_size_=
+		Size2(
+			std::max( 1u, static_cast<unsigned int>( float( rendering_context_.viewport_size.Width () ) * scale ) ),
+			std::max( 1u, static_cast<unsigned int>( float( rendering_context_.viewport_size.Height() ) * scale ) ) );
+
+	scaled_color_buffer_.resize( scaled_viewport_size_.Width() * scaled_viewport_size_.Height() );
+	scaled_rasterizer_.reset(
+		new Rasterizer(
+			scaled_viewport_size_.Width(), scaled_viewport_size_.Height(),
+			scaled_viewport_size_.Width(), scaled_color_buffer_.data() ) );
+
+	Log::Info( "Dynamic resolution: ", scaled_viewport_size_.Width(), "x", scaled_viewport_size_.Height() );
+}
+
+void MapDrawerSoft::UseFullRasterizer()
+{
+	rasterizer_= &full_rasterizer_;
+	screen_transform_x_= 0.5f * float( rendering_context_.viewport_size.Width () );
+	screen_transform_y_= 0.5f * float( rendering_context_.viewport_size.Height() );
+}
+
+void MapDrawerSoft::UpscaleScaledViewport()
+{
+	PC_ASSERT( scaled_rasterizer_ != nullptr );
+
+	const unsigned int src_width = scaled_viewport_size_.Width ();
+	const unsigned int src_height= scaled_viewport_size_.Height();
+	const unsigned int dst_width = rendering_context_.viewport_size.Width ();
+	const unsigned int dst_height= rendering_context_.viewport_size.Height();
+	const unsigned int dst_row_pixels= rendering_context_.row_pixels;
+
+	// Nearest filtering with 16.16 fixed steps.
+	const unsigned int x_step= ( src_width  << 16u ) / dst_width ;
+	const unsigned int y_step= ( src_height << 16u ) / dst_height;
+
+	uint32_t* const dst= rendering_context_.window_surface_data;
+	unsigned int prev_src_y= ~0u;
+	for( unsigned int y= 0u; y < dst_height; y++ )
+	{
+		const unsigned int src_y= ( y * y_step ) >> 16u;
+		uint32_t* const dst_row= dst + y * dst_row_pixels;
+
+		// Lower resolution means many equal rows - copy previous row in this case.
+		if( src_y == prev_src_y )
+		{
+			std::memcpy( dst_row, dst_row - dst_row_pixels, dst_width * sizeof(uint32_t) );
+			continue;
+		}
+		prev_src_y= src_y;
+
+		const uint32_t* const src_row= scaled_color_buffer_.data() + src_y * src_width;
+		unsigned int src_x= 0u;
+		for( unsigned int x= 0u; x < dst_width; x++, src_x+= x_step )
+			dst_row[x]= src_row[ src_x >> 16u ];
+	}
+}
+
+void MapDrawerSoft::LoadFloorsAndCeilings( const MapData& map_data )
+{
+	// Merged cells have one surface for several cells and need less polygons setup.
+	// Texture coordinates are clamped in rasterizer, so, surface of merged cells contains all cells textures.
+	const unsigned int max_merged_cells= settings_.GetOrSetBool( "r_merge_floor_cells", true ) ? c_max_merged_floor_cells_ : 1u;
+
+	map_floors_and_ceilings_.clear();
+	floors_quadtree_.clear();
+
+	for( unsigned int i= 0u; i < 2u; i++ )
+	{
+		const unsigned int first_cell= map_floors_and_ceilings_.size();
+
+		const unsigned char* const src= i == 0u ? map_data.floor_textures : map_data.ceiling_textures;
+
+		bool cell_used[ MapData::c_map_size * MapData::c_map_size ];
+		for( unsigned int j= 0u; j < MapData::c_map_size * MapData::c_map_size; j++ )
+		{
+			const unsigned char texture_number= src[j];
+			cell_used[j]=
+				texture_number == MapData::c_empty_floor_texture_id ||
+				texture_number == MapData::c_sky_floor_texture_id ||
+				texture_number >= MapData::c_floors_textures_count;
+		}
+
+		const auto can_merge=
+		[&]( const unsigned int x, const unsigned int y, const unsigned char texture_number ) -> bool
+		{
+			if( x >= MapData::c_map_size || y >= MapData::c_map_size )
+				return false;
+			const unsigned int address= x + y * MapData::c_map_size;
+			return !cell_used[ address ] && src[ address ] == texture_number;
+		};
 
 		for( unsigned int y= 0u; y < MapData::c_map_size; y++ )
 		for( unsigned int x= 0u; x < MapData::c_map_size; x++ )
 		{
+			if( cell_used[ x + y * MapData::c_map_size ] )
+				continue;
+
 			const unsigned char texture_number= src[ x + y * MapData::c_map_size ];
 
-			if( texture_number == MapData::c_empty_floor_texture_id ||
-				texture_number == MapData::c_sky_floor_texture_id ||
-				texture_number >= MapData::c_floors_textures_count )
-				continue;
+			// Grow rectangle greedily - first along x, than along y.
+			unsigned int size_x= 1u, size_y= 1u;
+			while( size_x < max_merged_cells && can_merge( x + size_x, y, texture_number ) )
+				size_x++;
+			while( size_y < max_merged_cells )
+			{
+				bool row_ok= true;
+				for( unsigned int dx= 0u; dx < size_x; dx++ )
+					row_ok= row_ok && can_merge( x + dx, y + size_y, texture_number );
+				if( !row_ok )
+					break;
+				size_y++;
+			}
+
+			for( unsigned int dy= 0u; dy < size_y; dy++ )
+			for( unsigned int dx= 0u; dx < size_x; dx++ )
+				cell_used[ x + dx + ( y + dy ) * MapData::c_map_size ]= true;
 
 			map_floors_and_ceilings_.emplace_back();
 			FloorCeilingCell& cell= map_floors_and_ceilings_.back();
 			cell.xy[0]= x;
 			cell.xy[1]= y;
+			cell.size[0]= size_x;
+			cell.size[1]= size_y;
 			cell.texture_id= texture_number;
 
 			for( SurfacesCache::Surface*& surf_ptr : cell.mips_surfaces )
 				surf_ptr= nullptr;
 		}
+
+		const unsigned int cell_count= map_floors_and_ceilings_.size() - first_cell;
+		( i == 0u ? floors_root_ : ceilings_root_ )=
+			cell_count == 0u
+				? ~0u
+				: BuildFloorsQuadtree_r( first_cell, cell_count, 0u, 0u, MapData::c_map_size );
+	}
+}
+
+unsigned int MapDrawerSoft::BuildFloorsQuadtree_r(
+	const unsigned int first_cell, const unsigned int cell_count,
+	const unsigned int x, const unsigned int y, const unsigned int size )
+{
+	PC_ASSERT( cell_count > 0u );
+
+	// Reserve node before children, so, children indices are always nonzero.
+	const unsigned int node_index= floors_quadtree_.size();
+	floors_quadtree_.emplace_back();
+
+	{
+		FloorsQuadtreeNode& node= floors_quadtree_.back();
+		node.first_cell= first_cell;
+		node.cell_count= cell_count;
+		node.bb_min[0]= node.bb_min[1]= 255u;
+		node.bb_max[0]= node.bb_max[1]= 0u;
+		for( unsigned int i= first_cell; i < first_cell + cell_count; i++ )
+		{
+			const FloorCeilingCell& cell= map_floors_and_ceilings_[i];
+			for( unsigned int j= 0u; j < 2u; j++ )
+			{
+				node.bb_min[j]= std::min( node.bb_min[j], cell.xy[j] );
+				node.bb_max[j]= std::max( node.bb_max[j], static_cast<unsigned char>( cell.xy[j] + cell.size[j] ) );
+			}
+		}
+		for( unsigned short& child : node.children )
+			child= 0u;
+		node.is_leaf= cell_count <= c_max_cells_in_floors_quadtree_leaf_ || size == 1u;
+		if( node.is_leaf )
+			return node_index;
 	}
+
+	// Sort cells by quadrants. Cell belongs to quadrant, which contains its origin.
+	const unsigned int half_size= size >> 1u;
+	const auto begin= map_floors_and_ceilings_.begin() + first_cell;
+	const auto end= begin + cell_count;
+	const auto y_middle=
+		std::stable_partition( begin, end, [&]( const FloorCeilingCell& cell ) { return cell.xy[1] < y + half_size; } );
+	const auto x_middle_top=
+		std::stable_partition( begin, y_middle, [&]( const FloorCeilingCell& cell ) { return cell.xy[0] < x + half_size; } );
+	const auto x_middle_bottom=
+		std::stable_partition( y_middle, end, [&]( const FloorCeilingCell& cell ) { return cell.xy[0] < x + half_size; } );
+
+	const decltype(begin) quadrants_bounds[5]= { begin, x_middle_top, y_middle, x_middle_bottom, end };
+	for( unsigned int i= 0u; i < 4u; i++ )
+	{
+		const unsigned int quadrant_first_cell= first_cell + ( quadrants_bounds[i] - begin );
+		const unsigned int quadrant_cell_count= quadrants_bounds[ i + 1u ] - quadrants_bounds[i];
+		if( quadrant_cell_count == 0u )
+			continue;
+
+		const unsigned int child_index=
+			BuildFloorsQuadtree_r(
+				quadrant_first_cell, quadrant_cell_count,
+				x + ( i & 1u ) * half_size,
+				y + ( i >> 1u ) * half_size,
+				half_size );
+		// Take reference after recursive call, because vector may be reallocated.
+		floors_quadtree_[ node_index ].children[i]= child_index;
+	}
+
+	return node_index;
 }
 
 template< bool is_dynamic_wall >
@@ -1185,7 +1568,7 @@ void MapDrawerSoft::DrawWallSegment(
 		out_v.z= fixed16_t( w * 65536.0f );
 	}
 
-	if( !is_dynamic_wall && rasterizer_.IsOccluded( verties_projected, polygon_vertex_count ) )
+	if( !is_dynamic_wall && rasterizer_->IsOccluded( verties_projected, polygon_vertex_count ) )
 		return;
 
 	int mip= 0;
@@ -1233,17 +1616,17 @@ void MapDrawerSoft::DrawWallSegment(
 	else
 		surface= GetWallSurface<3>( wall );
 
-	rasterizer_.SetTexture( surface->size[0], surface->size[1], surface->GetData() );
+	rasterizer_->SetTexture( surface->size[0], surface->size[1], surface->GetData() );
 
 	if( is_dynamic_wall )
 	{
 		if( texture.has_alpha )
-			rasterizer_.DrawTexturedConvexPolygonSpanCorrected<
+			rasterizer_->DrawTexturedConvexPolygonSpanCorrected<
 				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
 				Rasterizer::AlphaTest::Yes,
 				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::Yes>( verties_projected, polygon_vertex_count, !is_back );
 		else
-			rasterizer_.DrawTexturedConvexPolygonSpanCorrected<
+			rasterizer_->DrawTexturedConvexPolygonSpanCorrected<
 				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
 				Rasterizer::AlphaTest::No,
 				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::Yes>( verties_projected, polygon_vertex_count, !is_back );
@@ -1251,18 +1634,23 @@ void MapDrawerSoft::DrawWallSegment(
 	else
 	{
 		if( texture.has_alpha )
-			rasterizer_.DrawTexturedConvexPolygonSpanCorrected<
+			rasterizer_->DrawTexturedConvexPolygonSpanCorrected<
 				Rasterizer::DepthTest::No, Rasterizer::DepthWrite::Yes,
 				Rasterizer::AlphaTest::Yes,
 				Rasterizer::OcclusionTest::Yes, Rasterizer::OcclusionWrite::Yes>( verties_projected, polygon_vertex_count, !is_back );
+		else if( use_spans_buffer_ )
+			rasterizer_->DrawTexturedConvexPolygonSpanCorrected<
+				Rasterizer::DepthTest::No, Rasterizer::DepthWrite::Yes,
+				Rasterizer::AlphaTest::No,
+				Rasterizer::OcclusionTest::Spans, Rasterizer::OcclusionWrite::Yes>( verties_projected, polygon_vertex_count, !is_back );
 		else
-			rasterizer_.DrawTexturedConvexPolygonSpanCorrected<
+			rasterizer_->DrawTexturedConvexPolygonSpanCorrected<
 				Rasterizer::DepthTest::No, Rasterizer::DepthWrite::Yes,
 				Rasterizer::AlphaTest::No,
 				Rasterizer::OcclusionTest::Yes, Rasterizer::OcclusionWrite::Yes>( verties_projected, polygon_vertex_count, !is_back );
 	}
 
-	rasterizer_.UpdateOcclusionHierarchy( verties_projected, polygon_vertex_count, texture.has_alpha );
+	rasterizer_->UpdateOcclusionHierarchy( verties_projected, polygon_vertex_count, texture.has_alpha );
 }
 
 void MapDrawerSoft::DrawWalls(
@@ -1271,6 +1659,8 @@ void MapDrawerSoft::DrawWalls(
 	const m_Vec2& camera_position_xy,
 	const ViewClipPlanes& view_clip_planes )
 {
+	PC_PROFILER_ZONE( "Walls" );
+
 	// Draw static walls fron to back, using bsp tree.
 	map_bsp_tree_->EnumerateSegmentsFrontToBack(
 		camera_position_xy,
@@ -1313,133 +1703,263 @@ void MapDrawerSoft::DrawWalls(
 	}
 }
 
-void MapDrawerSoft::DrawFloorsAndCeilings( const m_Mat4& matrix, const ViewClipPlanes& view_clip_planes  )
+void MapDrawerSoft::DrawFloorsAndCeilings( const m_Mat4& matrix, const m_Vec2& camera_position_xy, const ViewClipPlanes& view_clip_planes )
 {
-	for( unsigned int i= 0u; i < map_floors_and_ceilings_.size(); i++ )
-	{
-		FloorCeilingCell& cell= map_floors_and_ceilings_[i];
-		const bool is_ceiling= i >= first_ceiling_;
-		const float z= is_ceiling ? GameConstants::walls_height : 0.0f;
-
-		PC_ASSERT( cell.texture_id < MapData::c_floors_textures_count );
-
-		clipped_vertices_[0].pos= m_Vec3( float(cell.xy[0]   ), float(cell.xy[1]   ), z );
-		clipped_vertices_[1].pos= m_Vec3( float(cell.xy[0]+1u), float(cell.xy[1]   ), z );
-		clipped_vertices_[2].pos= m_Vec3( float(cell.xy[0]+1u), float(cell.xy[1]+1u), z );
-		clipped_vertices_[3].pos= m_Vec3( float(cell.xy[0]   ), float(cell.xy[1]+1u), z );
-		clipped_vertices_[0].tc= m_Vec2( 0.0f, 0.0f );
-		clipped_vertices_[1].tc= m_Vec2( float( MapData::c_floor_texture_size << 16u ), 0.0f );
-		clipped_vertices_[2].tc= m_Vec2( float( MapData::c_floor_texture_size << 16u ), float( MapData::c_floor_texture_size << 16u ) );
-		clipped_vertices_[3].tc= m_Vec2( 0.0f, float( MapData::c_floor_texture_size << 16u ) );
-		clipped_vertices_[0].next= &clipped_vertices_[1];
-		clipped_vertices_[1].next= &clipped_vertices_[2];
-		clipped_vertices_[2].next= &clipped_vertices_[3];
-		clipped_vertices_[3].next= &clipped_vertices_[0];
-		fisrt_clipped_vertex_= &clipped_vertices_[0];
-		next_new_clipped_vertex_= 4u;
+	PC_PROFILER_ZONE( "Floors and ceilings" );
 
-		unsigned int polygon_vertex_count= 4u;
-		for( const m_Plane3& plane : view_clip_planes )
-		{
-			polygon_vertex_count= ClipPolygon( plane, polygon_vertex_count );
-			PC_ASSERT( polygon_vertex_count == 0u || polygon_vertex_count >= 3u );
-			if( polygon_vertex_count == 0u )
-				break;
-		}
-		if( polygon_vertex_count == 0u )
+	const unsigned int all_clip_planes_mask= ( 1u << view_clip_planes.size() ) - 1u;
+
+	if( floors_root_ != ~0u )
+		DrawFloorsAndCeilingsNode_r( floors_root_, false, matrix, camera_position_xy, view_clip_planes, all_clip_planes_mask );
+	if( ceilings_root_ != ~0u )
+		DrawFloorsAndCeilingsNode_r( ceilings_root_, true, matrix, camera_position_xy, view_clip_planes, all_clip_planes_mask );
+}
+
+void MapDrawerSoft::DrawFloorsAndCeilingsNode_r(
+	const unsigned int node_index,
+	const bool is_ceiling,
+	const m_Mat4& matrix,
+	const m_Vec2& camera_position_xy,
+	const ViewClipPlanes& view_clip_planes,
+	unsigned int clip_planes_mask )
+{
+	const FloorsQuadtreeNode& node= floors_quadtree_[ node_index ];
+	const float z= is_ceiling ? GameConstants::walls_height : 0.0f;
+
+	// Reject nodes outside view frustum. Do not clip children by planes, which node is fully ahead.
+	const m_Vec3 corners[4]=
+	{
+		m_Vec3( float(node.bb_min[0]), float(node.bb_min[1]), z ),
+		m_Vec3( float(node.bb_max[0]), float(node.bb_min[1]), z ),
+		m_Vec3( float(node.bb_max[0]), float(node.bb_max[1]), z ),
+		m_Vec3( float(node.bb_min[0]), float(node.bb_max[1]), z ),
+	};
+	for( unsigned int p= 0u; p < view_clip_planes.size(); p++ )
+	{
+		if( ( clip_planes_mask & ( 1u << p ) ) == 0u )
 			continue;
 
+		unsigned int corners_ahead= 0u;
+		for( const m_Vec3& corner : corners )
+			if( view_clip_planes[p].IsPointAheadPlane( corner ) )
+				corners_ahead++;
+
+		if( corners_ahead == 0u )
+			return;
+		if( corners_ahead == 4u )
+			clip_planes_mask&= ~( 1u << p );
+	}
+
+	// Reject occluded nodes. Cells of node lie inside node bounding box, so, they are occluded too.
+	// Single cells are checked later.
+	if( node.cell_count > 1u )
+	{
 		RasterizerVertex verties_projected[ c_max_clip_vertices_ ];
-		ClippedVertex* v= fisrt_clipped_vertex_;
-		for( unsigned int i= 0u; i < polygon_vertex_count; i++, v= v->next )
-		{
-			m_Vec3 vertex_projected= v->pos * matrix;
-			const float w= v->pos.x * matrix.value[3] + v->pos.y * matrix.value[7] + v->pos.z * matrix.value[11] + matrix.value[15];
+		const unsigned int polygon_vertex_count=
+			ClipAndProjectFloorCeilingRect(
+				node.bb_min[0], node.bb_min[1],
+				node.bb_max[0] - node.bb_min[0], node.bb_max[1] - node.bb_min[1],
+				z, matrix, view_clip_planes, clip_planes_mask, verties_projected );
+
+		if( polygon_vertex_count == 0u ||
+			rasterizer_->IsOccluded( verties_projected, polygon_vertex_count ) )
+			return;
+	}
 
-			vertex_projected/= w;
-			vertex_projected.z= w;
+	if( node.is_leaf )
+	{
+		for( unsigned int i= node.first_cell; i < node.first_cell + node.cell_count; i++ )
+			DrawFloorCeilingCell( map_floors_and_ceilings_[i], is_ceiling, matrix, view_clip_planes, clip_planes_mask );
+		return;
+	}
 
-			vertex_projected.x= ( vertex_projected.x + 1.0f ) * screen_transform_x_;
-			vertex_projected.y= ( vertex_projected.y + 1.0f ) * screen_transform_y_;
+	// Draw children front to back, because drawn floors occlude further floors.
+	unsigned int children[4];
+	float children_distances[4];
+	unsigned int child_count= 0u;
+	for( const unsigned short child_index : node.children )
+	{
+		if( child_index == 0u )
+			continue;
 
-			RasterizerVertex& out_v= verties_projected[ i ];
-			out_v.x= fixed16_t( vertex_projected.x * 65536.0f );
-			out_v.y= fixed16_t( vertex_projected.y * 65536.0f );
-			out_v.u= fixed16_t( v->tc.x );
-			out_v.v= fixed16_t( v->tc.y );
-			out_v.z= fixed16_t( w * 65536.0f );
+		const FloorsQuadtreeNode& child= floors_quadtree_[ child_index ];
+		const m_Vec2 center(
+			0.5f * float( child.bb_min[0] + child.bb_max[0] ),
+			0.5f * float( child.bb_min[1] + child.bb_max[1] ) );
+		const float distance= ( center - camera_position_xy ).SquareLength();
+
+		// Insertion sort.
+		unsigned int j= child_count;
+		while( j > 0u && children_distances[ j - 1u ] > distance )
+		{
+			children[j]= children[ j - 1u ];
+			children_distances[j]= children_distances[ j - 1u ];
+			j--;
 		}
+		children[j]= child_index;
+		children_distances[j]= distance;
+		child_count++;
+	}
+
+	for( unsigned int i= 0u; i < child_count; i++ )
+		DrawFloorsAndCeilingsNode_r( children[i], is_ceiling, matrix, camera_position_xy, view_clip_planes, clip_planes_mask );
+}
+
+unsigned int MapDrawerSoft::ClipAndProjectFloorCeilingRect(
+	const unsigned int x, const unsigned int y,
+	const unsigned int size_x, const unsigned int size_y,
+	const float z,
+	const m_Mat4& matrix,
+	const ViewClipPlanes& view_clip_planes,
+	const unsigned int clip_planes_mask,
+	RasterizerVertex* const out_vertices )
+{
+	const float tc_max_x= float( ( size_x * MapData::c_floor_texture_size ) << 16u );
+	const float tc_max_y= float( ( size_y * MapData::c_floor_texture_size ) << 16u );
+
+	clipped_vertices_[0].pos= m_Vec3( float(x         ), float(y         ), z );
+	clipped_vertices_[1].pos= m_Vec3( float(x + size_x), float(y         ), z );
+	clipped_vertices_[2].pos= m_Vec3( float(x + size_x), float(y + size_y), z );
+	clipped_vertices_[3].pos= m_Vec3( float(x         ), float(y + size_y), z );
+	clipped_vertices_[0].tc= m_Vec2( 0.0f, 0.0f );
+	clipped_vertices_[1].tc= m_Vec2( tc_max_x, 0.0f );
+	clipped_vertices_[2].tc= m_Vec2( tc_max_x, tc_max_y );
+	clipped_vertices_[3].tc= m_Vec2( 0.0f, tc_max_y );
+	clipped_vertices_[0].next= &clipped_vertices_[1];
+	clipped_vertices_[1].next= &clipped_vertices_[2];
+	clipped_vertices_[2].next= &clipped_vertices_[3];
+	clipped_vertices_[3].next= &clipped_vertices_[0];
+	fisrt_clipped_vertex_= &clipped_vertices_[0];
+	next_new_clipped_vertex_= 4u;
 
-		if( rasterizer_.IsOccluded( verties_projected, polygon_vertex_count ) )
+	unsigned int polygon_vertex_count= 4u;
+	for( unsigned int p= 0u; p < view_clip_planes.size(); p++ )
+	{
+		if( ( clip_planes_mask & ( 1u << p ) ) == 0u )
 			continue;
 
-		// Search longest edge for mip calculation.
-		unsigned int longest_edge_index= 0u;
-		fixed8_t longest_edge_squre_length= 1; // fixed8_t range should be enought for vector ( 2048, 2048 ) square length.
-		for( unsigned int i= 0u; i < polygon_vertex_count; i++ )
+		polygon_vertex_count= ClipPolygon( view_clip_planes[p], polygon_vertex_count );
+		PC_ASSERT( polygon_vertex_count == 0u || polygon_vertex_count >= 3u );
+		if( polygon_vertex_count == 0u )
+			return 0u;
+	}
+
+	ClippedVertex* v= fisrt_clipped_vertex_;
+	for( unsigned int i= 0u; i < polygon_vertex_count; i++, v= v->next )
+	{
+		m_Vec3 vertex_projected= v->pos * matrix;
+		const float w= v->pos.x * matrix.value[3] + v->pos.y * matrix.value[7] + v->pos.z * matrix.value[11] + matrix.value[15];
+
+		vertex_projected/= w;
+		vertex_projected.z= w;
+
+		vertex_projected.x= ( vertex_projected.x + 1.0f ) * screen_transform_x_;
+		vertex_projected.y= ( vertex_projected.y + 1.0f ) * screen_transform_y_;
+
+		RasterizerVertex& out_v= out_vertices[ i ];
+		out_v.x= fixed16_t( vertex_projected.x * 65536.0f );
+		out_v.y= fixed16_t( vertex_projected.y * 65536.0f );
+		out_v.u= fixed16_t( v->tc.x );
+		out_v.v= fixed16_t( v->tc.y );
+		out_v.z= fixed16_t( w * 65536.0f );
+	}
+
+	return polygon_vertex_count;
+}
+
+void MapDrawerSoft::DrawFloorCeilingCell(
+	FloorCeilingCell& cell,
+	const bool is_ceiling,
+	const m_Mat4& matrix,
+	const ViewClipPlanes& view_clip_planes,
+	const unsigned int clip_planes_mask )
+{
+	PC_ASSERT( cell.texture_id < MapData::c_floors_textures_count );
+
+	RasterizerVertex verties_projected[ c_max_clip_vertices_ ];
+	const unsigned int polygon_vertex_count=
+		ClipAndProjectFloorCeilingRect(
+			cell.xy[0], cell.xy[1], cell.size[0], cell.size[1],
+			is_ceiling ? GameConstants::walls_height : 0.0f,
+			matrix, view_clip_planes, clip_planes_mask, verties_projected );
+	if( polygon_vertex_count == 0u )
+		return;
+
+	if( rasterizer_->IsOccluded( verties_projected, polygon_vertex_count ) )
+		return;
+
+	// Search longest edge for mip calculation.
+	unsigned int longest_edge_index= 0u;
+	fixed8_t longest_edge_squre_length= 1; // fixed8_t range should be enought for vector ( 2048, 2048 ) square length.
+	for( unsigned int i= 0u; i < polygon_vertex_count; i++ )
+	{
+		unsigned int prev_i= i == 0u ? (polygon_vertex_count - 1u) : (i - 1u);
+		const fixed16_t dx= verties_projected[i].x - verties_projected[prev_i].x;
+		const fixed16_t dy= verties_projected[i].y - verties_projected[prev_i].y;
+		const fixed8_t square_length= FixedMul<16+8>( dx, dx ) + FixedMul<16+8>( dy, dy );
+		if( square_length > longest_edge_squre_length )
 		{
-			unsigned int prev_i= i == 0u ? (polygon_vertex_count - 1u) : (i - 1u);
-			const fixed16_t dx= verties_projected[i].x - verties_projected[prev_i].x;
-			const fixed16_t dy= verties_projected[i].y - verties_projected[prev_i].y;
-			const fixed8_t square_length= FixedMul<16+8>( dx, dx ) + FixedMul<16+8>( dy, dy );
-			if( square_length > longest_edge_squre_length )
-			{
-				longest_edge_squre_length= square_length;
-				longest_edge_index= i;
-			}
+			longest_edge_squre_length= square_length;
+			longest_edge_index= i;
+		}
+	}
+	int mip= 0;
+	const SurfacesCache::Surface* surface;
+	// Calculate d_tc / d_length for longest edge, select mip.
+	unsigned int prev_v= longest_edge_index == 0u ? (polygon_vertex_count - 1u) : (longest_edge_index - 1u);
+	const fixed16_t du= verties_projected[longest_edge_index].u - verties_projected[prev_v].u;
+	const fixed16_t dv= verties_projected[longest_edge_index].v - verties_projected[prev_v].v;
+	const fixed8_t square_tc_delta= FixedMul<16+8>( du, du ) + FixedMul<16+8>( dv, dv );
+	const int d_tc_d_len_square = square_tc_delta / longest_edge_squre_length;
+
+	if( d_tc_d_len_square < 1 * 1 )
+	{
+		mip= 0;
+		surface= GetFloorCeilingSurface<0>( cell );
+	}
+	else
+	{
+		if( d_tc_d_len_square < 2 * 2 )
+		{
+			mip= 1;
+			surface= GetFloorCeilingSurface<1>( cell );
 		}
-		int mip= 0;
-		const SurfacesCache::Surface* surface;
-		// Calculate d_tc / d_length for longest edge, select mip.
-		unsigned int prev_v= longest_edge_index == 0u ? (polygon_vertex_count - 1u) : (longest_edge_index - 1u);
-		const fixed16_t du= verties_projected[longest_edge_index].u - verties_projected[prev_v].u;
-		const fixed16_t dv= verties_projected[longest_edge_index].v - verties_projected[prev_v].v;
-		const fixed8_t square_tc_delta= FixedMul<16+8>( du, du ) + FixedMul<16+8>( dv, dv );
-		const int d_tc_d_len_square = square_tc_delta / longest_edge_squre_length;
-
-		if( d_tc_d_len_square < 1 * 1 )
+		else if( d_tc_d_len_square < 4 * 4 )
 		{
-			mip= 0;
-			surface= GetFloorCeilingSurface<0>( cell );
+			mip= 2;
+			surface= GetFloorCeilingSurface<2>( cell );
 		}
 		else
 		{
-			if( d_tc_d_len_square < 2 * 2 )
-			{
-				mip= 1;
-				surface= GetFloorCeilingSurface<1>( cell );
-			}
-			else if( d_tc_d_len_square < 4 * 4 )
-			{
-				mip= 2;
-				surface= GetFloorCeilingSurface<2>( cell );
-			}
-			else
-			{
-				mip= 3;
-				surface= GetFloorCeilingSurface<3>( cell );
-			}
+			mip= 3;
+			surface= GetFloorCeilingSurface<3>( cell );
+		}
 
-			for( unsigned int i= 0u; i < polygon_vertex_count; i++ )
-			{
-				verties_projected[i].u >>= mip;
-				verties_projected[i].v >>= mip;
-			}
+		for( unsigned int i= 0u; i < polygon_vertex_count; i++ )
+		{
+			verties_projected[i].u >>= mip;
+			verties_projected[i].v >>= mip;
 		}
+	}
 
-		rasterizer_.SetTexture(
-			surface->size[0], surface->size[1],
-			surface->GetData() );
+	rasterizer_->SetTexture(
+		surface->size[0], surface->size[1],
+		surface->GetData() );
 
-		rasterizer_.DrawTexturedConvexPolygonPerLineCorrected<
+	if( use_spans_buffer_ )
+		rasterizer_->DrawTexturedConvexPolygonPerLineCorrected<
+			Rasterizer::DepthTest::No, Rasterizer::DepthWrite::Yes,
+			Rasterizer::AlphaTest::No,
+			Rasterizer::OcclusionTest::Spans, Rasterizer::OcclusionWrite::Yes>( verties_projected, polygon_vertex_count, is_ceiling );
+	else
+		rasterizer_->DrawTexturedConvexPolygonPerLineCorrected<
 			Rasterizer::DepthTest::No, Rasterizer::DepthWrite::Yes,
 			Rasterizer::AlphaTest::No,
 			Rasterizer::OcclusionTest::Yes, Rasterizer::OcclusionWrite::Yes>( verties_projected, polygon_vertex_count, is_ceiling );
 
-		// TODO - does this needs?
-		// Maybe update whole screen hierarchy after floors and ceilings?
-		rasterizer_.UpdateOcclusionHierarchy( verties_projected, polygon_vertex_count, false );
-	}
+	// TODO - does this needs?
+	// Maybe update whole screen hierarchy after floors and ceilings?
+	rasterizer_->UpdateOcclusionHierarchy( verties_projected, polygon_vertex_count, false );
 }
 
 void MapDrawerSoft::DrawModel(
@@ -1565,99 +2085,46 @@ void MapDrawerSoft::DrawModel(
 		y_min= std::min( std::max( y_min, 0.0f ), screen_transform_y_ * 2.0f );
 		x_max= std::min( std::max( x_max, 0.0f ), screen_transform_x_ * 2.0f );
 		y_max= std::min( std::max( y_max, 0.0f ), screen_transform_y_ * 2.0f );
-		if( rasterizer_.IsDepthOccluded(
+		if( rasterizer_->IsDepthOccluded(
 			fixed16_t(x_min * 65536.0f), fixed16_t(y_min * 65536.0f),
 			fixed16_t(x_max * 65536.0f), fixed16_t(y_max * 65536.0f),
 			fixed16_t(w_min * 65536.0f), fixed16_t(w_max * 65536.0f) ) )
 			return;
 	}
 
-	Rasterizer::TriangleDrawFunc draw_func, alpha_draw_func;
+	// If 'w' variation is small - draw model triangles with affine texturing, else - use perspective correction.
+	const float c_ratio_threshold= 1.2f; // 20 %
+	const bool affine= w_min > 0.0f && w_max / w_min < c_ratio_threshold;
 
-	if( transparent || force_transparent_nontransparent_polygons )
-	{
-		draw_func=
-			&Rasterizer::DrawTexturedTriangleSpanCorrected<
-				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::No,
-				Rasterizer::AlphaTest::No,
-				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
-				Rasterizer::Lighting::Yes, Rasterizer::Blending::Yes>;
-		alpha_draw_func=
-			&Rasterizer::DrawTexturedTriangleSpanCorrected<
-				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
-				Rasterizer::AlphaTest::Yes,
-				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
-				Rasterizer::Lighting::Yes, Rasterizer::Blending::Yes>;
-	}
-	else
-	{
-		draw_func=
-			&Rasterizer::DrawTexturedTriangleSpanCorrected<
-				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
-				Rasterizer::AlphaTest::No,
-				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
-				Rasterizer::Lighting::Yes, Rasterizer::Blending::No>;
-		alpha_draw_func=
-			&Rasterizer::DrawTexturedTriangleSpanCorrected<
-				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
-				Rasterizer::AlphaTest::Yes,
-				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
-				Rasterizer::Lighting::Yes, Rasterizer::Blending::No>;
-	}
+	// Player texture is color-shifted, so, it exists only in RGBA format.
+	const bool is_player= &models_group == &monsters_models_ && model_id == 0u;
+	const bool paletted= use_paletted_textures_ && !is_player;
 
-	if( w_min > 0.0f /* && w_max > 0.0f */ )
-	{
-		// If 'w' variation is small - draw model triangles with affine texturing, else - use perspective correction.
-		const float c_ratio_threshold= 1.2f; // 20 %
-		const float ratio= w_max / w_min;
-		if( ratio < c_ratio_threshold )
-		{
-			if( transparent )
-			{
-				draw_func= &Rasterizer::DrawAffineTexturedTriangle<
-					Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
-					Rasterizer::AlphaTest::No,
-					Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
-					Rasterizer::Lighting::Yes, Rasterizer::Blending::Yes>;
-				alpha_draw_func= &Rasterizer::DrawAffineTexturedTriangle<
-					Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
-					Rasterizer::AlphaTest::Yes,
-					Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
-					Rasterizer::Lighting::Yes, Rasterizer::Blending::Yes>;
-			}
-			else
-			{
-				draw_func= &Rasterizer::DrawAffineTexturedTriangle<
-					Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
-					Rasterizer::AlphaTest::No,
-					Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
-					Rasterizer::Lighting::Yes, Rasterizer::Blending::No>;
-				alpha_draw_func= &Rasterizer::DrawAffineTexturedTriangle<
-					Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
-					Rasterizer::AlphaTest::Yes,
-					Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
-					Rasterizer::Lighting::Yes, Rasterizer::Blending::No>;
-			}
-		}
-	}
+	Rasterizer::TriangleDrawFunc draw_func, alpha_draw_func;
+	if( paletted )
+		SelectModelDrawFuncs<Rasterizer::TextureFormat::Paletted>(
+			transparent, force_transparent_nontransparent_polygons, affine,
+			draw_func, alpha_draw_func );
+	else
+		SelectModelDrawFuncs<Rasterizer::TextureFormat::RGBA>(
+			transparent, force_transparent_nontransparent_polygons, affine,
+			draw_func, alpha_draw_func );
 
 	const m_Vec3 cam_pos_model_space= ( camera_position - position ) * inv_rotation_mat;
 
 	const unsigned int first_animation_vertex= model.animations_vertices.size() / model.frame_count * animation_frame;
 
-	if( &models_group == &monsters_models_ && model_id == 0u )
-	{
-		// Detect player - set colored texture.
-		const TextureView texture_view= GetPlayerTexture( color );
-		rasterizer_.SetTexture( texture_view.size[0], texture_view.size[1], texture_view.data );
-	}
+	// Paletted textures have no mips. For mipmapped textures mip is selected for each polygon.
+	const TexturesStore::Texture* mipmapped_texture= nullptr;
+	if( is_player )
+		mipmapped_texture= &GetPlayerTexture( color ); // Detect player - set colored texture.
+	else if( paletted )
+		rasterizer_->SetTexture(
+			base_model.texture_size[0], base_model.texture_size[1],
+			base_model.texture_data.data(),
+			models_lit_palettes_.data() );
 	else
-	{
-		const ModelsGroup::ModelEntry& model_entry= models_group.models[ model_id ];
-		rasterizer_.SetTexture(
-			model_entry.texture_size[0], model_entry.texture_size[1],
-			models_group.textures_data.data() + model_entry.texture_data_offset );
-	}
+		mipmapped_texture= models_group.textures[ model_id ].get();
 
 	// TODO - make other branch, if clip_planes_transformed_count == 0
 	// Transform animation vertices, then rasterize trianglez directly, without clipping.
@@ -1728,6 +2195,9 @@ void MapDrawerSoft::DrawModel(
 			out_v.z= fixed16_t( w * 65536.0f );
 		}
 
+		if( mipmapped_texture != nullptr )
+			SetPolygonMipTexture( *rasterizer_, *mipmapped_texture, 0u, verties_projected, polygon_vertex_count );
+
 		fixed16_t light= g_fixed16_one;
 		if( !fullbright )
 		{
@@ -1739,7 +2209,7 @@ void MapDrawerSoft::DrawModel(
 			if( lightmap_x < MapData::c_lightmap_size && lightmap_y < MapData::c_lightmap_size )
 				light= ScaleLightmapLight( current_map_data_->lightmap[ lightmap_x + lightmap_y * MapData::c_lightmap_size ] );
 		}
-		rasterizer_.SetLight( light );
+		rasterizer_->SetLight( light );
 
 		const bool triangle_needs_alpha_test= first_vertex.alpha_test_mask != 0u;
 		const Rasterizer::TriangleDrawFunc triangle_func= triangle_needs_alpha_test ? alpha_draw_func : draw_func;
@@ -1750,7 +2220,7 @@ void MapDrawerSoft::DrawModel(
 		{
 			traingle_vertices[1]= verties_projected[ i + 1u ];
 			traingle_vertices[2]= verties_projected[ i + 2u ];
-			(rasterizer_.*triangle_func)( traingle_vertices );
+			(rasterizer_->*triangle_func)( traingle_vertices );
 		}
 	} // for model triangles
 }
@@ -1893,7 +2363,7 @@ void MapDrawerSoft::DrawModelShadow(
 		y_min= std::min( std::max( y_min, 0.0f ), screen_transform_y_ * 2.0f );
 		x_max= std::min( std::max( x_max, 0.0f ), screen_transform_x_ * 2.0f );
 		y_max= std::min( std::max( y_max, 0.0f ), screen_transform_y_ * 2.0f );
-		if( rasterizer_.IsDepthOccluded(
+		if( rasterizer_->IsDepthOccluded(
 			fixed16_t(x_min * 65536.0f), fixed16_t(y_min * 65536.0f),
 			fixed16_t(x_max * 65536.0f), fixed16_t(y_max * 65536.0f),
 			fixed16_t(w_min * 65536.0f), fixed16_t(w_max * 65536.0f) ) )
@@ -1978,7 +2448,7 @@ void MapDrawerSoft::DrawModelShadow(
 		{
 			traingle_vertices[1]= verties_projected[ i + 1u ];
 			traingle_vertices[2]= verties_projected[ i + 2u ];
-			rasterizer_.DrawShadowTriangle( traingle_vertices );
+			rasterizer_->DrawShadowTriangle( traingle_vertices );
 		}
 	} // for model triangles
 }
@@ -1988,8 +2458,12 @@ void MapDrawerSoft::DrawSky(
 	const m_Vec3& sky_pos,
 	const ViewClipPlanes& view_clip_planes )
 {
+	PC_PROFILER_ZONE( "Sky" );
+
 	PC_ASSERT( sky_texture_.file_name[0] != '\0' );
-	PC_ASSERT( sky_texture_.size[0] > 0 && sky_texture_.size[1] > 0 );
+	PC_ASSERT( sky_texture_.texture != nullptr );
+	const TexturesStore::Texture& sky_texture= *sky_texture_.texture;
+	PC_ASSERT( sky_texture.size[0] > 0 && sky_texture.size[1] > 0 );
 
 	constexpr int c_repeat_x= 5;
 	constexpr int c_repeat_y= 3;
@@ -1998,12 +2472,8 @@ void MapDrawerSoft::DrawSky(
 	constexpr int c_y_polygons_start= -1; // TODO - does this need ? maybe, sky abowe horizont should be enough?
 	constexpr float c_radius= float(MapData::c_map_size);
 
-	const fixed16_t tex_size_x= fixed16_t( sky_texture_.size[0] << 16u );
-	const fixed16_t tex_size_y= fixed16_t( sky_texture_.size[1] << 16u );
-
-	rasterizer_.SetTexture(
-		sky_texture_.size[0], sky_texture_.size[1],
-		sky_texture_.data.data() );
+	const fixed16_t tex_size_x= fixed16_t( sky_texture.size[0] << 16u );
+	const fixed16_t tex_size_y= fixed16_t( sky_texture.size[1] << 16u );
 
 	// TODO - optimize this
 	// 180 quads is too many for sky.
@@ -2072,13 +2542,21 @@ void MapDrawerSoft::DrawSky(
 			out_v.z= fixed16_t( w * 65536.0f );
 		}
 
-		if( rasterizer_.IsOccluded( verties_projected, polygon_vertex_count ) )
+		if( rasterizer_->IsOccluded( verties_projected, polygon_vertex_count ) )
 			continue;
 
-		rasterizer_.DrawTexturedConvexPolygonSpanCorrected<
-			Rasterizer::DepthTest::No, Rasterizer::DepthWrite::No,
-			Rasterizer::AlphaTest::No,
-			Rasterizer::OcclusionTest::Yes, Rasterizer::OcclusionWrite::No>( verties_projected, polygon_vertex_count, true );
+		SetPolygonMipTexture( *rasterizer_, sky_texture, 0u, verties_projected, polygon_vertex_count );
+
+		if( use_spans_buffer_ )
+			rasterizer_->DrawTexturedConvexPolygonSpanCorrected<
+				Rasterizer::DepthTest::No, Rasterizer::DepthWrite::No,
+				Rasterizer::AlphaTest::No,
+				Rasterizer::OcclusionTest::Spans, Rasterizer::OcclusionWrite::No>( verties_projected, polygon_vertex_count, true );
+		else
+			rasterizer_->DrawTexturedConvexPolygonSpanCorrected<
+				Rasterizer::DepthTest::No, Rasterizer::DepthWrite::No,
+				Rasterizer::AlphaTest::No,
+				Rasterizer::OcclusionTest::Yes, Rasterizer::OcclusionWrite::No>( verties_projected, polygon_vertex_count, true );
 	}
 }
 
@@ -2088,111 +2566,68 @@ void MapDrawerSoft::DrawEffectsSprites(
 	const m_Vec3& camera_position,
 	const ViewClipPlanes& view_clip_planes )
 {
+	PC_PROFILER_ZONE( "Effects sprites" );
+
 	SortEffectsSprites( map_state.GetSpriteEffects(), camera_position, sorted_sprites_ );
 
-	for( const MapState::SpriteEffect* const sprite_ptr : sorted_sprites_ )
+	// Build quads of all sprites first, than clip and draw them.
+	sprites_billboards_.resize( sorted_sprites_.size() );
+	for( unsigned int i= 0u; i < sorted_sprites_.size(); i++ )
 	{
-		const MapState::SpriteEffect& sprite= *sprite_ptr;
+		const MapState::SpriteEffect& sprite= *sorted_sprites_[i];
 
 		const GameResources::SpriteEffectDescription& sprite_description= game_resources_->sprites_effects_description[ sprite.effect_id ];
-		const SpriteTexture& sprite_texture= sprite_effects_textures_[ sprite.effect_id ];
+		const ObjSprite& sprite_picture= game_resources_->effects_sprites[ sprite.effect_id ];
 
-		// TODO - optimize this. Use less matrix multiplications.
-		// TODO - maybe add hierarchical depth-test ?
+		const float additional_scale= ( sprite_description.half_size ? 0.5f : 1.0f ) / 128.0f;
 
-		const m_Vec3 vec_to_sprite= sprite.pos - camera_position;
-		float sprite_angles[2];
-		VecToAngles( vec_to_sprite, sprite_angles );
+		SpriteBillboard& billboard= sprites_billboards_[i];
+		BuildSpriteBillboard(
+			sprite.pos, sprite.pos - camera_position,
+			additional_scale * float(sprite_picture.size[0]),
+			additional_scale * float(sprite_picture.size[1]),
+			false,
+			billboard.vertices );
+		billboard.source_index= i;
+	}
 
-		m_Mat4 rotate_z, rotate_x, shift_mat, sprite_mat;
-		rotate_z.RotateZ( sprite_angles[0] - Constants::half_pi );
-		rotate_x.RotateX( sprite_angles[1] );
-		shift_mat.Translate( sprite.pos );
-		sprite_mat= rotate_x * rotate_z * shift_mat;
+	for( const SpriteBillboard& billboard : sprites_billboards_ )
+	{
+		const MapState::SpriteEffect& sprite= *sorted_sprites_[ billboard.source_index ];
 
-		const float additional_scale= ( sprite_description.half_size ? 0.5f : 1.0f ) / 128.0f;
-		const float size_x= additional_scale * float(sprite_texture.size[0]);
-		const float size_z= additional_scale * float(sprite_texture.size[1]) ;
-
-		clipped_vertices_[0].pos= m_Vec3( -size_x, 0.0f, -size_z ) * sprite_mat;
-		clipped_vertices_[1].pos= m_Vec3( +size_x, 0.0f, -size_z ) * sprite_mat;
-		clipped_vertices_[2].pos= m_Vec3( +size_x, 0.0f, +size_z ) * sprite_mat;
-		clipped_vertices_[3].pos= m_Vec3( -size_x, 0.0f, +size_z ) * sprite_mat;
-		clipped_vertices_[0].tc= m_Vec2( 0.0f, 0.0f );
-		clipped_vertices_[1].tc= m_Vec2( float(sprite_texture.size[0] << 16), 0.0f );
-		clipped_vertices_[2].tc= m_Vec2( float(sprite_texture.size[0] << 16), float(sprite_texture.size[1] << 16) );
-		clipped_vertices_[3].tc= m_Vec2( 0.0f, float(sprite_texture.size[1] << 16) );
-		clipped_vertices_[0].next= &clipped_vertices_[1];
-		clipped_vertices_[1].next= &clipped_vertices_[2];
-		clipped_vertices_[2].next= &clipped_vertices_[3];
-		clipped_vertices_[3].next= &clipped_vertices_[0];
-		fisrt_clipped_vertex_= &clipped_vertices_[0];
-		next_new_clipped_vertex_= 4u;
+		const GameResources::SpriteEffectDescription& sprite_description= game_resources_->sprites_effects_description[ sprite.effect_id ];
+		const ObjSprite& sprite_picture= game_resources_->effects_sprites[ sprite.effect_id ];
 
-		unsigned int polygon_vertex_count= 4u;
-		for( const m_Plane3& plane : view_clip_planes )
-		{
-			polygon_vertex_count= ClipPolygon( plane, polygon_vertex_count );
-			PC_ASSERT( polygon_vertex_count == 0u || polygon_vertex_count >= 3u );
-			if( polygon_vertex_count == 0u )
-				break;
-		}
+		RasterizerVertex verties_projected[ c_max_clip_vertices_ ];
+		const unsigned int polygon_vertex_count=
+			ClipAndProjectSpriteBillboard( billboard, sprite_picture, view_matrix, view_clip_planes, verties_projected );
 		if( polygon_vertex_count == 0u )
 			continue;
 
-		RasterizerVertex verties_projected[ c_max_clip_vertices_ ];
-		ClippedVertex* v= fisrt_clipped_vertex_;
-		for( unsigned int i= 0u; i < polygon_vertex_count; i++, v= v->next )
-		{
-			m_Vec3 vertex_projected= v->pos * view_matrix;
-			const float w= v->pos.x * view_matrix.value[3] + v->pos.y * view_matrix.value[7] + v->pos.z * view_matrix.value[11] + view_matrix.value[15];
-
-			vertex_projected/= w;
-			vertex_projected.z= w;
-
-			vertex_projected.x= ( vertex_projected.x + 1.0f ) * screen_transform_x_;
-			vertex_projected.y= ( vertex_projected.y + 1.0f ) * screen_transform_y_;
-
-			RasterizerVertex& out_v= verties_projected[ i ];
-			out_v.x= fixed16_t( vertex_projected.x * 65536.0f );
-			out_v.y= fixed16_t( vertex_projected.y * 65536.0f );
-			out_v.u= fixed16_t( v->tc.x );
-			out_v.v= fixed16_t( v->tc.y );
-			out_v.z= fixed16_t( w * 65536.0f );
-		}
-
-		const unsigned int frame= static_cast<unsigned int>( sprite.frame ) % sprite_texture.size[2];
-		rasterizer_.SetTexture(
-			sprite_texture.size[0], sprite_texture.size[1],
-			sprite_texture.data.data() + sprite_texture.size[0] * sprite_texture.size[1] * frame );
-
-		Rasterizer::ConvexPolygonDrawFunc draw_func;
+		const unsigned int frame= static_cast<unsigned int>( sprite.frame ) % sprite_picture.frame_count;
+		if( use_paletted_textures_ )
+			SetPalettedSpriteTexture( *rasterizer_, sprite_picture, frame, sprites_lit_palettes_.data() );
+		else
+			SetPolygonMipTexture( *rasterizer_, *sprite_effects_textures_[ sprite.effect_id ], frame, verties_projected, polygon_vertex_count );
 
+		fixed16_t light= g_fixed16_one;
 		if( !sprite_description.light_on )
 		{
-			fixed16_t light= g_fixed16_one;
 			const unsigned int lightmap_x= static_cast<unsigned int>( sprite.pos.x * float(MapData::c_lightmap_scale) );
 			const unsigned int lightmap_y= static_cast<unsigned int>( sprite.pos.y * float(MapData::c_lightmap_scale) );
 			if( lightmap_x < MapData::c_lightmap_size && lightmap_y < MapData::c_lightmap_size )
 				light= ScaleLightmapLight( current_map_data_->lightmap[ lightmap_x + lightmap_y * MapData::c_lightmap_size ] );
-			rasterizer_.SetLight( light );
-
-			draw_func=
-				&Rasterizer::DrawTexturedConvexPolygonSpanCorrected<
-					Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
-					Rasterizer::AlphaTest::Yes,
-					Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
-					Rasterizer::Lighting::Yes, Rasterizer::Blending::Yes>;
 		}
-		else
-			draw_func=
-				&Rasterizer::DrawTexturedConvexPolygonSpanCorrected<
-					Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
-					Rasterizer::AlphaTest::Yes,
-					Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
-					Rasterizer::Lighting::No, Rasterizer::Blending::Yes>;
+		// Paletted sprites are lit via palette, so, set full light for not lit sprites too.
+		if( !sprite_description.light_on || use_paletted_textures_ )
+			rasterizer_->SetLight( light );
+
+		const Rasterizer::ConvexPolygonDrawFunc draw_func=
+			use_paletted_textures_
+				? GetSpriteDrawFunc<Rasterizer::TextureFormat::Paletted>( !sprite_description.light_on )
+				: GetSpriteDrawFunc<Rasterizer::TextureFormat::RGBA>( !sprite_description.light_on );
 
-		(rasterizer_.*draw_func)( verties_projected, polygon_vertex_count, false );
+		(rasterizer_->*draw_func)( verties_projected, polygon_vertex_count, false );
 	}
 }
 
@@ -2202,11 +2637,15 @@ void MapDrawerSoft::DrawBMPObjectsSprites(
 	const m_Vec3& camera_position,
 	const ViewClipPlanes& view_clip_planes )
 {
+	PC_PROFILER_ZONE( "BMP objects sprites" );
+
 	const float sprites_frame= map_state.GetSpritesFrame();
+	const MapState::StaticModels& static_models= map_state.GetStaticModels();
 
-	// TODO - maybe add hierarchical depth test?
-	for( const MapState::StaticModel& model : map_state.GetStaticModels() )
+	sprites_billboards_.clear();
+	for( unsigned int i= 0u; i < static_models.size(); i++ )
 	{
+		const MapState::StaticModel& model= static_models[i];
 		if( model.model_id >= current_map_data_->models_description.size() )
 			continue;
 
@@ -2217,87 +2656,134 @@ void MapDrawerSoft::DrawBMPObjectsSprites(
 
 		const GameResources::BMPObjectDescription& bmp_description= game_resources_->bmp_objects_description[ bmp_obj_id ];
 		const ObjSprite& sprite_picture= game_resources_->bmp_objects_sprites[ bmp_obj_id ];
-		const SpriteTexture& sprite_texture= bmp_objects_sprites_[ bmp_obj_id ];
 
 		const float additional_scale= ( bmp_description.half_size ? 0.5f : 1.0f ) / 128.0f;
-		const m_Vec3 scale_vec(
-			float(sprite_texture.size[0]) * additional_scale,
-			1.0f,
-			float(sprite_texture.size[1]) * additional_scale );
+		const float half_size_x= float(sprite_picture.size[0]) * additional_scale;
+		const float half_size_z= float(sprite_picture.size[1]) * additional_scale;
 
 		m_Vec3 pos= model.pos;
-		pos.z+= float( model_description.bmpz ) / 64.0f + scale_vec.z;
-
-		const m_Vec3 vec_to_sprite= pos - camera_position;
-		float sprite_angles[2];
-		VecToAngles( vec_to_sprite, sprite_angles );
-
-		m_Mat4 rotate_z, shift_mat, sprite_mat;
-		rotate_z.RotateZ( sprite_angles[0] - Constants::half_pi );
-		shift_mat.Translate( pos );
-		sprite_mat= rotate_z * shift_mat;
-
-		clipped_vertices_[0].pos= m_Vec3( -scale_vec.x, 0.0f, -scale_vec.z ) * sprite_mat;
-		clipped_vertices_[1].pos= m_Vec3( +scale_vec.x, 0.0f, -scale_vec.z ) * sprite_mat;
-		clipped_vertices_[2].pos= m_Vec3( +scale_vec.x, 0.0f, +scale_vec.z ) * sprite_mat;
-		clipped_vertices_[3].pos= m_Vec3( -scale_vec.x, 0.0f, +scale_vec.z ) * sprite_mat;
-		clipped_vertices_[0].tc= m_Vec2( 0.0f, 0.0f );
-		clipped_vertices_[1].tc= m_Vec2( float(sprite_texture.size[0] << 16), 0.0f );
-		clipped_vertices_[2].tc= m_Vec2( float(sprite_texture.size[0] << 16), float(sprite_texture.size[1] << 16) );
-		clipped_vertices_[3].tc= m_Vec2( 0.0f, float(sprite_texture.size[1] << 16) );
-		clipped_vertices_[0].next= &clipped_vertices_[1];
-		clipped_vertices_[1].next= &clipped_vertices_[2];
-		clipped_vertices_[2].next= &clipped_vertices_[3];
-		clipped_vertices_[3].next= &clipped_vertices_[0];
-		fisrt_clipped_vertex_= &clipped_vertices_[0];
-		next_new_clipped_vertex_= 4u;
+		pos.z+= float( model_description.bmpz ) / 64.0f + half_size_z;
 
-		unsigned int polygon_vertex_count= 4u;
-		for( const m_Plane3& plane : view_clip_planes )
-		{
-			polygon_vertex_count= ClipPolygon( plane, polygon_vertex_count );
-			PC_ASSERT( polygon_vertex_count == 0u || polygon_vertex_count >= 3u );
-			if( polygon_vertex_count == 0u )
-				break;
-		}
+		sprites_billboards_.emplace_back();
+		SpriteBillboard& billboard= sprites_billboards_.back();
+		BuildSpriteBillboard( pos, pos - camera_position, half_size_x, half_size_z, true, billboard.vertices );
+		billboard.source_index= i;
+	}
+
+	for( const SpriteBillboard& billboard : sprites_billboards_ )
+	{
+		const MapState::StaticModel& model= static_models[ billboard.source_index ];
+		const int bmp_obj_id= current_map_data_->models_description[ model.model_id ].bobj - 1u;
+		const ObjSprite& sprite_picture= game_resources_->bmp_objects_sprites[ bmp_obj_id ];
+
+		RasterizerVertex verties_projected[ c_max_clip_vertices_ ];
+		const unsigned int polygon_vertex_count=
+			ClipAndProjectSpriteBillboard( billboard, sprite_picture, view_matrix, view_clip_planes, verties_projected );
 		if( polygon_vertex_count == 0u )
 			continue;
 
-		RasterizerVertex verties_projected[ c_max_clip_vertices_ ];
-		ClippedVertex* v= fisrt_clipped_vertex_;
-		for( unsigned int i= 0u; i < polygon_vertex_count; i++, v= v->next )
+		const unsigned int phase= GetModelBMPSpritePhase( model );
+		const unsigned int frame= static_cast<unsigned int>( sprites_frame + phase ) % sprite_picture.frame_count;
+
+		if( use_paletted_textures_ )
+		{
+			// BMP sprites are not lit, so, use palette for full light.
+			rasterizer_->SetLight( g_fixed16_one );
+			SetPalettedSpriteTexture( *rasterizer_, sprite_picture, frame, sprites_lit_palettes_.data() );
+			rasterizer_->DrawTexturedConvexPolygonSpanCorrected<
+				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
+				Rasterizer::AlphaTest::Yes,
+				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
+				Rasterizer::Lighting::No, Rasterizer::Blending::Yes, Rasterizer::TextureFormat::Paletted>
+					( verties_projected, polygon_vertex_count, false );
+		}
+		else
 		{
-			m_Vec3 vertex_projected= v->pos * view_matrix;
-			const float w= v->pos.x * view_matrix.value[3] + v->pos.y * view_matrix.value[7] + v->pos.z * view_matrix.value[11] + view_matrix.value[15];
+			SetPolygonMipTexture( *rasterizer_, *bmp_objects_sprites_[ bmp_obj_id ], frame, verties_projected, polygon_vertex_count );
+			rasterizer_->DrawTexturedConvexPolygonSpanCorrected<
+				Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
+				Rasterizer::AlphaTest::Yes,
+				Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
+				Rasterizer::Lighting::No, Rasterizer::Blending::Yes>
+					( verties_projected, polygon_vertex_count, false );
+		}
+	}
+}
 
-			vertex_projected/= w;
-			vertex_projected.z= w;
+unsigned int MapDrawerSoft::ClipAndProjectSpriteBillboard(
+	const SpriteBillboard& billboard,
+	const ObjSprite& sprite,
+	const m_Mat4& view_matrix,
+	const ViewClipPlanes& view_clip_planes,
+	RasterizerVertex* const out_vertices )
+{
+	for( unsigned int i= 0u; i < 4u; i++ )
+		clipped_vertices_[i].pos= billboard.vertices[i];
+	clipped_vertices_[0].tc= m_Vec2( 0.0f, 0.0f );
+	clipped_vertices_[1].tc= m_Vec2( float(sprite.size[0] << 16), 0.0f );
+	clipped_vertices_[2].tc= m_Vec2( float(sprite.size[0] << 16), float(sprite.size[1] << 16) );
+	clipped_vertices_[3].tc= m_Vec2( 0.0f, float(sprite.size[1] << 16) );
+	clipped_vertices_[0].next= &clipped_vertices_[1];
+	clipped_vertices_[1].next= &clipped_vertices_[2];
+	clipped_vertices_[2].next= &clipped_vertices_[3];
+	clipped_vertices_[3].next= &clipped_vertices_[0];
+	fisrt_clipped_vertex_= &clipped_vertices_[0];
+	next_new_clipped_vertex_= 4u;
 
-			vertex_projected.x= ( vertex_projected.x + 1.0f ) * screen_transform_x_;
-			vertex_projected.y= ( vertex_projected.y + 1.0f ) * screen_transform_y_;
+	unsigned int polygon_vertex_count= 4u;
+	for( const m_Plane3& plane : view_clip_planes )
+	{
+		polygon_vertex_count= ClipPolygon( plane, polygon_vertex_count );
+		PC_ASSERT( polygon_vertex_count == 0u || polygon_vertex_count >= 3u );
+		if( polygon_vertex_count == 0u )
+			return 0u;
+	}
 
-			RasterizerVertex& out_v= verties_projected[ i ];
-			out_v.x= fixed16_t( vertex_projected.x * 65536.0f );
-			out_v.y= fixed16_t( vertex_projected.y * 65536.0f );
-			out_v.u= fixed16_t( v->tc.x );
-			out_v.v= fixed16_t( v->tc.y );
-			out_v.z= fixed16_t( w * 65536.0f );
-		}
+	fixed16_t x_min= std::numeric_limits<fixed16_t>::max(), x_max= std::numeric_limits<fixed16_t>::min();
+	fixed16_t y_min= std::numeric_limits<fixed16_t>::max(), y_max= std::numeric_limits<fixed16_t>::min();
+	float w_min= Constants::max_float, w_max= Constants::min_float;
 
-		const unsigned int phase= GetModelBMPSpritePhase( model );
-		const unsigned int frame= static_cast<unsigned int>( sprites_frame + phase ) % sprite_picture.frame_count;
+	ClippedVertex* v= fisrt_clipped_vertex_;
+	for( unsigned int i= 0u; i < polygon_vertex_count; i++, v= v->next )
+	{
+		m_Vec3 vertex_projected= v->pos * view_matrix;
+		const float w= v->pos.x * view_matrix.value[3] + v->pos.y * view_matrix.value[7] + v->pos.z * view_matrix.value[11] + view_matrix.value[15];
+
+		vertex_projected/= w;
+		vertex_projected.z= w;
+
+		vertex_projected.x= ( vertex_projected.x + 1.0f ) * screen_transform_x_;
+		vertex_projected.y= ( vertex_projected.y + 1.0f ) * screen_transform_y_;
+
+		RasterizerVertex& out_v= out_vertices[ i ];
+		out_v.x= fixed16_t( vertex_projected.x * 65536.0f );
+		out_v.y= fixed16_t( vertex_projected.y * 65536.0f );
+		out_v.u= fixed16_t( v->tc.x );
+		out_v.v= fixed16_t( v->tc.y );
+		out_v.z= fixed16_t( w * 65536.0f );
 
-		rasterizer_.SetTexture(
-			sprite_texture.size[0], sprite_texture.size[1],
-			sprite_texture.data.data() + sprite_texture.size[0] * sprite_texture.size[1] * frame );
+		x_min= std::min( x_min, out_v.x );
+		x_max= std::max( x_max, out_v.x );
+		y_min= std::min( y_min, out_v.y );
+		y_max= std::max( y_max, out_v.y );
+		w_min= std::min( w_min, w );
+		w_max= std::max( w_max, w );
+	}
 
-		rasterizer_.DrawTexturedConvexPolygonSpanCorrected<
-			Rasterizer::DepthTest::Yes, Rasterizer::DepthWrite::Yes,
-			Rasterizer::AlphaTest::Yes,
-			Rasterizer::OcclusionTest::No, Rasterizer::OcclusionWrite::No,
-			Rasterizer::Lighting::No, Rasterizer::Blending::Yes>
-				( verties_projected, polygon_vertex_count, false );
+	// Try to reject sprite, using hierarchical depth-test.
+	// Sprite must be not so near for this test - farther, then z_near.
+	if( w_min > 1.1f / float( 1u << Rasterizer::c_max_inv_z_min_log2 ) )
+	{
+		const fixed16_t screen_x_max= fixed16_t( screen_transform_x_ * 2.0f * 65536.0f );
+		const fixed16_t screen_y_max= fixed16_t( screen_transform_y_ * 2.0f * 65536.0f );
+		if( rasterizer_->IsDepthOccluded(
+				std::min( std::max( x_min, 0 ), screen_x_max ), std::min( std::max( y_min, 0 ), screen_y_max ),
+				std::min( std::max( x_max, 0 ), screen_x_max ), std::min( std::max( y_max, 0 ), screen_y_max ),
+				fixed16_t( w_min * 65536.0f ), fixed16_t( w_max * 65536.0f ) ) )
+			return 0u;
 	}
+
+	return polygon_vertex_count;
 }
 
 unsigned int MapDrawerSoft::ClipPolygon(
@@ -2458,14 +2944,15 @@ const SurfacesCache::Surface* MapDrawerSoft::GetFloorCeilingSurface( FloorCeilin
 	if( cell.mips_surfaces[mip] != nullptr )
 		return cell.mips_surfaces[mip];
 
-	PC_ASSERT( cell.xy[0] < MapData::c_map_size );
-	PC_ASSERT( cell.xy[1] < MapData::c_map_size );
+	PC_ASSERT( cell.xy[0] + cell.size[0] <= MapData::c_map_size );
+	PC_ASSERT( cell.xy[1] + cell.size[1] <= MapData::c_map_size );
 	PC_ASSERT( cell.texture_id < MapData::c_floors_textures_count );
 
 	const unsigned int texture_size= MapData::c_floor_texture_size >> mip;
 	const unsigned int monolighted_block_size= ( MapData::c_floor_texture_size / MapData::c_lightmap_scale ) >> mip;
+	const unsigned int surface_width= texture_size * cell.size[0];
 
-	surfaces_cache_.AllocateSurface( texture_size, texture_size, &cell.mips_surfaces[mip] );
+	surfaces_cache_.AllocateSurface( surface_width, texture_size * cell.size[1], &cell.mips_surfaces[mip] );
 	SurfacesCache::Surface* const surface= cell.mips_surfaces[mip];
 	uint32_t* const out_data= surface->GetData();
 
@@ -2479,11 +2966,14 @@ const SurfacesCache::Surface* MapDrawerSoft::GetFloorCeilingSurface( FloorCeilin
 	if( mip == 3u )
 		in_data= floor_textures_[cell.texture_id].mip3;
 
-	for( unsigned int lightmap_cell_y= 0u; lightmap_cell_y < MapData::c_lightmap_scale; lightmap_cell_y++ )
-	for( unsigned int lightmap_cell_x= 0u; lightmap_cell_x < MapData::c_lightmap_scale; lightmap_cell_x++ )
+	// Merged cells have same texture, but different lightmap.
+	for( unsigned int lightmap_cell_y= 0u; lightmap_cell_y < MapData::c_lightmap_scale * cell.size[1]; lightmap_cell_y++ )
+	for( unsigned int lightmap_cell_x= 0u; lightmap_cell_x < MapData::c_lightmap_scale * cell.size[0]; lightmap_cell_x++ )
 	{
 		const unsigned int lightmap_global_x= lightmap_cell_x + MapData::c_lightmap_scale * cell.xy[0];
 		const unsigned int lightmap_global_y= lightmap_cell_y + MapData::c_lightmap_scale * cell.xy[1];
+		const unsigned int texture_offset_x= ( lightmap_cell_x % MapData::c_lightmap_scale ) * monolighted_block_size;
+		const unsigned int texture_offset_y= ( lightmap_cell_y % MapData::c_lightmap_scale ) * monolighted_block_size;
 
 		// TODO - Maybe scale light?
 		const unsigned char lightmap_value= current_map_data_->lightmap[ lightmap_global_x + lightmap_global_y * MapData::c_lightmap_size ];
@@ -2492,10 +2982,9 @@ const SurfacesCache::Surface* MapDrawerSoft::GetFloorCeilingSurface( FloorCeilin
 		for( unsigned int texel_y= 0u; texel_y < monolighted_block_size; texel_y++ )
 		for( unsigned int texel_x= 0u; texel_x < monolighted_block_size; texel_x++ )
 		{
-			const unsigned int texture_x= texel_x + lightmap_cell_x * monolighted_block_size;
-			const unsigned int texture_y= texel_y + lightmap_cell_y * monolighted_block_size;
-			const unsigned int texel_address= texture_x + texture_y * texture_size;
-			const uint32_t texel= in_data[ texel_address ];
+			const unsigned int texture_x= texel_x + texture_offset_x;
+			const unsigned int texture_y= texel_y + texture_offset_y;
+			const uint32_t texel= in_data[ texture_x + texture_y * texture_size ];
 			unsigned char components[4];
 			for( unsigned int i= 0u; i < 3u; i++ )
 			{
@@ -2503,7 +2992,9 @@ const SurfacesCache::Surface* MapDrawerSoft::GetFloorCeilingSurface( FloorCeilin
 				components[i]= std::min( c, 255u );
 			}
 
-			std::memcpy( &out_data[ texel_address ], components, sizeof(uint32_t) );
+			const unsigned int surface_x= texel_x + lightmap_cell_x * monolighted_block_size;
+			const unsigned int surface_y= texel_y + lightmap_cell_y * monolighted_block_size;
+			std::memcpy( &out_data[ surface_x + surface_y * surface_width ], components, sizeof(uint32_t) );
 		}
 	} // for lightmap cells
 
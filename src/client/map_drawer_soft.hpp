@@ -5,8 +5,10 @@
 #include "../rendering_context.hpp"
 #include "fwd.hpp"
 #include "i_map_drawer.hpp"
+#include "shadows_lights_grid.hpp"
 #include "software_renderer/rasterizer.hpp"
 #include "software_renderer/surfaces_cache.hpp"
+#include "software_renderer/textures_store.hpp"
 
 namespace PanzerChasm
 {
@@ -52,25 +54,32 @@ public:
 private:
 	struct ModelsGroup
 	{
-		struct ModelEntry
-		{
-			unsigned int texture_size[2];
-			unsigned int texture_data_offset; // in pixels
-		};
-
-		std::vector<ModelEntry> models;
-
-		// TODO - add mips support
-		std::vector<uint32_t> textures_data;
+		// Textures are shared with other drawers via textures store.
+		// Contains nulls in paletted mode.
+		std::vector<TexturesStore::TexturePtr> textures;
 	};
 
+	// Rectangle of one or several adjacent cells with same texture.
 	struct FloorCeilingCell
 	{
 		unsigned char xy[2];
+		unsigned char size[2]; // In cells.
 		unsigned char texture_id;
 		SurfacesCache::Surface* mips_surfaces[4];
 	};
 
+	// Node of quadtree of floors or ceilings.
+	// Cells of node and all its children lie contiguously in "map_floors_and_ceilings_".
+	struct FloorsQuadtreeNode
+	{
+		unsigned char bb_min[2]; // Bounding box of node cells.
+		unsigned char bb_max[2];
+		unsigned short first_cell;
+		unsigned short cell_count;
+		unsigned short children[4]; // Zero, if there is no child. Leaf nodes have no children.
+		bool is_leaf;
+	};
+
 	struct DrawWall
 	{
 		unsigned int surface_width; // In pixels. must be 64 or 128
@@ -105,41 +114,42 @@ private:
 	struct SkyTexture
 	{
 		char file_name[32];
-		unsigned int size[2];
-
-		// TODO - add mips support.
-		// TODO - do not store mip0 32bit texture.
-		std::vector<uint32_t> data;
-	};
-
-	struct SpriteTexture
-	{
-		unsigned int size[3]; // Contains several frames
 
-		// TODO - add mips support.
 		// TODO - do not store mip0 32bit texture.
-		std::vector<uint32_t> data;
+		TexturesStore::TexturePtr texture;
 	};
 
-	struct TextureView
+	// Camera-facing quad of sprite.
+	struct SpriteBillboard
 	{
-		unsigned int size[2];
-		const uint32_t* data;
+		m_Vec3 vertices[4];
+		unsigned int source_index; // Index of sprite effect or static model.
 	};
 
-	struct PlayerTexture
-	{
-		unsigned int size[2];
-		std::vector<uint32_t> data;
-	};
+	// Contains several frames.
+	// TODO - do not store mip0 32bit texture.
+	typedef TexturesStore::TexturePtr SpriteTexture;
 
 private:
+	// Reloads models and sprites textures, if paletted textures setting changed.
+	void UpdateTexturesMode();
+	// Sets quantized lighting of RGBA texels via lookup tables for rasterizers, if it is enabled in settings.
+	void UpdateLightTablesMode();
+	void LoadModelsTextures();
 	void LoadModelsGroup( const std::vector<Model>& models, ModelsGroup& out_group );
+	void LoadSpritesTextures();
 	void LoadWallsTextures( const MapData& map_data );
 	void LoadFloorsTextures( const MapData& map_data );
 	void LoadWalls( const MapData& map_data );
 	void LoadFloorsAndCeilings( const MapData& map_data );
-	TextureView GetPlayerTexture( unsigned char color );
+	unsigned int BuildFloorsQuadtree_r( unsigned int first_cell, unsigned int cell_count, unsigned int x, unsigned int y, unsigned int size );
+	const TexturesStore::Texture& GetPlayerTexture( unsigned char color );
+
+	// Selects resolution scale for next frame, using draw time of previous frames.
+	void UpdateResolutionScale();
+	void SetResolutionScaleLevel( unsigned int level );
+	void UseFullRasterizer();
+	void UpscaleScaledViewport();
 
 	template< bool is_dynamic_wall >
 	void DrawWallSegment(
@@ -151,7 +161,31 @@ private:
 		const ViewClipPlanes& view_clip_planes );
 
 	void DrawWalls( const MapState& map_state, const m_Mat4& matrix, const m_Vec2& camera_position_xy, const ViewClipPlanes& view_clip_planes );
-	void DrawFloorsAndCeilings( const m_Mat4& matrix, const ViewClipPlanes& view_clip_planes  );
+	void DrawFloorsAndCeilings( const m_Mat4& matrix, const m_Vec2& camera_position_xy, const ViewClipPlanes& view_clip_planes );
+	void DrawFloorsAndCeilingsNode_r(
+		unsigned int node_index,
+		bool is_ceiling,
+		const m_Mat4& matrix,
+		const m_Vec2& camera_position_xy,
+		const ViewClipPlanes& view_clip_planes,
+		unsigned int clip_planes_mask );
+	void DrawFloorCeilingCell(
+		FloorCeilingCell& cell,
+		bool is_ceiling,
+		const m_Mat4& matrix,
+		const ViewClipPlanes& view_clip_planes,
+		unsigned int clip_planes_mask );
+
+	// Returns vertex count of clipped polygon or zero, if rectangle is clipped.
+	// clipped_vertices_ used
+	unsigned int ClipAndProjectFloorCeilingRect(
+		unsigned int x, unsigned int y,
+		unsigned int size_x, unsigned int size_y,
+		float z,
+		const m_Mat4& matrix,
+		const ViewClipPlanes& view_clip_planes,
+		unsigned int clip_planes_mask,
+		RasterizerVertex* out_vertices );
 
 	void DrawModel(
 		const ModelsGroup& models_group,
@@ -199,6 +233,15 @@ private:
 		const m_Vec3& camera_position,
 		const ViewClipPlanes& view_clip_planes );
 
+	// Returns vertex count of projected polygon or zero, if billboard is clipped or occluded.
+	// clipped_vertices_ used
+	unsigned int ClipAndProjectSpriteBillboard(
+		const SpriteBillboard& billboard,
+		const ObjSprite& sprite,
+		const m_Mat4& view_matrix,
+		const ViewClipPlanes& view_clip_planes,
+		RasterizerVertex* out_vertices );
+
 	// Returns new vertex count.
 	// clipped_vertices_ used
 	unsigned int ClipPolygon(
@@ -223,14 +266,25 @@ private:
 	Settings& settings_;
 	const GameResourcesConstPtr game_resources_;
 	const RenderingContextSoft rendering_context_;
-	const float screen_transform_x_;
-	const float screen_transform_y_;
-
-	Rasterizer rasterizer_;
-	SurfacesCache surfaces_cache_;
+	TexturesStore& textures_store_;
+	float screen_transform_x_;
+	float screen_transform_y_;
+
+	Rasterizer full_rasterizer_; // Draws directly into window surface.
+	Rasterizer* rasterizer_; // Current rasterizer - full or scaled.
+	SurfacesCache surfaces_cache_; // Sized for full viewport, so, it is enough for any scale.
+
+	// Dynamic resolution. Map frame is drawn into own buffer with lower resolution, than upscaled into window surface.
+	std::unique_ptr<Rasterizer> scaled_rasterizer_; // Exists, if scale level is not zero.
+	std::vector<uint32_t> scaled_color_buffer_;
+	Size2 scaled_viewport_size_;
+	unsigned int resolution_scale_level_= 0u;
+	unsigned int frames_since_resolution_scale_change_= 0u;
+	float average_draw_time_ms_= 0.0f;
 
 	MapDataConstPtr current_map_data_;
 	std::unique_ptr<MapBSPTree> map_bsp_tree_;
+	ShadowsLightsGrid shadows_lights_grid_;
 
 	ModelsGroup map_models_;
 	ModelsGroup items_models_;
@@ -243,17 +297,31 @@ private:
 	std::vector<DrawWall> dynamic_walls_;
 
 	std::vector<FloorCeilingCell> map_floors_and_ceilings_;
-	unsigned int first_floor_= 0u;
-	unsigned int first_ceiling_= 0u;
+	std::vector<FloorsQuadtreeNode> floors_quadtree_;
+	unsigned int floors_root_= ~0u; // ~0 means no floors.
+	unsigned int ceilings_root_= ~0u;
 
 	std::vector<SpriteTexture> sprite_effects_textures_;
 	std::vector<SpriteTexture> bmp_objects_sprites_;
 	SkyTexture sky_texture_;
 
-	std::vector<PlayerTexture> player_textures_;
+	std::vector<TexturesStore::TexturePtr> player_textures_;
+
+	// Paletted models and sprites textures are sampled directly from source data, using palettes for each light level.
+	// RGBA models and sprites textures are not held in this mode.
+	bool use_paletted_textures_= false;
+	std::vector<uint32_t> models_lit_palettes_;
+	std::vector<uint32_t> sprites_lit_palettes_;
+
+	// Static world geometry (opaque walls, floors, ceilings, sky) is occluded via spans buffer instead of occlusion buffer.
+	bool use_spans_buffer_= false;
 
 	// Reuse vector (do not create new vector each frame).
 	std::vector<const MapState::SpriteEffect*> sorted_sprites_;
+	std::vector<SpriteBillboard> sprites_billboards_;
+
+	static constexpr unsigned int c_max_merged_floor_cells_= 2u; // Along each axis.
+	static constexpr unsigned int c_max_cells_in_floors_quadtree_leaf_= 4u;
 
 	// Put large arrays at back.
 
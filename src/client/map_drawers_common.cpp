@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cstring>
 
 #include "../map_loader.hpp"
 #include "../math_utils.hpp"
@@ -13,20 +14,50 @@ void SortEffectsSprites(
 	const m_Vec3& camera_position,
 	std::vector<const MapState::SpriteEffect*>& out_sorted_sprites )
 {
-	// Sort from far to near
-	out_sorted_sprites.resize( effects_sprites.size() );
-	for( unsigned int i= 0u; i < effects_sprites.size(); i++ )
-		out_sorted_sprites[i]= & effects_sprites[i];
-
-	std::sort(
-		out_sorted_sprites.begin(),
-		out_sorted_sprites.end(),
-		[&]( const MapState::SpriteEffect* const a, const MapState::SpriteEffect* const b )
+	// Sort from far to near.
+	// Use LSD radix sort with key - upper 16 bits of square distance. For positive floats order of bits is same, as order of values.
+	// Precision of such key is enough for sprites sorting.
+	const auto get_key=
+	[&]( const MapState::SpriteEffect* const sprite ) -> unsigned int
+	{
+		const float square_distance= ( camera_position - sprite->pos ).SquareLength();
+		uint32_t bits;
+		std::memcpy( &bits, &square_distance, sizeof(uint32_t) );
+		return 0xFFFFu - ( bits >> 16u );
+	};
+
+	// Use second half of output vector as temporary buffer.
+	const unsigned int sprite_count= effects_sprites.size();
+	out_sorted_sprites.resize( sprite_count * 2u );
+	const MapState::SpriteEffect** src= out_sorted_sprites.data();
+	const MapState::SpriteEffect** dst= src + sprite_count;
+
+	for( unsigned int i= 0u; i < sprite_count; i++ )
+		src[i]= & effects_sprites[i];
+
+	for( unsigned int shift= 0u; shift < 16u; shift+= 8u )
+	{
+		unsigned int offsets[256];
+		std::fill( offsets, offsets + 256u, 0u );
+		for( unsigned int i= 0u; i < sprite_count; i++ )
+			offsets[ ( get_key( src[i] ) >> shift ) & 255u ]++;
+
+		unsigned int offset= 0u;
+		for( unsigned int& bucket_offset : offsets )
 		{
-			const m_Vec3 dir_a= camera_position - a->pos;
-			const m_Vec3 dir_b= camera_position - b->pos;
-			return dir_a.SquareLength() > dir_b.SquareLength();
-		});
+			const unsigned int bucket_size= bucket_offset;
+			bucket_offset= offset;
+			offset+= bucket_size;
+		}
+
+		for( unsigned int i= 0u; i < sprite_count; i++ )
+			dst[ offsets[ ( get_key( src[i] ) >> shift ) & 255u ]++ ]= src[i];
+
+		std::swap( src, dst );
+	}
+
+	// Even number of passes - result is in first half.
+	out_sorted_sprites.resize( sprite_count );
 }
 
 bool BBoxIsOutsideView(
@@ -67,63 +98,4 @@ unsigned int GetModelBMPSpritePhase( const MapState::StaticModel& model )
 	return static_cast<unsigned int>( model.pos.x * 13.0f + model.pos.y * 19.0f + model.angle * 29.0f );
 }
 
-bool GetNearestLightSourcePos(
-	const m_Vec3& pos,
-	const MapData& map_data,
-	const MapState& map_state,
-	const bool use_dynamic_lights,
-	m_Vec3& out_light_pos )
-{
-	float nearest_source_square_distance= Constants::max_float;
-	m_Vec3 nearest_source( 0.0f, 0.0f, 0.0f );
-
-	for( const MapData::Light& light : map_data.lights )
-	{
-		const float square_distance= ( light.pos - pos.xy() ).SquareLength();
-		if( square_distance < nearest_source_square_distance )
-		{
-			nearest_source.x= light.pos.x;
-			nearest_source.y= light.pos.y;
-			nearest_source_square_distance= square_distance;
-		}
-	}
-
-	if( use_dynamic_lights )
-	{
-		for( const MapState::LightFlash& light_flash : map_state.GetLightFlashes() )
-		{
-			const float square_distance= ( light_flash.pos - pos.xy() ).SquareLength();
-			if( square_distance < nearest_source_square_distance )
-			{
-				nearest_source.x= light_flash.pos.x;
-				nearest_source.y= light_flash.pos.y;
-				nearest_source_square_distance= square_distance;
-			}
-		}
-
-		for( const MapState::LightSourcesContainer::value_type& light_source_value : map_state.GetLightSources() )
-		{
-			const MapState::LightSource& light= light_source_value.second;
-
-			const float square_distance= ( light.pos - pos.xy() ).SquareLength();
-			if( square_distance < nearest_source_square_distance )
-			{
-				nearest_source.x= light.pos.x;
-				nearest_source.y= light.pos.y;
-				nearest_source_square_distance= square_distance;
-			}
-		}
-	}
-
-	const float c_max_distance_to_light_source= 2.5f;
-	if( nearest_source_square_distance < c_max_distance_to_light_source* c_max_distance_to_light_source )
-	{
-		nearest_source.z= GameConstants::walls_height * 2.0f; // Lit from abowe.
-		out_light_pos= nearest_source;
-		return true;
-	}
-
-	return false;
-}
-
 } // namespace PanzerChasm
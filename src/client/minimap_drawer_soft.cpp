@@ -1,9 +1,13 @@
+#include <cmath>
+
 #include <matrix.hpp>
 
 #include "../assert.hpp"
 #include "../map_loader.hpp"
 #include "../math_utils.hpp"
+#include "../settings.hpp"
 #include "minimap_drawers_common.hpp"
+#include "minimap_state.hpp"
 
 #include "minimap_drawer_soft.hpp"
 
@@ -16,11 +20,9 @@ MinimapDrawerSoft::MinimapDrawerSoft(
 	const RenderingContextSoft& rendering_context )
 	: rendering_context_(rendering_context)
 	, game_resources_(game_resources)
+	, use_static_walls_layer_( settings.GetOrSetBool( "r_minimap_static_walls_cache", true ) )
 {
 	PC_ASSERT( game_resources_ != nullptr );
-
-	// TODO
-	PC_UNUSED( settings );
 }
 
 MinimapDrawerSoft::~MinimapDrawerSoft()
@@ -29,6 +31,7 @@ MinimapDrawerSoft::~MinimapDrawerSoft()
 void MinimapDrawerSoft::SetMap( const MapDataConstPtr& map_data )
 {
 	current_map_data_= map_data;
+	static_walls_layer_revision_= 0u;
 }
 
 void MinimapDrawerSoft::Draw(
@@ -82,18 +85,27 @@ void MinimapDrawerSoft::Draw(
 	const MinimapState::WallsVisibility& dynamic_walls_visibility= minimap_state.GetDynamicWallsVisibility();
 
 	line_color_= palette[ MinimapParams::walls_color ];
-	for( unsigned int w= 0u; w < current_map_data_->static_walls.size(); w++ )
+	if( use_static_walls_layer_ )
 	{
-		if( !force_all_visible && !static_walls_visibility[w] )
-			continue;
+		int layer_shift_x, layer_shift_y;
+		PrepareStaticWallsLayer( minimap_state, force_all_visible, final_mat3, layer_shift_x, layer_shift_y );
+		DrawStaticWallsLayer( layer_shift_x, layer_shift_y );
+	}
+	else
+	{
+		for( unsigned int w= 0u; w < current_map_data_->static_walls.size(); w++ )
+		{
+			if( !force_all_visible && !static_walls_visibility[w] )
+				continue;
 
-		const MapData::Wall& wall= current_map_data_->static_walls[w];
-		const m_Vec2 v0= wall.vert_pos[0] * final_mat3;
-		const m_Vec2 v1= wall.vert_pos[1] * final_mat3;
+			const MapData::Wall& wall= current_map_data_->static_walls[w];
+			const m_Vec2 v0= wall.vert_pos[0] * final_mat3;
+			const m_Vec2 v1= wall.vert_pos[1] * final_mat3;
 
-		DrawLine(
-			fixed16_t( v0.x * 65536.0f ), fixed16_t( v0.y * 65536.0f ),
-			fixed16_t( v1.x * 65536.0f ), fixed16_t( v1.y * 65536.0f ) );
+			DrawLine(
+				fixed16_t( v0.x * 65536.0f ), fixed16_t( v0.y * 65536.0f ),
+				fixed16_t( v1.x * 65536.0f ), fixed16_t( v1.y * 65536.0f ) );
+		}
 	}
 
 	const MapState::DynamicWalls& dynamic_walls= map_state.GetDynamicWalls();
@@ -160,18 +172,17 @@ void MinimapDrawerSoft::Draw(
 
 }
 
-void MinimapDrawerSoft::DrawLine(
+template<class PixelFunc>
+void MinimapDrawerSoft::DrawLineImpl(
 	const fixed16_t x0, const fixed16_t y0,
-	const fixed16_t x1, const fixed16_t y1 )
+	const fixed16_t x1, const fixed16_t y1,
+	const PixelFunc& pixel_func )
 {
 	// Do fast line reject.
 	if( x0 <  x_min_f_ && x1 <  x_min_f_ ) return;
 	if( y0 <  y_min_f_ && y1 <  y_min_f_ ) return;
 	if( x0 >= x_max_f_ && x1 >= x_max_f_ ) return;
-	if( y0 >= y_max_f_ && y1 >= y_min_f_ ) return;
-
-	uint32_t* const dst_pixels= rendering_context_.window_surface_data;
-	const int dst_row_pixels= rendering_context_.row_pixels;
+	if( y0 >= y_max_f_ && y1 >= y_max_f_ ) return;
 
 	const int width= line_width_;
 	const int width_minus_delta= width / 2;
@@ -216,8 +227,7 @@ void MinimapDrawerSoft::DrawLine(
 			for( int y= y_i - width_minus_delta; y < y_i + width_delta; y++ )
 			{
 				if( y < y_min_ || y >= y_max_ ) continue;
-				uint32_t& dst= dst_pixels[ x + y * dst_row_pixels ];
-				dst= ( ( ( dst ^ line_color_ ) & 0xFEFEFEFEu ) >> 1u ) + ( dst & line_color_ );
+				pixel_func( x, y );
 			}
 		}
 	}
@@ -252,11 +262,137 @@ void MinimapDrawerSoft::DrawLine(
 			for( int x= x_i - width_minus_delta; x < x_i + width_delta; x++ )
 			{
 				if( x < x_min_ || x >= x_max_ ) continue;
-				uint32_t& dst= dst_pixels[ x + y * dst_row_pixels ];
-				dst= ( ( ( dst ^ line_color_ ) & 0xFEFEFEFEu ) >> 1u ) + ( dst & line_color_ );
+				pixel_func( x, y );
 			}
 		}
 	}
 }
 
+void MinimapDrawerSoft::DrawLine(
+	const fixed16_t x0, const fixed16_t y0,
+	const fixed16_t x1, const fixed16_t y1 )
+{
+	uint32_t* const dst_pixels= rendering_context_.window_surface_data;
+	const int dst_row_pixels= rendering_context_.row_pixels;
+	const uint32_t line_color= line_color_;
+
+	DrawLineImpl(
+		x0, y0, x1, y1,
+		[dst_pixels, dst_row_pixels, line_color]( const int x, const int y )
+		{
+			uint32_t& dst= dst_pixels[ x + y * dst_row_pixels ];
+			dst= ( ( ( dst ^ line_color ) & 0xFEFEFEFEu ) >> 1u ) + ( dst & line_color );
+		} );
+}
+
+void MinimapDrawerSoft::PrepareStaticWallsLayer(
+	const MinimapState& minimap_state,
+	const bool force_all_visible,
+	const m_Mat3& final_mat3,
+	int& out_shift_x, int& out_shift_y )
+{
+	// Map is not rotated, so, projection contains only scale and translation.
+	const m_Vec2 scale( final_mat3.value[0], final_mat3.value[4] );
+	const m_Vec2 origin( final_mat3.value[6], final_mat3.value[7] );
+
+	bool layer_is_valid=
+		static_walls_layer_revision_ == minimap_state.GetStaticWallsVisibilityRevision() &&
+		static_walls_layer_all_visible_ == force_all_visible &&
+		static_walls_layer_scale_.x == scale.x && static_walls_layer_scale_.y == scale.y;
+
+	if( layer_is_valid )
+	{
+		// Snap layer to whole pixels. Check, if layer still covers map viewport.
+		out_shift_x= static_cast<int>( std::round( origin.x - static_walls_layer_origin_.x ) );
+		out_shift_y= static_cast<int>( std::round( origin.y - static_walls_layer_origin_.y ) );
+		layer_is_valid=
+			x_min_ - out_shift_x >= 0 && x_max_ - out_shift_x <= static_walls_layer_width_ &&
+			y_min_ - out_shift_y >= 0 && y_max_ - out_shift_y <= static_walls_layer_height_;
+	}
+	if( layer_is_valid )
+		return;
+
+	// Make layer bigger, than map viewport, for reusing of it while camera moves.
+	const int margin_x= ( x_max_ - x_min_ ) / 2;
+	const int margin_y= ( y_max_ - y_min_ ) / 2;
+	out_shift_x= x_min_ - margin_x;
+	out_shift_y= y_min_ - margin_y;
+
+	static_walls_layer_width_ = x_max_ - x_min_ + margin_x * 2;
+	static_walls_layer_height_= y_max_ - y_min_ + margin_y * 2;
+	static_walls_layer_scale_= scale;
+	static_walls_layer_origin_= origin - m_Vec2( float(out_shift_x), float(out_shift_y) );
+	static_walls_layer_revision_= minimap_state.GetStaticWallsVisibilityRevision();
+	static_walls_layer_all_visible_= force_all_visible;
+
+	m_Mat3 layer_mat3= final_mat3;
+	layer_mat3.value[6]= static_walls_layer_origin_.x;
+	layer_mat3.value[7]= static_walls_layer_origin_.y;
+	BuildStaticWallsLayer( minimap_state, force_all_visible, layer_mat3 );
+}
+
+void MinimapDrawerSoft::BuildStaticWallsLayer(
+	const MinimapState& minimap_state,
+	const bool force_all_visible,
+	const m_Mat3& layer_mat3 )
+{
+	static_walls_layer_.resize( static_walls_layer_width_ * static_walls_layer_height_ );
+	std::fill( static_walls_layer_.begin(), static_walls_layer_.end(), 0u );
+
+	const int prev_x_min= x_min_, prev_y_min= y_min_, prev_x_max= x_max_, prev_y_max= y_max_;
+	x_min_= 0; x_min_f_= 0;
+	y_min_= 0; y_min_f_= 0;
+	x_max_= static_walls_layer_width_ ; x_max_f_= x_max_ << 16;
+	y_max_= static_walls_layer_height_; y_max_f_= y_max_ << 16;
+
+	uint8_t* const layer_pixels= static_walls_layer_.data();
+	const int layer_width= static_walls_layer_width_;
+
+	const MinimapState::WallsVisibility& static_walls_visibility= minimap_state.GetStaticWallsVisibility();
+	for( unsigned int w= 0u; w < current_map_data_->static_walls.size(); w++ )
+	{
+		if( !force_all_visible && !static_walls_visibility[w] )
+			continue;
+
+		const MapData::Wall& wall= current_map_data_->static_walls[w];
+		const m_Vec2 v0= wall.vert_pos[0] * layer_mat3;
+		const m_Vec2 v1= wall.vert_pos[1] * layer_mat3;
+
+		DrawLineImpl(
+			fixed16_t( v0.x * 65536.0f ), fixed16_t( v0.y * 65536.0f ),
+			fixed16_t( v1.x * 65536.0f ), fixed16_t( v1.y * 65536.0f ),
+			[layer_pixels, layer_width]( const int x, const int y )
+			{
+				// After 8 blendings with same color result is not changed, so, more lines are not needed.
+				uint8_t& count= layer_pixels[ x + y * layer_width ];
+				if( count < 8u )
+					count++;
+			} );
+	}
+
+	x_min_= prev_x_min; x_min_f_= x_min_ << 16;
+	y_min_= prev_y_min; y_min_f_= y_min_ << 16;
+	x_max_= prev_x_max; x_max_f_= x_max_ << 16;
+	y_max_= prev_y_max; y_max_f_= y_max_ << 16;
+}
+
+void MinimapDrawerSoft::DrawStaticWallsLayer( const int shift_x, const int shift_y )
+{
+	uint32_t* const dst_pixels= rendering_context_.window_surface_data;
+	const int dst_row_pixels= rendering_context_.row_pixels;
+	const uint32_t line_color= line_color_;
+
+	for( int y= y_min_; y < y_max_; y++ )
+	{
+		const uint8_t* const src= static_walls_layer_.data() + ( y - shift_y ) * static_walls_layer_width_ - shift_x;
+		uint32_t* const dst= dst_pixels + y * dst_row_pixels;
+
+		for( int x= x_min_; x < x_max_; x++ )
+		{
+			for( unsigned int i= 0u; i < src[x]; i++ )
+				dst[x]= ( ( ( dst[x] ^ line_color ) & 0xFEFEFEFEu ) >> 1u ) + ( dst[x] & line_color );
+		}
+	}
+}
+
 } // namespace PanzerChasm
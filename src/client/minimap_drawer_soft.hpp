@@ -1,4 +1,7 @@
 #pragma once
+#include <vector>
+
+#include <matrix.hpp>
 
 #include "../rendering_context.hpp"
 #include "i_minimap_drawer.hpp"
@@ -28,6 +31,26 @@ public:
 		fixed16_t x0, fixed16_t y0,
 		fixed16_t x1, fixed16_t y1 );
 
+private:
+	template<class PixelFunc>
+	void DrawLineImpl(
+		fixed16_t x0, fixed16_t y0,
+		fixed16_t x1, fixed16_t y1,
+		const PixelFunc& pixel_func );
+
+	// Rebuilds layer, if it is invalid or does not cover current map viewport.
+	// Returns shift of layer pixels relative to screen pixels.
+	void PrepareStaticWallsLayer(
+		const MinimapState& minimap_state,
+		bool force_all_visible,
+		const m_Mat3& final_mat3,
+		int& out_shift_x, int& out_shift_y );
+	void BuildStaticWallsLayer(
+		const MinimapState& minimap_state,
+		bool force_all_visible,
+		const m_Mat3& layer_mat3 );
+	void DrawStaticWallsLayer( int shift_x, int shift_y );
+
 private:
 	const RenderingContextSoft rendering_context_;
 	const GameResourcesConstPtr game_resources_;
@@ -39,6 +62,17 @@ private:
 
 	uint32_t line_color_;
 	int line_width_;
+
+	// Static walls, drawn once and reused in following frames, while scale, position and visibility of walls allow it.
+	// Each pixel contains number of lines, drawn over it. All static walls have same color, so, blending with them
+	// may be done later.
+	const bool use_static_walls_layer_;
+	std::vector<uint8_t> static_walls_layer_;
+	int static_walls_layer_width_= 0, static_walls_layer_height_= 0;
+	m_Vec2 static_walls_layer_scale_; // Projection scale, used for layer building.
+	m_Vec2 static_walls_layer_origin_; // Position of world origin in layer.
+	unsigned int static_walls_layer_revision_= 0u; // Zero - layer is invalid.
+	bool static_walls_layer_all_visible_= false;
 };
 
 } // namespace PanzerChasm
@@ -70,8 +70,11 @@ static int ClipLineSegment(
 	return 0;
 }
 
+static unsigned int g_last_static_walls_visibility_revision= 0u;
+
 MinimapState::MinimapState( const MapDataConstPtr& map_data )
 	: map_data_( map_data )
+	, static_walls_visibility_revision_( ++g_last_static_walls_visibility_revision )
 {
 	PC_ASSERT( map_data != nullptr );
 
@@ -96,6 +99,8 @@ void MinimapState::SetState(
 
 	static_walls_visibility_ = static_walls_visibility ;
 	dynamic_walls_visibility_= dynamic_walls_visibility;
+
+	static_walls_visibility_revision_= ++g_last_static_walls_visibility_revision;
 }
 
 void MinimapState::Update(
@@ -223,7 +228,13 @@ void MinimapState::Update(
 	for( const MapData::IndexElement& index_element : screen_buffer )
 	{
 		if( index_element.type == MapData::IndexElement::StaticWall )
-			static_walls_visibility_[ index_element.index ]= true;
+		{
+			if( !static_walls_visibility_[ index_element.index ] )
+			{
+				static_walls_visibility_[ index_element.index ]= true;
+				static_walls_visibility_revision_= ++g_last_static_walls_visibility_revision;
+			}
+		}
 		else if( index_element.type == MapData::IndexElement::DynamicWall )
 			dynamic_walls_visibility_[ index_element.index ]= true;
 	}
@@ -239,4 +250,9 @@ const MinimapState::WallsVisibility& MinimapState::GetDynamicWallsVisibility() c
 	return dynamic_walls_visibility_;
 }
 
+unsigned int MinimapState::GetStaticWallsVisibilityRevision() const
+{
+	return static_walls_visibility_revision_;
+}
+
 } // namespace PanzerChasm
@@ -29,11 +29,16 @@ public:
 	const WallsVisibility& GetStaticWallsVisibility() const;
 	const WallsVisibility& GetDynamicWallsVisibility() const;
 
+	// Changed after each change of static walls visibility. Unique for all minimap states.
+	unsigned int GetStaticWallsVisibilityRevision() const;
+
 private:
 	const MapDataConstPtr map_data_;
 
 	WallsVisibility static_walls_visibility_;
 	WallsVisibility dynamic_walls_visibility_;
+
+	unsigned int static_walls_visibility_revision_;
 };
 
 } // namespace PanzerChasm
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+#include "../assert.hpp"
+#include "../game_constants.hpp"
+#include "../map_loader.hpp"
+#include "../math_utils.hpp"
+#include "map_state.hpp"
+
+#include "shadows_lights_grid.hpp"
+
+namespace PanzerChasm
+{
+
+static constexpr float g_max_distance_to_light_source= 2.5f;
+
+static int ClampCoord( const int coord, const int size )
+{
+	return std::max( 0, std::min( coord, size - 1 ) );
+}
+
+ShadowsLightsGrid::ShadowsLightsGrid()
+{
+	static_assert(
+		float( 1u << c_dynamic_cell_size_log2 ) >= g_max_distance_to_light_source,
+		"Dynamic lights cell is too small" );
+	static_assert(
+		( c_dynamic_grid_size << c_dynamic_cell_size_log2 ) == MapData::c_map_size,
+		"Dynamic lights grid must cover map" );
+
+	dynamic_cells_.resize( c_dynamic_grid_size * c_dynamic_grid_size );
+}
+
+ShadowsLightsGrid::~ShadowsLightsGrid()
+{}
+
+void ShadowsLightsGrid::SetMap( const MapData& map_data )
+{
+	const int map_size= int(MapData::c_map_size);
+
+	// Light may affect cell, if distance to nearest point of cell is less, than max distance.
+	const auto for_each_light_cell=
+	[&]( const MapData::Light& light, const std::function<void(unsigned int)>& func )
+	{
+		const int x_min= ClampCoord( int( std::floor( light.pos.x - g_max_distance_to_light_source ) ), map_size );
+		const int x_max= ClampCoord( int( std::floor( light.pos.x + g_max_distance_to_light_source ) ), map_size );
+		const int y_min= ClampCoord( int( std::floor( light.pos.y - g_max_distance_to_light_source ) ), map_size );
+		const int y_max= ClampCoord( int( std::floor( light.pos.y + g_max_distance_to_light_source ) ), map_size );
+
+		for( int y= y_min; y <= y_max; y++ )
+		for( int x= x_min; x <= x_max; x++ )
+		{
+			const m_Vec2 nearest_point(
+				std::max( float(x), std::min( light.pos.x, float(x + 1) ) ),
+				std::max( float(y), std::min( light.pos.y, float(y + 1) ) ) );
+			if( ( nearest_point - light.pos ).SquareLength() < g_max_distance_to_light_source * g_max_distance_to_light_source )
+				func( static_cast<unsigned int>( x + y * map_size ) );
+		}
+	};
+
+	static_cells_.resize( MapData::c_map_size * MapData::c_map_size );
+	for( CellLights& cell : static_cells_ )
+		cell.first= cell.count= 0u;
+
+	// Count lights of each cell, than fill lights lists. Lights order is same, as in map.
+	for( const MapData::Light& light : map_data.lights )
+		for_each_light_cell( light, [&]( const unsigned int cell ) { static_cells_[cell].count++; } );
+
+	unsigned int offset= 0u;
+	for( CellLights& cell : static_cells_ )
+	{
+		cell.first= offset;
+		offset+= cell.count;
+		cell.count= 0u;
+	}
+
+	static_lights_.resize( offset );
+	for( const MapData::Light& light : map_data.lights )
+		for_each_light_cell(
+			light,
+			[&]( const unsigned int cell_index )
+			{
+				CellLights& cell= static_cells_[ cell_index ];
+				static_lights_[ cell.first + cell.count ]= light.pos;
+				cell.count++;
+			} );
+
+	// Lights are also needed as list for positions outside map.
+	all_static_lights_.clear();
+	for( const MapData::Light& light : map_data.lights )
+		all_static_lights_.push_back( light.pos );
+}
+
+void ShadowsLightsGrid::UpdateDynamicLights( const MapState& map_state )
+{
+	dynamic_lights_unsorted_.clear();
+	for( const MapState::LightFlash& light_flash : map_state.GetLightFlashes() )
+		dynamic_lights_unsorted_.push_back( light_flash.pos );
+	for( const MapState::LightSourcesContainer::value_type& light_source_value : map_state.GetLightSources() )
+		dynamic_lights_unsorted_.push_back( light_source_value.second.pos );
+
+	// Counting sort of lights by cells.
+	for( CellLights& cell : dynamic_cells_ )
+		cell.first= cell.count= 0u;
+
+	for( const m_Vec2& pos : dynamic_lights_unsorted_ )
+		dynamic_cells_[ GetDynamicCellIndex( pos ) ].count++;
+
+	unsigned int offset= 0u;
+	for( CellLights& cell : dynamic_cells_ )
+	{
+		cell.first= offset;
+		offset+= cell.count;
+		cell.count= 0u;
+	}
+
+	dynamic_lights_.resize( dynamic_lights_unsorted_.size() );
+	for( const m_Vec2& pos : dynamic_lights_unsorted_ )
+	{
+		CellLights& cell= dynamic_cells_[ GetDynamicCellIndex( pos ) ];
+		dynamic_lights_[ cell.first + cell.count ]= pos;
+		cell.count++;
+	}
+}
+
+bool ShadowsLightsGrid::GetNearestLightSourcePos(
+	const m_Vec3& pos,
+	const bool use_dynamic_lights,
+	m_Vec3& out_light_pos ) const
+{
+	float nearest_source_square_distance= Constants::max_float;
+	m_Vec2 nearest_source( 0.0f, 0.0f );
+
+	const auto check_lights=
+	[&]( const m_Vec2* const lights, const unsigned int count )
+	{
+		for( unsigned int i= 0u; i < count; i++ )
+		{
+			const float square_distance= ( lights[i] - pos.xy() ).SquareLength();
+			if( square_distance < nearest_source_square_distance )
+			{
+				nearest_source= lights[i];
+				nearest_source_square_distance= square_distance;
+			}
+		}
+	};
+
+	const int map_size= int(MapData::c_map_size);
+	const int cell_x= static_cast<int>( std::floor( pos.x ) );
+	const int cell_y= static_cast<int>( std::floor( pos.y ) );
+	if( cell_x >= 0 && cell_x < map_size && cell_y >= 0 && cell_y < map_size && !static_cells_.empty() )
+	{
+		const CellLights& cell= static_cells_[ static_cast<unsigned int>( cell_x + cell_y * map_size ) ];
+		check_lights( static_lights_.data() + cell.first, cell.count );
+	}
+	else
+		check_lights( all_static_lights_.data(), all_static_lights_.size() );
+
+	if( use_dynamic_lights )
+	{
+		// Lights are clamped into border cells, so, for any light near given position, cell is nearby.
+		const int dynamic_cell_x= ClampCoord( cell_x >> int(c_dynamic_cell_size_log2), int(c_dynamic_grid_size) );
+		const int dynamic_cell_y= ClampCoord( cell_y >> int(c_dynamic_cell_size_log2), int(c_dynamic_grid_size) );
+
+		for( int y= std::max( dynamic_cell_y - 1, 0 ); y <= std::min( dynamic_cell_y + 1, int(c_dynamic_grid_size) - 1 ); y++ )
+		for( int x= std::max( dynamic_cell_x - 1, 0 ); x <= std::min( dynamic_cell_x + 1, int(c_dynamic_grid_size) - 1 ); x++ )
+		{
+			const CellLights& cell= dynamic_cells_[ static_cast<unsigned int>( x + y * int(c_dynamic_grid_size) ) ];
+			check_lights( dynamic_lights_.data() + cell.first, cell.count );
+		}
+	}
+
+	if( nearest_source_square_distance < g_max_distance_to_light_source * g_max_distance_to_light_source )
+	{
+		out_light_pos.x= nearest_source.x;
+		out_light_pos.y= nearest_source.y;
+		out_light_pos.z= GameConstants::walls_height * 2.0f; // Lit from abowe.
+		return true;
+	}
+
+	return false;
+}
+
+unsigned int ShadowsLightsGrid::GetDynamicCellIndex( const m_Vec2& pos )
+{
+	const int x= ClampCoord( static_cast<int>( std::floor( pos.x ) ) >> int(c_dynamic_cell_size_log2), int(c_dynamic_grid_size) );
+	const int y= ClampCoord( static_cast<int>( std::floor( pos.y ) ) >> int(c_dynamic_cell_size_log2), int(c_dynamic_grid_size) );
+	return static_cast<unsigned int>( x + y * int(c_dynamic_grid_size) );
+}
+
+} // namespace PanzerChasm
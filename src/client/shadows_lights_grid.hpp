@@ -0,0 +1,60 @@
+#pragma once
+#include <vector>
+
+#include <vec.hpp>
+
+#include "../fwd.hpp"
+#include "fwd.hpp"
+
+namespace PanzerChasm
+{
+
+// Lookup structure for selection of light source for models shadows.
+// Static lights, which may be nearest for point inside map cell, are precomputed for each cell.
+// Dynamic lights are sorted into coarse grid each frame.
+class ShadowsLightsGrid final
+{
+public:
+	ShadowsLightsGrid();
+	~ShadowsLightsGrid();
+
+	void SetMap( const MapData& map_data );
+
+	// Call each frame before "GetNearestLightSourcePos" with dynamic lights.
+	void UpdateDynamicLights( const MapState& map_state );
+
+	// Returns false, if no near light source.
+	// TODO - maybe return "upper" light source in this case?
+	bool GetNearestLightSourcePos(
+		const m_Vec3& pos,
+		bool use_dynamic_lights,
+		m_Vec3& out_light_pos ) const;
+
+private:
+	struct CellLights
+	{
+		unsigned int first;
+		unsigned int count;
+	};
+
+private:
+	// Dynamic lights cell must be not less, than max distance to light source.
+	static constexpr unsigned int c_dynamic_cell_size_log2= 2u;
+	static constexpr unsigned int c_dynamic_grid_size= 16u;
+
+private:
+	static unsigned int GetDynamicCellIndex( const m_Vec2& pos );
+
+private:
+	// Static lights.
+	std::vector<CellLights> static_cells_;
+	std::vector<m_Vec2> static_lights_;
+	std::vector<m_Vec2> all_static_lights_;
+
+	// Dynamic lights.
+	std::vector<CellLights> dynamic_cells_;
+	std::vector<m_Vec2> dynamic_lights_;
+	std::vector<m_Vec2> dynamic_lights_unsorted_;
+};
+
+} // namespace PanzerChasm
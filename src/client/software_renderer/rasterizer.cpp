@@ -11,6 +11,26 @@
 namespace PanzerChasm
 {
 
+// Returns light tables, shared between all rasterizers.
+static const uint8_t* GetLightTables()
+{
+	static const std::vector<uint8_t> light_tables=
+	[]
+	{
+		std::vector<uint8_t> result( Rasterizer::c_light_tables_size );
+		for( unsigned int level= 0u; level < Rasterizer::c_palette_light_levels; level++ )
+		{
+			// Take light in start of level range, so, full light level is exact identity.
+			const unsigned int light= level << Rasterizer::c_palette_light_level_shift;
+			for( unsigned int i= 0u; i < 256u; i++ )
+				result[ level * 256u + i ]= static_cast<uint8_t>( std::min( ( i * light ) >> 16u, 255u ) );
+		}
+		return result;
+	}();
+
+	return light_tables.data();
+}
+
 Rasterizer::Rasterizer(
 	const unsigned int viewport_size_x,
 	const unsigned int viewport_size_y,
@@ -20,6 +40,7 @@ Rasterizer::Rasterizer(
 	, viewport_size_y_( int(viewport_size_y) )
 	, row_size_( int(row_size) )
 	, color_buffer_( color_buffer )
+	, spans_buffer_( viewport_size_y )
 {
 	{ // Setup depth buffer and depth buffer hierarchy.
 		unsigned int memory_for_depth_required= 0u;
@@ -96,6 +117,8 @@ void Rasterizer::ClearDepthBuffer()
 
 void Rasterizer::ClearOcclusionBuffer()
 {
+	spans_buffer_.Clear();
+
 	// Set all occlusion buffer to zero.
 	std::memset(
 		occlusion_buffer_,
@@ -868,9 +891,70 @@ void Rasterizer::SetTexture(
 	texture_data_= data;
 }
 
+void Rasterizer::SetTexture(
+	const unsigned int size_x,
+	const unsigned int size_y,
+	const uint8_t* const data,
+	const uint32_t* const lit_palettes )
+{
+	PC_ASSERT( lit_palettes != nullptr );
+
+	texture_size_x_= size_x;
+	texture_size_y_= size_y;
+	max_valid_tc_u_ = ( texture_size_x_ << 16 ) - 1;
+	max_valid_tc_v_ = ( texture_size_y_ << 16 ) - 1;
+	texture_data_paletted_= data;
+	lit_palettes_= lit_palettes;
+
+	SetLight( light_ );
+}
+
+void Rasterizer::BuildLitPalettes( const uint32_t* const palette, uint32_t* const out_lit_palettes )
+{
+	for( unsigned int level= 0u; level < c_palette_light_levels; level++ )
+	{
+		// Take light in center of level range.
+		const unsigned int light= ( level << c_palette_light_level_shift ) + ( 1u << ( c_palette_light_level_shift - 1 ) );
+		uint32_t* const dst= out_lit_palettes + level * 256u;
+
+		for( unsigned int i= 0u; i < 256u; i++ )
+		{
+			unsigned char components[4];
+			std::memcpy( components, &palette[i], sizeof(uint32_t) );
+			for( unsigned int j= 0u; j < 3u; j++ )
+				components[j]= std::min( ( components[j] * light ) >> 16u, 255u );
+			std::memcpy( &dst[i], components, sizeof(uint32_t) );
+		}
+	}
+}
+
 void Rasterizer::SetLight( const fixed16_t light )
 {
 	light_= light;
+
+	const int level= std::max( 0, std::min( light >> c_palette_light_level_shift, int(c_palette_light_levels) - 1 ) );
+	if( lit_palettes_ != nullptr )
+		texture_palette_= lit_palettes_ + level * 256;
+
+	if( use_light_tables_ )
+	{
+		// Round light to nearest level.
+		const int table_level=
+			std::max( 0, std::min( ( light + ( 1 << ( c_palette_light_level_shift - 1 ) ) ) >> c_palette_light_level_shift, int(c_palette_light_levels) - 1 ) );
+		light_table_= GetLightTables() + table_level * 256;
+		texels_light_= table_level << c_palette_light_level_shift;
+	}
+	else
+	{
+		light_table_= nullptr;
+		texels_light_= light;
+	}
+}
+
+void Rasterizer::SetUseLightTables( const bool use_light_tables )
+{
+	use_light_tables_= use_light_tables;
+	SetLight( light_ );
 }
 
 void Rasterizer::DrawFullscreenBlend(
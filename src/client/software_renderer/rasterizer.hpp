@@ -3,6 +3,7 @@
 #include <vector>
 
 #include "fixed.hpp"
+#include "spans_buffer.hpp"
 
 namespace PanzerChasm
 {
@@ -44,6 +45,15 @@ public:
 
 	static constexpr unsigned int c_max_polygon_vertices= 14u;
 
+	// Paletted textures use lit palette for each light level, like original game renderer.
+	// Light level is ( light >> c_palette_light_level_shift ), so, light range is [ 0; 2 ).
+	static constexpr int c_palette_light_levels_log2= 6;
+	static constexpr unsigned int c_palette_light_levels= 1u << c_palette_light_levels_log2;
+	static constexpr int c_palette_light_level_shift= 17 - c_palette_light_levels_log2;
+	static constexpr unsigned int c_lit_palettes_size= 256u * c_palette_light_levels;
+	// RGBA textures may be lit via table of lit color components for each light level.
+	static constexpr unsigned int c_light_tables_size= 256u * c_palette_light_levels;
+
 	typedef void (Rasterizer::*TriangleDrawFunc)(const RasterizerVertex*);
 	typedef void (Rasterizer::*ConvexPolygonDrawFunc)(const RasterizerVertex*, unsigned int, bool);
 
@@ -53,8 +63,11 @@ public:
 	{ Yes, No };
 	enum class AlphaTest
 	{ Yes, No };
+	// "Spans" - skip parts of lines, covered by spans buffer. Check occlusion buffer only for lines, where something was drawn without spans.
+	// With occlusion write, lines are added into spans buffer. This is possible only for opaque polygons without depth test.
+	// Polygons must be drawn front-to-back.
 	enum class OcclusionTest
-	{ Yes, No };
+	{ Yes, No, Spans };
 	enum class OcclusionWrite
 	{ Yes, No };
 	enum class Lighting
@@ -63,6 +76,8 @@ public:
 	{ Yes, No };
 	enum class DepthHack
 	{ Yes, No };
+	enum class TextureFormat
+	{ RGBA, Paletted };
 
 	Rasterizer(
 		unsigned int viewport_size_x,
@@ -91,9 +106,24 @@ public:
 		unsigned int size_y,
 		const uint32_t* data );
 
+	// Set 8-bit texture. "lit_palettes" must contain c_lit_palettes_size elements.
+	// Lighting for such textures is performed via palette, selected in SetLight.
+	void SetTexture(
+		unsigned int size_x,
+		unsigned int size_y,
+		const uint8_t* data,
+		const uint32_t* lit_palettes );
+
+	// Build palette for each light level. Alpha of palette colors preserved.
+	static void BuildLitPalettes( const uint32_t* palette, uint32_t* out_lit_palettes );
+
 	// final_color= ( light * color ) >> 16
 	void SetLight( fixed16_t light );
 
+	// If enabled, light of RGBA texels is rounded to one of c_palette_light_levels levels and texels are lit via lookup tables.
+	// Disabled by default.
+	void SetUseLightTables( bool use_light_tables );
+
 	void DrawFullscreenBlend( const unsigned char* color_components, unsigned char alpha );
 
 	void DrawAffineColoredTriangle( const RasterizerVertex* trianlge_vertices, uint32_t color );
@@ -106,7 +136,8 @@ public:
 		DepthTest depth_test, DepthWrite depth_write,
 		AlphaTest alpha_test,
 		OcclusionTest occlusion_test, OcclusionWrite occlusion_write,
-		Lighting lighting= Lighting::No, Blending= Blending::No>
+		Lighting lighting= Lighting::No, Blending= Blending::No,
+		TextureFormat texture_format= TextureFormat::RGBA>
 	void DrawAffineTexturedTriangle( const RasterizerVertex* trianlge_vertices );
 
 	template<
@@ -120,7 +151,8 @@ public:
 		DepthTest depth_test, DepthWrite depth_write,
 		AlphaTest alpha_test,
 		OcclusionTest occlusion_test, OcclusionWrite occlusion_write,
-		Lighting lighting= Lighting::No, Blending blending= Blending::No, DepthHack depth_hack= DepthHack::No>
+		Lighting lighting= Lighting::No, Blending blending= Blending::No, DepthHack depth_hack= DepthHack::No,
+		TextureFormat texture_format= TextureFormat::RGBA>
 	void DrawTexturedTriangleSpanCorrected( const RasterizerVertex* trianlge_vertices );
 
 	template<
@@ -134,7 +166,8 @@ public:
 		DepthTest depth_test, DepthWrite depth_write,
 		AlphaTest alpha_test,
 		OcclusionTest occlusion_test, OcclusionWrite occlusion_write,
-		Lighting lighting= Lighting::No, Blending= Blending::No>
+		Lighting lighting= Lighting::No, Blending= Blending::No,
+		TextureFormat texture_format= TextureFormat::RGBA>
 	void DrawTexturedConvexPolygonSpanCorrected( const RasterizerVertex* trianlge_vertices, unsigned int vertex_count, bool is_anticlockwise );
 
 private:
@@ -148,6 +181,8 @@ private:
 	template<unsigned int level>
 	void SetToOneOcclusionHierarchyCell_r( unsigned int cell_x, unsigned int cell_y );
 
+	template<TextureFormat texture_format>
+	uint32_t FetchTexel( int u, int v ) const;
 	template<Lighting lighting>
 	uint32_t ApplyLight( uint32_t texel ) const;
 	template<Blending blending>
@@ -165,7 +200,8 @@ private:
 		DepthTest depth_test, DepthWrite depth_write,
 		AlphaTest alpha_test,
 		OcclusionTest occlusion_test, OcclusionWrite occlusion_write,
-		Lighting lighting, Blending blending= Blending::No>
+		Lighting lighting, Blending blending= Blending::No,
+		TextureFormat texture_format= TextureFormat::RGBA>
 	void DrawAffineTexturedTrianglePart();
 
 	template<
@@ -179,7 +215,8 @@ private:
 		DepthTest depth_test, DepthWrite depth_write,
 		AlphaTest alpha_test,
 		OcclusionTest occlusion_test, OcclusionWrite occlusion_write,
-		Lighting lighting, Blending blending= Blending::No, DepthHack depth_hack= DepthHack::No>
+		Lighting lighting, Blending blending= Blending::No, DepthHack depth_hack= DepthHack::No,
+		TextureFormat texture_format= TextureFormat::RGBA>
 	void DrawTexturedTriangleSpanCorrectedPart();
 
 private:
@@ -235,15 +272,24 @@ private:
 	} occlusion_hierarchy_levels_[ c_occlusion_hierarchy_levels ];
 	std::vector<unsigned short> occlusion_heirarchy_storage_;
 
+	// Spans buffer. Cleared together with occlusion buffer.
+	SpansBuffer spans_buffer_;
+
 	// Texture
 	int texture_size_x_= 0;
 	int texture_size_y_= 0;
 	fixed16_t max_valid_tc_u_= 0;
 	fixed16_t max_valid_tc_v_= 0;
 	const uint32_t* texture_data_= nullptr;
+	const uint8_t* texture_data_paletted_= nullptr;
+	const uint32_t* lit_palettes_= nullptr;
+	const uint32_t* texture_palette_= nullptr; // Palette for current light level.
 
 	// Light
 	fixed16_t light_= g_fixed16_one;
+	bool use_light_tables_= false;
+	fixed16_t texels_light_= g_fixed16_one; // Light for RGBA texels. Quantized, if light tables used.
+	const uint8_t* light_table_= nullptr; // Lit color components for current light level. Null, if light tables not used.
 
 	// Intermediate variables
 
@@ -1,4 +1,6 @@
 #pragma once
+#include <cstring>
+
 #include "rasterizer.hpp"
 
 #ifdef PC_MMX_INSTRUCTIONS
@@ -14,9 +16,13 @@ template<
 	Rasterizer::DepthTest depth_test, Rasterizer::DepthWrite depth_write,
 	Rasterizer::AlphaTest alpha_test,
 	Rasterizer::OcclusionTest occlusion_test, Rasterizer::OcclusionWrite occlusion_write,
-	Rasterizer::Lighting lighting, Rasterizer::Blending blending>
+	Rasterizer::Lighting lighting, Rasterizer::Blending blending,
+	Rasterizer::TextureFormat texture_format>
 void Rasterizer::DrawAffineTexturedTriangle( const RasterizerVertex* vertices )
 {
+	// Paletted textures lit via palette.
+	constexpr Lighting texel_lighting= texture_format == TextureFormat::Paletted ? Lighting::No : lighting;
+
 	PC_ASSERT( vertices[0].z > ( g_fixed16_one >> c_max_inv_z_min_log2 ) );
 	PC_ASSERT( vertices[1].z > ( g_fixed16_one >> c_max_inv_z_min_log2 ) );
 	PC_ASSERT( vertices[2].z > ( g_fixed16_one >> c_max_inv_z_min_log2 ) );
@@ -112,7 +118,7 @@ void Rasterizer::DrawAffineTexturedTriangle( const RasterizerVertex* vertices )
 			triangle_part_vertices_[3]= vertices[ upper_index ];
 			trianlge_part_tc_left_= vertices[ lower_index ];
 			triangle_part_inv_z_scaled_left_= lower_vertex_inv_z_scaled;
-			DrawAffineTexturedTrianglePart< depth_test, depth_write, alpha_test, occlusion_test, occlusion_write, lighting, blending >();
+			DrawAffineTexturedTrianglePart< depth_test, depth_write, alpha_test, occlusion_test, occlusion_write, texel_lighting, blending, texture_format >();
 		}
 		if( upper_middle_dy > 0 )
 		{
@@ -127,7 +133,7 @@ void Rasterizer::DrawAffineTexturedTriangle( const RasterizerVertex* vertices )
 			triangle_part_vertices_[3]= vertices[ upper_index ];
 			trianlge_part_tc_left_= vertices[ middle_index ];
 			triangle_part_inv_z_scaled_left_= middle_vertex_inv_z_scaled;
-			DrawAffineTexturedTrianglePart< depth_test, depth_write, alpha_test, occlusion_test, occlusion_write, lighting, blending >();
+			DrawAffineTexturedTrianglePart< depth_test, depth_write, alpha_test, occlusion_test, occlusion_write, texel_lighting, blending, texture_format >();
 		}
 	}
 	else
@@ -164,7 +170,7 @@ void Rasterizer::DrawAffineTexturedTriangle( const RasterizerVertex* vertices )
 			triangle_part_vertices_[1]= vertices[ upper_index ];
 			triangle_part_vertices_[2]= vertices[ lower_index ];
 			triangle_part_vertices_[3]= vertices[ middle_index ];
-			DrawAffineTexturedTrianglePart< depth_test, depth_write, alpha_test, occlusion_test, occlusion_write, lighting, blending >();
+			DrawAffineTexturedTrianglePart< depth_test, depth_write, alpha_test, occlusion_test, occlusion_write, texel_lighting, blending, texture_format >();
 		}
 		if( upper_middle_dy > 0 )
 		{
@@ -173,11 +179,20 @@ void Rasterizer::DrawAffineTexturedTriangle( const RasterizerVertex* vertices )
 			triangle_part_vertices_[1]= vertices[ upper_index ];
 			triangle_part_vertices_[2]= vertices[ middle_index ];
 			triangle_part_vertices_[3]= vertices[ upper_index ];
-			DrawAffineTexturedTrianglePart< depth_test, depth_write, alpha_test, occlusion_test, occlusion_write, lighting, blending >();
+			DrawAffineTexturedTrianglePart< depth_test, depth_write, alpha_test, occlusion_test, occlusion_write, texel_lighting, blending, texture_format >();
 		}
 	}
 }
 
+template<Rasterizer::TextureFormat texture_format>
+inline uint32_t Rasterizer::FetchTexel( const int u, const int v ) const
+{
+	if( texture_format == TextureFormat::Paletted )
+		return texture_palette_[ texture_data_paletted_[ u + v * texture_size_x_ ] ];
+	else
+		return texture_data_[ u + v * texture_size_x_ ];
+}
+
 template<Rasterizer::Lighting lighting>
 inline uint32_t Rasterizer::ApplyLight( const uint32_t texel ) const
 {
@@ -185,11 +200,22 @@ inline uint32_t Rasterizer::ApplyLight( const uint32_t texel ) const
 		return texel;
 	else
 	{
+		// Table lookup is much faster, than multiplication and clamping of each component.
+		// Alpha is zero in result.
 		unsigned char components[4];
-		for( unsigned int i= 0u; i < 3u; i++ )
+		std::memcpy( components, &texel, sizeof(uint32_t) );
+		if( light_table_ != nullptr )
 		{
-			const int c= ( reinterpret_cast<const unsigned char*>(&texel)[i] * light_ ) >> 16;
-			components[i]= std::min( c, 255 );
+			for( unsigned int i= 0u; i < 3u; i++ )
+				components[i]= light_table_[ components[i] ];
+		}
+		else
+		{
+			for( unsigned int i= 0u; i < 3u; i++ )
+			{
+				const int c= ( components[i] * texels_light_ ) >> 16;
+				components[i]= std::min( c, 255 );
+			}
 		}
 		components[3]= 0; // TODO - does this need?
 		uint32_t result;
@@ -526,9 +552,12 @@ template<
 	Rasterizer::DepthTest depth_test, Rasterizer::DepthWrite depth_write,
 	Rasterizer::AlphaTest alpha_test,
 	Rasterizer::OcclusionTest occlusion_test, Rasterizer::OcclusionWrite occlusion_write,
-	Rasterizer::Lighting lighting, Rasterizer::Blending blending>
+	Rasterizer::Lighting lighting, Rasterizer::Blending blending,
+	Rasterizer::TextureFormat texture_format>
 void Rasterizer::DrawAffineTexturedTrianglePart()
 {
+	static_assert( occlusion_test != OcclusionTest::Spans, "Spans occlusion test is not supported for affine triangles" );
+
 	const fixed16_t y_start_f= std::max( triangle_part_vertices_[0].y, triangle_part_vertices_[2].y );
 	const fixed16_t y_end_f  = std::min( triangle_part_vertices_[1].y, triangle_part_vertices_[3].y );
 	const int y_start= std::max( 0, Fixed16RoundToInt( y_start_f ) );
@@ -569,6 +598,9 @@ void Rasterizer::DrawAffineTexturedTrianglePart()
 			if( x_end <= x_start ) continue;
 		}
 
+		if( occlusion_write == OcclusionWrite::Yes )
+			spans_buffer_.MarkLinePartiallyCovered( y );
+
 		const fixed16_t x_cut= ( x_start << 16 ) + g_fixed16_half - x_left;
 
 		fixed16_t line_tc[2], line_tc_step[2];
@@ -619,7 +651,7 @@ void Rasterizer::DrawAffineTexturedTrianglePart()
 				const int v= line_tc[1] >> 16;
 				PC_ASSERT( u >= 0 && u < texture_size_x_ );
 				PC_ASSERT( v >= 0 && v < texture_size_y_ );
-				const uint32_t tex_value= texture_data_[ u + v * texture_size_x_ ];
+				const uint32_t tex_value= FetchTexel<texture_format>( u, v );
 
 				if( alpha_test == AlphaTest::Yes && (tex_value & c_alpha_mask) == 0u )
 					continue;
@@ -640,6 +672,11 @@ template<
 	Rasterizer::Lighting lighting, Rasterizer::Blending blending>
 void Rasterizer::DrawTexturedTrianglePerLineCorrectedPart()
 {
+	static_assert(
+		!( occlusion_test == OcclusionTest::Spans && occlusion_write == OcclusionWrite::Yes &&
+			( alpha_test == AlphaTest::Yes || depth_test == DepthTest::Yes ) ),
+		"Only opaque polygons without depth test may write spans" );
+
 	const fixed16_t y_start_f= std::max( triangle_part_vertices_[0].y, triangle_part_vertices_[2].y );
 	const fixed16_t y_end_f  = std::min( triangle_part_vertices_[1].y, triangle_part_vertices_[3].y );
 	const int y_start= std::max( 0, Fixed16RoundToInt( y_start_f ) );
@@ -680,102 +717,122 @@ void Rasterizer::DrawTexturedTrianglePerLineCorrectedPart()
 			if( x_end <= x_start ) continue;
 		}
 
-		const int effective_dx= x_end - x_start - 1;
-		const fixed16_t x_cut= ( x_start << 16 ) + g_fixed16_half - x_left;
-
-		fixed16_t tc_div_z_start[2], tc_div_z_end[2], inv_z_scaled_start, inv_z_scaled_end, tc_start[2], tc_end[2], line_tc_step[2];
-
-		tc_div_z_start[0]= tc_div_z_left[0] + Fixed16Mul( x_cut, line_tc_step_[0] );
-		tc_div_z_start[1]= tc_div_z_left[1] + Fixed16Mul( x_cut, line_tc_step_[1] );
+		// In spans mode check occlusion buffer only for lines, where something was drawn without spans.
+		const bool test_occlusion_pixels=
+			occlusion_test == OcclusionTest::Yes ||
+			( occlusion_test == OcclusionTest::Spans && spans_buffer_.IsLinePartiallyCovered( y ) );
+		if( occlusion_write == OcclusionWrite::Yes && occlusion_test != OcclusionTest::Spans )
+			spans_buffer_.MarkLinePartiallyCovered( y );
 
-		inv_z_scaled_start= inv_z_scaled_left  + Fixed16Mul( x_cut, line_inv_z_scaled_step_ );
-		if( inv_z_scaled_start < 0 ) inv_z_scaled_start= 0;
-
-		if( g_rasterizer_use_faster_tex_coord_z_div )
+		const auto draw_line_part=
+		[&]( const int x_start, const int x_end )
 		{
-			const fixed16_t z= FixedDiv< 16 + c_inv_z_scaler_log2 >( g_fixed16_one, inv_z_scaled_start );
-			tc_start[0]= Fixed16Mul( tc_div_z_start[0], z );
-			tc_start[1]= Fixed16Mul( tc_div_z_start[1], z );
-		}
-		else
-		{
-			tc_start[0]= FixedDiv< 16 + c_inv_z_scaler_log2 >( tc_div_z_start[0], inv_z_scaled_start );
-			tc_start[1]= FixedDiv< 16 + c_inv_z_scaler_log2 >( tc_div_z_start[1], inv_z_scaled_start );
-		}
+			const int effective_dx= x_end - x_start - 1;
+			const fixed16_t x_cut= ( x_start << 16 ) + g_fixed16_half - x_left;
 
-		if( tc_start[0] < 0 ) tc_start[0]= 0;
-		if( tc_start[0] > max_valid_tc_u_ ) tc_start[0]= max_valid_tc_u_;
-		if( tc_start[1] < 0 ) tc_start[1]= 0;
-		if( tc_start[1] > max_valid_tc_v_ ) tc_start[1]= max_valid_tc_v_;
+			fixed16_t tc_div_z_start[2], tc_div_z_end[2], inv_z_scaled_start, inv_z_scaled_end, tc_start[2], tc_end[2], line_tc_step[2];
 
-		if( effective_dx != 0 )
-		{
-			tc_div_z_end[0]= tc_div_z_start[0] + effective_dx * line_tc_step_[0];
-			tc_div_z_end[1]= tc_div_z_start[1] + effective_dx * line_tc_step_[1];
+			tc_div_z_start[0]= tc_div_z_left[0] + Fixed16Mul( x_cut, line_tc_step_[0] );
+			tc_div_z_start[1]= tc_div_z_left[1] + Fixed16Mul( x_cut, line_tc_step_[1] );
 
-			inv_z_scaled_end= inv_z_scaled_start + effective_dx * line_inv_z_scaled_step_;
-			if( inv_z_scaled_end < 0 ) inv_z_scaled_end= 0;
+			inv_z_scaled_start= inv_z_scaled_left  + Fixed16Mul( x_cut, line_inv_z_scaled_step_ );
+			if( inv_z_scaled_start < 0 ) inv_z_scaled_start= 0;
 
 			if( g_rasterizer_use_faster_tex_coord_z_div )
 			{
-				const fixed16_t z= FixedDiv< 16 + c_inv_z_scaler_log2 >( g_fixed16_one, inv_z_scaled_end );
-				tc_end[0]= Fixed16Mul( tc_div_z_end[0], z );
-				tc_end[1]= Fixed16Mul( tc_div_z_end[1], z );
+				const fixed16_t z= FixedDiv< 16 + c_inv_z_scaler_log2 >( g_fixed16_one, inv_z_scaled_start );
+				tc_start[0]= Fixed16Mul( tc_div_z_start[0], z );
+				tc_start[1]= Fixed16Mul( tc_div_z_start[1], z );
 			}
 			else
 			{
-				tc_end[0]= FixedDiv< 16 + c_inv_z_scaler_log2 >( tc_div_z_end[0], inv_z_scaled_end );
-				tc_end[1]= FixedDiv< 16 + c_inv_z_scaler_log2 >( tc_div_z_end[1], inv_z_scaled_end );
+				tc_start[0]= FixedDiv< 16 + c_inv_z_scaler_log2 >( tc_div_z_start[0], inv_z_scaled_start );
+				tc_start[1]= FixedDiv< 16 + c_inv_z_scaler_log2 >( tc_div_z_start[1], inv_z_scaled_start );
 			}
 
-			if( tc_end[0] < 0 ) tc_end[0]= 0;
-			if( tc_end[0] > max_valid_tc_u_ ) tc_end[0]= max_valid_tc_u_;
-			if( tc_end[1] < 0 ) tc_end[1]= 0;
-			if( tc_end[1] > max_valid_tc_v_ ) tc_end[1]= max_valid_tc_v_;
+			if( tc_start[0] < 0 ) tc_start[0]= 0;
+			if( tc_start[0] > max_valid_tc_u_ ) tc_start[0]= max_valid_tc_u_;
+			if( tc_start[1] < 0 ) tc_start[1]= 0;
+			if( tc_start[1] > max_valid_tc_v_ ) tc_start[1]= max_valid_tc_v_;
 
-			line_tc_step[0]= ( tc_end[0] - tc_start[0] ) / effective_dx;
-			line_tc_step[1]= ( tc_end[1] - tc_start[1] ) / effective_dx;
-		}
-		else
-			line_tc_step[0]= line_tc_step[1]= 0;
+			if( effective_dx != 0 )
+			{
+				tc_div_z_end[0]= tc_div_z_start[0] + effective_dx * line_tc_step_[0];
+				tc_div_z_end[1]= tc_div_z_start[1] + effective_dx * line_tc_step_[1];
 
-		fixed16_t line_tc[2], line_inv_z_scaled;
-		line_tc[0]= tc_start[0];
-		line_tc[1]= tc_start[1];
-		line_inv_z_scaled= inv_z_scaled_left + Fixed16Mul( x_cut, line_inv_z_scaled_step_ );
+				inv_z_scaled_end= inv_z_scaled_start + effective_dx * line_inv_z_scaled_step_;
+				if( inv_z_scaled_end < 0 ) inv_z_scaled_end= 0;
 
-		uint32_t* dst= color_buffer_ + y * row_size_;
-		unsigned short* depth_dst= depth_buffer_ + y * depth_buffer_width_;
+				if( g_rasterizer_use_faster_tex_coord_z_div )
+				{
+					const fixed16_t z= FixedDiv< 16 + c_inv_z_scaler_log2 >( g_fixed16_one, inv_z_scaled_end );
+					tc_end[0]= Fixed16Mul( tc_div_z_end[0], z );
+					tc_end[1]= Fixed16Mul( tc_div_z_end[1], z );
+				}
+				else
+				{
+					tc_end[0]= FixedDiv< 16 + c_inv_z_scaler_log2 >( tc_div_z_end[0], inv_z_scaled_end );
+					tc_end[1]= FixedDiv< 16 + c_inv_z_scaler_log2 >( tc_div_z_end[1], inv_z_scaled_end );
+				}
 
-		for( int x= x_start; x < x_end; x++,
-			line_tc[0]+= line_tc_step[0], line_tc[1]+= line_tc_step[1],
-			line_inv_z_scaled+= line_inv_z_scaled_step_ )
-		{
-			if( occlusion_test == OcclusionTest::Yes &&
-				( occlusion_dst[ x >> 3u ] & (1u<<(x&7u)) ) != 0u )
-				continue;
+				if( tc_end[0] < 0 ) tc_end[0]= 0;
+				if( tc_end[0] > max_valid_tc_u_ ) tc_end[0]= max_valid_tc_u_;
+				if( tc_end[1] < 0 ) tc_end[1]= 0;
+				if( tc_end[1] > max_valid_tc_v_ ) tc_end[1]= max_valid_tc_v_;
 
-			// TODO - check this.
-			// "depth" must be 65536 when inv_z == ( 1 << c_max_inv_z_min_log2 )
-			const unsigned short depth= line_inv_z_scaled >> ( c_inv_z_scaler_log2 + c_max_inv_z_min_log2 );
+				line_tc_step[0]= ( tc_end[0] - tc_start[0] ) / effective_dx;
+				line_tc_step[1]= ( tc_end[1] - tc_start[1] ) / effective_dx;
+			}
+			else
+				line_tc_step[0]= line_tc_step[1]= 0;
 
-			if( depth_test == DepthTest::No || depth > depth_dst[x] )
-			{
-				const int u= line_tc[0] >> 16;
-				const int v= line_tc[1] >> 16;
-				PC_ASSERT( u >= 0 && u < texture_size_x_ );
-				PC_ASSERT( v >= 0 && v < texture_size_y_ );
-				const uint32_t tex_value= texture_data_[ u + v * texture_size_x_ ];
+			fixed16_t line_tc[2], line_inv_z_scaled;
+			line_tc[0]= tc_start[0];
+			line_tc[1]= tc_start[1];
+			line_inv_z_scaled= inv_z_scaled_left + Fixed16Mul( x_cut, line_inv_z_scaled_step_ );
 
-				if( alpha_test == AlphaTest::Yes && (tex_value & c_alpha_mask) == 0u )
+			uint32_t* dst= color_buffer_ + y * row_size_;
+			unsigned short* depth_dst= depth_buffer_ + y * depth_buffer_width_;
+
+			for( int x= x_start; x < x_end; x++,
+				line_tc[0]+= line_tc_step[0], line_tc[1]+= line_tc_step[1],
+				line_inv_z_scaled+= line_inv_z_scaled_step_ )
+			{
+				if( test_occlusion_pixels &&
+					( occlusion_dst[ x >> 3u ] & (1u<<(x&7u)) ) != 0u )
 					continue;
 
-				if( depth_write == DepthWrite::Yes ) depth_dst[x]= depth;
-				if( occlusion_write == OcclusionWrite::Yes ) occlusion_dst[ x >> 3u ] |= 1u << (x&7u); // TODO - maybe set occlusion at end of line processing?
+				// TODO - check this.
+				// "depth" must be 65536 when inv_z == ( 1 << c_max_inv_z_min_log2 )
+				const unsigned short depth= line_inv_z_scaled >> ( c_inv_z_scaler_log2 + c_max_inv_z_min_log2 );
 
-				ApplyBlending<blending>( dst[x], ApplyLight<lighting>( tex_value ) );
+				if( depth_test == DepthTest::No || depth > depth_dst[x] )
+				{
+					const int u= line_tc[0] >> 16;
+					const int v= line_tc[1] >> 16;
+					PC_ASSERT( u >= 0 && u < texture_size_x_ );
+					PC_ASSERT( v >= 0 && v < texture_size_y_ );
+					const uint32_t tex_value= texture_data_[ u + v * texture_size_x_ ];
+
+					if( alpha_test == AlphaTest::Yes && (tex_value & c_alpha_mask) == 0u )
+						continue;
+
+					if( depth_write == DepthWrite::Yes ) depth_dst[x]= depth;
+					if( occlusion_write == OcclusionWrite::Yes ) occlusion_dst[ x >> 3u ] |= 1u << (x&7u); // TODO - maybe set occlusion at end of line processing?
+
+					ApplyBlending<blending>( dst[x], ApplyLight<lighting>( tex_value ) );
+				}
 			}
+		}; // draw_line_part
+
+		if( occlusion_test == OcclusionTest::Spans )
+		{
+			spans_buffer_.ForEachVisiblePart( y, x_start, x_end, draw_line_part );
+			if( occlusion_write == OcclusionWrite::Yes )
+				spans_buffer_.AddSpan( y, x_start, x_end );
 		}
+		else
+			draw_line_part( x_start, x_end );
 	} // for y
 }
 
@@ -783,9 +840,15 @@ template<
 	Rasterizer::DepthTest depth_test, Rasterizer::DepthWrite depth_write,
 	Rasterizer::AlphaTest alpha_test,
 	Rasterizer::OcclusionTest occlusion_test, Rasterizer::OcclusionWrite occlusion_write,
-	Rasterizer::Lighting lighting, Rasterizer::Blending blending, Rasterizer::DepthHack depth_hack>
+	Rasterizer::Lighting lighting, Rasterizer::Blending blending, Rasterizer::DepthHack depth_hack,
+	Rasterizer::TextureFormat texture_format>
 void Rasterizer::DrawTexturedTriangleSpanCorrectedPart()
 {
+	static_assert(
+		!( occlusion_test == OcclusionTest::Spans && occlusion_write == OcclusionWrite::Yes &&
+			( alpha_test == AlphaTest::Yes || depth_test == DepthTest::Yes ) ),
+		"Only opaque polygons without depth test may write spans" );
+
 	// TODO - maybe add mmx lighting support for other triangle-filling functions?
 #ifdef PC_MMX_INSTRUCTIONS
 	__m64 mm_light; // Store light in 10.6 fixed format.
@@ -794,7 +857,7 @@ void Rasterizer::DrawTexturedTriangleSpanCorrectedPart()
 	if( lighting == Lighting::Yes )
 	{
 		mm_zero= _mm_setzero_si64();
-		mm_light= _mm_set1_pi16( light_ >> c_mm_light_shift );
+		mm_light= _mm_set1_pi16( texels_light_ >> c_mm_light_shift );
 	}
 
 	#define DO_LIGHTING(tex_value, destination)\
@@ -853,241 +916,261 @@ void Rasterizer::DrawTexturedTriangleSpanCorrectedPart()
 			if( x_end <= x_start ) continue;
 		}
 
-		uint32_t* dst= color_buffer_ + y * row_size_;
-		unsigned short* depth_dst= depth_buffer_ + y * depth_buffer_width_;
-
+		// In spans mode check occlusion buffer only for lines, where something was drawn without spans.
+		const bool test_occlusion_pixels=
+			occlusion_test == OcclusionTest::Yes ||
+			( occlusion_test == OcclusionTest::Spans && spans_buffer_.IsLinePartiallyCovered( y ) );
+		if( occlusion_write == OcclusionWrite::Yes && occlusion_test != OcclusionTest::Spans )
+			spans_buffer_.MarkLinePartiallyCovered( y );
 
-		const fixed16_t x_cut= ( x_start << 16 ) + g_fixed16_half - x_left;
-		fixed16_t tc_div_z_current[2], line_inv_z_scaled;
-		line_inv_z_scaled= inv_z_scaled_left + Fixed16Mul( x_cut, line_inv_z_scaled_step_ );
-		tc_div_z_current[0]= tc_div_z_left[0] + Fixed16Mul( x_cut, line_tc_step_[0] );
-		tc_div_z_current[1]= tc_div_z_left[1] + Fixed16Mul( x_cut, line_tc_step_[1] );
-
-		const int spans_x_start= ( x_start + c_z_correct_span_size_minus_one ) & (~c_z_correct_span_size_minus_one);
-		const int spans_x_end= x_end & (~c_z_correct_span_size_minus_one);
-		const int start_part_dx= std::min( spans_x_start, x_end ) - x_start;
-		const int end_part_dx= x_end - spans_x_end;
-		PC_ASSERT( start_part_dx >= 0 );
-		PC_ASSERT( end_part_dx >= 0 );
-
-		fixed16_t tc_current[2], tc_next[2], tc_step[2], span_tc[2];
-		if( g_rasterizer_use_faster_tex_coord_z_div )
-		{
-			const fixed16_t z= FixedDiv< 16 + c_inv_z_scaler_log2>( g_fixed16_one, line_inv_z_scaled );
-			tc_current[0]= Fixed16Mul( tc_div_z_current[0], z );
-			tc_current[1]= Fixed16Mul( tc_div_z_current[1], z );
-		}
-		else
+		const auto draw_line_part=
+		[&]( const int x_start, const int x_end )
 		{
-			tc_current[0]= FixedDiv< 16 + c_inv_z_scaler_log2 >( tc_div_z_current[0], line_inv_z_scaled );
-			tc_current[1]= FixedDiv< 16 + c_inv_z_scaler_log2 >( tc_div_z_current[1], line_inv_z_scaled );
-		}
+			uint32_t* dst= color_buffer_ + y * row_size_;
+			unsigned short* depth_dst= depth_buffer_ + y * depth_buffer_width_;
 
-		if( tc_current[0] < 0 ) tc_current[0]= 0;
-		if( tc_current[0] > max_valid_tc_u_ ) tc_current[0]= max_valid_tc_u_;
-		if( tc_current[1] < 0 ) tc_current[1]= 0;
-		if( tc_current[1] > max_valid_tc_v_ ) tc_current[1]= max_valid_tc_v_;
 
-		if( start_part_dx > 0 )
-		{
-			const fixed_base_t next_inv_z_scaled= line_inv_z_scaled + start_part_dx * line_inv_z_scaled_step_;
+			const fixed16_t x_cut= ( x_start << 16 ) + g_fixed16_half - x_left;
+			fixed16_t tc_div_z_current[2], line_inv_z_scaled;
+			line_inv_z_scaled= inv_z_scaled_left + Fixed16Mul( x_cut, line_inv_z_scaled_step_ );
+			tc_div_z_current[0]= tc_div_z_left[0] + Fixed16Mul( x_cut, line_tc_step_[0] );
+			tc_div_z_current[1]= tc_div_z_left[1] + Fixed16Mul( x_cut, line_tc_step_[1] );
+
+			const int spans_x_start= ( x_start + c_z_correct_span_size_minus_one ) & (~c_z_correct_span_size_minus_one);
+			const int spans_x_end= x_end & (~c_z_correct_span_size_minus_one);
+			const int start_part_dx= std::min( spans_x_start, x_end ) - x_start;
+			const int end_part_dx= x_end - spans_x_end;
+			PC_ASSERT( start_part_dx >= 0 );
+			PC_ASSERT( end_part_dx >= 0 );
+
+			fixed16_t tc_current[2], tc_next[2], tc_step[2], span_tc[2];
 			if( g_rasterizer_use_faster_tex_coord_z_div )
 			{
-				const fixed16_t z= FixedDiv< 16 + c_inv_z_scaler_log2>( g_fixed16_one, next_inv_z_scaled );
-				tc_next[0]= Fixed16Mul( tc_div_z_current[0] + start_part_dx * line_tc_step_[0], z );
-				tc_next[1]= Fixed16Mul( tc_div_z_current[1] + start_part_dx * line_tc_step_[1], z );
+				const fixed16_t z= FixedDiv< 16 + c_inv_z_scaler_log2>( g_fixed16_one, line_inv_z_scaled );
+				tc_current[0]= Fixed16Mul( tc_div_z_current[0], z );
+				tc_current[1]= Fixed16Mul( tc_div_z_current[1], z );
 			}
 			else
 			{
-				tc_next[0]= FixedDiv< 16 + c_inv_z_scaler_log2 >( tc_div_z_current[0] + start_part_dx * line_tc_step_[0], next_inv_z_scaled );
-				tc_next[1]= FixedDiv< 16 + c_inv_z_scaler_log2 >( tc_div_z_current[1] + start_part_dx * line_tc_step_[1], next_inv_z_scaled );
+				tc_current[0]= FixedDiv< 16 + c_inv_z_scaler_log2 >( tc_div_z_current[0], line_inv_z_scaled );
+				tc_current[1]= FixedDiv< 16 + c_inv_z_scaler_log2 >( tc_div_z_current[1], line_inv_z_scaled );
 			}
 
-			if( tc_next[0] < 0 ) tc_next[0]= 0;
-			if( tc_next[0] > max_valid_tc_u_ ) tc_next[0]= max_valid_tc_u_;
-			if( tc_next[1] < 0 ) tc_next[1]= 0;
-			if( tc_next[1] > max_valid_tc_v_ ) tc_next[1]= max_valid_tc_v_;
+			if( tc_current[0] < 0 ) tc_current[0]= 0;
+			if( tc_current[0] > max_valid_tc_u_ ) tc_current[0]= max_valid_tc_u_;
+			if( tc_current[1] < 0 ) tc_current[1]= 0;
+			if( tc_current[1] > max_valid_tc_v_ ) tc_current[1]= max_valid_tc_v_;
 
-			tc_step[0]= ( tc_next[0] - tc_current[0] ) / start_part_dx;
-			tc_step[1]= ( tc_next[1] - tc_current[1] ) / start_part_dx;
-			span_tc[0]= tc_current[0];
-			span_tc[1]= tc_current[1];
-
-			// Draw start part here.
-			for( int x= 0u; x < start_part_dx;
-				x++, line_inv_z_scaled+= line_inv_z_scaled_step_,
-				span_tc[0]+= tc_step[0], span_tc[1]+= tc_step[1] )
+			if( start_part_dx > 0 )
 			{
-				const int full_x= x_start + x;
-
-				if( occlusion_test == OcclusionTest::Yes &&
-					( occlusion_dst[ full_x >> 3 ] & (1<<(full_x&7)) ) != 0u )
-					continue;
-
-				unsigned short depth= line_inv_z_scaled >> ( c_inv_z_scaler_log2 + c_max_inv_z_min_log2 );
-				if( depth_hack == DepthHack::Yes ) depth= ( int(depth) + 65536 * 3 ) >> 2;
-				if( depth_test == DepthTest::No || depth > depth_dst[ full_x ] )
+				const fixed_base_t next_inv_z_scaled= line_inv_z_scaled + start_part_dx * line_inv_z_scaled_step_;
+				if( g_rasterizer_use_faster_tex_coord_z_div )
 				{
-					const int u= span_tc[0] >> 16;
-					const int v= span_tc[1] >> 16;
-					PC_ASSERT( u >= 0 && u < texture_size_x_ );
-					PC_ASSERT( v >= 0 && v < texture_size_y_ );
-					const uint32_t tex_value= texture_data_[ u + v * texture_size_x_ ];
+					const fixed16_t z= FixedDiv< 16 + c_inv_z_scaler_log2>( g_fixed16_one, next_inv_z_scaled );
+					tc_next[0]= Fixed16Mul( tc_div_z_current[0] + start_part_dx * line_tc_step_[0], z );
+					tc_next[1]= Fixed16Mul( tc_div_z_current[1] + start_part_dx * line_tc_step_[1], z );
+				}
+				else
+				{
+					tc_next[0]= FixedDiv< 16 + c_inv_z_scaler_log2 >( tc_div_z_current[0] + start_part_dx * line_tc_step_[0], next_inv_z_scaled );
+					tc_next[1]= FixedDiv< 16 + c_inv_z_scaler_log2 >( tc_div_z_current[1] + start_part_dx * line_tc_step_[1], next_inv_z_scaled );
+				}
 
-					if( alpha_test == AlphaTest::Yes && (tex_value & c_alpha_mask) == 0u )
-						continue;
-					if( depth_write == DepthWrite::Yes ) depth_dst[ full_x ]= depth;
-					if( occlusion_write == OcclusionWrite::Yes ) occlusion_dst[ full_x >> 3 ] |= 1 << (full_x&7);  // TODO - maybe set occlusion at end of line processing?
+				if( tc_next[0] < 0 ) tc_next[0]= 0;
+				if( tc_next[0] > max_valid_tc_u_ ) tc_next[0]= max_valid_tc_u_;
+				if( tc_next[1] < 0 ) tc_next[1]= 0;
+				if( tc_next[1] > max_valid_tc_v_ ) tc_next[1]= max_valid_tc_v_;
 
-					DO_LIGHTING(tex_value, dst[full_x]);
-				}
-			} // for span pixels
+				tc_step[0]= ( tc_next[0] - tc_current[0] ) / start_part_dx;
+				tc_step[1]= ( tc_next[1] - tc_current[1] ) / start_part_dx;
+				span_tc[0]= tc_current[0];
+				span_tc[1]= tc_current[1];
 
-			line_inv_z_scaled= next_inv_z_scaled;
-			tc_div_z_current[0]+= start_part_dx * line_tc_step_[0];
-			tc_div_z_current[1]+= start_part_dx * line_tc_step_[1];
-		}
-		else
-		{
-			tc_next[0]= tc_current[0];
-			tc_next[1]= tc_current[1];
-		}
+				// Draw start part here.
+				for( int x= 0u; x < start_part_dx;
+					x++, line_inv_z_scaled+= line_inv_z_scaled_step_,
+					span_tc[0]+= tc_step[0], span_tc[1]+= tc_step[1] )
+				{
+					const int full_x= x_start + x;
 
-		for( int span_x= spans_x_start; span_x < spans_x_end;
-			span_x+= c_z_correct_span_size,
-			tc_div_z_current[0]+= line_tc_step_[0] << c_z_correct_span_size_log2,
-			tc_div_z_current[1]+= line_tc_step_[1] << c_z_correct_span_size_log2 )
-		{
-			tc_current[0]= tc_next[0];
-			tc_current[1]= tc_next[1];
+					if( test_occlusion_pixels &&
+						( occlusion_dst[ full_x >> 3 ] & (1<<(full_x&7)) ) != 0u )
+						continue;
 
-			const fixed_base_t next_inv_z_scaled= line_inv_z_scaled + ( line_inv_z_scaled_step_ << c_z_correct_span_size_log2 );
-			if( g_rasterizer_use_faster_tex_coord_z_div )
-			{
-				const fixed16_t z= FixedDiv< 16 + c_inv_z_scaler_log2>( g_fixed16_one, next_inv_z_scaled );
-				tc_next[0]= Fixed16Mul( tc_div_z_current[0] + ( line_tc_step_[0] << c_z_correct_span_size_log2 ), z );
-				tc_next[1]= Fixed16Mul( tc_div_z_current[1] + ( line_tc_step_[1] << c_z_correct_span_size_log2 ), z );
+					unsigned short depth= line_inv_z_scaled >> ( c_inv_z_scaler_log2 + c_max_inv_z_min_log2 );
+					if( depth_hack == DepthHack::Yes ) depth= ( int(depth) + 65536 * 3 ) >> 2;
+					if( depth_test == DepthTest::No || depth > depth_dst[ full_x ] )
+					{
+						const int u= span_tc[0] >> 16;
+						const int v= span_tc[1] >> 16;
+						PC_ASSERT( u >= 0 && u < texture_size_x_ );
+						PC_ASSERT( v >= 0 && v < texture_size_y_ );
+						const uint32_t tex_value= FetchTexel<texture_format>( u, v );
+
+						if( alpha_test == AlphaTest::Yes && (tex_value & c_alpha_mask) == 0u )
+							continue;
+						if( depth_write == DepthWrite::Yes ) depth_dst[ full_x ]= depth;
+						if( occlusion_write == OcclusionWrite::Yes ) occlusion_dst[ full_x >> 3 ] |= 1 << (full_x&7);  // TODO - maybe set occlusion at end of line processing?
+
+						DO_LIGHTING(tex_value, dst[full_x]);
+					}
+				} // for span pixels
+
+				line_inv_z_scaled= next_inv_z_scaled;
+				tc_div_z_current[0]+= start_part_dx * line_tc_step_[0];
+				tc_div_z_current[1]+= start_part_dx * line_tc_step_[1];
 			}
 			else
 			{
-				tc_next[0]= FixedDiv< 16 + c_inv_z_scaler_log2 >( tc_div_z_current[0] + ( line_tc_step_[0] << c_z_correct_span_size_log2 ), next_inv_z_scaled );
-				tc_next[1]= FixedDiv< 16 + c_inv_z_scaler_log2 >( tc_div_z_current[1] + ( line_tc_step_[1] << c_z_correct_span_size_log2 ), next_inv_z_scaled );
+				tc_next[0]= tc_current[0];
+				tc_next[1]= tc_current[1];
 			}
 
-			if( tc_next[0] < 0 ) tc_next[0]= 0;
-			if( tc_next[0] > max_valid_tc_u_ ) tc_next[0]= max_valid_tc_u_;
-			if( tc_next[1] < 0 ) tc_next[1]= 0;
-			if( tc_next[1] > max_valid_tc_v_ ) tc_next[1]= max_valid_tc_v_;
-
-			SpanOcclusionType occlusion_value= 0u;
-			if( occlusion_test == OcclusionTest::Yes || occlusion_write == OcclusionWrite::Yes )
-				occlusion_value= *reinterpret_cast<SpanOcclusionType*>(occlusion_dst + (span_x >> 3) );
-			if( occlusion_test == OcclusionTest::Yes && occlusion_value == c_span_occlusion_value )
+			for( int span_x= spans_x_start; span_x < spans_x_end;
+				span_x+= c_z_correct_span_size,
+				tc_div_z_current[0]+= line_tc_step_[0] << c_z_correct_span_size_log2,
+				tc_div_z_current[1]+= line_tc_step_[1] << c_z_correct_span_size_log2 )
 			{
-				line_inv_z_scaled+= line_inv_z_scaled_step_ << c_z_correct_span_size_log2;
-				continue;
-			}
+				tc_current[0]= tc_next[0];
+				tc_current[1]= tc_next[1];
 
-			tc_step[0]= ( tc_next[0] - tc_current[0] ) / c_z_correct_span_size;
-			tc_step[1]= ( tc_next[1] - tc_current[1] ) / c_z_correct_span_size;
-			span_tc[0]= tc_current[0];
-			span_tc[1]= tc_current[1];
+				const fixed_base_t next_inv_z_scaled= line_inv_z_scaled + ( line_inv_z_scaled_step_ << c_z_correct_span_size_log2 );
+				if( g_rasterizer_use_faster_tex_coord_z_div )
+				{
+					const fixed16_t z= FixedDiv< 16 + c_inv_z_scaler_log2>( g_fixed16_one, next_inv_z_scaled );
+					tc_next[0]= Fixed16Mul( tc_div_z_current[0] + ( line_tc_step_[0] << c_z_correct_span_size_log2 ), z );
+					tc_next[1]= Fixed16Mul( tc_div_z_current[1] + ( line_tc_step_[1] << c_z_correct_span_size_log2 ), z );
+				}
+				else
+				{
+					tc_next[0]= FixedDiv< 16 + c_inv_z_scaler_log2 >( tc_div_z_current[0] + ( line_tc_step_[0] << c_z_correct_span_size_log2 ), next_inv_z_scaled );
+					tc_next[1]= FixedDiv< 16 + c_inv_z_scaler_log2 >( tc_div_z_current[1] + ( line_tc_step_[1] << c_z_correct_span_size_log2 ), next_inv_z_scaled );
+				}
 
-			for( int x= 0; x < c_z_correct_span_size;
-				x++, line_inv_z_scaled+= line_inv_z_scaled_step_,
-				span_tc[0]+= tc_step[0], span_tc[1]+= tc_step[1] )
-			{
-				if( occlusion_test == OcclusionTest::Yes &&
-					( occlusion_value & ( 1 << x ) ) != 0 )
-					continue;
+				if( tc_next[0] < 0 ) tc_next[0]= 0;
+				if( tc_next[0] > max_valid_tc_u_ ) tc_next[0]= max_valid_tc_u_;
+				if( tc_next[1] < 0 ) tc_next[1]= 0;
+				if( tc_next[1] > max_valid_tc_v_ ) tc_next[1]= max_valid_tc_v_;
 
-				unsigned short depth= line_inv_z_scaled >> ( c_inv_z_scaler_log2 + c_max_inv_z_min_log2 );
-				if( depth_hack == DepthHack::Yes ) depth= ( int(depth) + 65536 * 3 ) >> 2;
-				if( depth_test == DepthTest::No || depth > depth_dst[ span_x + x ] )
+				SpanOcclusionType occlusion_value= 0u;
+				if( test_occlusion_pixels || occlusion_write == OcclusionWrite::Yes )
+					occlusion_value= *reinterpret_cast<SpanOcclusionType*>(occlusion_dst + (span_x >> 3) );
+				if( test_occlusion_pixels && occlusion_value == c_span_occlusion_value )
 				{
-					const int u= span_tc[0] >> 16;
-					const int v= span_tc[1] >> 16;
-					PC_ASSERT( u >= 0 && u < texture_size_x_ );
-					PC_ASSERT( v >= 0 && v < texture_size_y_ );
-					const uint32_t tex_value= texture_data_[ u + v * texture_size_x_ ];
+					line_inv_z_scaled+= line_inv_z_scaled_step_ << c_z_correct_span_size_log2;
+					continue;
+				}
 
-					if( alpha_test == AlphaTest::Yes && (tex_value & c_alpha_mask) == 0u )
+				tc_step[0]= ( tc_next[0] - tc_current[0] ) / c_z_correct_span_size;
+				tc_step[1]= ( tc_next[1] - tc_current[1] ) / c_z_correct_span_size;
+				span_tc[0]= tc_current[0];
+				span_tc[1]= tc_current[1];
+
+				for( int x= 0; x < c_z_correct_span_size;
+					x++, line_inv_z_scaled+= line_inv_z_scaled_step_,
+					span_tc[0]+= tc_step[0], span_tc[1]+= tc_step[1] )
+				{
+					if( test_occlusion_pixels &&
+						( occlusion_value & ( 1 << x ) ) != 0 )
 						continue;
-					if( depth_write == DepthWrite::Yes ) depth_dst[ span_x + x ]= depth;
-					if( occlusion_write == OcclusionWrite::Yes && alpha_test == AlphaTest::Yes ) occlusion_value|= 1 << x;
 
-					DO_LIGHTING(tex_value, dst[ span_x + x ]);
+					unsigned short depth= line_inv_z_scaled >> ( c_inv_z_scaler_log2 + c_max_inv_z_min_log2 );
+					if( depth_hack == DepthHack::Yes ) depth= ( int(depth) + 65536 * 3 ) >> 2;
+					if( depth_test == DepthTest::No || depth > depth_dst[ span_x + x ] )
+					{
+						const int u= span_tc[0] >> 16;
+						const int v= span_tc[1] >> 16;
+						PC_ASSERT( u >= 0 && u < texture_size_x_ );
+						PC_ASSERT( v >= 0 && v < texture_size_y_ );
+						const uint32_t tex_value= FetchTexel<texture_format>( u, v );
+
+						if( alpha_test == AlphaTest::Yes && (tex_value & c_alpha_mask) == 0u )
+							continue;
+						if( depth_write == DepthWrite::Yes ) depth_dst[ span_x + x ]= depth;
+						if( occlusion_write == OcclusionWrite::Yes && alpha_test == AlphaTest::Yes ) occlusion_value|= 1 << x;
+
+						DO_LIGHTING(tex_value, dst[ span_x + x ]);
+					}
+				} // for span pixels
+
+				// TODO - maybe set occlusion at end of line processing?
+				if( occlusion_write == OcclusionWrite::Yes )
+				{
+					if( alpha_test == AlphaTest::Yes )
+						*reinterpret_cast<SpanOcclusionType*>( occlusion_dst + (span_x >> 3) ) = occlusion_value;
+					else
+						*reinterpret_cast<SpanOcclusionType*>( occlusion_dst + (span_x >> 3) ) = c_span_occlusion_value;
 				}
-			} // for span pixels
-
-			// TODO - maybe set occlusion at end of line processing?
-			if( occlusion_write == OcclusionWrite::Yes )
-			{
-				if( alpha_test == AlphaTest::Yes )
-					*reinterpret_cast<SpanOcclusionType*>( occlusion_dst + (span_x >> 3) ) = occlusion_value;
-				else
-					*reinterpret_cast<SpanOcclusionType*>( occlusion_dst + (span_x >> 3) ) = c_span_occlusion_value;
-			}
 
-		} // for spans
+			} // for spans
 
-		if( end_part_dx > 0 && spans_x_start <= spans_x_end )
-		{
-			tc_current[0]= tc_next[0];
-			tc_current[1]= tc_next[1];
-
-			const fixed_base_t next_inv_z_scaled= line_inv_z_scaled + end_part_dx * line_inv_z_scaled_step_;
-			if( g_rasterizer_use_faster_tex_coord_z_div )
-			{
-				const fixed16_t z= FixedDiv< 16 + c_inv_z_scaler_log2>( g_fixed16_one, next_inv_z_scaled );
-				tc_next[0]= Fixed16Mul( tc_div_z_current[0] + end_part_dx * line_tc_step_[0], z );
-				tc_next[1]= Fixed16Mul( tc_div_z_current[1] + end_part_dx * line_tc_step_[1], z );
-			}
-			else
+			if( end_part_dx > 0 && spans_x_start <= spans_x_end )
 			{
-				tc_next[0]= FixedDiv< 16 + c_inv_z_scaler_log2 >( tc_div_z_current[0] + end_part_dx * line_tc_step_[0], next_inv_z_scaled );
-				tc_next[1]= FixedDiv< 16 + c_inv_z_scaler_log2 >( tc_div_z_current[1] + end_part_dx * line_tc_step_[1], next_inv_z_scaled );
-			}
+				tc_current[0]= tc_next[0];
+				tc_current[1]= tc_next[1];
 
-			if( tc_next[0] < 0 ) tc_next[0]= 0;
-			if( tc_next[0] > max_valid_tc_u_ ) tc_next[0]= max_valid_tc_u_;
-			if( tc_next[1] < 0 ) tc_next[1]= 0;
-			if( tc_next[1] > max_valid_tc_v_ ) tc_next[1]= max_valid_tc_v_;
+				const fixed_base_t next_inv_z_scaled= line_inv_z_scaled + end_part_dx * line_inv_z_scaled_step_;
+				if( g_rasterizer_use_faster_tex_coord_z_div )
+				{
+					const fixed16_t z= FixedDiv< 16 + c_inv_z_scaler_log2>( g_fixed16_one, next_inv_z_scaled );
+					tc_next[0]= Fixed16Mul( tc_div_z_current[0] + end_part_dx * line_tc_step_[0], z );
+					tc_next[1]= Fixed16Mul( tc_div_z_current[1] + end_part_dx * line_tc_step_[1], z );
+				}
+				else
+				{
+					tc_next[0]= FixedDiv< 16 + c_inv_z_scaler_log2 >( tc_div_z_current[0] + end_part_dx * line_tc_step_[0], next_inv_z_scaled );
+					tc_next[1]= FixedDiv< 16 + c_inv_z_scaler_log2 >( tc_div_z_current[1] + end_part_dx * line_tc_step_[1], next_inv_z_scaled );
+				}
 
-			tc_step[0]= ( tc_next[0] - tc_current[0] ) / end_part_dx;
-			tc_step[1]= ( tc_next[1] - tc_current[1] ) / end_part_dx;
-			span_tc[0]= tc_current[0];
-			span_tc[1]= tc_current[1];
+				if( tc_next[0] < 0 ) tc_next[0]= 0;
+				if( tc_next[0] > max_valid_tc_u_ ) tc_next[0]= max_valid_tc_u_;
+				if( tc_next[1] < 0 ) tc_next[1]= 0;
+				if( tc_next[1] > max_valid_tc_v_ ) tc_next[1]= max_valid_tc_v_;
 
-			// Draw end part here.
-			for( int x= spans_x_end; x < x_end;
-				x++, line_inv_z_scaled+= line_inv_z_scaled_step_,
-				span_tc[0]+= tc_step[0], span_tc[1]+= tc_step[1] )
-			{
-				if( occlusion_test == OcclusionTest::Yes &&
-					( occlusion_dst[ x >> 3 ] & (1<<(x&7)) ) != 0u )
-					continue;
+				tc_step[0]= ( tc_next[0] - tc_current[0] ) / end_part_dx;
+				tc_step[1]= ( tc_next[1] - tc_current[1] ) / end_part_dx;
+				span_tc[0]= tc_current[0];
+				span_tc[1]= tc_current[1];
 
-				unsigned short depth= line_inv_z_scaled >> ( c_inv_z_scaler_log2 + c_max_inv_z_min_log2 );
-				if( depth_hack == DepthHack::Yes ) depth= ( int(depth) + 65536 * 3 ) >> 2;
-				if( depth_test == DepthTest::No || depth > depth_dst[x] )
+				// Draw end part here.
+				for( int x= spans_x_end; x < x_end;
+					x++, line_inv_z_scaled+= line_inv_z_scaled_step_,
+					span_tc[0]+= tc_step[0], span_tc[1]+= tc_step[1] )
 				{
-					const int u= span_tc[0] >> 16;
-					const int v= span_tc[1] >> 16;
-					PC_ASSERT( u >= 0 && u < texture_size_x_ );
-					PC_ASSERT( v >= 0 && v < texture_size_y_ );
-					const uint32_t tex_value= texture_data_[ u + v * texture_size_x_ ];
-
-					if( alpha_test == AlphaTest::Yes && (tex_value & c_alpha_mask) == 0u )
+					if( test_occlusion_pixels &&
+						( occlusion_dst[ x >> 3 ] & (1<<(x&7)) ) != 0u )
 						continue;
 
-					if( depth_write == DepthWrite::Yes ) depth_dst[x]= depth;
-					if( occlusion_write == OcclusionWrite::Yes ) occlusion_dst[ x >> 3 ] |= 1 << (x&7); // TODO - maybe set occlusion at end of line processing?
+					unsigned short depth= line_inv_z_scaled >> ( c_inv_z_scaler_log2 + c_max_inv_z_min_log2 );
+					if( depth_hack == DepthHack::Yes ) depth= ( int(depth) + 65536 * 3 ) >> 2;
+					if( depth_test == DepthTest::No || depth > depth_dst[x] )
+					{
+						const int u= span_tc[0] >> 16;
+						const int v= span_tc[1] >> 16;
+						PC_ASSERT( u >= 0 && u < texture_size_x_ );
+						PC_ASSERT( v >= 0 && v < texture_size_y_ );
+						const uint32_t tex_value= FetchTexel<texture_format>( u, v );
+
+						if( alpha_test == AlphaTest::Yes && (tex_value & c_alpha_mask) == 0u )
+							continue;
+
+						if( depth_write == DepthWrite::Yes ) depth_dst[x]= depth;
+						if( occlusion_write == OcclusionWrite::Yes ) occlusion_dst[ x >> 3 ] |= 1 << (x&7); // TODO - maybe set occlusion at end of line processing?
 
-					DO_LIGHTING(tex_value, dst[x]);
+						DO_LIGHTING(tex_value, dst[x]);
+					}
 				}
 			}
+		}; // draw_line_part
+
+		if( occlusion_test == OcclusionTest::Spans )
+		{
+			spans_buffer_.ForEachVisiblePart( y, x_start, x_end, draw_line_part );
+			if( occlusion_write == OcclusionWrite::Yes )
+				spans_buffer_.AddSpan( y, x_start, x_end );
 		}
+		else
+			draw_line_part( x_start, x_end );
 	} // for y
 
 #ifdef PC_MMX_INSTRUCTIONS
@@ -1115,12 +1198,16 @@ template<
 	Rasterizer::DepthTest depth_test, Rasterizer::DepthWrite depth_write,
 	Rasterizer::AlphaTest alpha_test,
 	Rasterizer::OcclusionTest occlusion_test, Rasterizer::OcclusionWrite occlusion_write,
-	Rasterizer::Lighting lighting, Rasterizer::Blending blending, Rasterizer::DepthHack depth_hack>
+	Rasterizer::Lighting lighting, Rasterizer::Blending blending, Rasterizer::DepthHack depth_hack,
+	Rasterizer::TextureFormat texture_format>
 void Rasterizer::DrawTexturedTriangleSpanCorrected( const RasterizerVertex* vertices )
 {
+	// Paletted textures lit via palette.
+	constexpr Lighting texel_lighting= texture_format == TextureFormat::Paletted ? Lighting::No : lighting;
+
 	DrawTrianglePerspectiveCorrectedImpl<
 		TrianglePartDrawFunc,
-		&Rasterizer::DrawTexturedTriangleSpanCorrectedPart<depth_test, depth_write, alpha_test, occlusion_test, occlusion_write, lighting, blending, depth_hack > >
+		&Rasterizer::DrawTexturedTriangleSpanCorrectedPart<depth_test, depth_write, alpha_test, occlusion_test, occlusion_write, texel_lighting, blending, depth_hack, texture_format > >
 			( vertices );
 }
 
@@ -1141,12 +1228,16 @@ template<
 	Rasterizer::DepthTest depth_test, Rasterizer::DepthWrite depth_write,
 	Rasterizer::AlphaTest alpha_test,
 	Rasterizer::OcclusionTest occlusion_test, Rasterizer::OcclusionWrite occlusion_write,
-	Rasterizer::Lighting lighting, Rasterizer::Blending blending>
+	Rasterizer::Lighting lighting, Rasterizer::Blending blending,
+	Rasterizer::TextureFormat texture_format>
 void Rasterizer::DrawTexturedConvexPolygonSpanCorrected(  const RasterizerVertex* vertices, unsigned int vertex_count, bool is_anticlockwise )
 {
+	// Paletted textures lit via palette.
+	constexpr Lighting texel_lighting= texture_format == TextureFormat::Paletted ? Lighting::No : lighting;
+
 	DrawConvexPolygonPerspectiveCorrectedImpl<
 		TrianglePartDrawFunc,
-		&Rasterizer::DrawTexturedTriangleSpanCorrectedPart<depth_test, depth_write, alpha_test, occlusion_test, occlusion_write, lighting, blending > >
+		&Rasterizer::DrawTexturedTriangleSpanCorrectedPart<depth_test, depth_write, alpha_test, occlusion_test, occlusion_write, texel_lighting, blending, DepthHack::No, texture_format > >
 			( vertices, vertex_count, is_anticlockwise );
 }
 
@@ -0,0 +1,92 @@
+#include <algorithm>
+
+#include "../../assert.hpp"
+
+#include "spans_buffer.hpp"
+
+namespace PanzerChasm
+{
+
+SpansBuffer::SpansBuffer( const unsigned int height )
+	: lines_( height )
+{
+	Clear();
+}
+
+SpansBuffer::~SpansBuffer()
+{}
+
+void SpansBuffer::Clear()
+{
+	for( Line& line : lines_ )
+	{
+		line.first_span= c_null_span;
+		line.partially_covered= false;
+	}
+	spans_.clear(); // Keep capacity for next frame.
+}
+
+bool SpansBuffer::IsFullyCovered( const int y, const int x_begin, const int x_end ) const
+{
+	bool covered= true;
+	ForEachVisiblePart(
+		y, x_begin, x_end,
+		[&]( int, int ) { covered= false; } );
+	return covered;
+}
+
+void SpansBuffer::AddSpan( const int y, int x_begin, int x_end )
+{
+	PC_ASSERT( y >= 0 && y < int(lines_.size()) );
+	if( x_end <= x_begin )
+		return;
+
+	Line& line= lines_[y];
+
+	// Find first span, which is not left of new span. Spans, touching new span, are merged.
+	uint32_t prev= c_null_span;
+	uint32_t current= line.first_span;
+	while( current != c_null_span && spans_[current].x_end < x_begin )
+	{
+		prev= current;
+		current= spans_[current].next;
+	}
+
+	if( current != c_null_span && spans_[current].x_begin <= x_end )
+	{
+		// Extend first overlapping span and absorb all other overlapping spans.
+		Span& span= spans_[current];
+		span.x_begin= std::min( span.x_begin, x_begin );
+		span.x_end= std::max( span.x_end, x_end );
+
+		uint32_t next= span.next;
+		while( next != c_null_span && spans_[next].x_begin <= span.x_end )
+		{
+			span.x_end= std::max( span.x_end, spans_[next].x_end );
+			next= spans_[next].next;
+		}
+		span.next= next;
+		return;
+	}
+
+	const uint32_t new_span= static_cast<uint32_t>( spans_.size() );
+	spans_.push_back( Span{ x_begin, x_end, current } );
+
+	if( prev == c_null_span )
+		line.first_span= new_span;
+	else
+		spans_[prev].next= new_span;
+}
+
+void SpansBuffer::MarkLinePartiallyCovered( const int y )
+{
+	PC_ASSERT( y >= 0 && y < int(lines_.size()) );
+	lines_[y].partially_covered= true;
+}
+
+bool SpansBuffer::IsLinePartiallyCovered( const int y ) const
+{
+	return lines_[y].partially_covered;
+}
+
+} // namespace PanzerChasm
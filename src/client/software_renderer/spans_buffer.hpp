@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+namespace PanzerChasm
+{
+
+// Span buffer (S-buffer) for hidden surface removal of opaque world geometry, drawn front-to-back.
+// Each line contains sorted list of nonoverlapping covered spans.
+// Lines, where something was drawn without spans (alpha-tested or depth-tested polygons), are marked as "partially covered".
+// Pixels of such lines must be checked via per-pixel occlusion buffer.
+class SpansBuffer final
+{
+public:
+	explicit SpansBuffer( unsigned int height );
+	~SpansBuffer();
+
+	void Clear();
+
+	// Calls func( x_begin, x_end ) for each part of [x_begin; x_end) not covered by spans, from left to right.
+	template<class Func>
+	void ForEachVisiblePart( int y, int x_begin, int x_end, const Func& func ) const;
+
+	bool IsFullyCovered( int y, int x_begin, int x_end ) const;
+
+	// Marks [x_begin; x_end) as covered.
+	void AddSpan( int y, int x_begin, int x_end );
+
+	void MarkLinePartiallyCovered( int y );
+	bool IsLinePartiallyCovered( int y ) const;
+
+private:
+	static constexpr uint32_t c_null_span= ~0u;
+
+	struct Span
+	{
+		int x_begin, x_end;
+		uint32_t next; // Index of next span or c_null_span.
+	};
+
+	struct Line
+	{
+		uint32_t first_span;
+		bool partially_covered;
+	};
+
+private:
+	std::vector<Line> lines_;
+	std::vector<Span> spans_; // Spans of all lines. Merged spans are not reused until "Clear".
+};
+
+template<class Func>
+void SpansBuffer::ForEachVisiblePart( const int y, int x_begin, const int x_end, const Func& func ) const
+{
+	for( uint32_t s= lines_[y].first_span; s != c_null_span && x_begin < x_end; s= spans_[s].next )
+	{
+		const Span& span= spans_[s];
+		if( span.x_end <= x_begin )
+			continue;
+		if( span.x_begin >= x_end )
+			break;
+
+		if( span.x_begin > x_begin )
+			func( x_begin, span.x_begin );
+		x_begin= span.x_end;
+	}
+
+	if( x_begin < x_end )
+		func( x_begin, x_end );
+}
+
+} // namespace PanzerChasm
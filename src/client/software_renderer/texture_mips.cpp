@@ -0,0 +1,97 @@
+#include <cstring>
+
+#include "rasterizer.hpp"
+
+#include "texture_mips.hpp"
+
+namespace PanzerChasm
+{
+
+void BuildMip(
+	const uint32_t* const in_data, const unsigned int in_size_x, const unsigned int in_size_y,
+	uint32_t* const out_data )
+{
+	const unsigned int out_size_x= in_size_x >> 1u;
+	const unsigned int out_size_y= in_size_y >> 1u;
+	for( unsigned int y= 0u; y < out_size_y; y++ )
+	for( unsigned int x= 0u; x < out_size_x; x++ )
+	{
+		uint32_t pixels[4];
+		const unsigned int src_x= x << 1u;
+		const unsigned int src_y= y << 1u;
+		pixels[0]= in_data[ src_x +        src_y        * in_size_x ];
+		pixels[1]= in_data[ src_x + 1u +   src_y        * in_size_x ];
+		pixels[2]= in_data[ src_x + 1u + ( src_y + 1u ) * in_size_x ];
+		pixels[3]= in_data[ src_x +      ( src_y + 1u ) * in_size_x ];
+
+		unsigned char components[4];
+		for( unsigned int c= 0u; c < 4u; c++ )
+		{
+			components[c]= (
+				reinterpret_cast<const unsigned char*>(&pixels[0])[c] +
+				reinterpret_cast<const unsigned char*>(&pixels[1])[c] +
+				reinterpret_cast<const unsigned char*>(&pixels[2])[c] +
+				reinterpret_cast<const unsigned char*>(&pixels[3])[c] ) >> 2u;
+		}
+		std::memcpy( &out_data[ x + y * out_size_x ], components, sizeof(uint32_t) );
+	}
+}
+
+void BuildMipAlphaCorrected(
+	const uint32_t* const in_data, const unsigned int in_size_x, const unsigned int in_size_y,
+	uint32_t* const out_data )
+{
+	const unsigned int out_size_x= in_size_x >> 1u;
+	const unsigned int out_size_y= in_size_y >> 1u;
+	for( unsigned int y= 0u; y < out_size_y; y++ )
+	for( unsigned int x= 0u; x < out_size_x; x++ )
+	{
+		uint32_t pixels[4];
+		const unsigned int src_x= x << 1u;
+		const unsigned int src_y= y << 1u;
+		pixels[0]= in_data[ src_x +        src_y        * in_size_x ];
+		pixels[1]= in_data[ src_x + 1u +   src_y        * in_size_x ];
+		pixels[2]= in_data[ src_x + 1u + ( src_y + 1u ) * in_size_x ];
+		pixels[3]= in_data[ src_x +      ( src_y + 1u ) * in_size_x ];
+
+		// Calculate avg color, except for pixels with full alpha (=0)
+		unsigned int components_sum[4]= { 0u, 0u, 0u, 0u };
+		unsigned int nonalpha_pixels= 0u;
+		for( unsigned int p= 0u; p < 4u; p++ )
+		{
+			if( (pixels[p] & Rasterizer::c_alpha_mask) != 0u )
+			{
+				nonalpha_pixels++;
+				for( unsigned int c= 0u; c < 3u; c++ )
+					components_sum[c]+= reinterpret_cast<const unsigned char*>(&pixels[p])[c];
+			} // else - full alpha
+			components_sum[3]+= reinterpret_cast<const unsigned char*>(&pixels[p])[3];
+		}
+		unsigned char components[4];
+		if( nonalpha_pixels > 0u )
+		{
+			for( unsigned int c= 0u; c < 3u; c++ )
+				components[c]= components_sum[c] / nonalpha_pixels;
+		}
+		else
+		{
+			for( unsigned int c= 0u; c < 3u; c++ )
+				components[c]= 0u;
+		}
+		components[3]= components_sum[3] >> 2u;
+
+		std::memcpy( &out_data[ x + y * out_size_x ], components, sizeof(uint32_t) );
+	}
+}
+
+void MakeBinaryAlpha( uint32_t* const pixels, const unsigned int pixel_count )
+{
+	for( unsigned int i= 0u; i < pixel_count; i++ )
+	{
+		// TODO - calibrate alpha edge.
+		if( ( pixels[i] & Rasterizer::c_alpha_mask ) < Rasterizer::c_alpha_mask / 3u )
+			pixels[i]&= ~Rasterizer::c_alpha_mask;
+	}
+}
+
+} // namespace PanzerChasm
@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+
+namespace PanzerChasm
+{
+
+// Build next mip, using simple 2x2 box filter.
+void BuildMip(
+	const uint32_t* in_data, unsigned int in_size_x, unsigned int in_size_y,
+	uint32_t* out_data );
+
+// Build next mip. Colors of pixels with full alpha are not used for color averaging.
+void BuildMipAlphaCorrected(
+	const uint32_t* in_data, unsigned int in_size_x, unsigned int in_size_y,
+	uint32_t* out_data );
+
+// Convert alpha to 0 or not 0, for alpha-test.
+void MakeBinaryAlpha( uint32_t* pixels, unsigned int pixel_count );
+
+} // namespace PanzerChasm
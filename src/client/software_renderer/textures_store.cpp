@@ -0,0 +1,200 @@
+#include "../../assert.hpp"
+#include "../../game_constants.hpp"
+#include "../../images.hpp"
+#include "../../model.hpp"
+#include "../../obj.hpp"
+#include "../../vfs.hpp"
+#include "rasterizer.hpp"
+#include "texture_mips.hpp"
+
+#include "textures_store.hpp"
+
+namespace PanzerChasm
+{
+
+static constexpr unsigned int c_garbage_collection_interval= 64u;
+
+size_t TexturesStore::KeyHasher::operator()( const Key& key ) const
+{
+	return std::hash<const void*>()( key.asset ) ^ ( static_cast<size_t>( key.variant ) * 31u );
+}
+
+TexturesStore::TexturesStore( const PaletteTransformedPtr& palette )
+	: palette_( palette )
+{
+	PC_ASSERT( palette_ != nullptr );
+}
+
+TexturesStore::~TexturesStore()
+{}
+
+TexturesStore::TexturePtr TexturesStore::GetModelTexture( const Model& model, const int color_shift )
+{
+	const Key key{ &model.texture_data, color_shift };
+	TextureWeakPtr& weak_texture= textures_[ key ];
+	if( const TexturePtr existent_texture= weak_texture.lock() )
+		return existent_texture;
+
+	const PaletteTransformed& palette= *palette_;
+	const unsigned int pixel_count= model.texture_data.size();
+
+	const std::shared_ptr<Texture> texture= std::make_shared<Texture>();
+	texture->size[0]= model.texture_size[0];
+	texture->size[1]= model.texture_size[1];
+	texture->frame_count= 1u;
+	texture->data.resize( pixel_count );
+
+	const unsigned char* src= model.texture_data.data();
+	std::vector<unsigned char> data_shifted;
+	if( color_shift != 0 )
+	{
+		data_shifted.resize( pixel_count );
+		ColorShift(
+			14 * 16u, 14 * 16u + 16u,
+			static_cast<char>(color_shift),
+			pixel_count,
+			model.texture_data.data(),
+			data_shifted.data() );
+		src= data_shifted.data();
+	}
+
+	for( unsigned int i= 0u; i < pixel_count; i++ )
+	{
+		const unsigned char color_index= src[i];
+		uint32_t color= palette[ color_index ];
+		if( color_index == 0u ) color&= ~Rasterizer::c_alpha_mask; // For models color #0 is transparent.
+		texture->data[i]= color;
+	}
+	BuildMips( *texture, true );
+
+	weak_texture= texture;
+	insertions_since_garbage_collection_++;
+	CollectGarbage();
+
+	return texture;
+}
+
+TexturesStore::TexturePtr TexturesStore::GetSpriteTexture( const ObjSprite& sprite )
+{
+	const Key key{ &sprite.data, 0 };
+	TextureWeakPtr& weak_texture= textures_[ key ];
+	if( const TexturePtr existent_texture= weak_texture.lock() )
+		return existent_texture;
+
+	const PaletteTransformed& palette= *palette_;
+	const unsigned int pixel_count= sprite.size[0] * sprite.size[1] * sprite.frame_count;
+
+	const std::shared_ptr<Texture> texture= std::make_shared<Texture>();
+	texture->size[0]= sprite.size[0];
+	texture->size[1]= sprite.size[1];
+	texture->frame_count= sprite.frame_count;
+	texture->data.resize( pixel_count );
+
+	for( unsigned int i= 0u; i < pixel_count; i++ )
+		texture->data[i]= palette[ sprite.data[i] ];
+	BuildMips( *texture, true );
+
+	weak_texture= texture;
+	insertions_since_garbage_collection_++;
+	CollectGarbage();
+
+	return texture;
+}
+
+TexturesStore::TexturePtr TexturesStore::GetCelTexture( const Vfs& vfs, const char* const file_path )
+{
+	TextureWeakPtr& weak_texture= cel_textures_[ file_path ];
+	if( const TexturePtr existent_texture= weak_texture.lock() )
+		return existent_texture;
+
+	const Vfs::FileContent file_content= vfs.ReadFile( file_path );
+	const CelTextureHeader& cel_header= *reinterpret_cast<const CelTextureHeader*>( file_content.data() );
+
+	const PaletteTransformed& palette= *palette_;
+	const unsigned int pixel_count= cel_header.size[0] * cel_header.size[1];
+	const unsigned char* const src= file_content.data() + sizeof(CelTextureHeader);
+
+	const std::shared_ptr<Texture> texture= std::make_shared<Texture>();
+	texture->size[0]= cel_header.size[0];
+	texture->size[1]= cel_header.size[1];
+	texture->frame_count= 1u;
+	texture->data.resize( pixel_count );
+
+	for( unsigned int i= 0u; i < pixel_count; i++ )
+		texture->data[i]= palette[ src[i] ];
+	BuildMips( *texture, false );
+
+	weak_texture= texture;
+	insertions_since_garbage_collection_++;
+	CollectGarbage();
+
+	return texture;
+}
+
+void TexturesStore::BuildMips( Texture& texture, const bool has_alpha )
+{
+	texture.mip_count= 1u;
+	while( texture.mip_count < Texture::c_max_mips )
+	{
+		const unsigned int next_mip_block= 1u << texture.mip_count;
+		if( texture.size[0] % next_mip_block != 0u || texture.size[1] % next_mip_block != 0u )
+			break;
+		texture.mip_count++;
+	}
+
+	unsigned int data_size= 0u;
+	for( unsigned int mip= 0u; mip < texture.mip_count; mip++ )
+	{
+		texture.mips_offsets[mip]= data_size;
+		data_size+= ( texture.size[0] >> mip ) * ( texture.size[1] >> mip ) * texture.frame_count;
+	}
+	for( unsigned int mip= texture.mip_count; mip < Texture::c_max_mips; mip++ )
+		texture.mips_offsets[mip]= data_size;
+
+	PC_ASSERT( texture.data.size() == texture.size[0] * texture.size[1] * texture.frame_count );
+	texture.data.resize( data_size );
+
+	for( unsigned int mip= 1u; mip < texture.mip_count; mip++ )
+	{
+		const unsigned int src_size_x= texture.size[0] >> ( mip - 1u );
+		const unsigned int src_size_y= texture.size[1] >> ( mip - 1u );
+		for( unsigned int frame= 0u; frame < texture.frame_count; frame++ )
+		{
+			const uint32_t* const src= texture.GetFrame( frame, mip - 1u );
+			uint32_t* const dst=
+				texture.data.data() + texture.mips_offsets[mip] + ( src_size_x >> 1u ) * ( src_size_y >> 1u ) * frame;
+			if( has_alpha )
+			{
+				BuildMipAlphaCorrected( src, src_size_x, src_size_y, dst );
+				MakeBinaryAlpha( dst, ( src_size_x >> 1u ) * ( src_size_y >> 1u ) );
+			}
+			else
+				BuildMip( src, src_size_x, src_size_y, dst );
+		}
+	}
+}
+
+void TexturesStore::CollectGarbage()
+{
+	if( insertions_since_garbage_collection_ < c_garbage_collection_interval )
+		return;
+	insertions_since_garbage_collection_= 0u;
+
+	// Remove entries for textures, released by all consumers.
+	for( auto it= textures_.begin(); it != textures_.end(); )
+	{
+		if( it->second.expired() )
+			it= textures_.erase( it );
+		else
+			++it;
+	}
+	for( auto it= cel_textures_.begin(); it != cel_textures_.end(); )
+	{
+		if( it->second.expired() )
+			it= cel_textures_.erase( it );
+		else
+			++it;
+	}
+}
+
+} // namespace PanzerChasm
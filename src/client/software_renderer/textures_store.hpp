@@ -0,0 +1,85 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../../fwd.hpp"
+#include "../../rendering_context.hpp"
+
+namespace PanzerChasm
+{
+
+struct Model;
+
+// Storage for textures, converted to software renderer format.
+// Store does not own textures - it shares them between consumers and holds only weak references.
+// Texture is freed, when last consumer releases it.
+class TexturesStore final
+{
+public:
+	struct Texture
+	{
+		static constexpr unsigned int c_max_mips= 4u;
+
+		unsigned int size[2]; // Size of mip 0.
+		unsigned int frame_count; // Frames stored one after another.
+		unsigned int mip_count; // Mips are generated while texture size is divisible by 2.
+		unsigned int mips_offsets[ c_max_mips ];
+
+		// All frames of mip 0, then all frames of mip 1, etc.
+		std::vector<uint32_t> data;
+
+		const uint32_t* GetFrame( const unsigned int frame, const unsigned int mip= 0u ) const
+		{
+			return data.data() + mips_offsets[mip] + ( size[0] >> mip ) * ( size[1] >> mip ) * frame;
+		}
+	};
+
+	typedef std::shared_ptr<const Texture> TexturePtr;
+
+public:
+	explicit TexturesStore( const PaletteTransformedPtr& palette );
+	~TexturesStore();
+
+	// Color #0 of models is transparent.
+	// Nonzero color shift is used for players colors.
+	TexturePtr GetModelTexture( const Model& model, int color_shift= 0 );
+	TexturePtr GetSpriteTexture( const ObjSprite& sprite );
+	TexturePtr GetCelTexture( const Vfs& vfs, const char* file_path );
+
+private:
+	struct Key
+	{
+		const void* asset; // Address of source data.
+		int variant;
+
+		bool operator==( const Key& other ) const
+		{
+			return asset == other.asset && variant == other.variant;
+		}
+	};
+
+	struct KeyHasher
+	{
+		size_t operator()( const Key& key ) const;
+	};
+
+	typedef std::weak_ptr<const Texture> TextureWeakPtr;
+
+private:
+	// Texture must contain mip 0 for all frames.
+	static void BuildMips( Texture& texture, bool has_alpha );
+
+	void CollectGarbage();
+
+private:
+	const PaletteTransformedPtr palette_;
+
+	std::unordered_map< Key, TextureWeakPtr, KeyHasher > textures_;
+	std::unordered_map< std::string, TextureWeakPtr > cel_textures_;
+	unsigned int insertions_since_garbage_collection_= 0u;
+};
+
+} // namespace PanzerChasm
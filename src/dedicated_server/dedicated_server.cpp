@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include "../assert.hpp"
+#include "../game_resources.hpp"
+#include "../log.hpp"
+#include "../map_loader.hpp"
+#include "../shared_settings_keys.hpp"
+#include "../vfs.hpp"
+
+#include "dedicated_server.hpp"
+
+namespace PanzerChasm
+{
+
+static const unsigned int c_default_tick_rate= 60u;
+// Server splits too long ticks and skips too short ticks, see "Server::UpdateTimes".
+// Keep tick rate in range, where each loop iteration produces exactly one map tick.
+static const unsigned int c_min_tick_rate=  40u;
+static const unsigned int c_max_tick_rate= 200u;
+
+static DifficultyType DifficultyNumberToDifficulty( const unsigned int n )
+{
+	switch( n )
+	{
+	case 0: return Difficulty::Easy;
+	case 1: return Difficulty::Normal;
+	case 2: return Difficulty::Hard;
+	default: return Difficulty::Normal;
+	};
+}
+
+static GameRules ParseGameRules( const char* const rules_name )
+{
+	if( std::strcmp( rules_name, "cooperative" ) == 0 || std::strcmp( rules_name, "coop" ) == 0 )
+		return GameRules::Cooperative;
+	if( std::strcmp( rules_name, "deathmatch" ) != 0 && std::strcmp( rules_name, "dm" ) != 0 )
+		Log::Warning( "Unknown game rules \"", rules_name, "\", using deathmatch" );
+	return GameRules::Deathmatch;
+}
+
+static uint16_t ParsePort( const char* const port_string, const uint16_t default_port )
+{
+	if( port_string == nullptr )
+		return default_port;
+
+	const int port= std::atoi( port_string );
+	if( port <= 0 || port > 65535 )
+	{
+		Log::Warning( "Invalid port \"", port_string, "\", using ", default_port );
+		return default_port;
+	}
+	return static_cast<uint16_t>(port);
+}
+
+DedicatedServer::DedicatedServer( const int argc, const char* const* const argv )
+	: program_arguments_( argc, argv )
+	, settings_( program_arguments_.GetParamValue( "config" ) != nullptr ? program_arguments_.GetParamValue( "config" ) : "PanzerChasmServer.cfg" )
+	, commands_processor_( settings_ )
+{
+	{ // Register host commands
+		CommandsMapPtr commands= std::make_shared<CommandsMap>();
+
+		commands->emplace( "quit", std::bind( &DedicatedServer::Quit, this ) );
+
+		host_commands_= std::move( commands );
+		commands_processor_.RegisterCommands( host_commands_ );
+	}
+
+	{
+		Log::Info( "Read game archive" );
+
+		const char* csm_file= "CSM.BIN";
+		if( const char* const overrided_csm_file = program_arguments_.GetParamValue( "csm" ) )
+		{
+			csm_file= overrided_csm_file;
+			Log::Info( "Trying to load CSM file: \"", overrided_csm_file, "\"" );
+		}
+
+		const char* const addon_path= program_arguments_.GetParamValue( "addon" );
+		if( addon_path != nullptr )
+			Log::Info( "Trying to load addon \"", addon_path, "\"" );
+
+		vfs_= std::make_shared<Vfs>( csm_file, addon_path );
+	}
+
+	Log::Info( "Loading game resources" );
+	game_resources_= LoadGameResources( vfs_ );
+
+	map_loader_= std::make_shared<MapLoader>( vfs_ );
+
+	{
+		unsigned int tick_rate= c_default_tick_rate;
+		if( const char* const tick_rate_string= program_arguments_.GetParamValue( "tickrate" ) )
+			tick_rate= static_cast<unsigned int>( std::max( 0, std::atoi( tick_rate_string ) ) );
+		tick_rate= std::min( std::max( tick_rate, c_min_tick_rate ), c_max_tick_rate );
+
+		Log::Info( "Server tick rate: ", tick_rate );
+		tick_duration_=
+			std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double>( 1.0 / double(tick_rate) ) );
+	}
+
+	StartServer();
+
+	program_arguments_.EnumerateAllParamValues(
+		"exec",
+		[&]( const char* const command )
+		{
+			commands_processor_.ProcessCommand( command );
+		} );
+
+	next_tick_time_= Clock::now();
+}
+
+DedicatedServer::~DedicatedServer()
+{
+	if( server_ != nullptr )
+	{
+		server_->DisconnectAllClients();
+		server_->StopMap();
+	}
+}
+
+bool DedicatedServer::Loop()
+{
+	if( server_ == nullptr )
+		return false;
+
+	server_->SetLagCompensationMaxTime(
+		Time::FromSeconds( double( std::max( 0, settings_.GetOrSetInt( SettingsKeys::lag_compensation_max_ms, Server::c_default_lag_compensation_max_ms ) ) ) / 1000.0 ) );
+	server_->Loop( false );
+
+	// Sleep until next tick. If we are too late, do not try to catch up - just start counting again.
+	next_tick_time_+= tick_duration_;
+	const Clock::time_point current_time= Clock::now();
+	if( next_tick_time_ > current_time )
+		std::this_thread::sleep_until( next_tick_time_ );
+	else
+		next_tick_time_= current_time;
+
+	return !quit_requested_;
+}
+
+void DedicatedServer::Quit()
+{
+	quit_requested_= true;
+}
+
+void DedicatedServer::StartServer()
+{
+	unsigned int map_number= 1u;
+	if( const char* const map_string= program_arguments_.GetParamValue( "map" ) )
+		map_number= static_cast<unsigned int>( std::max( 1, std::atoi( map_string ) ) );
+
+	DifficultyType difficulty= Difficulty::Normal;
+	if( const char* const difficulty_string= program_arguments_.GetParamValue( "difficulty" ) )
+		difficulty= DifficultyNumberToDifficulty( std::atoi( difficulty_string ) );
+
+	GameRules game_rules= GameRules::Deathmatch;
+	if( const char* const rules_string= program_arguments_.GetParamValue( "rules" ) )
+		game_rules= ParseGameRules( rules_string );
+
+	const uint16_t tcp_port= ParsePort( program_arguments_.GetParamValue( "port" ), Net::c_default_server_tcp_port );
+	const uint16_t udp_port= ParsePort( program_arguments_.GetParamValue( "udp-port" ), Net::c_default_server_udp_base_port );
+
+	Log::Info( "Initialize net subsystem" );
+	net_.reset( new Net() );
+
+	connections_listener_= net_->CreateServerListener( tcp_port, udp_port );
+	if( connections_listener_ == nullptr )
+	{
+		Log::Warning( "Can not start server: network error." );
+		return;
+	}
+
+	Log::Info( "Create server" );
+	server_.reset(
+		new Server(
+			commands_processor_,
+			game_resources_,
+			map_loader_,
+			connections_listener_,
+			DrawLoadingCallback() ) );
+
+	if( !server_->ChangeMap( map_number, difficulty, game_rules ) )
+	{
+		Log::Warning( "Can not start server: can not load map ", map_number );
+		server_= nullptr;
+		return;
+	}
+
+	Log::Info( "Server started on tcp port ", tcp_port, ", udp base port ", udp_port );
+}
+
+} // namespace PanzerChasm
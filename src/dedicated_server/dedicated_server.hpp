@@ -0,0 +1,55 @@
+#pragma once
+#include <chrono>
+#include <memory>
+
+#include "../commands_processor.hpp"
+#include "../net/net.hpp"
+#include "../program_arguments.hpp"
+#include "../server/server.hpp"
+#include "../settings.hpp"
+
+namespace PanzerChasm
+{
+
+// Headless host for server. Has no window, no sound, no client.
+// Runs server with fixed tick rate and sleeps between ticks.
+class DedicatedServer final
+{
+public:
+	DedicatedServer( int argc, const char* const* argv );
+	~DedicatedServer();
+
+	// Returns false on quit
+	bool Loop();
+
+	void Quit();
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+private:
+	void StartServer();
+
+private:
+	// Put members here in reverse deinitialization order.
+
+	bool quit_requested_= false;
+
+	const ProgramArguments program_arguments_;
+	Settings settings_;
+	CommandsProcessor commands_processor_;
+	CommandsMapConstPtr host_commands_;
+
+	VfsPtr vfs_;
+	GameResourcesConstPtr game_resources_;
+	MapLoaderPtr map_loader_;
+
+	std::unique_ptr<Net> net_;
+	IConnectionsListenerPtr connections_listener_;
+	std::unique_ptr<Server> server_;
+
+	Clock::duration tick_duration_;
+	Clock::time_point next_tick_time_;
+};
+
+} // namespace PanzerChasm
@@ -0,0 +1,32 @@
+// main.cpp - dedicated server entry point
+
+#include <csignal>
+#include <memory>
+
+#include "dedicated_server.hpp"
+using namespace PanzerChasm;
+
+static volatile std::sig_atomic_t g_stop_requested= 0;
+
+static void StopSignalHandler( int )
+{
+	g_stop_requested= 1;
+}
+
+extern "C" int main( int argc, char *argv[] )
+{
+	// Skip first param - program path.
+	argc--;
+	argv++;
+
+	std::signal( SIGINT, StopSignalHandler );
+	std::signal( SIGTERM, StopSignalHandler );
+
+	std::unique_ptr<DedicatedServer> server( new DedicatedServer( argc, argv ) );
+
+	while( g_stop_requested == 0 && server->Loop() )
+	{
+	}
+
+	return 0;
+}
@@ -52,6 +52,8 @@ typedef std::shared_ptr<Vfs> VfsPtr;
 
 class SystemWindow;
 
+class WorkersPool;
+
 typedef unsigned short EntityId;
 
 // Draw stuff
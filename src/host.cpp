@@ -1,10 +1,12 @@
 #include <cstring>
+#include <thread>
 
 #include <framebuffer.hpp>
 #include <glsl_program.hpp>
 #include <ogl_state_manager.hpp>
 #include <shaders_loading.hpp>
 
+#include "client/software_renderer/textures_store.hpp"
 #include "drawers_factory_gl.hpp"
 #include "drawers_factory_soft.hpp"
 #include "game_resources.hpp"
@@ -12,8 +14,10 @@
 #include "i_text_drawer.hpp"
 #include "log.hpp"
 #include "map_loader.hpp"
+#include "profiler.hpp"
 #include "shared_drawers.hpp"
 #include "save_load.hpp"
+#include "shared_settings_keys.hpp"
 #include "sound/sound_engine.hpp"
 
 #include "host.hpp"
@@ -80,6 +84,8 @@ Host::Host( const int argc, const char* const* const argv )
 		commands->emplace( "runserver", std::bind( &Host::RunServerCommand, this, std::placeholders::_1 ) );
 		commands->emplace( "save", std::bind( &Host::SaveCommand, this, std::placeholders::_1 ) );
 		commands->emplace( "load", std::bind( &Host::LoadCommand, this, std::placeholders::_1 ) );
+		commands->emplace( "timedemo", std::bind( &Host::TimedemoCommand, this, std::placeholders::_1 ) );
+		commands->emplace( "profiler_dump", std::bind( &Host::ProfilerDumpCommand, this, std::placeholders::_1 ) );
 		commands->emplace( "vid_restart", std::bind( &Host::VidRestart, this ) );
 
 		host_commands_= std::move( commands );
@@ -156,10 +162,13 @@ bool Host::Loop()
 {
 	const Time tick_start_time= Time::CurrentTime();
 
+	Profiler::SetEnabled( settings_.GetOrSetBool( "cl_profiler", false ) );
+
 	// Events processing
 	InputState input_state;
 	if( system_window_ != nullptr )
 	{
+		PC_PROFILER_ZONE( "Events" );
 		events_.clear();
 		system_window_->GetInput( events_ );
 		system_window_->GetInputState( input_state );
@@ -208,12 +217,19 @@ bool Host::Loop()
 	if( sound_engine_ != nullptr )
 		sound_engine_->Tick();
 
+	ReportSaveWriteResult();
+
 	// Loop operations
 	if( local_server_ != nullptr )
+	{
+		local_server_->SetLagCompensationMaxTime(
+			Time::FromSeconds( double( std::max( 0, settings_.GetOrSetInt( SettingsKeys::lag_compensation_max_ms, Server::c_default_lag_compensation_max_ms ) ) ) / 1000.0 ) );
 		local_server_->Loop( really_paused || needs_pause_server );
+	}
 
 	if( client_ != nullptr )
 	{
+		PC_PROFILER_ZONE( "Client::Loop" );
 		if( input_goes_to_console || input_goes_to_menu )
 		{
 			InputState dummy_input_state;
@@ -226,6 +242,7 @@ bool Host::Loop()
 	// Draw operations
 	if( system_window_ && !system_window_->IsMinimized() )
 	{
+		PC_PROFILER_ZONE( "Draw" );
 		system_window_->BeginFrame();
 
 		if( client_ != nullptr && !client_->Disconnected() )
@@ -261,15 +278,22 @@ bool Host::Loop()
 				str, scale, ITextDrawer::FontColor::Golden, ITextDrawer::Alignment::Right );
 		}
 
+		if( Profiler::IsEnabled() )
+			DrawProfilerStats();
+
+		PC_PROFILER_ZONE( "Present" );
 		system_window_->EndFrame();
 	}
 
+	Profiler::EndFrame();
 
 	// Try sleep just a bit, if we run too fast.
+	// Do not sleep in timedemo - it must run as fast as possible.
 	const Time tick_end_time= Time::CurrentTime();
 	const double tick_duration_ms= ( tick_end_time - tick_start_time ).ToSeconds() * 1000.0f;
 	const float c_min_acceptable_tick_duration_ms= 5.0f;
-	if( tick_duration_ms < 0.9f * c_min_acceptable_tick_duration_ms )
+	const bool playing_timedemo= client_ != nullptr && client_->PlayingDemo();
+	if( !playing_timedemo && tick_duration_ms < 0.9f * c_min_acceptable_tick_duration_ms )
 		SDL_Delay( static_cast<Uint32>( std::max( c_min_acceptable_tick_duration_ms - tick_duration_ms, 1.0 ) ) );
 
 	loops_counter_.Tick();
@@ -393,6 +417,9 @@ bool Host::SaveAvailable() const
 
 void Host::GetSavesNames( SavesNames& out_saves_names )
 {
+	// Wait for current save, because it can change comments.
+	save_writer_.Wait();
+
 	//for( SaveComment& save_comment : out_saves_names )
 	for( unsigned int slot= 0u; slot < c_save_slots; slot++ )
 	{
@@ -499,6 +526,39 @@ void Host::LoadCommand( const CommandsArguments& args )
 	DoLoad( args.front().c_str() );
 }
 
+void Host::TimedemoCommand( const CommandsArguments& args )
+{
+	if( args.empty() )
+	{
+		Log::Info( "Expected demo file name" );
+		return;
+	}
+
+	EnsureClient();
+	ClearBeforeGameStart();
+
+	if( !client_->PlayTimedemo( args.front().c_str() ) )
+		Log::User( "Can not play demo \"", args.front(), "\"" );
+}
+
+void Host::ProfilerDumpCommand( const CommandsArguments& args )
+{
+	if( args.empty() )
+	{
+		Log::Info( "Expected trace file name" );
+		return;
+	}
+
+	if( !Profiler::IsEnabled() )
+	{
+		Log::Info( "Profiler is disabled. Set \"cl_profiler\" to 1 and try again" );
+		return;
+	}
+
+	if( Profiler::DumpTrace( args.front().c_str() ) )
+		Log::Info( "Profiler trace written into \"", args.front(), "\"" );
+}
+
 void Host::DoVidRestart()
 {
 	// Clear old resources.
@@ -562,6 +622,8 @@ void Host::DoVidRestart()
 			std::memcpy( &(*rendering_context.palette_transformed)[i], &components, 4u );
 		}
 
+		rendering_context.textures_store= std::make_shared<TexturesStore>( rendering_context.palette_transformed );
+
 		drawers_factory_=
 			std::make_shared<DrawersFactorySoft>(
 				settings_,
@@ -616,35 +678,63 @@ void Host::DoSave( const char* const save_file_name )
 
 	Log::Info( "Save game" );
 
-	SaveLoadBuffer buffer;
+	SaveLoadBuffer& buffer= save_writer_.BeginSave();
+	// Previous write is finished now. Print its result before writer reusing.
+	ReportSaveWriteResult();
+
 	SaveComment save_comment;
 
 	local_server_->Save( buffer );
 	client_->Save( buffer, save_comment );
 
-	if( SaveData( save_file_name, save_comment, buffer ) )
-		Log::User( "Game saved." );
-	else
-		Log::User( "Game save failed." );
+	const MapDataConstPtr current_map= client_->CurrentMap();
+
+	// Compress and write save in background. Result will be printed later.
+	save_writer_.StartWrite( save_file_name, save_comment, current_map == nullptr ? 0u : current_map->number );
 }
 
 void Host::DoLoad( const char* const save_file_name )
 {
+	// Maybe we load save, which is writing now.
+	save_writer_.Wait();
+
+	SaveHeader save_header;
+	SaveLoadBuffer compressed_save_buffer;
 	SaveLoadBuffer save_buffer;
 	unsigned int save_buffer_pos= 0u;
 
 	Log::Info( "Load game" );
 
-	if( !LoadData( save_file_name, save_buffer ) )
+	if( !LoadCompressedData( save_file_name, save_header, compressed_save_buffer ) )
 	{
 		Log::User( "Loading failed." );
 		return;
 	}
 
+	// Decompress save content in background, while map is loading.
+	bool decompressed_ok= false;
+	std::string decompress_error;
+	std::thread decompress_thread(
+		[&]
+		{
+			decompressed_ok= DecompressData( save_header, compressed_save_buffer, save_buffer, decompress_error );
+		} );
+
 	EnsureClient();
 	EnsureServer();
 	EnsureLoopbackBuffer();
 
+	// Map loader caches last map, so, server will get this map later without loading.
+	map_loader_->LoadMap( save_header.map_number );
+
+	decompress_thread.join();
+	if( !decompressed_ok )
+	{
+		Log::Warning( decompress_error );
+		Log::User( "Loading failed." );
+		return;
+	}
+
 	ClearBeforeGameStart();
 
 	const bool map_changed=
@@ -672,6 +762,18 @@ void Host::DoLoad( const char* const save_file_name )
 	Log::User( "Game loaded." );
 }
 
+void Host::ReportSaveWriteResult()
+{
+	bool save_write_ok;
+	std::string save_write_error;
+	if( save_writer_.TakeFinishedWrite( save_write_ok, save_write_error ) )
+	{
+		if( !save_write_ok )
+			Log::Warning( save_write_error );
+		Log::User( save_write_ok ? "Game saved." : "Game save failed." );
+	}
+}
+
 void Host::DrawLoadingFrame( const float progress, const char* const caption )
 {
 	// TODO - use this.
@@ -685,6 +787,29 @@ void Host::DrawLoadingFrame( const float progress, const char* const caption )
 	}
 }
 
+void Host::DrawProfilerStats()
+{
+	const std::vector<Profiler::ZoneStats>& zones_stats= Profiler::GetZonesStats();
+
+	const unsigned int scale= 1u;
+	const unsigned int line_height= shared_drawers_->text->GetLineHeight();
+	const unsigned int offset= 4u * scale;
+	unsigned int y= 0u;
+
+	char str[64];
+	for( const Profiler::ZoneStats& zone_stats : zones_stats )
+	{
+		std::snprintf(
+			str, sizeof(str), "%*s%s: %03.2f ms",
+			int(zone_stats.depth * 2u), "", zone_stats.name, zone_stats.average_ms );
+
+		shared_drawers_->text->Print(
+			offset, y,
+			str, scale, ITextDrawer::FontColor::White, ITextDrawer::Alignment::Left );
+		y+= line_height;
+	}
+}
+
 MapDataConstPtr Host::CurrentMap()
 {
 	if( client_ == nullptr )
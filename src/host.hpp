@@ -8,6 +8,7 @@
 #include "menu.hpp"
 #include "net/net.hpp"
 #include "program_arguments.hpp"
+#include "save_writer.hpp"
 #include "server/server.hpp"
 #include "settings.hpp"
 #include "system_event.hpp"
@@ -66,14 +67,19 @@ private:
 	void RunServerCommand( const CommandsArguments& args );
 	void SaveCommand( const CommandsArguments& args );
 	void LoadCommand( const CommandsArguments& args );
+	void TimedemoCommand( const CommandsArguments& args );
+	void ProfilerDumpCommand( const CommandsArguments& args );
 
 	void DoVidRestart();
 
 	void DoRunLevel( unsigned int map_number, DifficultyType difficulty );
 	void DoSave( const char* save_file_name );
 	void DoLoad( const char* save_file_name );
+	// Prints result of finished background save write, if it was not printed yet.
+	void ReportSaveWriteResult();
 
 	void DrawLoadingFrame( float progress, const char* caption );
+	void DrawProfilerStats();
 
 	void EnsureClient();
 	void EnsureServer();
@@ -111,6 +117,8 @@ private:
 
 	MapLoaderPtr map_loader_;
 
+	SaveWriter save_writer_;
+
 	LoopbackBufferPtr loopback_buffer_;
 	std::shared_ptr<ConnectionsListenerProxy> connections_listener_proxy_; // Create it together with server.
 	std::unique_ptr<Server> local_server_;
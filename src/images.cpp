@@ -1,4 +1,10 @@
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#ifdef PC_SSE2_INSTRUCTIONS
+#include <emmintrin.h>
+#endif
 
 #include "assert.hpp"
 #include "vfs.hpp"
@@ -8,6 +14,47 @@
 namespace PanzerChasm
 {
 
+// Convert palette into table of RGBA colors, for fetching of whole color with single lookup.
+static void MakeRGBAPaletteTable(
+	const Palette& palette,
+	const unsigned int transpareny_color_index,
+	uint32_t* const out_table )
+{
+	for( unsigned int i= 0u; i < 256u; i++ )
+	{
+		const unsigned char components[4]=
+		{
+			palette[ i * 3u + 0u ],
+			palette[ i * 3u + 1u ],
+			palette[ i * 3u + 2u ],
+			static_cast<unsigned char>( i == transpareny_color_index ? 0u : 255u ),
+		};
+		std::memcpy( &out_table[i], components, sizeof(uint32_t) );
+	}
+}
+
+static void ConvertToRGBA(
+	const unsigned int pixel_count,
+	const unsigned char* const in_data,
+	const uint32_t* const palette_table,
+	unsigned char* const out_data )
+{
+	unsigned int p= 0u;
+	for( ; p + 4u <= pixel_count; p+= 4u )
+	{
+		const uint32_t colors[4]=
+		{
+			palette_table[ in_data[ p + 0u ] ],
+			palette_table[ in_data[ p + 1u ] ],
+			palette_table[ in_data[ p + 2u ] ],
+			palette_table[ in_data[ p + 3u ] ],
+		};
+		std::memcpy( out_data + p * 4u, colors, sizeof(colors) );
+	}
+	for( ; p < pixel_count; p++ )
+		std::memcpy( out_data + p * 4u, &palette_table[ in_data[p] ], sizeof(uint32_t) );
+}
+
 void ConvertToRGBA(
 	const unsigned int pixel_count,
 	const unsigned char* const in_data,
@@ -15,13 +62,10 @@ void ConvertToRGBA(
 	unsigned char* const out_data,
 	const unsigned char transpareny_color_index )
 {
-	for( unsigned int p= 0u; p < pixel_count; p++ )
-	{
-		for( unsigned int j= 0u; j < 3u; j++ )
-			out_data[ p * 4u + j ]= palette[ in_data[p] * 3u + j ];
+	uint32_t palette_table[256];
+	MakeRGBAPaletteTable( palette, transpareny_color_index, palette_table );
 
-		out_data[ p * 4u + 3 ]= in_data[p] == transpareny_color_index ? 0u : 255u;
-	}
+	ConvertToRGBA( pixel_count, in_data, palette_table, out_data );
 }
 
 void FlipAndConvertToRGBA(
@@ -30,17 +74,16 @@ void FlipAndConvertToRGBA(
 	const Palette& palette,
 	unsigned char* const out_data )
 {
+	uint32_t palette_table[256];
+	MakeRGBAPaletteTable( palette, 255u, palette_table );
+
 	for( unsigned int y= 0u; y < height; y++ )
 	{
-		const unsigned char* const src= in_data + (height - y - 1u) * width;
-		unsigned char* const dst= out_data + 4u * y * width;
-		for( unsigned int x= 0u; x < width; x++ )
-		{
-			for( unsigned int j= 0u; j < 3u; j++ )
-				dst[ x * 4u + j ]= palette[ src[x] * 3u + j ];
-
-			dst[ x * 4u + 3 ]= src[x] == 255u ? 0u : 255u;
-		}
+		ConvertToRGBA(
+			width,
+			in_data + (height - y - 1u) * width,
+			palette_table,
+			out_data + 4u * y * width );
 	}
 }
 
@@ -51,7 +94,28 @@ void ColorShift(
 	const unsigned char* in_data,
 	unsigned char* out_data )
 {
-	for( unsigned int i= 0u; i < pixel_count; i++ )
+	unsigned int i= 0u;
+
+#ifdef PC_SSE2_INSTRUCTIONS
+	// SSE2 have only signed bytes comparison, so, flip sign bit of colors before comparison.
+	const __m128i sign_bit= _mm_set1_epi8( static_cast<char>(0x80) );
+	const __m128i start_color_signed= _mm_set1_epi8( static_cast<char>( start_color ^ 0x80u ) );
+	const __m128i end_color_signed= _mm_set1_epi8( static_cast<char>( end_color ^ 0x80u ) );
+	const __m128i shift_vec= _mm_set1_epi8( shift );
+
+	for( ; i + 16u <= pixel_count; i+= 16u )
+	{
+		const __m128i c= _mm_loadu_si128( reinterpret_cast<const __m128i*>( in_data + i ) );
+		const __m128i c_signed= _mm_xor_si128( c, sign_bit );
+		const __m128i less_than_start= _mm_cmpgt_epi8( start_color_signed, c_signed );
+		const __m128i less_than_end= _mm_cmpgt_epi8( end_color_signed, c_signed );
+		const __m128i in_range= _mm_andnot_si128( less_than_start, less_than_end );
+		const __m128i result= _mm_add_epi8( c, _mm_and_si128( in_range, shift_vec ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i*>( out_data + i ), result );
+	}
+#endif
+
+	for( ; i < pixel_count; i++ )
 	{
 		const unsigned char c= in_data[i];
 		if( c >= start_color && c < end_color )
@@ -313,6 +377,69 @@ void CreateNetgameScoreBackgroundTextureRGBA(
 void FillAlphaTexelsColorRGBA(
 	const unsigned int width, const unsigned int height,
 	unsigned char* const data )
+{
+	// SSE2 version of this kernel was not faster, than scalar code (most time is spent on alpha texels with irregular neighbors).
+	FillAlphaTexelsColorRGBAScalar( width, height, data );
+}
+
+// Reference scalar implementations.
+
+void ConvertToRGBAScalar(
+	const unsigned int pixel_count,
+	const unsigned char* const in_data,
+	const Palette& palette,
+	unsigned char* const out_data,
+	const unsigned char transpareny_color_index )
+{
+	for( unsigned int p= 0u; p < pixel_count; p++ )
+	{
+		for( unsigned int j= 0u; j < 3u; j++ )
+			out_data[ p * 4u + j ]= palette[ in_data[p] * 3u + j ];
+
+		out_data[ p * 4u + 3 ]= in_data[p] == transpareny_color_index ? 0u : 255u;
+	}
+}
+
+void FlipAndConvertToRGBAScalar(
+	const unsigned int width, const unsigned int height,
+	const unsigned char* const in_data,
+	const Palette& palette,
+	unsigned char* const out_data )
+{
+	for( unsigned int y= 0u; y < height; y++ )
+	{
+		const unsigned char* const src= in_data + (height - y - 1u) * width;
+		unsigned char* const dst= out_data + 4u * y * width;
+		for( unsigned int x= 0u; x < width; x++ )
+		{
+			for( unsigned int j= 0u; j < 3u; j++ )
+				dst[ x * 4u + j ]= palette[ src[x] * 3u + j ];
+
+			dst[ x * 4u + 3 ]= src[x] == 255u ? 0u : 255u;
+		}
+	}
+}
+
+void ColorShiftScalar(
+	unsigned char start_color, unsigned char end_color,
+	char shift,
+	unsigned int pixel_count,
+	const unsigned char* in_data,
+	unsigned char* out_data )
+{
+	for( unsigned int i= 0u; i < pixel_count; i++ )
+	{
+		const unsigned char c= in_data[i];
+		if( c >= start_color && c < end_color )
+			out_data[i]= (unsigned char)( int(c) + int(shift) );
+		else
+			out_data[i]= c;
+	}
+}
+
+void FillAlphaTexelsColorRGBAScalar(
+	const unsigned int width, const unsigned int height,
+	unsigned char* const data )
 {
 	const unsigned int c_alpha_edge= 128u;
 
@@ -81,4 +81,33 @@ void FillAlphaTexelsColorRGBA(
 	unsigned int width, unsigned int height,
 	unsigned char* data );
 
+// Reference scalar implementations of image conversion kernels above.
+// Optimized kernels are selected at compile time and must produce exactly same results as these functions.
+// FillAlphaTexelsColorRGBA just calls scalar kernel.
+// Used for checking of optimized kernels.
+
+void ConvertToRGBAScalar(
+	unsigned int pixel_count,
+	const unsigned char* in_data,
+	const Palette& palette,
+	unsigned char* out_data,
+	unsigned char transpareny_color_index= 255u );
+
+void FlipAndConvertToRGBAScalar(
+	unsigned int width, unsigned int height,
+	const unsigned char* in_data,
+	const Palette& palette,
+	unsigned char* out_data );
+
+void ColorShiftScalar(
+	unsigned char start_color, unsigned char end_color,
+	char shift,
+	unsigned int pixel_count,
+	const unsigned char* in_data,
+	unsigned char* out_data );
+
+void FillAlphaTexelsColorRGBAScalar(
+	unsigned int width, unsigned int height,
+	unsigned char* data );
+
 } // namespace PanzerChasm
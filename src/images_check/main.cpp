@@ -0,0 +1,160 @@
+// main.cpp - check of image conversion kernels.
+// Runs optimized kernels from images.cpp on random images and compares results with reference scalar kernels byte for byte.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../images.hpp"
+#include "../program_arguments.hpp"
+using namespace PanzerChasm;
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+typedef std::vector<unsigned char> Image;
+
+unsigned int GetUIntParam( const ProgramArguments& program_arguments, const char* const name, const unsigned int default_value )
+{
+	if( const char* const value= program_arguments.GetParamValue( name ) )
+		return static_cast<unsigned int>( std::max( 0, std::atoi( value ) ) );
+	return default_value;
+}
+
+// Deterministic random, independent of standard library implementation.
+struct SimpleRand
+{
+	uint32_t state;
+
+	uint32_t Next()
+	{
+		state= state * 1664525u + 1013904223u;
+		return state >> 8u;
+	}
+};
+
+struct KernelStats
+{
+	const char* name;
+	unsigned int failed_images= 0u;
+	double optimized_ms= 0.0;
+	double scalar_ms= 0.0;
+};
+
+template<class Func>
+double MeasureMs( const Func& func )
+{
+	const Clock::time_point start_time= Clock::now();
+	func();
+	return std::chrono::duration<double, std::milli>( Clock::now() - start_time ).count();
+}
+
+// Indexed image with runs of same colors and many transparent pixels, like real sprites.
+Image GenerateIndexedImage( SimpleRand& rand, const unsigned int pixel_count )
+{
+	Image result( pixel_count );
+	unsigned int p= 0u;
+	while( p < pixel_count )
+	{
+		const unsigned int run_length= 1u + rand.Next() % 24u;
+		const unsigned char color= rand.Next() % 4u == 0u ? 255u : static_cast<unsigned char>( rand.Next() );
+		for( unsigned int i= 0u; i < run_length && p < pixel_count; i++, p++ )
+			result[p]= rand.Next() % 8u == 0u ? static_cast<unsigned char>( rand.Next() ) : color;
+	}
+	return result;
+}
+
+void CheckImage( KernelStats& stats, const Image& optimized_result, const Image& scalar_result, const unsigned int width, const unsigned int height )
+{
+	if( optimized_result != scalar_result )
+	{
+		if( stats.failed_images == 0u )
+			std::printf( "%s: results are different for image %ux%u\n", stats.name, width, height );
+		stats.failed_images++;
+	}
+}
+
+} // namespace
+
+extern "C" int main( int argc, char *argv[] )
+{
+	// Skip first param - program path.
+	argc--;
+	argv++;
+
+	const ProgramArguments program_arguments( argc, argv );
+
+	const unsigned int image_count= std::max( 1u, GetUIntParam( program_arguments, "images", 500u ) );
+	const unsigned int max_size= std::max( 1u, GetUIntParam( program_arguments, "max_size", 256u ) );
+	SimpleRand rand{ GetUIntParam( program_arguments, "seed", 0u ) };
+
+#ifdef PC_SSE2_INSTRUCTIONS
+	std::printf( "SSE2 kernels, %u images\n", image_count );
+#else
+	std::printf( "Scalar kernels, %u images\n", image_count );
+#endif
+
+	// FillAlphaTexelsColorRGBA is not checked - it uses scalar kernel.
+	KernelStats convert_stats, flip_and_convert_stats, color_shift_stats;
+	convert_stats.name= "ConvertToRGBA";
+	flip_and_convert_stats.name= "FlipAndConvertToRGBA";
+	color_shift_stats.name= "ColorShift";
+
+	for( unsigned int i= 0u; i < image_count; i++ )
+	{
+		// Use small and odd sizes too, for checking of tails of vector loops.
+		const unsigned int width = 1u + rand.Next() % max_size;
+		const unsigned int height= 1u + rand.Next() % max_size;
+		const unsigned int pixel_count= width * height;
+
+		Palette palette;
+		for( unsigned char& c : palette )
+			c= static_cast<unsigned char>( rand.Next() );
+
+		const Image indexed= GenerateIndexedImage( rand, pixel_count );
+		Image optimized_result, scalar_result;
+
+		{
+			const unsigned char transparent_color= rand.Next() % 2u == 0u ? 255u : static_cast<unsigned char>( rand.Next() );
+			optimized_result.assign( pixel_count * 4u, 0u );
+			scalar_result.assign( pixel_count * 4u, 0u );
+			convert_stats.optimized_ms+= MeasureMs( [&]{ ConvertToRGBA( pixel_count, indexed.data(), palette, optimized_result.data(), transparent_color ); } );
+			convert_stats.scalar_ms+= MeasureMs( [&]{ ConvertToRGBAScalar( pixel_count, indexed.data(), palette, scalar_result.data(), transparent_color ); } );
+			CheckImage( convert_stats, optimized_result, scalar_result, width, height );
+		}
+		{
+			optimized_result.assign( pixel_count * 4u, 0u );
+			scalar_result.assign( pixel_count * 4u, 0u );
+			flip_and_convert_stats.optimized_ms+= MeasureMs( [&]{ FlipAndConvertToRGBA( width, height, indexed.data(), palette, optimized_result.data() ); } );
+			flip_and_convert_stats.scalar_ms+= MeasureMs( [&]{ FlipAndConvertToRGBAScalar( width, height, indexed.data(), palette, scalar_result.data() ); } );
+			CheckImage( flip_and_convert_stats, optimized_result, scalar_result, width, height );
+		}
+		{
+			// Range may be empty or inverted.
+			const unsigned char start_color= static_cast<unsigned char>( rand.Next() );
+			const unsigned char end_color= rand.Next() % 8u == 0u ? static_cast<unsigned char>( rand.Next() ) : static_cast<unsigned char>( std::min( 255u, start_color + rand.Next() % 64u ) );
+			const char shift= static_cast<char>( rand.Next() );
+			optimized_result.assign( pixel_count, 0u );
+			scalar_result.assign( pixel_count, 0u );
+			color_shift_stats.optimized_ms+= MeasureMs( [&]{ ColorShift( start_color, end_color, shift, pixel_count, indexed.data(), optimized_result.data() ); } );
+			color_shift_stats.scalar_ms+= MeasureMs( [&]{ ColorShiftScalar( start_color, end_color, shift, pixel_count, indexed.data(), scalar_result.data() ); } );
+			CheckImage( color_shift_stats, optimized_result, scalar_result, width, height );
+		}
+	}
+
+	unsigned int total_failed_images= 0u;
+	for( const KernelStats* const stats : { &convert_stats, &flip_and_convert_stats, &color_shift_stats } )
+	{
+		std::printf(
+			"%-26s %s, optimized: %.3f ms, scalar: %.3f ms\n",
+			stats->name,
+			stats->failed_images == 0u ? "ok    " : "FAILED",
+			stats->optimized_ms, stats->scalar_ms );
+		total_failed_images+= stats->failed_images;
+	}
+
+	return total_failed_images == 0u ? 0 : -1;
+}
@@ -1,4 +1,6 @@
+#ifndef PC_DEDICATED_SERVER
 #include <SDL_messagebox.h>
+#endif
 
 #include "log.hpp"
 
@@ -15,11 +17,16 @@ void Log::SetLogCallback( LogCallback callback )
 
 void Log::ShowFatalMessageBox( const std::string& error_message )
 {
+#ifdef PC_DEDICATED_SERVER
+	// No windows in dedicated server, message is already printed to console and log.
+	(void)error_message;
+#else
 	SDL_ShowSimpleMessageBox(
 		SDL_MESSAGEBOX_ERROR,
 		"Fatal error",
 		error_message.c_str(),
 		nullptr );
+#endif
 }
 
 } // namespace PanzerChasm
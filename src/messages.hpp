@@ -24,7 +24,7 @@ enum class MessageId : unsigned char
 namespace Messages
 {
 
-constexpr unsigned int c_protocol_version= 106u; // Increment each time, when protocol changed.
+constexpr unsigned int c_protocol_version= 107u; // Increment each time, when protocol changed.
 
 typedef short CoordType;
 typedef unsigned short AngleType;
@@ -55,6 +55,7 @@ struct ServerState : public MessageBase
 	unsigned short map_time_s;
 	unsigned char player_count;
 	GameRules game_rules;
+	unsigned int state_id; // Increased in each server loop. Zero is invalid.
 };
 
 struct MonsterState : public MessageBase
@@ -353,6 +354,7 @@ struct PlayerMove : public MessageBase
 	bool shoot_pressed : 1;
 	bool jump_pressed : 1;
 	unsigned char color : 4;
+	unsigned int acknowledged_state_id; // Id of last ServerState, received by client. Used for lag compensation.
 };
 
 // Client to server. Transmited, when client renamed.
@@ -3,6 +3,7 @@
 #include "assert.hpp"
 #include "i_connection.hpp"
 #include "messages.hpp"
+#include "profiler.hpp"
 
 #include "messages_extractor.hpp"
 
@@ -12,6 +13,8 @@ namespace PanzerChasm
 template<class MessagesHandler>
 void MessagesExtractor::ProcessMessages( MessagesHandler& messages_handler )
 {
+	PC_PROFILER_ZONE( "ProcessMessages" );
+
 	if( broken_ ) return;
 
 	for( unsigned int i= 0u; i < 2u; i++ ) // for reliable and unreliable messages
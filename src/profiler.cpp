@@ -0,0 +1,162 @@
+#include <cstdio>
+
+#include "assert.hpp"
+#include "log.hpp"
+
+#include "profiler.hpp"
+
+namespace PanzerChasm
+{
+
+bool Profiler::enabled_= false;
+std::vector<Profiler::Event> Profiler::events_;
+unsigned int Profiler::next_event_index_= 0u;
+bool Profiler::events_overflowed_= false;
+unsigned int Profiler::current_depth_= 0u;
+std::vector<Profiler::ZoneAccumulator> Profiler::zones_accumulators_;
+unsigned int Profiler::accumulated_frames_= 0u;
+std::vector<Profiler::ZoneStats> Profiler::zones_stats_;
+
+void Profiler::SetEnabled( const bool enabled )
+{
+	if( enabled == enabled_ )
+		return;
+
+	enabled_= enabled;
+	if( enabled_ )
+		events_.resize( c_max_events );
+	else
+	{
+		// Free memory, reset state.
+		events_.clear();
+		events_.shrink_to_fit();
+		zones_accumulators_.clear();
+		zones_stats_.clear();
+	}
+
+	next_event_index_= 0u;
+	events_overflowed_= false;
+	current_depth_= 0u;
+	accumulated_frames_= 0u;
+}
+
+void Profiler::EndFrame()
+{
+	if( !enabled_ )
+		return;
+
+	accumulated_frames_++;
+	if( accumulated_frames_ < c_stats_frames )
+		return;
+
+	zones_stats_.clear();
+	for( ZoneAccumulator& accumulator : zones_accumulators_ )
+	{
+		ZoneStats stats;
+		stats.name= accumulator.name;
+		stats.depth= accumulator.depth;
+		stats.average_ms=
+			std::chrono::duration<float, std::milli>( accumulator.total_duration ).count() / float(accumulated_frames_);
+		zones_stats_.push_back( stats );
+
+		accumulator.total_duration= Clock::duration::zero();
+	}
+	accumulated_frames_= 0u;
+}
+
+const std::vector<Profiler::ZoneStats>& Profiler::GetZonesStats()
+{
+	return zones_stats_;
+}
+
+bool Profiler::DumpTrace( const char* const file_name )
+{
+	if( events_.empty() )
+		return false;
+
+	std::FILE* const file= std::fopen( file_name, "wb" );
+	if( file == nullptr )
+	{
+		Log::Warning( "Can not open file \"", file_name, "\"" );
+		return false;
+	}
+
+	// Events are sorted by start time. Oldest events are at next_event_index_ if buffer was overflowed.
+	const unsigned int event_count= events_overflowed_ ? c_max_events : next_event_index_;
+	const unsigned int first_event_index= events_overflowed_ ? next_event_index_ : 0u;
+	const Clock::time_point base_time= events_[ first_event_index % c_max_events ].start;
+
+	std::fprintf( file, "{\"traceEvents\":[\n" );
+	for( unsigned int i= 0u; i < event_count; i++ )
+	{
+		const Event& event= events_[ ( first_event_index + i ) % c_max_events ];
+		const double start_us= std::chrono::duration<double, std::micro>( event.start - base_time ).count();
+		const double duration_us= std::chrono::duration<double, std::micro>( event.duration ).count();
+
+		std::fprintf(
+			file,
+			"{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,\"tid\":0}%s\n",
+			event.name, start_us, duration_us,
+			i + 1u < event_count ? "," : "" );
+	}
+	std::fprintf( file, "]}\n" );
+
+	std::fclose( file );
+	return true;
+}
+
+unsigned int Profiler::BeginZone( const char* const name )
+{
+	PC_ASSERT( !events_.empty() );
+
+	const unsigned int event_index= next_event_index_;
+	next_event_index_++;
+	if( next_event_index_ == c_max_events )
+	{
+		next_event_index_= 0u;
+		events_overflowed_= true;
+	}
+
+	// Count of different zones is small, linear search is fast enough.
+	// Accumulators are created in order of first zone start, so, parent zones go before nested zones.
+	unsigned int accumulator_index= 0u;
+	while( accumulator_index < zones_accumulators_.size() && zones_accumulators_[ accumulator_index ].name != name )
+		accumulator_index++;
+
+	if( accumulator_index == zones_accumulators_.size() )
+	{
+		ZoneAccumulator accumulator;
+		accumulator.name= name;
+		accumulator.depth= current_depth_;
+		accumulator.total_duration= Clock::duration::zero();
+		zones_accumulators_.push_back( accumulator );
+	}
+
+	Event& event= events_[ event_index ];
+	event.name= name;
+	event.depth= current_depth_;
+	event.accumulator_index= accumulator_index;
+	event.duration= Clock::duration::zero();
+	current_depth_++;
+
+	event.start= Clock::now();
+	return event_index;
+}
+
+void Profiler::EndZone( const unsigned int event_index )
+{
+	const Clock::time_point end_time= Clock::now();
+
+	// Profiler may be disabled inside zone.
+	if( events_.empty() )
+		return;
+
+	Event& event= events_[ event_index ];
+	event.duration= end_time - event.start;
+	zones_accumulators_[ event.accumulator_index ].total_duration+= event.duration;
+
+	if( current_depth_ > 0u )
+		current_depth_--;
+}
+
+} // namespace PanzerChasm
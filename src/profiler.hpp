@@ -0,0 +1,107 @@
+#pragma once
+#include <chrono>
+#include <vector>
+
+namespace PanzerChasm
+{
+
+// Simple profiler for scoped zones.
+// When disabled, zone costs only one flag check.
+// Not thread-safe. Use it only in main thread.
+class Profiler final
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	struct ZoneStats
+	{
+		const char* name;
+		unsigned int depth; // Nesting level of zone.
+		float average_ms; // Average time per frame.
+	};
+
+	// Scoped zone. Name must be string literal or other string with static storage duration.
+	class Zone final
+	{
+	public:
+		explicit Zone( const char* const name )
+		{
+			if( enabled_ )
+				event_index_= BeginZone( name );
+		}
+
+		~Zone()
+		{
+			if( event_index_ != c_no_event )
+				EndZone( event_index_ );
+		}
+
+		Zone( const Zone& )= delete;
+		Zone& operator=( const Zone& )= delete;
+
+	private:
+		unsigned int event_index_= c_no_event;
+	};
+
+public:
+	static void SetEnabled( bool enabled );
+	static bool IsEnabled() { return enabled_; }
+
+	// Call it once per frame.
+	static void EndFrame();
+
+	// Zones stats, averaged for last several frames.
+	static const std::vector<ZoneStats>& GetZonesStats();
+
+	// Write last recorded zones in Chrome trace event format.
+	// Returns true, if all ok.
+	static bool DumpTrace( const char* file_name );
+
+private:
+	struct Event
+	{
+		const char* name;
+		Clock::time_point start;
+		Clock::duration duration;
+		unsigned int depth;
+		unsigned int accumulator_index;
+	};
+
+	struct ZoneAccumulator
+	{
+		const char* name;
+		unsigned int depth;
+		Clock::duration total_duration;
+	};
+
+	static constexpr unsigned int c_no_event= ~0u;
+	static constexpr unsigned int c_max_events= 1u << 16u;
+	static constexpr unsigned int c_stats_frames= 30u;
+
+private:
+	static unsigned int BeginZone( const char* name );
+	static void EndZone( unsigned int event_index );
+
+private:
+	static bool enabled_;
+
+	// Ring buffer of last events.
+	static std::vector<Event> events_;
+	static unsigned int next_event_index_;
+	static bool events_overflowed_;
+	static unsigned int current_depth_;
+
+	static std::vector<ZoneAccumulator> zones_accumulators_;
+	static unsigned int accumulated_frames_;
+	static std::vector<ZoneStats> zones_stats_;
+};
+
+#ifdef PC_NO_PROFILER
+#define PC_PROFILER_ZONE(name)
+#else
+#define PC_PROFILER_ZONE_CONCAT_IMPL(a, b) a##b
+#define PC_PROFILER_ZONE_CONCAT(a, b) PC_PROFILER_ZONE_CONCAT_IMPL(a, b)
+#define PC_PROFILER_ZONE(name) const ::PanzerChasm::Profiler::Zone PC_PROFILER_ZONE_CONCAT( profiler_zone_, __LINE__ )( name )
+#endif
+
+} // namespace PanzerChasm
@@ -0,0 +1,231 @@
+// main.cpp - software rasterizer hidden surface removal benchmark.
+// Draws synthetic scene of front-to-back sorted opaque walls and floors, than sky, like map drawer does,
+// using occlusion buffer or spans buffer, and compares results of both modes.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "../client/software_renderer/rasterizer.inl"
+#include "../program_arguments.hpp"
+using namespace PanzerChasm;
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+constexpr unsigned int c_texture_size= 64u;
+
+struct Polygon
+{
+	RasterizerVertex vertices[4];
+	bool is_floor;
+	unsigned int texture_index;
+};
+
+unsigned int GetUIntParam( const ProgramArguments& program_arguments, const char* const name, const unsigned int default_value )
+{
+	if( const char* const value= program_arguments.GetParamValue( name ) )
+		return static_cast<unsigned int>( std::max( 0, std::atoi( value ) ) );
+	return default_value;
+}
+
+// Deterministic random, independent of standard library implementation.
+struct SimpleRand
+{
+	uint32_t state;
+
+	uint32_t Next()
+	{
+		state= state * 1664525u + 1013904223u;
+		return state >> 8u;
+	}
+
+	float NextFloat( const float min, const float max )
+	{
+		return min + ( max - min ) * float( Next() & 0xFFFFu ) / 65535.0f;
+	}
+};
+
+RasterizerVertex MakeVertex( const float x, const float y, const float u, const float v, const float z )
+{
+	RasterizerVertex result;
+	result.x= fixed16_t( x * 65536.0f );
+	result.y= fixed16_t( y * 65536.0f );
+	result.u= fixed16_t( u * 65536.0f );
+	result.v= fixed16_t( v * 65536.0f );
+	result.z= fixed16_t( z * 65536.0f );
+	return result;
+}
+
+// Walls are vertical trapezoids, floors are horizontal trapezoids, like projected map geometry.
+std::vector<Polygon> GenerateScene( const unsigned int polygon_count, const unsigned int width, const unsigned int height, const uint32_t seed )
+{
+	SimpleRand rand{ seed };
+	std::vector<Polygon> result( polygon_count );
+
+	const float w= float(width), h= float(height);
+	for( unsigned int i= 0u; i < polygon_count; i++ )
+	{
+		Polygon& polygon= result[i];
+		polygon.is_floor= rand.Next() % 3u == 0u;
+		polygon.texture_index= rand.Next() % 4u;
+
+		// Polygons are sorted front-to-back, so, each next polygon is farther.
+		const float z_near= 0.5f + float(i) * 0.25f;
+		const float z_far= z_near + rand.NextFloat( 0.1f, 0.2f );
+		const float tc_size= float(c_texture_size) - 1.0f;
+
+		if( polygon.is_floor )
+		{
+			const float y0= rand.NextFloat( 0.0f, h ), y1= y0 + rand.NextFloat( h * 0.05f, h * 0.4f );
+			const float x0= rand.NextFloat( -w * 0.2f, w ), x1= x0 + rand.NextFloat( w * 0.1f, w * 0.8f );
+			const float shrink= ( x1 - x0 ) * 0.2f;
+			polygon.vertices[0]= MakeVertex( x0, y0, 0.0f, 0.0f, z_far );
+			polygon.vertices[1]= MakeVertex( x1, y0, tc_size, 0.0f, z_far );
+			polygon.vertices[2]= MakeVertex( x1 + shrink, y1, tc_size, tc_size, z_near );
+			polygon.vertices[3]= MakeVertex( x0 - shrink, y1, 0.0f, tc_size, z_near );
+		}
+		else
+		{
+			const float x0= rand.NextFloat( -w * 0.2f, w ), x1= x0 + rand.NextFloat( w * 0.05f, w * 0.5f );
+			const float y0= rand.NextFloat( -h * 0.2f, h * 0.6f ), y1= y0 + rand.NextFloat( h * 0.1f, h * 0.6f );
+			const float shrink= ( y1 - y0 ) * 0.15f;
+			polygon.vertices[0]= MakeVertex( x0, y0, 0.0f, 0.0f, z_near );
+			polygon.vertices[1]= MakeVertex( x1, y0 + shrink, tc_size, 0.0f, z_far );
+			polygon.vertices[2]= MakeVertex( x1, y1 - shrink, tc_size, tc_size, z_far );
+			polygon.vertices[3]= MakeVertex( x0, y1, 0.0f, tc_size, z_near );
+		}
+	}
+
+	return result;
+}
+
+template<Rasterizer::OcclusionTest occlusion_test>
+void DrawScene(
+	Rasterizer& rasterizer,
+	const std::vector<Polygon>& scene,
+	const std::vector< std::vector<uint32_t> >& textures,
+	const RasterizerVertex* const sky_vertices )
+{
+	rasterizer.ClearDepthBuffer();
+	rasterizer.ClearOcclusionBuffer();
+
+	for( const Polygon& polygon : scene )
+	{
+		rasterizer.SetTexture( c_texture_size, c_texture_size, textures[ polygon.texture_index ].data() );
+		if( polygon.is_floor )
+			rasterizer.DrawTexturedConvexPolygonPerLineCorrected<
+				Rasterizer::DepthTest::No, Rasterizer::DepthWrite::Yes,
+				Rasterizer::AlphaTest::No,
+				occlusion_test, Rasterizer::OcclusionWrite::Yes>( polygon.vertices, 4u, true );
+		else
+			rasterizer.DrawTexturedConvexPolygonSpanCorrected<
+				Rasterizer::DepthTest::No, Rasterizer::DepthWrite::Yes,
+				Rasterizer::AlphaTest::No,
+				occlusion_test, Rasterizer::OcclusionWrite::Yes>( polygon.vertices, 4u, true );
+	}
+
+	rasterizer.SetTexture( c_texture_size, c_texture_size, textures.back().data() );
+	rasterizer.DrawTexturedConvexPolygonSpanCorrected<
+		Rasterizer::DepthTest::No, Rasterizer::DepthWrite::No,
+		Rasterizer::AlphaTest::No,
+		occlusion_test, Rasterizer::OcclusionWrite::No>( sky_vertices, 4u, true );
+}
+
+template<Rasterizer::OcclusionTest occlusion_test>
+double RunBenchmark(
+	Rasterizer& rasterizer,
+	const std::vector<Polygon>& scene,
+	const std::vector< std::vector<uint32_t> >& textures,
+	const RasterizerVertex* const sky_vertices,
+	const unsigned int frame_count )
+{
+	DrawScene<occlusion_test>( rasterizer, scene, textures, sky_vertices ); // Warmup.
+
+	const Clock::time_point start_time= Clock::now();
+	for( unsigned int i= 0u; i < frame_count; i++ )
+		DrawScene<occlusion_test>( rasterizer, scene, textures, sky_vertices );
+	const Clock::time_point end_time= Clock::now();
+
+	return std::chrono::duration<double, std::milli>( end_time - start_time ).count() / double(frame_count);
+}
+
+} // namespace
+
+extern "C" int main( int argc, char *argv[] )
+{
+	// Skip first param - program path.
+	argc--;
+	argv++;
+
+	const ProgramArguments program_arguments( argc, argv );
+
+	const unsigned int width = std::max( 16u, GetUIntParam( program_arguments, "width" , 640u ) );
+	const unsigned int height= std::max( 16u, GetUIntParam( program_arguments, "height", 480u ) );
+	const unsigned int polygon_count= GetUIntParam( program_arguments, "polygons", 400u );
+	const unsigned int frame_count= std::max( 1u, GetUIntParam( program_arguments, "frames", 200u ) );
+	const uint32_t seed= GetUIntParam( program_arguments, "seed", 0u );
+
+	// Last texture is sky.
+	std::vector< std::vector<uint32_t> > textures( 5u );
+	{
+		SimpleRand rand{ seed + 1u };
+		for( std::vector<uint32_t>& texture : textures )
+		{
+			texture.resize( c_texture_size * c_texture_size );
+			for( uint32_t& texel : texture )
+				texel= rand.Next() | Rasterizer::c_alpha_mask;
+		}
+	}
+
+	const float w= float(width), h= float(height), tc_size= float(c_texture_size) - 1.0f;
+	const RasterizerVertex sky_vertices[4]=
+	{
+		MakeVertex( 0.0f, 0.0f, 0.0f, 0.0f, 64.0f ),
+		MakeVertex(    w, 0.0f, tc_size, 0.0f, 64.0f ),
+		MakeVertex(    w,    h, tc_size, tc_size, 64.0f ),
+		MakeVertex( 0.0f,    h, 0.0f, tc_size, 64.0f ),
+	};
+
+	const std::vector<Polygon> scene= GenerateScene( polygon_count, width, height, seed );
+
+	std::vector<uint32_t> occlusion_buffer_result( width * height ), spans_buffer_result( width * height );
+	Rasterizer occlusion_buffer_rasterizer( width, height, width, occlusion_buffer_result.data() );
+	Rasterizer spans_buffer_rasterizer( width, height, width, spans_buffer_result.data() );
+
+	std::printf( "%ux%u, %u polygons, %u frames\n", width, height, polygon_count, frame_count );
+
+	const double occlusion_buffer_ms=
+		RunBenchmark<Rasterizer::OcclusionTest::Yes>( occlusion_buffer_rasterizer, scene, textures, sky_vertices, frame_count );
+	const double spans_buffer_ms=
+		RunBenchmark<Rasterizer::OcclusionTest::Spans>( spans_buffer_rasterizer, scene, textures, sky_vertices, frame_count );
+
+	std::printf( "occlusion buffer: %.4f ms per frame\n", occlusion_buffer_ms );
+	std::printf( "spans buffer:     %.4f ms per frame\n", spans_buffer_ms );
+
+	// Texture coordinates are interpolated from start of each drawn line part, so, some texels may differ.
+	// So, check visibility with solid color texture for each polygon - results must be same.
+	std::vector<Polygon> check_scene= scene;
+	std::vector< std::vector<uint32_t> > check_textures( scene.size() + 1u );
+	for( unsigned int i= 0u; i < check_scene.size(); i++ )
+		check_scene[i].texture_index= i;
+	for( unsigned int i= 0u; i < check_textures.size(); i++ )
+		check_textures[i].resize( c_texture_size * c_texture_size, ( i * 2654435761u ) | Rasterizer::c_alpha_mask );
+
+	DrawScene<Rasterizer::OcclusionTest::Yes>( occlusion_buffer_rasterizer, check_scene, check_textures, sky_vertices );
+	DrawScene<Rasterizer::OcclusionTest::Spans>( spans_buffer_rasterizer, check_scene, check_textures, sky_vertices );
+
+	unsigned int different_pixels= 0u;
+	for( unsigned int i= 0u; i < width * height; i++ )
+		if( occlusion_buffer_result[i] != spans_buffer_result[i] )
+			different_pixels++;
+
+	std::printf( "different pixels: %u\n", different_pixels );
+
+	return different_pixels == 0u ? 0 : -1;
+}
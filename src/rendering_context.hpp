@@ -17,6 +17,9 @@ struct RenderingContextGL
 typedef std::array< uint32_t, 256u > PaletteTransformed;
 typedef std::shared_ptr< PaletteTransformed > PaletteTransformedPtr;
 
+class TexturesStore;
+typedef std::shared_ptr< TexturesStore > TexturesStorePtr;
+
 struct RenderingContextSoft
 {
 	Size2 viewport_size;
@@ -27,6 +30,9 @@ struct RenderingContextSoft
 	unsigned char color_indeces_rgba[4];
 
 	PaletteTransformedPtr palette_transformed;
+
+	// Converted textures, shared between drawers.
+	TexturesStorePtr textures_store;
 };
 
 } // namespace PanzerChasm
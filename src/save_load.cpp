@@ -1,5 +1,8 @@
+#include <algorithm>
 #include <cctype>
+#include <cstdio>
 #include <cstring>
+#include <string>
 
 // Include OS-dependend stuff for "mkdir".
 #ifdef _WIN32
@@ -60,36 +63,173 @@ SaveHeader::HashType SaveHeader::CalculateHash( const unsigned char* data, unsig
 	return crc;
 }
 
+// Simple LZ77 compression, similar to LZ4 block format.
+// Data is a sequence of blocks. Each block is literals followed by match.
+// Token - 4 bits of literals count and 4 bits of match length. Counts >= 15 are continued with 255-bytes runs.
+// Match is 2 bytes of offset and optional match length continuation.
+// Last block contains only literals.
+
+static constexpr unsigned int c_min_match_length= 4u;
+static constexpr unsigned int c_max_match_offset= 65535u;
+static constexpr unsigned int c_hash_table_size_log2= 12u;
+
+static void WriteCompressionLength( unsigned int length, SaveLoadBuffer& out_data )
+{
+	while( length >= 255u )
+	{
+		out_data.push_back( 255u );
+		length-= 255u;
+	}
+	out_data.push_back( static_cast<unsigned char>(length) );
+}
+
+static void WriteCompressionBlock(
+	const unsigned char* const literals, const unsigned int literals_count,
+	const unsigned int match_offset, const unsigned int match_length,
+	SaveLoadBuffer& out_data )
+{
+	const unsigned int match_length_minus_min= match_length == 0u ? 0u : ( match_length - c_min_match_length );
+
+	out_data.push_back(
+		static_cast<unsigned char>(
+			( std::min( literals_count, 15u ) << 4u ) |
+			  std::min( match_length_minus_min, 15u ) ) );
+
+	if( literals_count >= 15u )
+		WriteCompressionLength( literals_count - 15u, out_data );
+	out_data.insert( out_data.end(), literals, literals + literals_count );
+
+	if( match_length == 0u )
+		return;
+
+	out_data.push_back( static_cast<unsigned char>( match_offset & 255u ) );
+	out_data.push_back( static_cast<unsigned char>( match_offset >> 8u ) );
+	if( match_length_minus_min >= 15u )
+		WriteCompressionLength( match_length_minus_min - 15u, out_data );
+}
+
+static void CompressData( const SaveLoadBuffer& data, SaveLoadBuffer& out_data )
+{
+	const unsigned char* const in= data.data();
+	const unsigned int size= data.size();
+
+	out_data.clear();
+	out_data.reserve( size + size / 255u + 16u );
+
+	// Positions of sequences, plus one. Zero means "no position".
+	unsigned int hash_table[ 1u << c_hash_table_size_log2 ];
+	std::memset( hash_table, 0, sizeof(hash_table) );
+
+	unsigned int pos= 0u;
+	unsigned int literals_start= 0u;
+	while( pos + c_min_match_length <= size )
+	{
+		uint32_t sequence;
+		std::memcpy( &sequence, in + pos, sizeof(uint32_t) );
+		const unsigned int hash= ( sequence * 2654435761u ) >> ( 32u - c_hash_table_size_log2 );
+
+		const unsigned int candidate= hash_table[ hash ];
+		hash_table[ hash ]= pos + 1u;
+
+		if( candidate != 0u &&
+			pos - ( candidate - 1u ) <= c_max_match_offset &&
+			std::memcmp( in + candidate - 1u, in + pos, c_min_match_length ) == 0 )
+		{
+			const unsigned int match_pos= candidate - 1u;
+			unsigned int match_length= c_min_match_length;
+			while( pos + match_length < size && in[ match_pos + match_length ] == in[ pos + match_length ] )
+				match_length++;
+
+			WriteCompressionBlock(
+				in + literals_start, pos - literals_start,
+				pos - match_pos, match_length,
+				out_data );
+
+			pos+= match_length;
+			literals_start= pos;
+		}
+		else
+			pos++;
+	}
+
+	WriteCompressionBlock( in + literals_start, size - literals_start, 0u, 0u, out_data );
+}
+
+static bool ReadCompressionLength(
+	const SaveLoadBuffer& compressed_data, unsigned int& pos,
+	unsigned int& in_out_length )
+{
+	unsigned char b;
+	do
+	{
+		if( pos >= compressed_data.size() )
+			return false;
+		b= compressed_data[pos];
+		pos++;
+		in_out_length+= b;
+	} while( b == 255u );
+
+	return true;
+}
+
 bool SaveData(
 	const char* file_name,
 	const SaveComment& save_comment,
-	const SaveLoadBuffer& data )
+	const unsigned int map_number,
+	const SaveLoadBuffer& data,
+	std::string& out_error )
 {
-	FILE* f= std::fopen( file_name, "wb" );
+	SaveLoadBuffer compressed_data;
+	CompressData( data, compressed_data );
+
+	const std::string temp_file_name= std::string( file_name ) + ".tmp";
+
+	FILE* f= std::fopen( temp_file_name.c_str(), "wb" );
 	if( f == nullptr )
 	{
-		Log::Warning( "Can not write save \"", file_name, "\"" );
+		out_error= "Can not write save \"" + temp_file_name + "\".";
 		return false;
 	}
 
 	SaveHeader header;
 	std::memcpy( header.id, SaveHeader::c_expected_id, sizeof(header.id) );
 	header.version= SaveHeader::c_expected_version;
-	header.content_size= data.size();
-	header.content_hash= SaveHeader::CalculateHash( data.data(), data.size() );
+	header.content_size= compressed_data.size();
+	header.content_hash= SaveHeader::CalculateHash( compressed_data.data(), compressed_data.size() );
+	header.uncompressed_content_size= data.size();
+	header.map_number= map_number;
 
 	FileWrite( f, &header, sizeof(SaveHeader) );
 	FileWrite( f, save_comment.data(), sizeof(SaveComment) );
-	FileWrite( f, data.data(), data.size() );
+	FileWrite( f, compressed_data.data(), compressed_data.size() );
+
+	const bool write_ok= std::ferror(f) == 0;
+	if( std::fclose(f) != 0 || !write_ok )
+	{
+		out_error= "Can not write save \"" + temp_file_name + "\" - write error.";
+		std::remove( temp_file_name.c_str() );
+		return false;
+	}
+
+#ifdef _WIN32
+	// "rename" on Windows does not replace existing files.
+	std::remove( file_name );
+#endif
+	if( std::rename( temp_file_name.c_str(), file_name ) != 0 )
+	{
+		out_error= "Can not replace save \"" + std::string( file_name ) + "\".";
+		std::remove( temp_file_name.c_str() );
+		return false;
+	}
 
-	std::fclose(f);
 	return true;
 }
 
 // Returns true, if all ok
-bool LoadData(
+bool LoadCompressedData(
 	const char* file_name,
-	SaveLoadBuffer& out_data )
+	SaveHeader& out_header,
+	SaveLoadBuffer& out_compressed_data )
 {
 	FILE* const f= std::fopen( file_name, "rb" );
 	if( f == nullptr )
@@ -109,7 +249,7 @@ bool LoadData(
 		return false;
 	}
 
-	SaveHeader header;
+	SaveHeader& header= out_header;
 	FileRead( f, &header, sizeof(SaveHeader) );
 
 	if( std::memcmp( header.id, header.c_expected_id, sizeof(header.id) ) != 0 )
@@ -132,16 +272,22 @@ bool LoadData(
 		std::fclose(f);
 		return false;
 	}
+	if( header.uncompressed_content_size > SaveHeader::c_max_uncompressed_content_size )
+	{
+		Log::Warning( "Save file is broken - uncompressed content size is too big." );
+		std::fclose(f);
+		return false;
+	}
 
 	SaveComment save_comment;
 	FileRead( f, save_comment.data(), sizeof(SaveComment) );
 
-	out_data.resize( content_size );
-	FileRead( f, out_data.data(), out_data.size() );
+	out_compressed_data.resize( content_size );
+	FileRead( f, out_compressed_data.data(), out_compressed_data.size() );
 
-	if( header.content_hash != SaveHeader::CalculateHash( out_data.data(), out_data.size() ) )
+	if( header.content_hash != SaveHeader::CalculateHash( out_compressed_data.data(), out_compressed_data.size() ) )
 	{
-		out_data.clear();
+		out_compressed_data.clear();
 
 		Log::Warning( "Save file is broken - saved content hash is different from actual content hash." );
 		std::fclose(f);
@@ -152,6 +298,80 @@ bool LoadData(
 	return true;
 }
 
+bool DecompressData(
+	const SaveHeader& header,
+	const SaveLoadBuffer& compressed_data,
+	SaveLoadBuffer& out_data,
+	std::string& out_error )
+{
+	const unsigned int in_size= compressed_data.size();
+	const unsigned int out_size= header.uncompressed_content_size;
+
+	// Check size again, because this function may be called without LoadCompressedData.
+	if( out_size > SaveHeader::c_max_uncompressed_content_size )
+	{
+		out_error= "Save file is broken - uncompressed content size is too big.";
+		return false;
+	}
+
+	out_data.resize( out_size );
+
+	out_error= "Save file is broken - can not decompress content.";
+
+	unsigned int in_pos= 0u;
+	unsigned int out_pos= 0u;
+	while(true)
+	{
+		if( in_pos >= in_size )
+			return false;
+
+		const unsigned char token= compressed_data[ in_pos ];
+		in_pos++;
+
+		unsigned int literals_count= token >> 4u;
+		if( literals_count == 15u && !ReadCompressionLength( compressed_data, in_pos, literals_count ) )
+			return false;
+
+		if( literals_count > in_size - in_pos || literals_count > out_size - out_pos )
+			return false;
+		std::memcpy( out_data.data() + out_pos, compressed_data.data() + in_pos, literals_count );
+		in_pos+= literals_count;
+		out_pos+= literals_count;
+
+		if( in_pos == in_size )
+			break; // Last block.
+
+		if( in_size - in_pos < 2u )
+			return false;
+		const unsigned int match_offset= compressed_data[ in_pos ] | ( compressed_data[ in_pos + 1u ] << 8u );
+		in_pos+= 2u;
+
+		unsigned int match_length= token & 15u;
+		if( match_length == 15u && !ReadCompressionLength( compressed_data, in_pos, match_length ) )
+			return false;
+		match_length+= c_min_match_length;
+
+		if( match_offset == 0u || match_offset > out_pos || match_length > out_size - out_pos )
+			return false;
+
+		// Match may overlap with itself, so, copy bytes one by one.
+		unsigned char* const dst= out_data.data() + out_pos;
+		const unsigned char* const src= dst - match_offset;
+		for( unsigned int i= 0u; i < match_length; i++ )
+			dst[i]= src[i];
+		out_pos+= match_length;
+	}
+
+	if( out_pos != out_size )
+	{
+		out_error= "Save file is broken - decompressed content size is different from saved size.";
+		return false;
+	}
+
+	out_error.clear();
+	return true;
+}
+
 bool LoadSaveComment(
 	const char* file_name,
 	SaveComment& out_save_comment )
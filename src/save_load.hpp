@@ -1,4 +1,6 @@
 #pragma once
+#include <string>
+
 #include "assert.hpp"
 #include "fwd.hpp"
 
@@ -11,30 +13,51 @@ public:
 	typedef unsigned int HashType;
 
 	static const char c_expected_id[8];
-	static constexpr unsigned int c_expected_version= 0x109u; // Change each time, when format changed.
+	static constexpr unsigned int c_expected_version= 0x10Au; // Change each time, when format changed.
 
 public:
 	static HashType CalculateHash( const unsigned char* data, unsigned int data_size );
 
+	// Uncompressed size is not covered by content hash, so, limit it before allocation of memory for decompression.
+	// Real saves are much smaller.
+	static constexpr unsigned int c_max_uncompressed_content_size= 64u * 1024u * 1024u;
+
 public:
 	unsigned char id[8]; // must be equal to c_expected_id
 	unsigned int version;
-	unsigned int content_size;
-	unsigned int content_hash;
+	unsigned int content_size; // Size of compressed content.
+	unsigned int content_hash; // Hash of compressed content.
+	unsigned int uncompressed_content_size;
+	unsigned int map_number; // Stored in header for map loading before content decompression.
 };
 
-SIZE_ASSERT( SaveHeader, 20u );
+SIZE_ASSERT( SaveHeader, 28u );
 
+// Compresses data and writes it into file.
+// Writes into temporary file first and renames it after that, so, old save is not broken if write fails.
+// Does not write log, can be called from any thread. Returns reason of failure in "out_error".
 // Returns true, if all ok
 bool SaveData(
 	const char* file_name,
 	const SaveComment& save_comment,
-	const SaveLoadBuffer& data );
+	unsigned int map_number,
+	const SaveLoadBuffer& data,
+	std::string& out_error );
 
+// Reads save file without content decompression.
 // Returns true, if all ok
-bool LoadData(
+bool LoadCompressedData(
 	const char* file_name,
-	SaveLoadBuffer& out_data );
+	SaveHeader& out_header,
+	SaveLoadBuffer& out_compressed_data );
+
+// Does not write log, can be called from any thread. Returns reason of failure in "out_error".
+// Returns true, if all ok
+bool DecompressData(
+	const SaveHeader& header,
+	const SaveLoadBuffer& compressed_data,
+	SaveLoadBuffer& out_data,
+	std::string& out_error );
 
 bool LoadSaveComment(
 	const char* file_name,
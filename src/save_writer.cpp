@@ -0,0 +1,75 @@
+#include "assert.hpp"
+#include "save_load.hpp"
+
+#include "save_writer.hpp"
+
+namespace PanzerChasm
+{
+
+// Usual saves are about 100-500 kilobytes. Reserve buffer at once for avoiding reallocations during serialization.
+static constexpr unsigned int c_initial_buffer_size= 1024u * 1024u;
+
+SaveWriter::SaveWriter()
+	: write_finished_(false)
+{}
+
+SaveWriter::~SaveWriter()
+{
+	Wait();
+}
+
+SaveLoadBuffer& SaveWriter::BeginSave()
+{
+	Wait();
+
+	buffer_.clear(); // Capacity is kept.
+	buffer_.reserve( c_initial_buffer_size );
+	return buffer_;
+}
+
+void SaveWriter::StartWrite( const char* const file_name, const SaveComment& save_comment, const unsigned int map_number )
+{
+	PC_ASSERT( !thread_.joinable() );
+	PC_ASSERT( !result_pending_ ); // Result of previous write must be taken before new write.
+
+	file_name_= file_name;
+	save_comment_= save_comment;
+	map_number_= map_number;
+
+	write_finished_.store( false );
+	result_pending_= true;
+	thread_= std::thread( &SaveWriter::WriteFunc, this );
+}
+
+bool SaveWriter::TakeFinishedWrite( bool& out_write_ok, std::string& out_error )
+{
+	if( !result_pending_ )
+		return false;
+
+	if( thread_.joinable() )
+	{
+		if( !write_finished_.load() )
+			return false;
+		thread_.join();
+	}
+
+	result_pending_= false;
+	out_write_ok= write_ok_;
+	out_error= write_error_;
+	return true;
+}
+
+void SaveWriter::Wait()
+{
+	if( thread_.joinable() )
+		thread_.join();
+}
+
+void SaveWriter::WriteFunc()
+{
+	write_error_.clear();
+	write_ok_= SaveData( file_name_.c_str(), save_comment_, map_number_, buffer_, write_error_ );
+	write_finished_.store( true );
+}
+
+} // namespace PanzerChasm
@@ -0,0 +1,48 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "fwd.hpp"
+
+namespace PanzerChasm
+{
+
+// Compresses and writes saves in background thread.
+// Save buffer is reused between saves, so, serialization does not reallocate memory in each save.
+class SaveWriter final
+{
+public:
+	SaveWriter();
+	~SaveWriter();
+
+	// Waits for previous write. Returns empty buffer for serialization of new save.
+	SaveLoadBuffer& BeginSave();
+
+	// Starts writing of buffer, returned by BeginSave.
+	// Result of previous write must be taken via TakeFinishedWrite before this call.
+	void StartWrite( const char* file_name, const SaveComment& save_comment, unsigned int map_number );
+
+	// Returns true once for each finished write. If write failed, "out_error" contains reason.
+	bool TakeFinishedWrite( bool& out_write_ok, std::string& out_error );
+
+	// Waits for current write, if it exists.
+	void Wait();
+
+private:
+	void WriteFunc();
+
+private:
+	std::thread thread_;
+	std::atomic<bool> write_finished_;
+	bool write_ok_= false;
+	std::string write_error_;
+	bool result_pending_= false;
+
+	SaveLoadBuffer buffer_;
+	std::string file_name_;
+	SaveComment save_comment_;
+	unsigned int map_number_= 0u;
+};
+
+} // namespace PanzerChasm
@@ -1,3 +1,5 @@
+#include <cstring>
+
 #include "../assert.hpp"
 
 #include "collision_index.hpp"
@@ -135,6 +137,65 @@ CollisionIndex::CollisionIndex( const MapDataConstPtr& map_data )
 CollisionIndex::~CollisionIndex()
 {}
 
+const std::vector<MapData::IndexElement>& CollisionIndex::GetElementsInRadius(
+	const m_Vec2& pos, const float radius,
+	ElementsCache& cache ) const
+{
+	const float radius_extended= radius + c_fetch_distance_eps_;
+
+	const int x_start= std::max( static_cast<int>( std::floor( pos.x - radius_extended ) ), 0 );
+	const int x_end  = std::min( static_cast<int>( std::floor( pos.x + radius_extended ) ), int(MapData::c_map_size - 1u) );
+	const int y_start= std::max( static_cast<int>( std::floor( pos.y - radius_extended ) ), 0 );
+	const int y_end  = std::min( static_cast<int>( std::floor( pos.y + radius_extended ) ), int(MapData::c_map_size - 1u) );
+
+	if( x_start == cache.x_start && x_end == cache.x_end &&
+		y_start == cache.y_start && y_end == cache.y_end )
+		return cache.elements;
+
+	cache.x_start= x_start;
+	cache.x_end= x_end;
+	cache.y_start= y_start;
+	cache.y_end= y_end;
+	cache.elements.clear();
+
+	// One bit for each possible element. Elements may be placed in many cells, process them only once.
+	constexpr unsigned int c_elements_per_type= 1u << 13u;
+	constexpr unsigned int c_max_types= 1u << 3u;
+	uint32_t processed_elements[ c_elements_per_type * c_max_types / 32u ];
+	std::memset( processed_elements, 0, sizeof(processed_elements) );
+
+	for( int y= y_start; y <= y_end; y++ )
+	for( int x= x_start; x <= x_end; x++ )
+	{
+		unsigned short i= index_field_[ x + y * int(MapData::c_map_size) ];
+		while( i != IndexElement::c_dummy_next )
+		{
+			PC_ASSERT( i <= index_elements_.size() );
+			const IndexElement& element= index_elements_[i];
+
+			const unsigned int bit= element.index_element.type * c_elements_per_type + element.index_element.index;
+			const uint32_t mask= 1u << ( bit & 31u );
+			if( ( processed_elements[ bit >> 5u ] & mask ) == 0u )
+			{
+				processed_elements[ bit >> 5u ]|= mask;
+				cache.elements.push_back( element.index_element );
+			}
+
+			i= element.next;
+		}
+	}
+
+	for( const unsigned short dynamic_model_index : dynamic_models_indeces_ )
+	{
+		MapData::IndexElement element;
+		element.type= MapData::IndexElement::StaticModel;
+		element.index= dynamic_model_index;
+		cache.elements.push_back( element );
+	}
+
+	return cache.elements;
+}
+
 void CollisionIndex::AddElementToIndex( unsigned int x, unsigned int y, const MapData::IndexElement& element )
 {
 	PC_ASSERT( x < MapData::c_map_size );
@@ -11,10 +11,28 @@ namespace PanzerChasm
 // Dynamic walls not supported.
 class CollisionIndex final
 {
+public:
+	// Unique potentially-collidable elements around some object.
+	// Stays valid while object is inside same cells neighbourhood.
+	struct ElementsCache
+	{
+		// Cells rectangle of cached elements. Invalid by default.
+		int x_start= -1, x_end= -1;
+		int y_start= -1, y_end= -1;
+
+		std::vector<MapData::IndexElement> elements;
+	};
+
 public:
 	explicit CollisionIndex( const MapDataConstPtr& map_data );
 	~CollisionIndex();
 
+	// Returns same elements as ProcessElementsInRadius, but without duplicates.
+	// Rebuilds cache only if cells rectangle of given circle is changed.
+	const std::vector<MapData::IndexElement>& GetElementsInRadius(
+		const m_Vec2& pos, float radius,
+		ElementsCache& cache ) const;
+
 	template<class Func>
 	void ProcessElementsInRadius(
 		const m_Vec2& pos, float radius,
@@ -0,0 +1,126 @@
+#pragma once
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "../assert.hpp"
+#include "../fwd.hpp"
+
+namespace PanzerChasm
+{
+
+// Dense container of entities, indexed by EntityId.
+// Values are stored contiguously, so, iteration is linear scan of array.
+// If values are pointers, pointed objects are still placed separately in memory.
+// Lookup by id uses flat table of indices, because EntityId is 16 bit.
+// Removing swaps removed entity with last entity, so, order of entities is not stable.
+// Any insertion or removal invalidates iterators.
+template<class T>
+class EntitiesContainer final
+{
+public:
+	typedef std::pair<EntityId, T> value_type;
+	typedef typename std::vector<value_type>::iterator iterator;
+	typedef typename std::vector<value_type>::const_iterator const_iterator;
+
+public:
+	EntitiesContainer();
+
+	iterator begin() { return entities_.begin(); }
+	iterator end() { return entities_.end(); }
+	const_iterator begin() const { return entities_.begin(); }
+	const_iterator end() const { return entities_.end(); }
+
+	size_t size() const { return entities_.size(); }
+	bool empty() const { return entities_.empty(); }
+
+	iterator find( EntityId id );
+	const_iterator find( EntityId id ) const;
+
+	// Returns iterator to existing entity and false, if entity with same id already exists.
+	std::pair<iterator, bool> emplace( EntityId id, const T& value );
+
+	// Inserts default value, if entity does not exist.
+	T& operator[]( EntityId id );
+
+	// Returns number of removed entities.
+	size_t erase( EntityId id );
+	void clear();
+
+private:
+	typedef uint16_t IndexType;
+	static constexpr IndexType c_invalid_index= 0xFFFFu;
+	static constexpr unsigned int c_max_entities= 1u << ( sizeof(EntityId) * 8u );
+
+private:
+	std::vector<value_type> entities_;
+	std::vector<IndexType> indices_; // Index of entity in "entities_" for each id.
+};
+
+template<class T>
+EntitiesContainer<T>::EntitiesContainer()
+	: indices_( c_max_entities, IndexType(c_invalid_index) )
+{}
+
+template<class T>
+typename EntitiesContainer<T>::iterator EntitiesContainer<T>::find( const EntityId id )
+{
+	const IndexType index= indices_[id];
+	return index == c_invalid_index ? entities_.end() : entities_.begin() + index;
+}
+
+template<class T>
+typename EntitiesContainer<T>::const_iterator EntitiesContainer<T>::find( const EntityId id ) const
+{
+	const IndexType index= indices_[id];
+	return index == c_invalid_index ? entities_.end() : entities_.begin() + index;
+}
+
+template<class T>
+std::pair<typename EntitiesContainer<T>::iterator, bool> EntitiesContainer<T>::emplace( const EntityId id, const T& value )
+{
+	const IndexType index= indices_[id];
+	if( index != c_invalid_index )
+		return std::make_pair( entities_.begin() + index, false );
+
+	// Last index is reserved for invalid index.
+	PC_ASSERT( entities_.size() < size_t(c_invalid_index) );
+
+	indices_[id]= static_cast<IndexType>( entities_.size() );
+	entities_.emplace_back( id, value );
+	return std::make_pair( entities_.end() - 1, true );
+}
+
+template<class T>
+T& EntitiesContainer<T>::operator[]( const EntityId id )
+{
+	return emplace( id, T() ).first->second;
+}
+
+template<class T>
+size_t EntitiesContainer<T>::erase( const EntityId id )
+{
+	const IndexType index= indices_[id];
+	if( index == c_invalid_index )
+		return 0u;
+
+	if( index + 1u != entities_.size() )
+	{
+		entities_[index]= std::move( entities_.back() );
+		indices_[ entities_[index].first ]= index;
+	}
+	entities_.pop_back();
+	indices_[id]= c_invalid_index;
+
+	return 1u;
+}
+
+template<class T>
+void EntitiesContainer<T>::clear()
+{
+	for( const value_type& value : entities_ )
+		indices_[ value.first ]= c_invalid_index;
+	entities_.clear();
+}
+
+} // namespace PanzerChasm
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstring>
 
 #include <matrix.hpp>
@@ -5,6 +6,7 @@
 #include "../game_constants.hpp"
 #include "../math_utils.hpp"
 #include "../particles.hpp"
+#include "../profiler.hpp"
 #include "../sound/sound_id.hpp"
 #include "a_code.hpp"
 #include "collisions.hpp"
@@ -108,9 +110,6 @@ Map::Map(
 
 	unsigned int difficulty_mask= static_cast<unsigned int>( difficulty_ );
 
-	std::memset( wind_field_, 0, sizeof(wind_field_) );
-	std::memset( death_field_, 0, sizeof(death_field_) );
-
 	procedures_.resize( map_data_->procedures.size() );
 	for( unsigned int p= 0u; p < procedures_.size(); p++ )
 	{
@@ -171,6 +170,8 @@ Map::Map(
 		}
 	}
 
+	BuildProceduresObjectsLinks();
+
 	items_.resize( map_data_->items.size() );
 	for( unsigned int i= 0u; i < items_.size(); i++ )
 	{
@@ -214,23 +215,7 @@ Map::Map(
 			if( ( map_monster.difficulty_flags & difficulty_mask ) == 0u )
 				continue;
 
-			const EntityId& monster_id= GetNextMonsterId();
-			const MonsterBasePtr& monster=
-				monsters_[ monster_id ]=
-					MonsterPtr(
-						new Monster(
-							map_monster,
-							GetFloorLevel( map_monster.pos ),
-							game_resources_,
-							random_generator_,
-							map_start_time ) );
-
-			monsters_birth_messages_.emplace_back();
-			Messages::MonsterBirth& message= monsters_birth_messages_.back();
-
-			monster->BuildStateMessage( message.initial_state );
-			message.initial_state.monster_id= monster_id;
-			message.monster_id= monster_id;
+			SpawnMonster( map_monster, map_start_time );
 		}
 	}
 }
@@ -316,6 +301,7 @@ void Map::DespawnPlayer( const EntityId player_id )
 {
 	const bool erased= players_.erase( player_id ) != 0u;
 	monsters_.erase( player_id );
+	monsters_collision_caches_.erase( player_id );
 
 	if( erased )
 	{
@@ -325,6 +311,48 @@ void Map::DespawnPlayer( const EntityId player_id )
 	}
 }
 
+EntityId Map::SpawnMonster( const MapData::Monster& map_monster, const Time current_time )
+{
+	PC_ASSERT( map_monster.monster_id != 0u );
+
+	const EntityId monster_id= GetNextMonsterId();
+	const MonsterBasePtr& monster=
+		monsters_[ monster_id ]=
+			MonsterPtr(
+				new Monster(
+					map_monster,
+					GetFloorLevel( map_monster.pos ),
+					game_resources_,
+					random_generator_,
+					current_time ) );
+
+	monsters_birth_messages_.emplace_back();
+	Messages::MonsterBirth& message= monsters_birth_messages_.back();
+
+	monster->BuildStateMessage( message.initial_state );
+	message.initial_state.monster_id= monster_id;
+	message.monster_id= monster_id;
+
+	return monster_id;
+}
+
+void Map::SetRandomSeed( const LongRand::RandResultType seed )
+{
+	random_generator_->SetInnerState( seed );
+}
+
+void Map::SetTickStats( TickStats* const tick_stats )
+{
+	tick_stats_= tick_stats;
+}
+
+void Map::SetLagCompensationMaxTime( const Time max_time )
+{
+	lag_compensation_max_time_= max_time;
+	if( !IsLagCompensationEnabled() )
+		monsters_positions_history_.Clear();
+}
+
 void Map::Shoot(
 	const EntityId owner_id,
 	const unsigned int rocket_id,
@@ -457,9 +485,94 @@ void Map::AddTextMessage( const char* const text )
 		text_message_callback_( text );
 }
 
+void Map::GetDynamicWallsGridRect(
+	const m_Vec2& p0, const m_Vec2& p1,
+	int& out_x_start, int& out_x_end, int& out_y_start, int& out_y_end )
+{
+	constexpr float c_eps= 0.1f;
+	const int shift= int(DynamicWallsGrid::c_cell_size_log2);
+	const int max_cell= int(DynamicWallsGrid::c_size - 1u);
+
+	// Clamp before conversion to integer, because coordinates may be very large.
+	const auto to_cell=
+	[&]( const float coord ) -> int
+	{
+		const float clamped= std::max( 0.0f, std::min( coord, float(MapData::c_map_size) ) );
+		return std::min( static_cast<int>(clamped) >> shift, max_cell );
+	};
+
+	out_x_start= to_cell( std::min( p0.x, p1.x ) - c_eps );
+	out_x_end  = to_cell( std::max( p0.x, p1.x ) + c_eps );
+	out_y_start= to_cell( std::min( p0.y, p1.y ) - c_eps );
+	out_y_end  = to_cell( std::max( p0.y, p1.y ) + c_eps );
+}
+
+bool Map::IsCollidableDynamicWall( const DynamicWall& wall ) const
+{
+	if( wall.vert_pos[0] == wall.vert_pos[1] )
+		return false;
+
+	const MapData::WallTextureDescription& tex= map_data_->walls_textures[ wall.texture_id ];
+	if( tex.gso[0] )
+		return false;
+
+	// PROCESS.05:
+	// ;  up            [ x,y] [ H]   [s:num]     ,if H>=80 then walktrough
+	if( wall.z >= 80.0f / 64.0f )
+		return false;
+
+	return true;
+}
+
+void Map::BuildDynamicWallsGrid()
+{
+	DynamicWallsGrid& grid= dynamic_walls_grid_;
+	constexpr unsigned int c_cell_count= DynamicWallsGrid::c_size * DynamicWallsGrid::c_size;
+
+	// Count walls in each cell, than place walls, using counters as offsets.
+	std::memset( grid.cells_offsets, 0, sizeof(grid.cells_offsets) );
+	for( const DynamicWall& wall : dynamic_walls_ )
+	{
+		if( !IsCollidableDynamicWall( wall ) )
+			continue;
+
+		int x_start, x_end, y_start, y_end;
+		GetDynamicWallsGridRect( wall.vert_pos[0], wall.vert_pos[1], x_start, x_end, y_start, y_end );
+		for( int y= y_start; y <= y_end; y++ )
+		for( int x= x_start; x <= x_end; x++ )
+			grid.cells_offsets[ x + y * int(DynamicWallsGrid::c_size) + 1 ]++;
+	}
+
+	for( unsigned int i= 0u; i < c_cell_count; i++ )
+		grid.cells_offsets[ i + 1u ]+= grid.cells_offsets[i];
+
+	grid.walls_indeces.resize( grid.cells_offsets[ c_cell_count ] );
+
+	unsigned int cells_fill_pos[ c_cell_count ];
+	std::memcpy( cells_fill_pos, grid.cells_offsets, sizeof(cells_fill_pos) );
+
+	for( unsigned int w= 0u; w < dynamic_walls_.size(); w++ )
+	{
+		const DynamicWall& wall= dynamic_walls_[w];
+		if( !IsCollidableDynamicWall( wall ) )
+			continue;
+
+		int x_start, x_end, y_start, y_end;
+		GetDynamicWallsGridRect( wall.vert_pos[0], wall.vert_pos[1], x_start, x_end, y_start, y_end );
+		for( int y= y_start; y <= y_end; y++ )
+		for( int x= x_start; x <= x_end; x++ )
+		{
+			unsigned int& pos= cells_fill_pos[ x + y * int(DynamicWallsGrid::c_size) ];
+			grid.walls_indeces[ pos ]= static_cast<unsigned short>(w);
+			pos++;
+		}
+	}
+}
+
 m_Vec3 Map::CollideWithMap(
 	const m_Vec3 in_pos, const float height, const float radius,
 	const Time tick_delta,
+	CollisionIndex::ElementsCache& elements_cache,
 	bool& out_on_floor, MovementRestriction& out_movement_restriction ) const
 {
 	m_Vec2 pos= in_pos.xy();
@@ -469,34 +582,10 @@ m_Vec3 Map::CollideWithMap(
 	const float z_top= z_bottom + height;
 	float new_z= in_pos.z;
 
-	// Store list of objects, collisions with which alread processed.
-	constexpr unsigned int c_max_collisions= 32u;
-	MapData::IndexElement processed_collisions[ c_max_collisions ];
-	unsigned int processed_collisions_count= 0u;
-	const auto collision_processed=
-	[&]( const MapData::IndexElement& index_element )
-	{
-		if( processed_collisions_count == c_max_collisions )
-			return true;
-		for( unsigned int i= 0u; i < processed_collisions_count; i++ )
-			if( std::memcmp( &processed_collisions[i], &index_element, sizeof(MapData::IndexElement) ) == 0 )
-				return true;
-		return false;
-	};
-	const auto process_collision=
-	[&]( const MapData::IndexElement& index_element )
-	{
-		PC_ASSERT( processed_collisions_count < c_max_collisions );
-		processed_collisions[ processed_collisions_count ]= index_element;
-		processed_collisions_count++;
-	};
-
-	const auto elements_process_func=
-	[&]( const MapData::IndexElement& index_element )
+	// Cached elements are unique, so, each element is processed only once.
+	const std::vector<MapData::IndexElement>& elements= collision_index_.GetElementsInRadius( pos, radius, elements_cache );
+	for( const MapData::IndexElement& index_element : elements )
 	{
-		if( collision_processed(index_element) )
-			return;
-
 		if( index_element.type == MapData::IndexElement::StaticWall )
 		{
 			PC_ASSERT( index_element.index < map_data_->static_walls.size() );
@@ -504,12 +593,12 @@ m_Vec3 Map::CollideWithMap(
 
 			const MapData::WallTextureDescription& tex= map_data_->walls_textures[ wall.texture_id ];
 			if( tex.gso[0] )
-				return;
+				continue;
 
 			// Do not collide with wall, if we are behind it. But collide, if wall is transparent.
 			if( wall.texture_id < MapData::c_first_transparent_texture_id &&
 				mVec2Cross( pos - wall.vert_pos[0], wall.vert_pos[1] - wall.vert_pos[0] ) > 0.0f )
-				return;
+				continue;
 
 			m_Vec2 new_pos;
 			if( CollideCircleWithLineSegment(
@@ -517,7 +606,6 @@ m_Vec3 Map::CollideWithMap(
 					pos, radius,
 					new_pos ) )
 			{
-				process_collision( index_element );
 				pos= new_pos;
 				out_movement_restriction.AddRestriction( GetNormalForWall( wall ).xy() );
 			}
@@ -526,22 +614,22 @@ m_Vec3 Map::CollideWithMap(
 		{
 			const StaticModel& model= static_models_[ index_element.index ];
 			if( model.model_id >= map_data_->models_description.size() )
-				return;
+				continue;
 
 			const MapData::ModelDescription& model_description= map_data_->models_description[ model.model_id ];
 			if( model_description.radius <= 0.0f )
-				return;
+				continue;
 
 			const ACode a_code= static_cast<ACode>( model_description.ac );
 			if( a_code >= ACode::RedKey && a_code <= ACode::BlueKey )
-				return; // Skip keys
+				continue; // Skip keys
 
 			const Model& model_geometry= map_data_->models[ model.model_id ];
 
 			const float model_z_min= model_geometry.z_min + model.pos.z;
 			const float model_z_max= model_geometry.z_max + model.pos.z;
 			if( z_top < model_z_min || z_bottom > model_z_max )
-				return;
+				continue;
 
 			bool collided= false;
 
@@ -568,7 +656,6 @@ m_Vec3 Map::CollideWithMap(
 
 			if( collided )
 			{
-				process_collision( index_element );
 				// Pull up or down player.
 				if( model_z_max - z_bottom <= GameConstants::z_pull_distance &&
 					model_z_max + height <= GameConstants::walls_height )
@@ -607,34 +694,19 @@ m_Vec3 Map::CollideWithMap(
 		{
 			// TODO
 		}
-	};
-
-	collision_index_.ProcessElementsInRadius(
-		pos, radius,
-		elements_process_func );
+	}
 
-	// Dynamic walls
-	for( const DynamicWall& wall : dynamic_walls_ )
+	// Dynamic walls.
+	const auto collide_with_dynamic_wall=
+	[&]( const DynamicWall& wall )
 	{
-		if( wall.vert_pos[0] == wall.vert_pos[1] )
-			continue;
-
-		const MapData::WallTextureDescription& tex= map_data_->walls_textures[ wall.texture_id ];
-		if( tex.gso[0] )
-			continue;
-
-		// PROCESS.05:
-		// ;  up            [ x,y] [ H]   [s:num]     ,if H>=80 then walktrough
-		if( wall.z >= 80.0f / 64.0f )
-			continue;
-
 		if( z_top < wall.z || z_bottom > wall.z + GameConstants::walls_height )
-			continue;
+			return;
 
 		// Do not collide with wall, if we are behind it. But collide, if wall is transparent.
 		if( wall.texture_id < MapData::c_first_transparent_texture_id &&
 			mVec2Cross( pos - wall.vert_pos[0], wall.vert_pos[1] - wall.vert_pos[0] ) > 0.0f )
-			continue;
+			return;
 
 		m_Vec2 new_pos;
 		if( CollideCircleWithLineSegment(
@@ -645,6 +717,61 @@ m_Vec3 Map::CollideWithMap(
 			pos= new_pos;
 			out_movement_restriction.AddRestriction( GetNormalForWall( wall ).xy() );
 		}
+	};
+
+	// Collisions with previous walls may push us up to radius, so, fetch walls in doubled radius.
+	int grid_x_start, grid_x_end, grid_y_start, grid_y_end;
+	GetDynamicWallsGridRect(
+		pos - m_Vec2( radius, radius ) * 2.0f, pos + m_Vec2( radius, radius ) * 2.0f,
+		grid_x_start, grid_x_end, grid_y_start, grid_y_end );
+
+	// Collect candidates and sort them, because walls must be processed in same order, as in map.
+	constexpr unsigned int c_max_candidate_walls= 64u;
+	unsigned short candidate_walls[ c_max_candidate_walls ];
+	unsigned int candidate_wall_count= 0u;
+	bool too_many_candidates= false;
+
+	for( int y= grid_y_start; y <= grid_y_end; y++ )
+	for( int x= grid_x_start; x <= grid_x_end; x++ )
+	{
+		const unsigned int cell= static_cast<unsigned int>( x + y * int(DynamicWallsGrid::c_size) );
+		for( unsigned int i= dynamic_walls_grid_.cells_offsets[ cell ]; i < dynamic_walls_grid_.cells_offsets[ cell + 1u ]; i++ )
+		{
+			const unsigned short wall_index= dynamic_walls_grid_.walls_indeces[i];
+			const DynamicWall& wall= dynamic_walls_[ wall_index ];
+
+			// Wall may be placed in many cells. Take it only in first cell of intersection of wall and fetch rectangles.
+			int wall_x_start, wall_x_end, wall_y_start, wall_y_end;
+			GetDynamicWallsGridRect(
+				wall.vert_pos[0], wall.vert_pos[1],
+				wall_x_start, wall_x_end, wall_y_start, wall_y_end );
+			if( x != std::max( grid_x_start, wall_x_start ) || y != std::max( grid_y_start, wall_y_start ) )
+				continue;
+
+			if( candidate_wall_count < c_max_candidate_walls )
+			{
+				candidate_walls[ candidate_wall_count ]= wall_index;
+				candidate_wall_count++;
+			}
+			else
+				too_many_candidates= true;
+		}
+	}
+
+	if( too_many_candidates )
+	{
+		// Rare case - process all walls.
+		for( const DynamicWall& wall : dynamic_walls_ )
+		{
+			if( IsCollidableDynamicWall( wall ) )
+				collide_with_dynamic_wall( wall );
+		}
+	}
+	else
+	{
+		std::sort( candidate_walls, candidate_walls + candidate_wall_count );
+		for( unsigned int i= 0u; i < candidate_wall_count; i++ )
+			collide_with_dynamic_wall( dynamic_walls_[ candidate_walls[i] ] );
 	}
 
 	if( new_z <= 0.0f )
@@ -1058,6 +1185,8 @@ void Map::ProcessPlayerPosition(
 
 void Map::Tick( const Time current_time, const Time last_tick_delta )
 {
+	PC_PROFILER_ZONE( "Map::Tick" );
+
 	const Time prev_tick_time= current_time - last_tick_delta;
 	const unsigned int death_ticks=
 		static_cast<unsigned int>( GameConstants::death_ticks_per_second * current_time  .ToSeconds() ) -
@@ -1065,90 +1194,39 @@ void Map::Tick( const Time current_time, const Time last_tick_delta )
 
 	const float last_tick_delta_s= last_tick_delta.ToSeconds();
 
-	// Update state of procedures
-	for( unsigned int p= 0u; p < procedures_.size(); p++ )
+	// Measure phases only if someone collects stats.
+	Time phase_start_time= tick_stats_ != nullptr ? Time::CurrentTime() : Time::FromSeconds(0);
+	const auto end_phase=
+	[&]( Time TickStats::* const phase )
 	{
-		const MapData::Procedure& procedure= map_data_->procedures[p];
-		ProcedureState& procedure_state= procedures_[p];
-
-		const Time time_since_last_state_change= current_time - procedure_state.last_state_change_time;
-		const float new_stage=
-			procedure.speed > 0.0f
-				? ( time_since_last_state_change.ToSeconds() * procedure.speed * GameConstants::procedures_speed_scale )
-				: 1.0f;
-
-		// Check map end
-		if( procedure_state.movement_state != ProcedureState::MovementState::None &&
-			procedure.end_delay_s > 0.0f &&
-			time_since_last_state_change.ToSeconds() >= procedure.end_delay_s )
-			map_end_triggered_= true;
+		if( tick_stats_ == nullptr )
+			return;
+		const Time phase_end_time= Time::CurrentTime();
+		tick_stats_->*phase+= phase_end_time - phase_start_time;
+		phase_start_time= phase_end_time;
+	};
 
-		switch( procedure_state.movement_state )
+	// Wake up waiting procedures.
+	procedures_timers_.PopExpired(
+		current_time,
+		[&]( const unsigned int procedure_number )
 		{
-		case ProcedureState::MovementState::None:
-			break;
-
-		case ProcedureState::MovementState::StartWait:
-			if( time_since_last_state_change.ToSeconds() >= procedure.start_delay_s )
-			{
-				ActivateProcedureSwitches( procedure, true, current_time );
-				DoProcedureImmediateCommands( procedure, current_time );
-				EmitProcedureSound( procedure );
-				procedure_state.movement_state= ProcedureState::MovementState::Movement;
-				procedure_state.movement_stage= 0.0f;
-				procedure_state.last_state_change_time= current_time;
-			}
-			else
-				procedure_state.movement_stage= new_stage;
-			break;
-
-		case ProcedureState::MovementState::Movement:
-			if( new_stage >= 1.0f )
-			{
-				// TODO - do it at the end of movement?
-				// Maybe, do this at end of reverse-movement?
-				DoProcedureDeactivationCommands( procedure );
+			AddActiveProcedure( procedure_number );
+		} );
 
-				procedure_state.movement_state= ProcedureState::MovementState::BackWait;
-				procedure_state.movement_stage= 0.0f;
-				procedure_state.last_state_change_time= current_time;
-			}
-			else
-				procedure_state.movement_stage= new_stage;
+	// Update state of active procedures.
+	// Procedures may activate other procedures. Process activated procedures in this tick, if they are after current procedure.
+	for( unsigned int p= 0u; ; p++ )
+	{
+		const auto it= std::lower_bound( active_procedures_.begin(), active_procedures_.end(), p );
+		if( it == active_procedures_.end() )
 			break;
 
-		case ProcedureState::MovementState::BackWait:
-		{
-			const Time wait_time= current_time - procedure_state.last_state_change_time;
-			if(
-				procedure.back_wait_s > 0.0f &&
-				wait_time.ToSeconds() >= procedure.back_wait_s )
-			{
-				ActivateProcedureSwitches( procedure, false, current_time );
-				DeactivateProcedureLightSources( procedure );
-				procedure_state.movement_state= ProcedureState::MovementState::ReverseMovement;
-				procedure_state.movement_stage= 0.0f;
-				procedure_state.last_state_change_time= current_time;
-			}
-		}
-			break;
+		p= *it;
+		ProcessProcedure( p, current_time );
+	}
 
-		case ProcedureState::MovementState::ReverseMovement:
-			// Emit reverse movement sound if we really start move and not blocked by player.
-			if( procedure_state.movement_stage <= 0.01f && new_stage > 0.01f )
-				EmitProcedureSound( procedure );
-
-			if( new_stage >= 1.0f )
-			{
-				procedure_state.movement_state= ProcedureState::MovementState::None;
-				procedure_state.movement_stage= 0.0f;
-				procedure_state.last_state_change_time= current_time;
-			}
-			else
-				procedure_state.movement_stage= new_stage;
-			break;
-		}; // switch state
-	} // for procedures
+	end_phase( &TickStats::procedures );
 
 	MoveMapObjects( current_time );
 
@@ -1218,7 +1296,13 @@ void Map::Tick( const Time current_time, const Time last_tick_delta )
 			model.current_animation_frame= model.animation_start_frame;
 	} // for static models
 
+	end_phase( &TickStats::map_objects );
+
 	// Process shots
+	// Monsters do not move while shots are processed, so, collect their positions once.
+	if( !rockets_.empty() )
+		CollectMonstersShotCylinders( monsters_shot_cylinders_, current_time );
+
 	for( unsigned int r= 0u; r < rockets_.size(); )
 	{
 		Rocket& rocket= rockets_[r];
@@ -1230,7 +1314,10 @@ void Map::Tick( const Time current_time, const Time last_tick_delta )
 		HitResult hit_result;
 
 		if( has_infinite_speed )
-			hit_result= ProcessShot( rocket.start_point, rocket.normalized_direction, Constants::max_float, rocket.owner_id );
+			hit_result=
+				ProcessShot(
+					rocket.start_point, rocket.normalized_direction, Constants::max_float, rocket.owner_id,
+					GetLagCompensationFrame( rocket.owner_id, current_time ) );
 		else
 		{
 			const float c_length_eps= 1.0f / 64.0f;
@@ -1576,6 +1663,8 @@ void Map::Tick( const Time current_time, const Time last_tick_delta )
 			m++;
 	}
 
+	end_phase( &TickStats::rockets );
+
 	// Process monsters
 	for( MonstersContainer::value_type& monster_value : monsters_ )
 	{
@@ -1619,15 +1708,19 @@ void Map::Tick( const Time current_time, const Time last_tick_delta )
 		// TODO - select more correct way to do this.
 		const int wind_x= static_cast<int>( monster.Position().x - 0.5f );
 		const int wind_y= static_cast<int>( monster.Position().y - 0.5f );
-		if( wind_x >= 0 && wind_x < int(MapData::c_map_size - 1u) &&
-			wind_y >= 0 && wind_y < int(MapData::c_map_size - 1u) )
+		if( !wind_field_.IsEmpty() &&
+			wind_x >= 0 && wind_x < int(MapData::c_map_size - 1u) &&
+			wind_y >= 0 && wind_y < int(MapData::c_map_size - 1u) &&
+			wind_field_.HasNonemptyCells( wind_x, wind_y, wind_x + 1, wind_y + 1 ) )
 		{
 			// Find interpolated value of wind in 4 cells, nearest to monster center.
 			const auto wind_fetch=
 			[&]( int x, int y )
 			{
-				const char* const wind_cell= wind_field_[ x + y * int(MapData::c_map_size) ];
-				return m_Vec2( wind_cell[0], wind_cell[1] );
+				const WindCell* const wind_cell= wind_field_.Get( x, y );
+				if( wind_cell == nullptr )
+					return m_Vec2( 0.0f, 0.0f );
+				return m_Vec2( wind_cell->dir[0], wind_cell->dir[1] );
 			};
 			const float dx= monster.Position().x - 0.5f - float(wind_x);
 			const float dy= monster.Position().y - 0.5f - float(wind_y);
@@ -1652,28 +1745,32 @@ void Map::Tick( const Time current_time, const Time last_tick_delta )
 		// TODO - make death zone intersection calculation correct, like with wind zones.
 		const int monster_x= static_cast<int>( monster.Position().x );
 		const int monster_y= static_cast<int>( monster.Position().y );
-		if( monster_x >= 0 && monster_x < int(MapData::c_map_size) &&
+		if( !death_field_.IsEmpty() && death_ticks > 0u &&
+			monster_x >= 0 && monster_x < int(MapData::c_map_size) &&
 			monster_y >= 0 && monster_y < int(MapData::c_map_size) )
 		{
-			const DamageFiledCell& cell= death_field_[ monster_x + monster_y * int(MapData::c_map_size) ];
-			if( cell.damage > 0u && death_ticks > 0u )
+			const DamageFiledCell* const cell= death_field_.Get( monster_x, monster_y );
+			if( cell != nullptr )
 			{
 				// It looks, like damage field with "z_bottom" == -1 does not damage players.
-				if( monster.MonsterId() == 0u && cell.z_bottom < 0 )
+				if( monster.MonsterId() == 0u && cell->z_bottom < 0 )
 					continue;
 
 				// TODO - select correct monster height
-				if( !( monster.Position().z > float(cell.z_top) / 64u ||
-					   monster.Position().z + GameConstants::player_height < float(cell.z_bottom) / 64u ) )
+				if( !( monster.Position().z > float(cell->z_top) / 64u ||
+					   monster.Position().z + GameConstants::player_height < float(cell->z_bottom) / 64u ) )
 					monster.Hit(
-						int( cell.damage * death_ticks ), m_Vec2( 0.0f, 0.0f ), 0u,
+						int( cell->damage * death_ticks ), m_Vec2( 0.0f, 0.0f ), 0u,
 						*this,
 						monster_value.first, current_time );
 			}
 		}
 	}
 
+	end_phase( &TickStats::monsters );
+
 	// Collide monsters with map
+	BuildDynamicWallsGrid();
 	for( MonstersContainer::value_type& monster_value : monsters_ )
 	{
 		MonsterBase& monster= *monster_value.second;
@@ -1696,6 +1793,7 @@ void Map::Tick( const Time current_time, const Time last_tick_delta )
 		const m_Vec3 new_monster_pos=
 			CollideWithMap(
 				old_monster_pos, height, radius, last_tick_delta,
+				monsters_collision_caches_[ monster_value.first ],
 				on_floor, movement_restriction );
 
 		const m_Vec3 position_delta= new_monster_pos - old_monster_pos;
@@ -1890,6 +1988,12 @@ void Map::Tick( const Time current_time, const Time last_tick_delta )
 		}
 	}
 
+	end_phase( &TickStats::collisions );
+
+	// Remember positions, which clients will see after this tick.
+	if( IsLagCompensationEnabled() )
+		CollectMonstersShotCylinders( monsters_positions_history_.BeginFrame( current_time ), current_time );
+
 	// Process backpacks
 	for( auto& backpack_value : backpacks_ )
 	{
@@ -1901,8 +2005,9 @@ void Map::Tick( const Time current_time, const Time last_tick_delta )
 	}
 
 	// Process rotating lights.
-	for( StaticModel& model : static_models_ )
+	for( const unsigned short m : rotating_light_models_ )
 	{
+		StaticModel& model= static_models_[m];
 		if( model.linked_rotating_light != nullptr )
 		{
 			if( current_time >= model.linked_rotating_light->end_time )
@@ -1910,13 +2015,21 @@ void Map::Tick( const Time current_time, const Time last_tick_delta )
 				// Kill expired rotating light source.
 				rotating_light_sources_death_messages_.emplace_back();
 				Messages::RotatingLightSourceDeath& message= rotating_light_sources_death_messages_.back();
-				message.light_source_id= &model - static_models_.data();
+				message.light_source_id= m;
 
 				model.linked_rotating_light= nullptr;
+
+				// Return model to its normal angle.
+				MapData::IndexElement object;
+				object.type= MapData::IndexElement::StaticModel;
+				object.index= m;
+				MarkObjectForMove( object );
 			}
 		}
 	}
 
+	end_phase( &TickStats::map_objects );
+
 	// At end of this procedure, report about map change, if this needed.
 	// Do it here, because map can be desctructed at callback call.
 	if( game_rules_ != GameRules::Deathmatch &&
@@ -2129,6 +2242,77 @@ void Map::ClearUpdateEvents()
 	monsters_sounds_messages_.clear();
 }
 
+void Map::BuildProceduresObjectsLinks()
+{
+	procedures_objects_.clear();
+	dynamic_walls_move_commands_.clear();
+	static_models_move_commands_.clear();
+	rotating_light_models_.clear();
+
+	procedures_objects_.resize( procedures_.size() );
+	dynamic_walls_move_commands_.resize( dynamic_walls_.size() );
+	static_models_move_commands_.resize( static_models_.size() );
+
+	std::vector<bool> rotating_light_models_flags( static_models_.size(), false );
+
+	for( unsigned int p= 0u; p < procedures_.size(); p++ )
+	{
+		const std::vector<MapData::Procedure::ActionCommand>& action_commands= map_data_->procedures[p].action_commands;
+		for( unsigned int c= 0u; c < action_commands.size(); c++ )
+		{
+			const MapData::Procedure::ActionCommand& command= action_commands[c];
+
+			using Action= MapData::Procedure::ActionCommandId;
+			const bool is_move_command=
+				command.id == Action::Move || command.id == Action::XMove || command.id == Action::YMove ||
+				command.id == Action::Rotate || command.id == Action::Up;
+			if( !( is_move_command || command.id == Action::Light ) )
+				continue;
+
+			const unsigned int x= static_cast<unsigned int>(command.args[0]);
+			const unsigned int y= static_cast<unsigned int>(command.args[1]);
+			if( x >= MapData::c_map_size || y >= MapData::c_map_size )
+				continue;
+
+			const MapData::IndexElement& index_element= map_data_->map_index[ x + y * MapData::c_map_size ];
+
+			if( command.id == Action::Light )
+			{
+				if( index_element.type == MapData::IndexElement::StaticModel && index_element.index < static_models_.size() &&
+					!rotating_light_models_flags[ index_element.index ] )
+				{
+					rotating_light_models_flags[ index_element.index ]= true;
+					rotating_light_models_.push_back( index_element.index );
+				}
+				continue;
+			}
+
+			std::vector<ObjectMoveCommand>* object_commands;
+			if( index_element.type == MapData::IndexElement::DynamicWall && index_element.index < dynamic_walls_.size() )
+				object_commands= &dynamic_walls_move_commands_[ index_element.index ];
+			else if( index_element.type == MapData::IndexElement::StaticModel && index_element.index < static_models_.size() )
+				object_commands= &static_models_move_commands_[ index_element.index ];
+			else
+				continue;
+
+			// Procedure may have many commands for one object.
+			if( object_commands->empty() || object_commands->back().procedure_number != p )
+				procedures_objects_[p].push_back( index_element );
+
+			ObjectMoveCommand move_command;
+			move_command.procedure_number= static_cast<unsigned short>(p);
+			move_command.command_index= static_cast<unsigned short>(c);
+			object_commands->push_back( move_command );
+		}
+	}
+
+	// Keep models order, like in loop over all models.
+	std::sort( rotating_light_models_.begin(), rotating_light_models_.end() );
+
+	dynamic_walls_move_flags_.resize( dynamic_walls_.size(), false );
+	static_models_move_flags_.resize( static_models_.size(), false );
+}
+
 void Map::ActivateProcedure( const unsigned int procedure_number, const Time current_time )
 {
 	ProcedureState& procedure_state= procedures_[ procedure_number ];
@@ -2136,6 +2320,172 @@ void Map::ActivateProcedure( const unsigned int procedure_number, const Time cur
 	procedure_state.movement_stage= 0.0f;
 	procedure_state.movement_state= ProcedureState::MovementState::StartWait;
 	procedure_state.last_state_change_time= current_time;
+
+	OnProcedureStateChanged( procedure_number, current_time );
+}
+
+void Map::ProcessProcedure( const unsigned int procedure_number, const Time current_time )
+{
+	const MapData::Procedure& procedure= map_data_->procedures[ procedure_number ];
+	ProcedureState& procedure_state= procedures_[ procedure_number ];
+	const ProcedureState::MovementState prev_movement_state= procedure_state.movement_state;
+
+	const Time time_since_last_state_change= current_time - procedure_state.last_state_change_time;
+	const float new_stage=
+		procedure.speed > 0.0f
+			? ( time_since_last_state_change.ToSeconds() * procedure.speed * GameConstants::procedures_speed_scale )
+			: 1.0f;
+
+	// Check map end
+	if( procedure_state.movement_state != ProcedureState::MovementState::None &&
+		procedure.end_delay_s > 0.0f &&
+		time_since_last_state_change.ToSeconds() >= procedure.end_delay_s )
+		map_end_triggered_= true;
+
+	switch( procedure_state.movement_state )
+	{
+	case ProcedureState::MovementState::None:
+		break;
+
+	case ProcedureState::MovementState::StartWait:
+		if( time_since_last_state_change.ToSeconds() >= procedure.start_delay_s )
+		{
+			ActivateProcedureSwitches( procedure, true, current_time );
+			DoProcedureImmediateCommands( procedure, current_time );
+			EmitProcedureSound( procedure );
+			procedure_state.movement_state= ProcedureState::MovementState::Movement;
+			procedure_state.movement_stage= 0.0f;
+			procedure_state.last_state_change_time= current_time;
+		}
+		else
+			procedure_state.movement_stage= new_stage;
+		break;
+
+	case ProcedureState::MovementState::Movement:
+		if( new_stage >= 1.0f )
+		{
+			// TODO - do it at the end of movement?
+			// Maybe, do this at end of reverse-movement?
+			DoProcedureDeactivationCommands( procedure );
+
+			procedure_state.movement_state= ProcedureState::MovementState::BackWait;
+			procedure_state.movement_stage= 0.0f;
+			procedure_state.last_state_change_time= current_time;
+		}
+		else
+			procedure_state.movement_stage= new_stage;
+		break;
+
+	case ProcedureState::MovementState::BackWait:
+	{
+		const Time wait_time= current_time - procedure_state.last_state_change_time;
+		if(
+			procedure.back_wait_s > 0.0f &&
+			wait_time.ToSeconds() >= procedure.back_wait_s )
+		{
+			ActivateProcedureSwitches( procedure, false, current_time );
+			DeactivateProcedureLightSources( procedure );
+			procedure_state.movement_state= ProcedureState::MovementState::ReverseMovement;
+			procedure_state.movement_stage= 0.0f;
+			procedure_state.last_state_change_time= current_time;
+		}
+	}
+		break;
+
+	case ProcedureState::MovementState::ReverseMovement:
+		// Emit reverse movement sound if we really start move and not blocked by player.
+		if( procedure_state.movement_stage <= 0.01f && new_stage > 0.01f )
+			EmitProcedureSound( procedure );
+
+		if( new_stage >= 1.0f )
+		{
+			procedure_state.movement_state= ProcedureState::MovementState::None;
+			procedure_state.movement_stage= 0.0f;
+			procedure_state.last_state_change_time= current_time;
+		}
+		else
+			procedure_state.movement_stage= new_stage;
+		break;
+	}; // switch state
+
+	if( procedure_state.movement_state == ProcedureState::MovementState::Movement ||
+		procedure_state.movement_state == ProcedureState::MovementState::ReverseMovement )
+	{
+		// Keep procedure active, move its objects.
+		changed_procedures_.push_back( procedure_number );
+		return;
+	}
+
+	// Procedure stops or waits. Remove it from active list and wake it up later, if needed.
+	const auto it= std::lower_bound( active_procedures_.begin(), active_procedures_.end(), procedure_number );
+	if( it != active_procedures_.end() && *it == procedure_number )
+		active_procedures_.erase( it );
+
+	if( procedure_state.movement_state != prev_movement_state )
+		changed_procedures_.push_back( procedure_number );
+
+	ScheduleProcedure( procedure_number, current_time );
+}
+
+void Map::OnProcedureStateChanged( const unsigned int procedure_number, const Time current_time )
+{
+	changed_procedures_.push_back( procedure_number );
+	ScheduleProcedure( procedure_number, current_time );
+}
+
+void Map::ScheduleProcedure( const unsigned int procedure_number, const Time current_time )
+{
+	const MapData::Procedure& procedure= map_data_->procedures[ procedure_number ];
+	const ProcedureState& procedure_state= procedures_[ procedure_number ];
+
+	switch( procedure_state.movement_state )
+	{
+	case ProcedureState::MovementState::None:
+		return;
+
+	case ProcedureState::MovementState::Movement:
+	case ProcedureState::MovementState::ReverseMovement:
+		AddActiveProcedure( procedure_number );
+		return;
+
+	case ProcedureState::MovementState::StartWait:
+	case ProcedureState::MovementState::BackWait:
+		break;
+	};
+
+	// Find nearest time, when state of waiting procedure may change.
+	bool have_wake_up_time= false;
+	Time wake_up_time= Time::FromSeconds(0);
+	const auto add_wake_up_time=
+	[&]( const float delay_s )
+	{
+		const Time t= procedure_state.last_state_change_time + Time::FromSeconds( delay_s );
+		if( !have_wake_up_time || t < wake_up_time )
+			wake_up_time= t;
+		have_wake_up_time= true;
+	};
+
+	if( procedure_state.movement_state == ProcedureState::MovementState::StartWait )
+		add_wake_up_time( procedure.start_delay_s );
+	if( procedure_state.movement_state == ProcedureState::MovementState::BackWait && procedure.back_wait_s > 0.0f )
+		add_wake_up_time( procedure.back_wait_s );
+	if( procedure.end_delay_s > 0.0f && !map_end_triggered_ )
+		add_wake_up_time( procedure.end_delay_s );
+
+	if( !have_wake_up_time )
+		return; // Procedure waits forever.
+
+	if( wake_up_time <= current_time )
+		AddActiveProcedure( procedure_number ); // Time is over, but state is not changed because of time rounding. Check procedure in each tick.
+	else
+		procedures_timers_.Add( wake_up_time, procedure_number );
+}
+
+void Map::AddActiveProcedure( const unsigned int procedure_number )
+{
+	const auto it= std::lower_bound( active_procedures_.begin(), active_procedures_.end(), procedure_number );
+	if( it == active_procedures_.end() || *it != procedure_number )
+		active_procedures_.insert( it, procedure_number );
 }
 
 void Map::TryActivateProcedure(
@@ -2168,6 +2518,7 @@ void Map::TryActivateProcedure(
 
 		procedure_state.last_state_change_time= current_time - Time::FromSeconds( dt_s );
 		procedure_state.movement_state= ProcedureState::MovementState::Movement;
+		OnProcedureStateChanged( procedure_number, current_time );
 		return;
 	}
 
@@ -2614,6 +2965,8 @@ void Map::ReturnProcedure( const unsigned int procedure_number, const Time curre
 		procedure_state.last_state_change_time= current_time;
 		break;
 	};
+
+	OnProcedureStateChanged( procedure_number, current_time );
 }
 
 void Map::ProcessWind( const MapData::Procedure::ActionCommand& command, bool activate )
@@ -2627,18 +2980,15 @@ void Map::ProcessWind( const MapData::Procedure::ActionCommand& command, bool ac
 	const int dir_x= static_cast<int>( command.args[4] );
 	const int dir_y= static_cast<int>( command.args[5] );
 
-	for( unsigned int y= y0; y <= y1 && y < MapData::c_map_size; y++ )
-	for( unsigned int x= x0; x <= x1 && x < MapData::c_map_size; x++ )
+	if( activate && ( dir_x != 0 || dir_y != 0 ) )
 	{
-		char* const cell= wind_field_[ x + y * MapData::c_map_size ];
-		if( activate )
-		{
-			cell[0]= dir_x;
-			cell[1]= dir_y;
-		}
-		else
-			cell[0]= cell[1]= 0;
+		WindCell cell;
+		cell.dir[0]= dir_x;
+		cell.dir[1]= dir_y;
+		wind_field_.Fill( x0, y0, x1, y1, cell );
 	}
+	else
+		wind_field_.Clear( x0, y0, x1, y1 );
 }
 
 void Map::ProcessDeathZone( const MapData::Procedure::ActionCommand& command, const bool activate )
@@ -2653,19 +3003,16 @@ void Map::ProcessDeathZone( const MapData::Procedure::ActionCommand& command, co
 	const int z_1= static_cast<int>( command.args[5] );
 	const unsigned char damage= static_cast<unsigned char>( command.args[6] );
 
-	for( unsigned int y= y0; y <= y1 && y < MapData::c_map_size; y++ )
-	for( unsigned int x= x0; x <= x1 && x < MapData::c_map_size; x++ )
+	if( activate && damage > 0u )
 	{
-		DamageFiledCell& cell= death_field_[ x + y * MapData::c_map_size ];
-		if( activate )
-		{
-			cell.damage= damage;
-			cell.z_bottom= std::max( std::min( z_0, 127 ), -128 );
-			cell.z_top   = std::max( std::min( z_1, 127 ), -128 );
-		}
-		else
-			cell.damage= 0u;
+		DamageFiledCell cell;
+		cell.damage= damage;
+		cell.z_bottom= std::max( std::min( z_0, 127 ), -128 );
+		cell.z_top   = std::max( std::min( z_1, 127 ), -128 );
+		death_field_.Fill( x0, y0, x1, y1, cell );
 	}
+	else
+		death_field_.Clear( x0, y0, x1, y1 );
 }
 
 void Map::DestroyModel( const unsigned int model_index )
@@ -2782,20 +3129,43 @@ void Map::TryWarnMonsters( const m_Vec3& pos, const Time current_time )
 
 void Map::MoveMapObjects( const Time current_time )
 {
-	// Zero objects transformations. Set mortal flag to false.
-	for( DynamicWall& wall : dynamic_walls_ )
+	// Recalculate transformations only for objects of changed procedures.
+	// Objects of procedures in "None" or waiting state are not moved, so, their transformations are still actual.
+	if( move_all_objects_ )
 	{
-		wall.transformation.Clear();
-		wall.vert_move_speed[0]= wall.vert_move_speed[1]= m_Vec2( 0.0f, 0.0f );
-		wall.mortal= false;
+		MapData::IndexElement object;
+		object.type= MapData::IndexElement::DynamicWall;
+		for( unsigned int w= 0u; w < dynamic_walls_.size(); w++ )
+		{
+			object.index= w;
+			MarkObjectForMove( object );
+		}
+		object.type= MapData::IndexElement::StaticModel;
+		for( unsigned int m= 0u; m < static_models_.size(); m++ )
+		{
+			object.index= m;
+			MarkObjectForMove( object );
+		}
+		move_all_objects_= false;
 	}
 
-	for( StaticModel& model : static_models_ )
+	for( const unsigned int procedure_number : changed_procedures_ )
 	{
-		model.transformation.Clear();
-		model.transformation_angle_delta= 0.0f;
-		model.move_speed= m_Vec2( 0.0f, 0.0f );
-		model.mortal= false;
+		for( const MapData::IndexElement& object : procedures_objects_[ procedure_number ] )
+			MarkObjectForMove( object );
+	}
+	changed_procedures_.clear();
+
+	// Rotating lights effect models. Models rotating together with their lights.
+	for( const unsigned short m : rotating_light_models_ )
+	{
+		if( static_models_[m].linked_rotating_light != nullptr )
+		{
+			MapData::IndexElement object;
+			object.type= MapData::IndexElement::StaticModel;
+			object.index= m;
+			MarkObjectForMove( object );
+		}
 	}
 
 	/* Accumulate transformations from procedures on objects.
@@ -2804,238 +3174,281 @@ void Map::MoveMapObjects( const Time current_time )
 	 * Examples of "bad" transformations combination:
 	 * Rotate + Move, Rotate + Rotate with different center, etc.
 	 */
-	for( unsigned int p= 0u; p < procedures_.size(); p++ )
+	for( const unsigned short w : dynamic_walls_to_move_ )
 	{
-		const MapData::Procedure& procedure= map_data_->procedures[p];
-		const ProcedureState& procedure_state= procedures_[p];
+		const MapData::Wall& map_wall= map_data_->dynamic_walls[ w ];
+		DynamicWall& wall= dynamic_walls_[ w ];
 
-		float absolute_action_stage;
-		float move_dir_sign= 0.0f;
-		if( procedure_state.movement_state == ProcedureState::MovementState::Movement )
-		{
-			absolute_action_stage= procedure_state.movement_stage;
-			move_dir_sign= +1.0f;
-		}
-		else if( procedure_state.movement_state == ProcedureState::MovementState::BackWait )
-			absolute_action_stage= 1.0f;
-		else if( procedure_state.movement_state == ProcedureState::MovementState::ReverseMovement )
+		// Zero object transformation. Set mortal flag to false.
+		wall.transformation.Clear();
+		wall.vert_move_speed[0]= wall.vert_move_speed[1]= m_Vec2( 0.0f, 0.0f );
+		wall.mortal= false;
+
+		for( const ObjectMoveCommand& move_command : dynamic_walls_move_commands_[ w ] )
+			ApplyProcedureMoveCommand( move_command.procedure_number, move_command.command_index );
+
+		// Apply object transformation.
+		for( unsigned int j= 0u; j < 2u; j++ )
+			wall.vert_pos[j]= map_wall.vert_pos[j] * wall.transformation.mat;
+
+		wall.z= wall.transformation.d_z;
+
+		dynamic_walls_move_flags_[ w ]= false;
+	}
+	dynamic_walls_to_move_.clear();
+
+	for( const unsigned short m : static_models_to_move_ )
+	{
+		const MapData::StaticModel& map_model= map_data_->static_models[ m ];
+		StaticModel& model= static_models_[ m ];
+
+		// Zero object transformation. Set mortal flag to false.
+		model.transformation.Clear();
+		model.transformation_angle_delta= 0.0f;
+		model.move_speed= m_Vec2( 0.0f, 0.0f );
+		model.mortal= false;
+
+		for( const ObjectMoveCommand& move_command : static_models_move_commands_[ m ] )
+			ApplyProcedureMoveCommand( move_command.procedure_number, move_command.command_index );
+
+		if( model.linked_rotating_light != nullptr )
 		{
-			absolute_action_stage= 1.0f - procedure_state.movement_stage;
-			move_dir_sign= -1.0f;
+			const float c_speed= Constants::two_pi; // TODO - check speeed. Maybe it depends on light source parameters.
+			const float angle_delta= c_speed * ( current_time - model.linked_rotating_light->start_time ).ToSeconds();
+			model.transformation_angle_delta+= angle_delta;
 		}
-		else
-			absolute_action_stage= 0.0f;
 
+		// Apply object transformation.
+		const m_Vec2 xy= map_model.pos * model.transformation.mat;
+		model.pos.x= xy.x;
+		model.pos.y= xy.y;
+		model.pos.z= model.baze_z + model.transformation.d_z;
 
-		const bool mortal=
-			procedure.mortal &&
-			( procedure_state.movement_state == ProcedureState::MovementState::Movement || procedure_state.movement_state == ProcedureState::MovementState::ReverseMovement );
+		model.angle= map_model.angle + model.transformation_angle_delta;
 
-		for( const MapData::Procedure::ActionCommand& command : procedure.action_commands )
-		{
-			using Action= MapData::Procedure::ActionCommandId;
-			switch( command.id )
-			{
-			case Action::Move:
-			case Action::XMove:
-			case Action::YMove:
-			{
-				const unsigned char x= static_cast<unsigned char>(command.args[0]);
-				const unsigned char y= static_cast<unsigned char>(command.args[1]);
-				const float dx= command.args[2] * g_commands_coords_scale;
-				const float dy= command.args[3] * g_commands_coords_scale;
-				const float sound_number= command.args[4];
-				PC_UNUSED(sound_number);
-
-				// TODO - maybe fractions depends on way length?
-				//const float total_way_length= std::abs(dx) + std::abs(dy);
-				const float x_fraction= 0.5f;//std::abs(dx) / total_way_length;
-				const float y_fraction= 0.5f;//std::abs(dy) / total_way_length;
-
-				m_Vec2 d_pos( 0.0f, 0.0f );
-				m_Vec2 move_dir;
-				if( command.id == Action::XMove )
-				{
-					if( absolute_action_stage <= x_fraction )
-					{
-						d_pos.x+= dx * absolute_action_stage / x_fraction;
-						move_dir= m_Vec2( dx, 0.0f );
-					}
-					else
-					{
-						d_pos.x+= dx;
-						d_pos.y+= dy * ( absolute_action_stage - x_fraction ) / y_fraction;
-						move_dir= m_Vec2( dy, 0.0f );
-					}
-				}
-				else if( command.id == Action::YMove )
-				{
-					if( absolute_action_stage <= y_fraction )
-					{
-						d_pos.y+= dy * absolute_action_stage / y_fraction;
-						move_dir= m_Vec2( dy, 0.0f );
-					}
-					else
-					{
-						d_pos.x+= dx * ( absolute_action_stage - y_fraction ) / x_fraction;
-						d_pos.y+= dy;
-						move_dir= m_Vec2( dx, 0.0f );
-					}
-				}
-				else//if( command.id == Action::Move )
-				{
-					d_pos.x+= dx * absolute_action_stage;
-					d_pos.y+= dy * absolute_action_stage;
-					move_dir= m_Vec2( dx, dy );
-				}
+		static_models_move_flags_[ m ]= false;
+	}
+	static_models_to_move_.clear();
+}
 
-				move_dir*= move_dir_sign;
+void Map::ApplyProcedureMoveCommand( const unsigned int procedure_number, const unsigned int command_index )
+{
+	const MapData::Procedure& procedure= map_data_->procedures[ procedure_number ];
+	const ProcedureState& procedure_state= procedures_[ procedure_number ];
 
-				m_Mat3 mat;
-				mat.Translate( d_pos );
+	float absolute_action_stage;
+	float move_dir_sign= 0.0f;
+	if( procedure_state.movement_state == ProcedureState::MovementState::Movement )
+	{
+		absolute_action_stage= procedure_state.movement_stage;
+		move_dir_sign= +1.0f;
+	}
+	else if( procedure_state.movement_state == ProcedureState::MovementState::BackWait )
+		absolute_action_stage= 1.0f;
+	else if( procedure_state.movement_state == ProcedureState::MovementState::ReverseMovement )
+	{
+		absolute_action_stage= 1.0f - procedure_state.movement_stage;
+		move_dir_sign= -1.0f;
+	}
+	else
+		absolute_action_stage= 0.0f;
 
-				PC_ASSERT( x < MapData::c_map_size && y < MapData::c_map_size );
-				const MapData::IndexElement& index_element= map_data_->map_index[ x + y * MapData::c_map_size ];
 
-				if( index_element.type == MapData::IndexElement::DynamicWall )
-				{
-					PC_ASSERT( index_element.index < map_data_->dynamic_walls.size() );
-					DynamicWall& wall= dynamic_walls_[ index_element.index ];
-					wall.transformation.mat= wall.transformation.mat * mat;
-					wall.vert_move_speed[0]+= move_dir;
-					wall.vert_move_speed[1]+= move_dir;
-					if( mortal ) wall.mortal= true;
-				}
-				else if( index_element.type == MapData::IndexElement::StaticModel )
-				{
-					PC_ASSERT( index_element.index < static_models_.size() );
-					StaticModel& model= static_models_[ index_element.index ];
-					model.transformation.mat= model.transformation.mat * mat;
-					model.move_speed+= move_dir;
-					if( mortal ) model.mortal= true;
-				}
-			}
-				break;
+	const bool mortal=
+		procedure.mortal &&
+		( procedure_state.movement_state == ProcedureState::MovementState::Movement || procedure_state.movement_state == ProcedureState::MovementState::ReverseMovement );
 
-			case Action::Rotate:
-			{
-				const unsigned char x= static_cast<unsigned char>(command.args[0]);
-				const unsigned char y= static_cast<unsigned char>(command.args[1]);
-				const float center_x= command.args[2] * g_commands_coords_scale;
-				const float center_y= command.args[3] * g_commands_coords_scale;
-				const float angle= command.args[4] * Constants::to_rad;
-				const float sound_number= command.args[5];
-				PC_UNUSED(sound_number);
-
-				const m_Vec2 center( center_x, center_y );
-				const float angle_delta= angle * absolute_action_stage;
-
-				m_Mat3 shift, rot, back_shift, mat;
-				shift.Translate( -center );
-				rot.RotateZ( angle_delta );
-				back_shift.Translate( center );
-				mat= shift * rot * back_shift;
-
-				PC_ASSERT( x < MapData::c_map_size && y < MapData::c_map_size );
-				const MapData::IndexElement& index_element= map_data_->map_index[ x + y * MapData::c_map_size ];
+	PC_ASSERT( command_index < procedure.action_commands.size() );
+	const MapData::Procedure::ActionCommand& command= procedure.action_commands[ command_index ];
 
-				if( index_element.type == MapData::IndexElement::DynamicWall )
-				{
-					PC_ASSERT( index_element.index < map_data_->dynamic_walls.size() );
-					DynamicWall& wall= dynamic_walls_[ index_element.index ];
-					wall.transformation.mat= wall.transformation.mat * mat;
-					if( mortal ) wall.mortal= true;
-
-					// Calculate speed for wall vertices. This needs for mortal walls.
-					// TODO - check this calculation.
-					const float radial_speed_value= angle * Constants::two_pi;
-					for( unsigned int i= 0u; i < 2u; i++ )
-					{
-						const m_Vec2 vec_from_rotation_center= center - wall.vert_pos[i];
-						const m_Vec2 speed_vec( vec_from_rotation_center.y, -vec_from_rotation_center.x );
-						wall.vert_move_speed[i]+= speed_vec * radial_speed_value * move_dir_sign;
-					}
-				}
-				else if( index_element.type == MapData::IndexElement::StaticModel )
-				{
-					PC_ASSERT( index_element.index < static_models_.size() );
-					StaticModel& model= static_models_[ index_element.index ];
-					model.transformation.mat= model.transformation.mat * mat;
-					model.transformation_angle_delta+= angle_delta;
-					if( mortal ) model.mortal= true;
-				}
-			}
-				break;
+	using Action= MapData::Procedure::ActionCommandId;
+	switch( command.id )
+	{
+	case Action::Move:
+	case Action::XMove:
+	case Action::YMove:
+	{
+		const unsigned char x= static_cast<unsigned char>(command.args[0]);
+		const unsigned char y= static_cast<unsigned char>(command.args[1]);
+		const float dx= command.args[2] * g_commands_coords_scale;
+		const float dy= command.args[3] * g_commands_coords_scale;
+		const float sound_number= command.args[4];
+		PC_UNUSED(sound_number);
+
+		// TODO - maybe fractions depends on way length?
+		//const float total_way_length= std::abs(dx) + std::abs(dy);
+		const float x_fraction= 0.5f;//std::abs(dx) / total_way_length;
+		const float y_fraction= 0.5f;//std::abs(dy) / total_way_length;
 
-			case Action::Up:
+		m_Vec2 d_pos( 0.0f, 0.0f );
+		m_Vec2 move_dir;
+		if( command.id == Action::XMove )
+		{
+			if( absolute_action_stage <= x_fraction )
+			{
+				d_pos.x+= dx * absolute_action_stage / x_fraction;
+				move_dir= m_Vec2( dx, 0.0f );
+			}
+			else
 			{
-				const unsigned char x= static_cast<unsigned char>(command.args[0]);
-				const unsigned char y= static_cast<unsigned char>(command.args[1]);
-				const float height= command.args[2] * g_commands_coords_scale * 4.0f;
-				const float sound_number= command.args[3];
-				PC_UNUSED(sound_number);
+				d_pos.x+= dx;
+				d_pos.y+= dy * ( absolute_action_stage - x_fraction ) / y_fraction;
+				move_dir= m_Vec2( dy, 0.0f );
+			}
+		}
+		else if( command.id == Action::YMove )
+		{
+			if( absolute_action_stage <= y_fraction )
+			{
+				d_pos.y+= dy * absolute_action_stage / y_fraction;
+				move_dir= m_Vec2( dy, 0.0f );
+			}
+			else
+			{
+				d_pos.x+= dx * ( absolute_action_stage - y_fraction ) / x_fraction;
+				d_pos.y+= dy;
+				move_dir= m_Vec2( dx, 0.0f );
+			}
+		}
+		else//if( command.id == Action::Move )
+		{
+			d_pos.x+= dx * absolute_action_stage;
+			d_pos.y+= dy * absolute_action_stage;
+			move_dir= m_Vec2( dx, dy );
+		}
 
-				PC_ASSERT( x < MapData::c_map_size && y < MapData::c_map_size );
-				const MapData::IndexElement& index_element= map_data_->map_index[ x + y * MapData::c_map_size ];
+		move_dir*= move_dir_sign;
 
-				const float dz= height * absolute_action_stage;
+		m_Mat3 mat;
+		mat.Translate( d_pos );
 
-				if( index_element.type == MapData::IndexElement::DynamicWall )
-				{
-					PC_ASSERT( index_element.index < map_data_->dynamic_walls.size() );
-					DynamicWall& wall= dynamic_walls_[ index_element.index ];
-					wall.transformation.d_z+= dz;
-				}
-				else if( index_element.type == MapData::IndexElement::StaticModel )
-				{
-					PC_ASSERT( index_element.index < static_models_.size() );
-					StaticModel& model= static_models_[ index_element.index ];
-					model.transformation.d_z+= dz;
-				}
-			}
-				break;
+		PC_ASSERT( x < MapData::c_map_size && y < MapData::c_map_size );
+		const MapData::IndexElement& index_element= map_data_->map_index[ x + y * MapData::c_map_size ];
 
-			default:
-				// TODO
-				break;
-			}
-		} // for action commands
-	} // for procedures
+		if( index_element.type == MapData::IndexElement::DynamicWall )
+		{
+			PC_ASSERT( index_element.index < map_data_->dynamic_walls.size() );
+			DynamicWall& wall= dynamic_walls_[ index_element.index ];
+			wall.transformation.mat= wall.transformation.mat * mat;
+			wall.vert_move_speed[0]+= move_dir;
+			wall.vert_move_speed[1]+= move_dir;
+			if( mortal ) wall.mortal= true;
+		}
+		else if( index_element.type == MapData::IndexElement::StaticModel )
+		{
+			PC_ASSERT( index_element.index < static_models_.size() );
+			StaticModel& model= static_models_[ index_element.index ];
+			model.transformation.mat= model.transformation.mat * mat;
+			model.move_speed+= move_dir;
+			if( mortal ) model.mortal= true;
+		}
+	}
+		break;
 
-	// Rotating lights effect models. Models rotating together with their lights.
-	for( StaticModel& model : static_models_ )
+	case Action::Rotate:
 	{
-		if( model.linked_rotating_light != nullptr )
+		const unsigned char x= static_cast<unsigned char>(command.args[0]);
+		const unsigned char y= static_cast<unsigned char>(command.args[1]);
+		const float center_x= command.args[2] * g_commands_coords_scale;
+		const float center_y= command.args[3] * g_commands_coords_scale;
+		const float angle= command.args[4] * Constants::to_rad;
+		const float sound_number= command.args[5];
+		PC_UNUSED(sound_number);
+
+		const m_Vec2 center( center_x, center_y );
+		const float angle_delta= angle * absolute_action_stage;
+
+		m_Mat3 shift, rot, back_shift, mat;
+		shift.Translate( -center );
+		rot.RotateZ( angle_delta );
+		back_shift.Translate( center );
+		mat= shift * rot * back_shift;
+
+		PC_ASSERT( x < MapData::c_map_size && y < MapData::c_map_size );
+		const MapData::IndexElement& index_element= map_data_->map_index[ x + y * MapData::c_map_size ];
+
+		if( index_element.type == MapData::IndexElement::DynamicWall )
 		{
-			const float c_speed= Constants::two_pi; // TODO - check speeed. Maybe it depends on light source parameters.
-			const float angle_delta= c_speed * ( current_time - model.linked_rotating_light->start_time ).ToSeconds();
+			PC_ASSERT( index_element.index < map_data_->dynamic_walls.size() );
+			DynamicWall& wall= dynamic_walls_[ index_element.index ];
+			wall.transformation.mat= wall.transformation.mat * mat;
+			if( mortal ) wall.mortal= true;
+
+			// Calculate speed for wall vertices. This needs for mortal walls.
+			// TODO - check this calculation.
+			const float radial_speed_value= angle * Constants::two_pi;
+			for( unsigned int i= 0u; i < 2u; i++ )
+			{
+				const m_Vec2 vec_from_rotation_center= center - wall.vert_pos[i];
+				const m_Vec2 speed_vec( vec_from_rotation_center.y, -vec_from_rotation_center.x );
+				wall.vert_move_speed[i]+= speed_vec * radial_speed_value * move_dir_sign;
+			}
+		}
+		else if( index_element.type == MapData::IndexElement::StaticModel )
+		{
+			PC_ASSERT( index_element.index < static_models_.size() );
+			StaticModel& model= static_models_[ index_element.index ];
+			model.transformation.mat= model.transformation.mat * mat;
 			model.transformation_angle_delta+= angle_delta;
+			if( mortal ) model.mortal= true;
 		}
 	}
+		break;
 
-	// Apply objects transformations.
-	for( unsigned int w= 0u; w < dynamic_walls_.size(); w++ )
+	case Action::Up:
 	{
-		const MapData::Wall& map_wall= map_data_->dynamic_walls[ w ];
-		DynamicWall& wall= dynamic_walls_[ w ];
+		const unsigned char x= static_cast<unsigned char>(command.args[0]);
+		const unsigned char y= static_cast<unsigned char>(command.args[1]);
+		const float height= command.args[2] * g_commands_coords_scale * 4.0f;
+		const float sound_number= command.args[3];
+		PC_UNUSED(sound_number);
 
-		for( unsigned int j= 0u; j < 2u; j++ )
-			wall.vert_pos[j]= map_wall.vert_pos[j] * wall.transformation.mat;
+		PC_ASSERT( x < MapData::c_map_size && y < MapData::c_map_size );
+		const MapData::IndexElement& index_element= map_data_->map_index[ x + y * MapData::c_map_size ];
 
-		wall.z= wall.transformation.d_z;
-	}
+		const float dz= height * absolute_action_stage;
 
-	for( unsigned int m= 0u; m < static_models_.size(); m++ )
-	{
-		const MapData::StaticModel& map_model= map_data_->static_models[ m ];
-		StaticModel& model= static_models_[ m ];
+		if( index_element.type == MapData::IndexElement::DynamicWall )
+		{
+			PC_ASSERT( index_element.index < map_data_->dynamic_walls.size() );
+			DynamicWall& wall= dynamic_walls_[ index_element.index ];
+			wall.transformation.d_z+= dz;
+		}
+		else if( index_element.type == MapData::IndexElement::StaticModel )
+		{
+			PC_ASSERT( index_element.index < static_models_.size() );
+			StaticModel& model= static_models_[ index_element.index ];
+			model.transformation.d_z+= dz;
+		}
+	}
+		break;
 
-		const m_Vec2 xy= map_model.pos * model.transformation.mat;
-		model.pos.x= xy.x;
-		model.pos.y= xy.y;
-		model.pos.z= model.baze_z + model.transformation.d_z;
+	default:
+		// Only move commands are linked with objects.
+		PC_ASSERT( false );
+		break;
+	}
+}
 
-		model.angle= map_model.angle + model.transformation_angle_delta;
+void Map::MarkObjectForMove( const MapData::IndexElement& object )
+{
+	if( object.type == MapData::IndexElement::DynamicWall )
+	{
+		PC_ASSERT( object.index < dynamic_walls_.size() );
+		if( !dynamic_walls_move_flags_[ object.index ] )
+		{
+			dynamic_walls_move_flags_[ object.index ]= true;
+			dynamic_walls_to_move_.push_back( object.index );
+		}
+	}
+	else if( object.type == MapData::IndexElement::StaticModel )
+	{
+		PC_ASSERT( object.index < static_models_.size() );
+		if( !static_models_move_flags_[ object.index ] )
+		{
+			static_models_move_flags_[ object.index ]= true;
+			static_models_to_move_.push_back( object.index );
+		}
 	}
 }
 
@@ -3043,7 +3456,8 @@ Map::HitResult Map::ProcessShot(
 	const m_Vec3& shot_start_point,
 	const m_Vec3& shot_direction_normalized,
 	const float max_distance,
-	const EntityId skip_monster_id ) const
+	const EntityId skip_monster_id,
+	const MonstersPositionsHistory::Frame* const rewinded_monsters ) const
 {
 	HitResult result;
 	float nearest_shot_point_square_distance= max_distance * max_distance;
@@ -3142,20 +3556,29 @@ Map::HitResult Map::ProcessShot(
 	}
 
 	// Monsters
-	for( const MonstersContainer::value_type& monster_value : monsters_ )
+	const MonstersPositionsHistory::Frame& frame=
+		rewinded_monsters != nullptr ? *rewinded_monsters : monsters_shot_cylinders_;
+	for( unsigned int i= 0u; i < frame.ids.size(); i++ )
 	{
-		if( monster_value.first == skip_monster_id )
+		if( frame.ids[i] == skip_monster_id )
 			continue;
 
 		m_Vec3 candidate_pos;
-		if( monster_value.second->TryShot(
+		if( !RayIntersectCylinder(
+				m_Vec2( frame.x[i], frame.y[i] ), frame.radius[i],
+				frame.z_min[i], frame.z_max[i],
 				shot_start_point, shot_direction_normalized,
 				candidate_pos ) )
-		{
-			process_candidate_shot_pos(
-				candidate_pos, HitResult::ObjectType::Monster,
-				monster_value.first );
-		}
+			continue;
+
+		// Monster may die or despawn after moment of frame.
+		const auto it= monsters_.find( frame.ids[i] );
+		if( it == monsters_.end() || it->second->Health() <= 0 )
+			continue;
+
+		process_candidate_shot_pos(
+			candidate_pos, HitResult::ObjectType::Monster,
+			frame.ids[i] );
 	}
 
 	// Floors, ceilings
@@ -3188,6 +3611,45 @@ Map::HitResult Map::ProcessShot(
 	return result;
 }
 
+void Map::CollectMonstersShotCylinders( MonstersPositionsHistory::Frame& frame, const Time current_time ) const
+{
+	frame.Clear( current_time );
+	for( const MonstersContainer::value_type& monster_value : monsters_ )
+	{
+		const MonsterBase& monster= *monster_value.second;
+		if( monster.Health() <= 0 )
+			continue;
+
+		float radius;
+		m_Vec2 z_minmax;
+		monster.GetShotCylinder( radius, z_minmax );
+		frame.AddMonster( monster_value.first, monster.Position(), radius, z_minmax );
+	}
+}
+
+bool Map::IsLagCompensationEnabled() const
+{
+	return lag_compensation_max_time_.GetInternalRepresentation() > 0 && game_rules_ != GameRules::SinglePlayer;
+}
+
+const MonstersPositionsHistory::Frame* Map::GetLagCompensationFrame( const EntityId shooter_id, const Time current_time ) const
+{
+	if( !IsLagCompensationEnabled() )
+		return nullptr;
+
+	// Only players shots are compensated.
+	const auto it= players_.find( shooter_id );
+	if( it == players_.end() )
+		return nullptr;
+
+	Time view_time= it->second->GetViewTime();
+	const Time min_view_time= current_time - lag_compensation_max_time_;
+	if( view_time < min_view_time )
+		view_time= min_view_time;
+
+	return monsters_positions_history_.GetFrame( view_time );
+}
+
 bool Map::FindNearestPlayerPos( const m_Vec3& pos, m_Vec3& out_pos ) const
 {
 	if( players_.empty() )
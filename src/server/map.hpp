@@ -11,7 +11,11 @@
 #include "collision_index.hpp"
 #include "backpack.hpp"
 #include "fwd.hpp"
+#include "entities_container.hpp"
+#include "monsters_positions_history.hpp"
 #include "movement_restriction.hpp"
+#include "sparse_field.hpp"
+#include "timer_wheel.hpp"
 
 namespace PanzerChasm
 {
@@ -23,9 +27,22 @@ public:
 	typedef std::function<void()> MapEndCallback;
 	typedef std::function<void(const char*)> TextMessageCallback;
 
-	typedef std::unordered_map< EntityId, MonsterBasePtr > MonstersContainer;
+	typedef EntitiesContainer< MonsterBasePtr > MonstersContainer;
 	typedef std::unordered_map< EntityId, PlayerPtr > PlayersContainer;
 
+	// Accumulated durations of tick phases. Used for profiling.
+	struct TickStats
+	{
+		Time procedures= Time::FromSeconds(0);
+		Time map_objects= Time::FromSeconds(0);
+		Time rockets= Time::FromSeconds(0);
+		Time monsters= Time::FromSeconds(0);
+		Time collisions= Time::FromSeconds(0);
+		// Filled by server.
+		Time players= Time::FromSeconds(0);
+		Time messages= Time::FromSeconds(0);
+	};
+
 	Map(
 		DifficultyType difficulty,
 		GameRules game_rules,
@@ -55,6 +72,18 @@ public:
 	EntityId SpawnPlayer( const PlayerPtr& player );
 	void DespawnPlayer( EntityId player_id );
 
+	// Returns monster_id for spawned monster.
+	EntityId SpawnMonster( const MapData::Monster& map_monster, Time current_time );
+
+	void SetRandomSeed( LongRand::RandResultType seed );
+
+	// Stats are accumulated in each tick. Pass nullptr to stop collecting.
+	void SetTickStats( TickStats* tick_stats );
+
+	// Hitscan shots of players are checked against monsters positions, which player saw, but not older, than max time.
+	// Works only in multiplayer games. Zero time disables lag compensation.
+	void SetLagCompensationMaxTime( Time max_time );
+
 	void Shoot(
 		EntityId owner_id,
 		unsigned int rocket_id,
@@ -81,9 +110,11 @@ public:
 	void AddParticleEffect( const m_Vec3& pos, ParticleEffect particle_effect );
 	void AddTextMessage( const char* text );
 
+	// Elements cache must be unique for each colliding object.
 	m_Vec3 CollideWithMap(
 		const m_Vec3 in_pos, float height, float radius,
 		Time tick_delta,
+		CollisionIndex::ElementsCache& elements_cache,
 		bool& out_on_floor, MovementRestriction& out_movement_restriction ) const;
 
 	bool CanSee( const m_Vec3& from, const m_Vec3& to ) const;
@@ -143,6 +174,18 @@ private:
 
 	typedef std::vector<DynamicWall> DynamicWalls;
 
+	// Broadphase for collisions with dynamic walls. Rebuilt each tick, because walls are moving.
+	// Contains only walls, which can stop monsters.
+	struct DynamicWallsGrid
+	{
+		static constexpr unsigned int c_cell_size_log2= 2u;
+		static constexpr unsigned int c_size= MapData::c_map_size >> c_cell_size_log2;
+
+		// Walls of cell are in range [ cells_offsets[i], cells_offsets[i + 1] ).
+		unsigned int cells_offsets[ c_size * c_size + 1u ];
+		std::vector<unsigned short> walls_indeces;
+	};
+
 	struct StaticModel
 	{
 		Transformation transformation;
@@ -272,6 +315,11 @@ private:
 		m_Vec3 pos;
 	};
 
+	struct WindCell
+	{
+		signed char dir[2];
+	};
+
 	struct DamageFiledCell
 	{
 		unsigned char damage; // 0 - means no damage
@@ -290,6 +338,14 @@ private:
 	void EmitProcedureSound( const MapData::Procedure& procedure );
 	void ReturnProcedure( unsigned int procedure_number, Time current_time );
 
+	// Procedures scheduling.
+	void BuildProceduresObjectsLinks();
+	void ProcessProcedure( unsigned int procedure_number, Time current_time );
+	// Call it after each procedure state change.
+	void OnProcedureStateChanged( unsigned int procedure_number, Time current_time );
+	void ScheduleProcedure( unsigned int procedure_number, Time current_time );
+	void AddActiveProcedure( unsigned int procedure_number );
+
 	void ProcessWind( const MapData::Procedure::ActionCommand& command, bool activate );
 	void ProcessDeathZone( const MapData::Procedure::ActionCommand& command, bool activate );
 	void DestroyModel( unsigned int model_index );
@@ -298,7 +354,16 @@ private:
 		int base_damage, EntityId explosion_owner_monster_id, Time current_time );
 
 	void TryWarnMonsters( const m_Vec3& pos, Time current_time );
+
+	bool IsCollidableDynamicWall( const DynamicWall& wall ) const;
+	void BuildDynamicWallsGrid();
+	// Returns inclusive cells rectangle of dynamic walls grid for given bounding box points.
+	static void GetDynamicWallsGridRect(
+		const m_Vec2& p0, const m_Vec2& p1,
+		int& out_x_start, int& out_x_end, int& out_y_start, int& out_y_end );
 	void MoveMapObjects( Time current_time );
+	void ApplyProcedureMoveCommand( unsigned int procedure_number, unsigned int command_index );
+	void MarkObjectForMove( const MapData::IndexElement& object );
 
 	template<class Func>
 	void ProcessElementLinks(
@@ -306,11 +371,20 @@ private:
 		unsigned int index,
 		const Func& func );
 
+	// If rewinded monsters are given, shot is checked against them instead of current monsters positions.
+	// Current monsters positions must be collected via "CollectMonstersShotCylinders" before.
 	HitResult ProcessShot(
 		const m_Vec3& shot_start_point,
 		const m_Vec3& shot_direction_normalized,
 		float max_distance,
-		EntityId skip_monster_id ) const;
+		EntityId skip_monster_id,
+		const MonstersPositionsHistory::Frame* rewinded_monsters= nullptr ) const;
+
+	void CollectMonstersShotCylinders( MonstersPositionsHistory::Frame& frame, Time current_time ) const;
+
+	bool IsLagCompensationEnabled() const;
+	// Returns nullptr, if shot must not be compensated.
+	const MonstersPositionsHistory::Frame* GetLagCompensationFrame( EntityId shooter_id, Time current_time ) const;
 
 	bool FindNearestPlayerPos( const m_Vec3& pos, m_Vec3& out_pos ) const;
 
@@ -338,12 +412,44 @@ private:
 
 	const LongRandPtr random_generator_;
 
+	TickStats* tick_stats_= nullptr;
+
+	Time lag_compensation_max_time_= Time::FromSeconds(0);
+	MonstersPositionsHistory monsters_positions_history_; // Do not save.
+	MonstersPositionsHistory::Frame monsters_shot_cylinders_; // Current monsters positions for shots. Do not save.
+
 	unsigned int next_spawn_number_= 0u; // For multiplayer modes only. Do not save.
 
 	DynamicWalls dynamic_walls_;
+	DynamicWallsGrid dynamic_walls_grid_;
 
 	std::vector<ProcedureState> procedures_;
 
+	// Procedures scheduling. Do not save - restored from procedures state.
+	// Active procedures are processed in each tick. Waiting procedures are woken up by timers.
+	std::vector<unsigned int> active_procedures_; // Sorted.
+	TimerWheel procedures_timers_;
+	std::vector<unsigned int> changed_procedures_; // Objects of these procedures must be moved in current tick.
+
+	// Links between procedures and objects, moved by them. Constant.
+	struct ObjectMoveCommand
+	{
+		unsigned short procedure_number;
+		unsigned short command_index; // Index of procedure action command, which moves object.
+	};
+	std::vector< std::vector<MapData::IndexElement> > procedures_objects_;
+	std::vector< std::vector<ObjectMoveCommand> > dynamic_walls_move_commands_;
+	std::vector< std::vector<ObjectMoveCommand> > static_models_move_commands_;
+	// Models, which may get rotating light - targets of "light" commands. Constant.
+	std::vector<unsigned short> rotating_light_models_;
+
+	// Objects, which transformations must be recalculated in current tick.
+	std::vector<unsigned short> dynamic_walls_to_move_;
+	std::vector<unsigned short> static_models_to_move_;
+	std::vector<bool> dynamic_walls_move_flags_;
+	std::vector<bool> static_models_move_flags_;
+	bool move_all_objects_= true;
+
 	bool map_end_triggered_= false;
 
 	StaticModels static_models_;
@@ -359,6 +465,7 @@ private:
 	PlayersContainer players_;
 	MonstersContainer monsters_; // + players
 	EntityId next_monster_id_= 1u;
+	std::unordered_map<EntityId, CollisionIndex::ElementsCache> monsters_collision_caches_; // Do not save.
 
 	LightSourcesContainer light_sources_;
 
@@ -379,11 +486,11 @@ private:
 	std::vector<Messages::MonsterLinkedSound> monster_linked_sounds_messages_;
 	std::vector<Messages::MonsterSound> monsters_sounds_messages_;
 
-	// Put large objects here.
+	// Fields contain only nonzero cells.
+	SparseField<WindCell> wind_field_;
+	SparseField<DamageFiledCell> death_field_;
 
-	// TODO - compress this fields
-	char wind_field_[ MapData::c_map_size * MapData::c_map_size ][2];
-	DamageFiledCell death_field_[ MapData::c_map_size * MapData::c_map_size ];
+	// Put large objects here.
 
 	const CollisionIndex collision_index_;
 };
@@ -1,3 +1,5 @@
+#include <cstring>
+
 #include "../save_load_streams.hpp"
 #include "map.hpp"
 #include "monster.hpp"
@@ -160,17 +162,26 @@ void Map::Save( SaveStream& save_stream ) const
 		save_stream.WriteUInt16( light_source.turn_on_time_ms );
 	}
 
-	// Wind field
+	// Fields are saved as full arrays of cells.
 	// TODO - optimize large arrays saving
-	for( const char* const wind_field_cell : wind_field_ )
+	// Wind field
+	for( unsigned int y= 0u; y < MapData::c_map_size; y++ )
+	for( unsigned int x= 0u; x < MapData::c_map_size; x++ )
 	{
-		save_stream.WriteInt8( int8_t( wind_field_cell[0] ) );
-		save_stream.WriteInt8( int8_t( wind_field_cell[1] ) );
+		WindCell wind_field_cell{ { 0, 0 } };
+		if( const WindCell* const cell= wind_field_.Get( x, y ) )
+			wind_field_cell= *cell;
+		save_stream.WriteInt8( int8_t( wind_field_cell.dir[0] ) );
+		save_stream.WriteInt8( int8_t( wind_field_cell.dir[1] ) );
 	}
 
 	// Death field
-	for( const DamageFiledCell& damage_field_cell : death_field_ )
+	for( unsigned int y= 0u; y < MapData::c_map_size; y++ )
+	for( unsigned int x= 0u; x < MapData::c_map_size; x++ )
 	{
+		DamageFiledCell damage_field_cell{ 0u, 0, 0 };
+		if( const DamageFiledCell* const cell= death_field_.Get( x, y ) )
+			damage_field_cell= *cell;
 		save_stream.WriteUInt8( damage_field_cell.damage );
 		save_stream.WriteInt8( damage_field_cell.z_bottom );
 		save_stream.WriteInt8( damage_field_cell.z_top );
@@ -393,20 +404,59 @@ Map::Map(
 		load_stream.ReadUInt16( light_source.turn_on_time_ms );
 	}
 
-	// Wind field
+	// Fields are saved as full arrays of cells. Fill sparse fields with horizontal spans of equal nonempty cells.
 	// TODO - optimize large arrays saving
-	for( char* const wind_field_cell : wind_field_ )
+	// Wind field
+	for( unsigned int y= 0u; y < MapData::c_map_size; y++ )
 	{
-		load_stream.ReadInt8( reinterpret_cast<int8_t&>(wind_field_cell[0]) );
-		load_stream.ReadInt8( reinterpret_cast<int8_t&>(wind_field_cell[1]) );
+		WindCell row[ MapData::c_map_size ];
+		for( WindCell& wind_field_cell : row )
+		{
+			load_stream.ReadInt8( reinterpret_cast<int8_t&>(wind_field_cell.dir[0]) );
+			load_stream.ReadInt8( reinterpret_cast<int8_t&>(wind_field_cell.dir[1]) );
+		}
+
+		for( unsigned int x= 0u; x < MapData::c_map_size; )
+		{
+			unsigned int span_end= x + 1u;
+			while( span_end < MapData::c_map_size && std::memcmp( &row[span_end], &row[x], sizeof(WindCell) ) == 0 )
+				span_end++;
+
+			if( row[x].dir[0] != 0 || row[x].dir[1] != 0 )
+				wind_field_.Fill( x, y, span_end - 1u, y, row[x] );
+			x= span_end;
+		}
 	}
 
 	// Death field
-	for( DamageFiledCell& damage_field_cell : death_field_ )
+	for( unsigned int y= 0u; y < MapData::c_map_size; y++ )
+	{
+		DamageFiledCell row[ MapData::c_map_size ];
+		for( DamageFiledCell& damage_field_cell : row )
+		{
+			load_stream.ReadUInt8( damage_field_cell.damage );
+			load_stream.ReadInt8( damage_field_cell.z_bottom );
+			load_stream.ReadInt8( damage_field_cell.z_top );
+		}
+
+		for( unsigned int x= 0u; x < MapData::c_map_size; )
+		{
+			unsigned int span_end= x + 1u;
+			while( span_end < MapData::c_map_size && std::memcmp( &row[span_end], &row[x], sizeof(DamageFiledCell) ) == 0 )
+				span_end++;
+
+			if( row[x].damage > 0u )
+				death_field_.Fill( x, y, span_end - 1u, y, row[x] );
+			x= span_end;
+		}
+	}
+
+	// Restore procedures scheduling. Not stopped procedures will be rescheduled in first tick.
+	BuildProceduresObjectsLinks();
+	for( unsigned int p= 0u; p < procedures_.size(); p++ )
 	{
-		load_stream.ReadUInt8( damage_field_cell.damage );
-		load_stream.ReadInt8( damage_field_cell.z_bottom );
-		load_stream.ReadInt8( damage_field_cell.z_top );
+		if( procedures_[p].movement_state != ProcedureState::MovementState::None )
+			AddActiveProcedure( p );
 	}
 }
 
@@ -99,18 +99,28 @@ unsigned char MonsterBase::GetBodyPartsMask() const
 	return mask;
 }
 
+void MonsterBase::GetShotCylinder( float& out_radius, m_Vec2& out_z_minmax ) const
+{
+	const Model& model= game_resources_->monsters_models[ monster_id_ ];
+	const GameResources::MonsterDescription& description= game_resources_->monsters_description[ monster_id_ ];
+
+	out_radius= description.w_radius;
+	out_z_minmax= m_Vec2( model.z_min, model.z_max );
+}
+
 bool MonsterBase::TryShot( const m_Vec3& from, const m_Vec3& direction_normalized, m_Vec3& out_pos ) const
 {
 	if( health_ <= 0 )
 		return false;
 
-	const Model& model= game_resources_->monsters_models[ monster_id_ ];
-	const GameResources::MonsterDescription& description= game_resources_->monsters_description[ monster_id_ ];
+	float radius;
+	m_Vec2 z_minmax;
+	GetShotCylinder( radius, z_minmax );
 
 	return
 		RayIntersectCylinder(
-			pos_.xy(), description.w_radius,
-			pos_.z + model.z_min, pos_.z + model.z_max,
+			pos_.xy(), radius,
+			pos_.z + z_minmax.x, pos_.z + z_minmax.y,
 			from, direction_normalized,
 			out_pos );
 }
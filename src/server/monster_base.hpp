@@ -41,6 +41,8 @@ public:
 	unsigned int CurrentAnimationFrame() const;
 	unsigned char GetBodyPartsMask() const;
 
+	// Cylinder for shots. z_minmax is relative to position.
+	void GetShotCylinder( float& out_radius, m_Vec2& out_z_minmax ) const;
 	bool TryShot( const m_Vec3& from, const m_Vec3& direction_normalized, m_Vec3& out_pos ) const;
 
 	void SetMovementRestriction( const MovementRestriction& restriction );
@@ -0,0 +1,70 @@
+#include "../assert.hpp"
+
+#include "monsters_positions_history.hpp"
+
+namespace PanzerChasm
+{
+
+void MonstersPositionsHistory::Frame::Clear( const Time in_time )
+{
+	time= in_time;
+	ids.clear();
+	x.clear();
+	y.clear();
+	z_min.clear();
+	z_max.clear();
+	radius.clear();
+}
+
+void MonstersPositionsHistory::Frame::AddMonster( const EntityId id, const m_Vec3& pos, const float in_radius, const m_Vec2& z_minmax )
+{
+	ids.push_back( id );
+	x.push_back( pos.x );
+	y.push_back( pos.y );
+	z_min.push_back( pos.z + z_minmax.x );
+	z_max.push_back( pos.z + z_minmax.y );
+	radius.push_back( in_radius );
+}
+
+MonstersPositionsHistory::MonstersPositionsHistory()
+{}
+
+MonstersPositionsHistory::~MonstersPositionsHistory()
+{}
+
+MonstersPositionsHistory::Frame& MonstersPositionsHistory::BeginFrame( const Time time )
+{
+	if( frame_count_ > 0u )
+		current_frame_= ( current_frame_ + 1u ) % c_max_frames;
+	if( frame_count_ < c_max_frames )
+		frame_count_++;
+
+	Frame& frame= frames_[ current_frame_ ];
+	frame.Clear( time );
+	return frame;
+}
+
+void MonstersPositionsHistory::Clear()
+{
+	frame_count_= 0u;
+	current_frame_= 0u;
+}
+
+const MonstersPositionsHistory::Frame* MonstersPositionsHistory::GetFrame( const Time time ) const
+{
+	if( frame_count_ == 0u )
+		return nullptr;
+
+	// Go from newest frames to oldest.
+	const Frame* frame= nullptr;
+	for( unsigned int i= 0u; i < frame_count_; i++ )
+	{
+		frame= &frames_[ ( current_frame_ + c_max_frames - i ) % c_max_frames ];
+		if( frame->time <= time )
+			break;
+	}
+
+	return frame;
+}
+
+} // namespace PanzerChasm
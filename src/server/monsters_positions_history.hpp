@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+
+#include <vec.hpp>
+
+#include "../fwd.hpp"
+#include "../time.hpp"
+
+namespace PanzerChasm
+{
+
+// Ring of monsters positions in previous ticks. Used for lag compensation of hitscan shots.
+class MonstersPositionsHistory final
+{
+public:
+	// Positions and bounding cylinders of alive monsters in one tick.
+	// Structure of arrays - shots iterate over all monsters, but need only few fields.
+	struct Frame
+	{
+		// Clears arrays, but keeps their capacity.
+		void Clear( Time in_time );
+		void AddMonster( EntityId id, const m_Vec3& pos, float radius, const m_Vec2& z_minmax );
+
+		Time time= Time::FromSeconds(0);
+		std::vector<EntityId> ids;
+		std::vector<float> x;
+		std::vector<float> y;
+		std::vector<float> z_min;
+		std::vector<float> z_max;
+		std::vector<float> radius;
+	};
+
+	static constexpr unsigned int c_max_frames= 64u;
+
+public:
+	MonstersPositionsHistory();
+	~MonstersPositionsHistory();
+
+	// Starts new frame and returns it for filling. Oldest frame is overwritten.
+	Frame& BeginFrame( Time time );
+
+	void Clear();
+
+	// Returns latest frame with time <= given time, or oldest frame, if all frames are later.
+	// Returns nullptr, if history is empty.
+	const Frame* GetFrame( Time time ) const;
+
+private:
+	Frame frames_[ c_max_frames ];
+	unsigned int frame_count_= 0u;
+	unsigned int current_frame_= 0u;
+};
+
+} // namespace PanzerChasm
@@ -854,6 +854,16 @@ void Player::SetName( std::string name )
 	name_= std::move(name);
 }
 
+void Player::SetViewTime( const Time view_time )
+{
+	view_time_= view_time;
+}
+
+Time Player::GetViewTime() const
+{
+	return view_time_;
+}
+
 bool Player::Move( const Time time_delta )
 {
 	const float time_delta_s= time_delta.ToSeconds();
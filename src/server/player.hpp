@@ -95,6 +95,10 @@ public:
 
 	void SetName( std::string name );
 
+	// Server time of state, which player saw in moment of last input. Used for lag compensation.
+	void SetViewTime( Time view_time );
+	Time GetViewTime() const;
+
 private:
 	// Returns true, if jumped.
 	bool Move( Time time_delta );
@@ -177,6 +181,7 @@ private:
 
 	unsigned int frags_= 0u; // Multiplayer only, do not save
 	std::string name_; // Multiplayer only, do not save
+	Time view_time_= Time::FromSeconds(0); // Multiplayer only, do not save
 
 	std::vector<Messages::PlayerItemPickup> pickup_messages_;
 	std::vector<Messages::FullscreenBlendEffect> fullscreen_blend_messages_;
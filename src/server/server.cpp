@@ -3,6 +3,7 @@
 #include "../log.hpp"
 #include "../math_utils.hpp"
 #include "../messages_extractor.inl"
+#include "../profiler.hpp"
 #include "../save_load_streams.hpp"
 #include "player.hpp"
 
@@ -33,6 +34,7 @@ Server::Server(
 	, text_message_callback_( std::bind( &Server::AddTextMessage, this, std::placeholders::_1 ) )
 	, last_tick_( Time::CurrentTime() )
 	, server_accumulated_time_( Time::FromSeconds(0) )
+	, states_times_( c_states_history_size, Time::FromSeconds(0) )
 {
 	PC_ASSERT( game_resources_ != nullptr );
 	PC_ASSERT( map_loader_ != nullptr );
@@ -58,6 +60,8 @@ Server::~Server()
 
 void Server::Loop( bool paused )
 {
+	PC_PROFILER_ZONE( "Server::Loop" );
+
 	if( paused )
 	{
 		last_tick_= Time::CurrentTime();
@@ -170,6 +174,8 @@ void Server::Loop( bool paused )
 		if( map_ != nullptr )
 			map_->Tick( map_ticks_[t].end, map_ticks_[t].duration );
 
+		const Time players_start_time= tick_stats_ != nullptr ? Time::CurrentTime() : Time::FromSeconds(0);
+
 		// Process players position
 		for( const ConnectedPlayerPtr& connected_player : players_ )
 		{
@@ -179,8 +185,19 @@ void Server::Loop( bool paused )
 					connected_player->player_monster_id,
 					connected_player->connection_info.messages_sender );
 		}
+
+		if( tick_stats_ != nullptr )
+			tick_stats_->players+= Time::CurrentTime() - players_start_time;
 	}
 
+	const Time messages_start_time= tick_stats_ != nullptr ? Time::CurrentTime() : Time::FromSeconds(0);
+
+	// Remember time of sent state, because clients will report us, which state they see.
+	state_id_++;
+	if( state_id_ == 0u )
+		state_id_= 1u;
+	states_times_[ state_id_ % c_states_history_size ]= server_accumulated_time_;
+
 	// Send messages
 	Messages::ServerState server_state_message;
 	BuildServerStateMessage( server_state_message );
@@ -222,6 +239,9 @@ void Server::Loop( bool paused )
 
 	text_massages_.clear();
 
+	if( tick_stats_ != nullptr )
+		tick_stats_->messages+= Time::CurrentTime() - messages_start_time;
+
 	// Change map, if needed at end of this loop
 	if( map_end_triggered_ )
 	{
@@ -285,6 +305,8 @@ bool Server::ChangeMap(
 			server_accumulated_time_,
 			map_end_callback_,
 			text_message_callback_ ) );
+	map_->SetTickStats( tick_stats_ );
+	map_->SetLagCompensationMaxTime( lag_compensation_max_time_ );
 
 	map_end_triggered_= false;
 	join_first_client_with_existing_player_= false;
@@ -394,6 +416,8 @@ bool Server::Load( const SaveLoadBuffer& buffer, unsigned int& buffer_pos )
 			game_resources_,
 			map_end_callback_,
 			text_message_callback_ ) );
+	map_->SetTickStats( tick_stats_ );
+	map_->SetLagCompensationMaxTime( lag_compensation_max_time_ );
 
 	map_end_triggered_= false;
 	join_first_client_with_existing_player_= true;
@@ -434,6 +458,12 @@ void Server::operator()( const Messages::PlayerMove& message )
 	if( current_map_data_ == nullptr )
 		return;
 
+	// If state is unknown or too old, assume, that player sees current state.
+	if( message.acknowledged_state_id != 0u && state_id_ - message.acknowledged_state_id < c_states_history_size )
+		current_player_->player->SetViewTime( states_times_[ message.acknowledged_state_id % c_states_history_size ] );
+	else
+		current_player_->player->SetViewTime( server_accumulated_time_ );
+
 	if( current_player_->player->IsFullyDead() )
 	{
 		// Respawn when player press shoot-button.
@@ -488,9 +518,45 @@ void Server::operator()( const Messages::PlayerName& message )
 	}
 }
 
+void Server::SetFixedTickDuration( const Time duration )
+{
+	fixed_tick_duration_= duration;
+}
+
+void Server::SetTickStats( Map::TickStats* const tick_stats )
+{
+	tick_stats_= tick_stats;
+	if( map_ != nullptr )
+		map_->SetTickStats( tick_stats_ );
+}
+
+void Server::SetLagCompensationMaxTime( const Time max_time )
+{
+	lag_compensation_max_time_= max_time;
+	if( map_ != nullptr )
+		map_->SetLagCompensationMaxTime( lag_compensation_max_time_ );
+}
+
+Map* Server::GetMap()
+{
+	return map_.get();
+}
+
 void Server::UpdateTimes()
 {
 	const Time current_time= Time::CurrentTime();
+
+	if( fixed_tick_duration_ != Time::FromSeconds(0) )
+	{
+		// Game time does not depend on real time.
+		map_tick_count_= 1u;
+		map_ticks_[0].end= server_accumulated_time_ + fixed_tick_duration_;
+		map_ticks_[0].duration= fixed_tick_duration_;
+		server_accumulated_time_+= fixed_tick_duration_;
+		last_tick_= current_time;
+		return;
+	}
+
 	Time dt= current_time - last_tick_;
 
 	const float dt_s= dt.ToSeconds();
@@ -560,6 +626,7 @@ void Server::BuildServerStateMessage( Messages::ServerState& message )
 	PC_ASSERT( players_.size() <= GameConstants::max_players );
 
 	message.map_time_s= 0; // TODO - calculate time.
+	message.state_id= state_id_;
 	message.game_rules= game_rules_;
 	message.player_count= players_.size();
 	for( unsigned int i= 0u; i < players_.size(); i++ )
@@ -12,6 +12,9 @@ namespace PanzerChasm
 
 class Server final
 {
+public:
+	static constexpr int c_default_lag_compensation_max_ms= 200;
+
 public:
 	Server(
 		CommandsProcessor& commands_processor,
@@ -32,6 +35,19 @@ public:
 
 	void DisconnectAllClients();
 
+	// If duration is nonzero, each loop makes exactly one map tick with this duration, independent of real time.
+	// Used for benchmarks, where results must be reproducible.
+	void SetFixedTickDuration( Time duration );
+
+	// Stats are accumulated in each loop. Pass nullptr to stop collecting.
+	void SetTickStats( Map::TickStats* tick_stats );
+
+	// Max rewind time for hitscan shots of players in multiplayer games. Zero disables lag compensation.
+	void SetLagCompensationMaxTime( Time max_time );
+
+	// Returns nullptr, if map is not started.
+	Map* GetMap();
+
 public: // Messages handlers
 	void operator()( const Messages::MessageBase& message );
 	void operator()( const Messages::DummyNetMessage& ) {}
@@ -62,6 +78,9 @@ private:
 	};
 	static constexpr unsigned int c_max_multiple_map_ticks= 6u;
 
+	// Times of last sent server states. Older states are not used for lag compensation.
+	static constexpr unsigned int c_states_history_size= 64u;
+
 private:
 	void UpdateTimes();
 	void BuildServerStateMessage( Messages::ServerState& message );
@@ -102,6 +121,13 @@ private:
 
 	TickTime map_ticks_[ c_max_multiple_map_ticks ];
 	unsigned int map_tick_count_;
+	Time fixed_tick_duration_= Time::FromSeconds(0);
+
+	Map::TickStats* tick_stats_= nullptr;
+
+	Time lag_compensation_max_time_= Time::FromSeconds(0);
+	unsigned int state_id_= 0u;
+	std::vector<Time> states_times_;
 
 	std::vector<Messages::DynamicTextMessage> text_massages_;
 
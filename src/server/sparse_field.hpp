@@ -0,0 +1,192 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "../assert.hpp"
+#include "../map_loader.hpp"
+
+namespace PanzerChasm
+{
+
+// Sparse field of map cells, which is usually empty.
+// Stores list of filled rectangles and mask of nonempty cells.
+// Value of cell is value of latest filled rectangle, containing this cell.
+template<class Cell>
+class SparseField final
+{
+public:
+	static constexpr unsigned int c_size= MapData::c_map_size;
+
+public:
+	SparseField();
+
+	// Rectangles are inclusive. Parts of rectangles outside field are ignored.
+	void Fill( unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1, const Cell& cell );
+	void Clear( unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1 );
+
+	bool IsEmpty() const;
+	bool HasNonemptyCells( unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1 ) const;
+
+	// Returns nullptr for empty cell.
+	const Cell* Get( unsigned int x, unsigned int y ) const;
+
+private:
+	struct Region
+	{
+		unsigned char x0, y0, x1, y1;
+		Cell cell;
+	};
+
+	static_assert( c_size == 64u, "Mask row must be 64 bit" );
+
+private:
+	static uint64_t GetRowMask( unsigned int x0, unsigned int x1 );
+
+	// Remove regions, which have no own nonempty cells.
+	void RemoveUnusedRegions();
+
+private:
+	std::vector<Region> regions_;
+	uint64_t rows_masks_[ c_size ];
+};
+
+template<class Cell>
+SparseField<Cell>::SparseField()
+{
+	std::fill( rows_masks_, rows_masks_ + c_size, uint64_t(0u) );
+}
+
+template<class Cell>
+void SparseField<Cell>::Fill( const unsigned int x0, const unsigned int y0, unsigned int x1, unsigned int y1, const Cell& cell )
+{
+	if( x0 >= c_size || y0 >= c_size || x0 > x1 || y0 > y1 )
+		return;
+	x1= std::min( x1, c_size - 1u );
+	y1= std::min( y1, c_size - 1u );
+
+	// Old regions, fully covered by new region, are not needed anymore.
+	regions_.erase(
+		std::remove_if(
+			regions_.begin(), regions_.end(),
+			[&]( const Region& region )
+			{
+				return region.x0 >= x0 && region.x1 <= x1 && region.y0 >= y0 && region.y1 <= y1;
+			} ),
+		regions_.end() );
+
+	Region region;
+	region.x0= static_cast<unsigned char>(x0);
+	region.y0= static_cast<unsigned char>(y0);
+	region.x1= static_cast<unsigned char>(x1);
+	region.y1= static_cast<unsigned char>(y1);
+	region.cell= cell;
+	regions_.push_back( region );
+
+	const uint64_t row_mask= GetRowMask( x0, x1 );
+	for( unsigned int y= y0; y <= y1; y++ )
+		rows_masks_[y]|= row_mask;
+}
+
+template<class Cell>
+void SparseField<Cell>::Clear( const unsigned int x0, const unsigned int y0, unsigned int x1, unsigned int y1 )
+{
+	if( x0 >= c_size || y0 >= c_size || x0 > x1 || y0 > y1 )
+		return;
+	x1= std::min( x1, c_size - 1u );
+	y1= std::min( y1, c_size - 1u );
+
+	const uint64_t row_mask= GetRowMask( x0, x1 );
+	for( unsigned int y= y0; y <= y1; y++ )
+		rows_masks_[y]&= ~row_mask;
+
+	RemoveUnusedRegions();
+}
+
+template<class Cell>
+bool SparseField<Cell>::IsEmpty() const
+{
+	return regions_.empty();
+}
+
+template<class Cell>
+bool SparseField<Cell>::HasNonemptyCells( const unsigned int x0, const unsigned int y0, const unsigned int x1, const unsigned int y1 ) const
+{
+	PC_ASSERT( x0 <= x1 && x1 < c_size );
+	PC_ASSERT( y0 <= y1 && y1 < c_size );
+
+	const uint64_t row_mask= GetRowMask( x0, x1 );
+	for( unsigned int y= y0; y <= y1; y++ )
+		if( ( rows_masks_[y] & row_mask ) != 0u )
+			return true;
+	return false;
+}
+
+template<class Cell>
+const Cell* SparseField<Cell>::Get( const unsigned int x, const unsigned int y ) const
+{
+	PC_ASSERT( x < c_size && y < c_size );
+
+	if( ( rows_masks_[y] & ( uint64_t(1u) << x ) ) == 0u )
+		return nullptr;
+
+	// Latest region has priority.
+	for( auto it= regions_.rbegin(); it != regions_.rend(); ++it )
+	{
+		if( x >= it->x0 && x <= it->x1 && y >= it->y0 && y <= it->y1 )
+			return &it->cell;
+	}
+
+	PC_ASSERT(false);
+	return nullptr;
+}
+
+template<class Cell>
+uint64_t SparseField<Cell>::GetRowMask( const unsigned int x0, const unsigned int x1 )
+{
+	PC_ASSERT( x0 <= x1 && x1 < c_size );
+
+	const uint64_t high_bits= x1 == c_size - 1u ? ~uint64_t(0u) : ( ( uint64_t(1u) << ( x1 + 1u ) ) - 1u );
+	return high_bits & ~( ( uint64_t(1u) << x0 ) - 1u );
+}
+
+template<class Cell>
+void SparseField<Cell>::RemoveUnusedRegions()
+{
+	// Region is used, if it is latest region for some nonempty cell.
+	std::vector<bool> region_used( regions_.size(), false );
+	for( unsigned int y= 0u; y < c_size; y++ )
+	{
+		uint64_t row_mask= rows_masks_[y];
+		while( row_mask != 0u )
+		{
+			unsigned int x= 0u;
+			while( ( row_mask & ( uint64_t(1u) << x ) ) == 0u )
+				x++;
+			row_mask&= ~( uint64_t(1u) << x );
+
+			for( unsigned int r= static_cast<unsigned int>( regions_.size() ); r > 0u; r-- )
+			{
+				const Region& region= regions_[ r - 1u ];
+				if( x >= region.x0 && x <= region.x1 && y >= region.y0 && y <= region.y1 )
+				{
+					region_used[ r - 1u ]= true;
+					break;
+				}
+			}
+		}
+	}
+
+	unsigned int dst= 0u;
+	for( unsigned int r= 0u; r < regions_.size(); r++ )
+	{
+		if( region_used[r] )
+		{
+			regions_[dst]= regions_[r];
+			dst++;
+		}
+	}
+	regions_.resize( dst );
+}
+
+} // namespace PanzerChasm
@@ -0,0 +1,56 @@
+#include <algorithm>
+
+#include "../assert.hpp"
+
+#include "timer_wheel.hpp"
+
+namespace PanzerChasm
+{
+
+TimerWheel::TimerWheel()
+	: last_checked_slot_(0)
+{}
+
+TimerWheel::~TimerWheel()
+{}
+
+void TimerWheel::Add( const Time time, const unsigned int id )
+{
+	// Timers in past must be placed into slot, which will be checked in next call.
+	const int64_t slot= std::max( GetAbsoluteSlot( time ), last_checked_slot_ );
+
+	Timer timer{ time, id };
+	slots_[ slot % int64_t(c_slot_count) ].push_back( timer );
+	timer_count_++;
+}
+
+void TimerWheel::Clear()
+{
+	for( std::vector<Timer>& slot : slots_ )
+		slot.clear();
+	timer_count_= 0u;
+}
+
+int64_t TimerWheel::GetAbsoluteSlot( const Time time )
+{
+	return std::max( time.GetInternalRepresentation(), int64_t(0) ) / c_slot_duration;
+}
+
+void TimerWheel::CollectExpired( std::vector<Timer>& slot, const Time current_time )
+{
+	for( unsigned int i= 0u; i < slot.size(); )
+	{
+		if( slot[i].time <= current_time )
+		{
+			expired_timers_.push_back( slot[i] );
+			slot[i]= slot.back();
+			slot.pop_back();
+			PC_ASSERT( timer_count_ > 0u );
+			timer_count_--;
+		}
+		else
+			i++;
+	}
+}
+
+} // namespace PanzerChasm
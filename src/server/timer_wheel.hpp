@@ -0,0 +1,78 @@
+#pragma once
+#include <vector>
+
+#include "../time.hpp"
+
+namespace PanzerChasm
+{
+
+// Hashed timer wheel. Each timer is placed in slot, which depends on timer time.
+// Only slots, which time passed since previous call, are checked in each call.
+class TimerWheel final
+{
+public:
+	TimerWheel();
+	~TimerWheel();
+
+	void Add( Time time, unsigned int id );
+	void Clear();
+
+	// Calls func( id ) for each timer with time <= current_time and removes this timer.
+	// Timers, added inside func, will be processed in next call.
+	template<class Func>
+	void PopExpired( Time current_time, const Func& func );
+
+private:
+	struct Timer
+	{
+		Time time;
+		unsigned int id;
+	};
+
+	static constexpr unsigned int c_slot_count= 64u;
+	static constexpr int64_t c_slot_duration= 500; // In time internal units - 50 ms.
+
+private:
+	static int64_t GetAbsoluteSlot( Time time );
+	void CollectExpired( std::vector<Timer>& slot, Time current_time );
+
+private:
+	std::vector<Timer> slots_[ c_slot_count ];
+	unsigned int timer_count_= 0u;
+
+	// Last slot, checked in PopExpired. It may contain not expired timers, so, it is checked again in next call.
+	int64_t last_checked_slot_;
+
+	std::vector<Timer> expired_timers_;
+};
+
+template<class Func>
+void TimerWheel::PopExpired( const Time current_time, const Func& func )
+{
+	if( timer_count_ == 0u )
+	{
+		last_checked_slot_= GetAbsoluteSlot( current_time );
+		return;
+	}
+
+	const int64_t current_slot= GetAbsoluteSlot( current_time );
+	if( current_slot - last_checked_slot_ >= int64_t(c_slot_count) || current_slot < last_checked_slot_ )
+	{
+		// Too long time passed, or time goes back - check all slots.
+		for( std::vector<Timer>& slot : slots_ )
+			CollectExpired( slot, current_time );
+	}
+	else
+	{
+		for( int64_t s= last_checked_slot_; s <= current_slot; s++ )
+			CollectExpired( slots_[ s % int64_t(c_slot_count) ], current_time );
+	}
+	last_checked_slot_= current_slot;
+
+	// Call func after collecting, because func may add new timers.
+	for( const Timer& timer : expired_timers_ )
+		func( timer.id );
+	expired_timers_.clear();
+}
+
+} // namespace PanzerChasm
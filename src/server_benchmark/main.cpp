@@ -0,0 +1,258 @@
+// main.cpp - server tick benchmark entry point
+// Loads map, connects scripted bots via loopback buffers, spawns extra monsters
+// and runs fixed number of server ticks with fixed game time step.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "../commands_processor.hpp"
+#include "../connection_info.hpp"
+#include "../game_constants.hpp"
+#include "../game_resources.hpp"
+#include "../log.hpp"
+#include "../loopback_buffer.hpp"
+#include "../map_loader.hpp"
+#include "../math_utils.hpp"
+#include "../messages_extractor.inl"
+#include "../program_arguments.hpp"
+#include "../rand.hpp"
+#include "../server/server.hpp"
+#include "../settings.hpp"
+#include "../vfs.hpp"
+using namespace PanzerChasm;
+
+namespace
+{
+
+class BotsConnectionsListener final : public IConnectionsListener
+{
+public:
+	void AddBuffer( const LoopbackBufferPtr& buffer )
+	{
+		buffers_.push_back( buffer );
+	}
+
+public: // IConnectionsListener
+	virtual IConnectionPtr GetNewConnection() override
+	{
+		for( const LoopbackBufferPtr& buffer : buffers_ )
+		{
+			if( const IConnectionPtr connection= buffer->GetNewConnection() )
+				return connection;
+		}
+		return nullptr;
+	}
+
+private:
+	std::vector<LoopbackBufferPtr> buffers_;
+};
+
+// Bots ignore all server messages, but messages must be read, to prevent loopback buffers grow.
+struct IgnoreMessagesHandler
+{
+	template<class Message>
+	void operator()( const Message& ){}
+};
+
+struct Bot
+{
+	LoopbackBufferPtr buffer;
+	std::unique_ptr<ConnectionInfo> connection_info;
+};
+
+void BuildBotMove( const unsigned int bot_index, const unsigned int tick, Messages::PlayerMove& message )
+{
+	// Simple deterministic script - run in circles with different radius, look around, shoot periodically.
+	const float phase= float(tick) / 60.0f + float(bot_index) * 0.7f;
+	const float view_angle= phase * ( 0.5f + 0.1f * float( bot_index % 5u ) );
+	const float move_angle= view_angle + std::sin( phase * 0.3f ) * Constants::half_pi;
+
+	message.view_direction= AngleToMessageAngle( view_angle + Constants::half_pi );
+	message.move_direction= AngleToMessageAngle( move_angle );
+	message.acceleration= ( tick / 120u + bot_index ) % 4u == 0u ? 0u : 255u;
+	message.weapon_index= static_cast<unsigned char>( ( tick / 300u + bot_index ) % GameConstants::weapon_count );
+	message.view_dir_angle_x= AngleToMessageAngle( std::sin( phase ) * 0.3f );
+	message.view_dir_angle_z= AngleToMessageAngle( view_angle );
+	message.shoot_pressed= ( tick / 20u + bot_index ) % 3u == 0u;
+	message.jump_pressed= ( tick + bot_index * 17u ) % 90u == 0u;
+	message.color= bot_index % 16u;
+	message.acknowledged_state_id= 0u; // Bots do not read server state, so, they do not need lag compensation.
+}
+
+unsigned int GetUIntParam( const ProgramArguments& program_arguments, const char* const name, const unsigned int default_value )
+{
+	if( const char* const value= program_arguments.GetParamValue( name ) )
+		return static_cast<unsigned int>( std::max( 0, std::atoi( value ) ) );
+	return default_value;
+}
+
+double TimeToMs( const Time& time )
+{
+	return double( time.GetInternalRepresentation() ) * 1000.0 / double( Time::FromSeconds(1).GetInternalRepresentation() );
+}
+
+double Percentile( const std::vector<double>& sorted_values, const double p )
+{
+	if( sorted_values.empty() )
+		return 0.0;
+	const size_t index= std::min( sorted_values.size() - 1u, static_cast<size_t>( p * double( sorted_values.size() ) ) );
+	return sorted_values[index];
+}
+
+} // namespace
+
+extern "C" int main( int argc, char *argv[] )
+{
+	// Skip first param - program path.
+	argc--;
+	argv++;
+
+	const ProgramArguments program_arguments( argc, argv );
+
+	const unsigned int map_number= std::max( 1u, GetUIntParam( program_arguments, "map", 1u ) );
+	const unsigned int bot_count= std::min( GetUIntParam( program_arguments, "bots", 4u ), GameConstants::max_players );
+	const unsigned int extra_monster_count= GetUIntParam( program_arguments, "monsters", 32u );
+	const unsigned int tick_count= std::max( 1u, GetUIntParam( program_arguments, "ticks", 3000u ) );
+	const unsigned int warmup_tick_count= GetUIntParam( program_arguments, "warmup", 60u );
+	const unsigned int tick_rate= std::max( 1u, GetUIntParam( program_arguments, "tickrate", 60u ) );
+	const LongRand::RandResultType seed= GetUIntParam( program_arguments, "seed", 0u );
+
+	GameRules game_rules= GameRules::Cooperative;
+	if( const char* const rules= program_arguments.GetParamValue( "rules" ) )
+		game_rules= std::strcmp( rules, "deathmatch" ) == 0 ? GameRules::Deathmatch : GameRules::Cooperative;
+
+	Settings settings( "PanzerChasmServerBenchmark.cfg" );
+	CommandsProcessor commands_processor( settings );
+
+	const VfsPtr vfs=
+		std::make_shared<Vfs>(
+			program_arguments.GetParamValue( "csm" ) != nullptr ? program_arguments.GetParamValue( "csm" ) : "CSM.BIN",
+			program_arguments.GetParamValue( "addon" ) );
+
+	const GameResourcesConstPtr game_resources= LoadGameResources( vfs );
+	const MapLoaderPtr map_loader= std::make_shared<MapLoader>( vfs );
+
+	const std::shared_ptr<BotsConnectionsListener> connections_listener= std::make_shared<BotsConnectionsListener>();
+
+	Server server(
+		commands_processor,
+		game_resources,
+		map_loader,
+		connections_listener,
+		DrawLoadingCallback() );
+
+	server.SetFixedTickDuration( Time::FromSeconds( 1.0 / double(tick_rate) ) );
+
+	if( !server.ChangeMap( map_number, Difficulty::Hard, game_rules ) )
+	{
+		Log::Warning( "Can not load map ", map_number );
+		return -1;
+	}
+
+	// Map may be changed during benchmark, if it ends. Use this pointer only before first tick.
+	Map& map= *server.GetMap();
+	map.SetRandomSeed( seed );
+
+	{ // Spawn extra monsters in places of map monsters and spawn points.
+		const MapDataConstPtr map_data= map_loader->LoadMap( map_number );
+		LongRand rand( seed );
+
+		if( !map_data->monsters.empty() && game_resources->monsters_description.size() > 1u )
+		{
+			for( unsigned int i= 0u; i < extra_monster_count; i++ )
+			{
+				MapData::Monster monster= map_data->monsters[ rand.Rand() % map_data->monsters.size() ];
+				monster.monster_id= static_cast<unsigned char>( 1u + rand.Rand() % ( game_resources->monsters_description.size() - 1u ) );
+				monster.angle= rand.RandAngle();
+				monster.difficulty_flags= ~0u;
+				map.SpawnMonster( monster, Time::FromSeconds(0) );
+			}
+		}
+	}
+
+	std::vector<Bot> bots( bot_count );
+	for( Bot& bot : bots )
+	{
+		bot.buffer= std::make_shared<LoopbackBuffer>();
+		connections_listener->AddBuffer( bot.buffer );
+		bot.buffer->RequestConnect();
+		bot.connection_info.reset( new ConnectionInfo( bot.buffer->GetClientSideConnection() ) );
+	}
+
+	IgnoreMessagesHandler ignore_messages_handler;
+	Map::TickStats tick_stats;
+	std::vector<double> ticks_durations_ms;
+	ticks_durations_ms.reserve( tick_count );
+
+	Log::Info( "Run ", warmup_tick_count, " warmup ticks and ", tick_count, " ticks with ", bot_count, " bots and ", extra_monster_count, " extra monsters" );
+
+	for( unsigned int tick= 0u; tick < warmup_tick_count + tick_count; tick++ )
+	{
+		if( tick == 1u )
+		{
+			// Bots are connected at first tick. Give them weapons and make them immortal, to keep load stable.
+			commands_processor.ProcessCommand( "weapon" );
+			commands_processor.ProcessCommand( "ammo" );
+			commands_processor.ProcessCommand( "chojin" );
+		}
+		if( tick == warmup_tick_count )
+		{
+			tick_stats= Map::TickStats();
+			server.SetTickStats( &tick_stats );
+		}
+
+		for( unsigned int b= 0u; b < bots.size(); b++ )
+		{
+			Messages::PlayerMove message;
+			BuildBotMove( b, tick, message );
+			bots[b].connection_info->messages_sender.SendUnreliableMessage( message );
+			bots[b].connection_info->messages_sender.Flush();
+		}
+
+		const Time tick_start_time= Time::CurrentTime();
+		server.Loop( false );
+		const Time tick_end_time= Time::CurrentTime();
+
+		for( Bot& bot : bots )
+			bot.connection_info->messages_extractor.ProcessMessages( ignore_messages_handler );
+
+		if( tick >= warmup_tick_count )
+			ticks_durations_ms.push_back( TimeToMs( tick_end_time - tick_start_time ) );
+	}
+
+	server.SetTickStats( nullptr );
+
+	double total_ms= 0.0;
+	for( const double duration : ticks_durations_ms )
+		total_ms+= duration;
+
+	std::sort( ticks_durations_ms.begin(), ticks_durations_ms.end() );
+
+	const double tick_count_d= double( ticks_durations_ms.size() );
+	std::printf( "ticks: %u, monsters at end: %u\n",
+		tick_count,
+		server.GetMap() == nullptr ? 0u : static_cast<unsigned int>( server.GetMap()->GetMonsters().size() ) );
+	std::printf( "tick time, ms: avg %.4f, p50 %.4f, p99 %.4f, max %.4f\n",
+		total_ms / tick_count_d,
+		Percentile( ticks_durations_ms, 0.50 ),
+		Percentile( ticks_durations_ms, 0.99 ),
+		ticks_durations_ms.back() );
+	std::printf( "phases per tick, ms:\n" );
+	std::printf( "  procedures  %.4f\n", TimeToMs( tick_stats.procedures  ) / tick_count_d );
+	std::printf( "  map objects %.4f\n", TimeToMs( tick_stats.map_objects ) / tick_count_d );
+	std::printf( "  rockets     %.4f\n", TimeToMs( tick_stats.rockets     ) / tick_count_d );
+	std::printf( "  monsters    %.4f\n", TimeToMs( tick_stats.monsters    ) / tick_count_d );
+	std::printf( "  collisions  %.4f\n", TimeToMs( tick_stats.collisions  ) / tick_count_d );
+	std::printf( "  players     %.4f\n", TimeToMs( tick_stats.players     ) / tick_count_d );
+	std::printf( "  messages    %.4f\n", TimeToMs( tick_stats.messages    ) / tick_count_d );
+
+	server.DisconnectAllClients();
+	server.StopMap();
+
+	return 0;
+}
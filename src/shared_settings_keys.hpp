@@ -49,6 +49,8 @@ const char opengl_msaa_level[]= "r_msaa_level";
 const char shadows[]= "r_shadows";
 const char brightness[]= "r_brightness";
 
+const char lag_compensation_max_ms[]= "sv_lag_compensation_max_ms";
+
 } // namespace SettingsKeys
 
 } // PanzerChasm
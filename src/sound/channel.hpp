@@ -11,19 +11,24 @@ namespace Sound
 typedef short SampleType;
 class ISoundData;
 
+// Channel state. Owned by audio thread, changed only via driver commands.
 struct Channel
 {
 	static constexpr unsigned int c_max_channels= 32u;
 	static constexpr unsigned int  c_left_channel_number= 0u;
 	static constexpr unsigned int c_right_channel_number= 1u;
 
+	static constexpr int c_volume_bits= 15;
+	static constexpr int c_max_volume= ( 1 << c_volume_bits ) - 1;
+
 	bool is_active= false;
-	float volume[2]; // right/left volume
+	int volume[2]; // right/left volume, fixed point with c_volume_bits.
 
 	unsigned int position_samples;
 	bool looped;
+	unsigned int play_id= 0u;
 
-	ISoundData* src_sound_data= nullptr;
+	const ISoundData* src_sound_data= nullptr;
 };
 
 typedef std::array<Channel, Channel::c_max_channels> Channels;
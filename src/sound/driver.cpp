@@ -1,5 +1,10 @@
+#include <algorithm>
 #include <limits>
 
+#ifdef PC_SSE2_INSTRUCTIONS
+#include <emmintrin.h>
+#endif
+
 #include <SDL.h>
 
 #include "../assert.hpp"
@@ -29,12 +34,138 @@ static const unsigned int g_frac_bits= 10u;
 static const unsigned int g_frac= 1u << g_frac_bits;
 static const unsigned int g_frac_minus_one= g_frac - 1u;
 static_assert( g_frac_bits >= 8u, "Too low fractional bits" );
+static_assert( g_frac_bits <= 14u, "Too high fractional bits - interpolation weights must fit into 16 bits" );
+
+static unsigned int MaxDstSampleForSrcSample( const unsigned int i, const unsigned int freq_ratio_f )
+{
+	if( i == 0u ) return 0u;
+	const unsigned int result= ( ( i << g_frac_bits ) - 1u ) / freq_ratio_f;
+	PC_ASSERT( ( ( result * freq_ratio_f ) >> g_frac_bits ) < i );
+	return result + 1u;
+}
+
+// Convert source samples to signed values in range [ -128; 127 ].
+static int SignedSample( const unsigned char s )
+{
+	return int(s) - 128;
+}
+
+static int SignedSample( const signed char s )
+{
+	return s;
+}
+
+// Fill destination buffer with iterpolation,
+// because original game sounds have frequency about 11025 Hz, but destination buffer have frequency 22050 - 44100 Hz.
+// Result samples are 16-bit.
+template<class SrcSampleType>
+static void Resample(
+	const SrcSampleType* const src,
+	const unsigned int freq_ratio_f,
+	const unsigned int dst_sample_count,
+	SampleType* const dst )
+{
+	unsigned int i= 0u;
+
+#ifdef PC_SSE2_INSTRUCTIONS
+	for( ; i + 4u <= dst_sample_count; i+= 4u )
+	{
+		// Collect pairs of neighbor source samples and their weights, then interpolate 4 samples at once.
+		alignas(16) int16_t samples[8];
+		alignas(16) int16_t weights[8];
+		for( unsigned int j= 0u; j < 4u; j++ )
+		{
+			const unsigned int sample_coord_f= ( i + j ) * freq_ratio_f;
+			const unsigned int sample_coord= sample_coord_f >> g_frac_bits;
+			const unsigned int part= sample_coord_f & g_frac_minus_one;
+
+			samples[ j * 2u      ]= static_cast<int16_t>( SignedSample( src[ sample_coord      ] ) );
+			samples[ j * 2u + 1u ]= static_cast<int16_t>( SignedSample( src[ sample_coord + 1u ] ) );
+			weights[ j * 2u      ]= static_cast<int16_t>( g_frac - part );
+			weights[ j * 2u + 1u ]= static_cast<int16_t>( part );
+		}
+
+		const __m128i interpolated=
+			_mm_madd_epi16(
+				_mm_load_si128( reinterpret_cast<const __m128i*>( samples ) ),
+				_mm_load_si128( reinterpret_cast<const __m128i*>( weights ) ) );
+		const __m128i result= _mm_srai_epi32( interpolated, int(g_frac_bits) - 8 );
+		_mm_storel_epi64( reinterpret_cast<__m128i*>( dst + i ), _mm_packs_epi32( result, result ) );
+	}
+#endif
+
+	for( ; i < dst_sample_count; i++ )
+	{
+		const unsigned int sample_coord_f= i * freq_ratio_f;
+		const unsigned int sample_coord= sample_coord_f >> g_frac_bits;
+		const unsigned int part= sample_coord_f & g_frac_minus_one;
+
+		// Value in range [ -128 * g_frac; 127 * g_frac ]
+		const int interpolated=
+			SignedSample( src[ sample_coord ] ) * int( g_frac - part ) + SignedSample( src[ sample_coord + 1u ] ) * int( part );
+		dst[i]= static_cast<SampleType>( interpolated >> ( int(g_frac_bits) - 8 ) );
+	}
+}
+
+// Add mono samples to stereo mix buffer.
+static void MixToStereo(
+	const SampleType* const src,
+	const unsigned int sample_count,
+	const int* const volume,
+	int* const dst )
+{
+	unsigned int i= 0u;
+
+#ifdef PC_SSE2_INSTRUCTIONS
+	const __m128i volume_vec=
+		_mm_set_epi16(
+			short(volume[1]), short(volume[0]), short(volume[1]), short(volume[0]),
+			short(volume[1]), short(volume[0]), short(volume[1]), short(volume[0]) );
+
+	for( ; i + 8u <= sample_count; i+= 8u )
+	{
+		const __m128i samples= _mm_loadu_si128( reinterpret_cast<const __m128i*>( src + i ) );
+		const __m128i samples_duplicated[2]=
+		{
+			_mm_unpacklo_epi16( samples, samples ),
+			_mm_unpackhi_epi16( samples, samples ),
+		};
 
-const int g_volume_bits= 8;
-const int g_volume_scale= 1 << g_volume_bits;
+		for( unsigned int j= 0u; j < 2u; j++ )
+		{
+			// Calculate full 32-bit products.
+			const __m128i mul_lo= _mm_mullo_epi16( samples_duplicated[j], volume_vec );
+			const __m128i mul_hi= _mm_mulhi_epi16( samples_duplicated[j], volume_vec );
+
+			__m128i* const dst_vec= reinterpret_cast<__m128i*>( dst + ( i + j * 4u ) * 2u );
+			_mm_storeu_si128(
+				dst_vec,
+				_mm_add_epi32(
+					_mm_loadu_si128( dst_vec ),
+					_mm_srai_epi32( _mm_unpacklo_epi16( mul_lo, mul_hi ), Channel::c_volume_bits ) ) );
+			_mm_storeu_si128(
+				dst_vec + 1,
+				_mm_add_epi32(
+					_mm_loadu_si128( dst_vec + 1 ),
+					_mm_srai_epi32( _mm_unpackhi_epi16( mul_lo, mul_hi ), Channel::c_volume_bits ) ) );
+		}
+	}
+#endif
+
+	for( ; i < sample_count; i++ )
+	{
+		dst[ i * 2u      ]+= ( src[i] * volume[0] ) >> Channel::c_volume_bits;
+		dst[ i * 2u + 1u ]+= ( src[i] * volume[1] ) >> Channel::c_volume_bits;
+	}
+}
 
 Driver::Driver()
 {
+	for( std::atomic<uint32_t>& volume : channels_volumes_ )
+		volume.store( 0u );
+	for( std::atomic<unsigned int>& play_id : finished_play_ids_ )
+		play_id.store( 0u );
+
 	SDL_InitSubSystem( SDL_INIT_AUDIO );
 
 	SDL_AudioSpec requested_format;
@@ -80,6 +211,7 @@ Driver::Driver()
 	frequency_= obtained_format.freq;
 
 	mix_buffer_.resize( obtained_format.samples * g_left_and_right );
+	resampled_buffer_.resize( obtained_format.samples );
 
 	// Run
 	SDL_PauseAudioDevice( device_id_ , 0 );
@@ -94,21 +226,87 @@ Driver::~Driver()
 	SDL_QuitSubSystem( SDL_INIT_AUDIO );
 }
 
-void Driver::LockChannels()
+uint64_t Driver::PostCommand( const Command& command )
 {
-	if( device_id_ >= g_first_valid_device_id )
-		SDL_LockAudioDevice( device_id_ );
+	PC_ASSERT( command.channel < Channel::c_max_channels );
+	PC_ASSERT( command.type != Command::Type::Play || command.play_id != 0u );
+
+	posted_commands_count_++;
+
+	if( device_id_ < g_first_valid_device_id )
+	{
+		// No audio thread - nothing to do.
+		processed_commands_count_.store( posted_commands_count_ );
+		return posted_commands_count_;
+	}
+
+	if( pending_commands_.empty() && commands_queue_.Push( command ) )
+		return posted_commands_count_;
+
+	pending_commands_.push_back( command );
+	FlushCommands();
+	return posted_commands_count_;
 }
 
-void Driver::UnlockChannels()
+void Driver::FlushCommands()
 {
-	if( device_id_ >= g_first_valid_device_id )
-		SDL_UnlockAudioDevice( device_id_ );
+	unsigned int pushed= 0u;
+	while( pushed < pending_commands_.size() && commands_queue_.Push( pending_commands_[pushed] ) )
+		pushed++;
+
+	pending_commands_.erase( pending_commands_.begin(), pending_commands_.begin() + pushed );
+}
+
+uint64_t Driver::GetPostedCommandsCount() const
+{
+	return posted_commands_count_;
 }
 
-Channels& Driver::GetChannels()
+uint64_t Driver::GetProcessedCommandsCount() const
 {
-	return channels_;
+	return processed_commands_count_.load( std::memory_order_acquire );
+}
+
+void Driver::SetChannelVolume( const unsigned int channel, const float* const volume )
+{
+	PC_ASSERT( channel < Channel::c_max_channels );
+
+	uint32_t volume_packed= 0u;
+	for( unsigned int j= 0u; j < 2u; j++ )
+	{
+		const int v= std::max( 0, std::min( static_cast<int>( volume[j] * float( 1 << Channel::c_volume_bits ) ), Channel::c_max_volume ) );
+		volume_packed|= uint32_t(v) << ( j * 16u );
+	}
+
+	channels_volumes_[ channel ].store( volume_packed, std::memory_order_relaxed );
+}
+
+unsigned int Driver::GetFinishedPlayId( const unsigned int channel ) const
+{
+	PC_ASSERT( channel < Channel::c_max_channels );
+	return finished_play_ids_[ channel ].load( std::memory_order_acquire );
+}
+
+void Driver::StopAllChannels()
+{
+	const bool have_audio_thread= device_id_ >= g_first_valid_device_id;
+	if( have_audio_thread )
+		SDL_LockAudioDevice( device_id_ );
+
+	// Audio callback is not running now, so, we can act as queue consumer.
+	Command command;
+	while( commands_queue_.Pop( command ) ){}
+	pending_commands_.clear();
+	processed_commands_count_.store( posted_commands_count_ );
+
+	for( Channel& channel : channels_ )
+	{
+		channel.is_active= false;
+		channel.src_sound_data= nullptr;
+	}
+
+	if( have_audio_thread )
+		SDL_UnlockAudioDevice( device_id_ );
 }
 
 void SDLCALL Driver::AudioCallback( void* userdata, Uint8* stream, int len_bytes )
@@ -120,117 +318,135 @@ void SDLCALL Driver::AudioCallback( void* userdata, Uint8* stream, int len_bytes
 		static_cast<unsigned int>( len_bytes ) / ( sizeof(SampleType) * g_left_and_right ) );
 }
 
+void Driver::ProcessCommands()
+{
+	uint64_t processed= 0u;
+
+	Command command;
+	while( commands_queue_.Pop( command ) )
+	{
+		Channel& channel= channels_[ command.channel ];
+		switch( command.type )
+		{
+		case Command::Type::Play:
+			channel.is_active= true;
+			channel.looped= command.looped;
+			channel.src_sound_data= command.sound_data;
+			channel.position_samples= 0u;
+			channel.play_id= command.play_id;
+			break;
+
+		case Command::Type::Stop:
+			channel.is_active= false;
+			channel.src_sound_data= nullptr;
+			break;
+		};
+
+		processed++;
+	}
+
+	if( processed > 0u )
+		processed_commands_count_.fetch_add( processed, std::memory_order_release );
+}
+
 void Driver::FillAudioBuffer( SampleType* const buffer, const unsigned int sample_count )
 {
 	PC_ASSERT( sample_count * g_left_and_right <= mix_buffer_.size() );
 
+	ProcessCommands();
+
 	// Zero mix buffer.
-	for( unsigned int i= 0u; i < sample_count * g_left_and_right; i++ )
-		mix_buffer_[i]= 0;
+	std::fill( mix_buffer_.begin(), mix_buffer_.begin() + sample_count * g_left_and_right, 0 );
 
-	for( Channel& channel : channels_ )
+	for( unsigned int c= 0u; c < Channel::c_max_channels; c++ )
 	{
+		Channel& channel= channels_[c];
 		if( !channel.is_active || channel.src_sound_data == nullptr )
 			continue;
 
-		// Fill destination audio buffer with iterpolation,
-		// because original game sounds have frequency about 11025 Hz, but destination buffer have frequency 22050 - 44100 Hz.
-		const unsigned int freq_ratio_f= ( channel.src_sound_data->frequency_ << g_frac_bits ) / frequency_;
-		const int volume[2]=
-		{
-			static_cast<int>( channel.volume[0] * float( g_volume_scale ) ),
-			static_cast<int>( channel.volume[1] * float( g_volume_scale ) ),
-		};
+		const ISoundData& sound_data= *channel.src_sound_data;
+
+		const uint32_t volume_packed= channels_volumes_[c].load( std::memory_order_relaxed );
+		channel.volume[0]= static_cast<int>( volume_packed & 0xFFFFu );
+		channel.volume[1]= static_cast<int>( volume_packed >> 16u );
+
+		const unsigned int freq_ratio_f= ( sound_data.frequency_ << g_frac_bits ) / frequency_;
 
 		unsigned int channel_dst_samples_processed= 0u;
 		do
 		{
-			const auto max_dst_sample_for_src_sample=
-			[&]( const unsigned int i ) -> unsigned int
-			{
-				if( i == 0u ) return 0u;
-				const unsigned int result= ( ( i << g_frac_bits ) - 1u ) / freq_ratio_f;
-				PC_ASSERT( ( ( result * freq_ratio_f ) >> g_frac_bits ) < i );
-				return result + 1u;
-			};
-
-			int* const dst= mix_buffer_.data() + channel_dst_samples_processed * g_left_and_right;
-			const unsigned int can_read_src_samples= std::max( int( channel.src_sound_data->sample_count_ - channel.position_samples ) - 1, 0 );
+			const unsigned int start_position= channel.position_samples;
+			const unsigned int can_read_src_samples= std::max( int( sound_data.sample_count_ - channel.position_samples ) - 1, 0 );
 			const unsigned int dst_samples_to_write=
 				std::min(
 					sample_count - channel_dst_samples_processed,
-					max_dst_sample_for_src_sample( can_read_src_samples ) );
+					MaxDstSampleForSrcSample( can_read_src_samples, freq_ratio_f ) );
 
-			switch( channel.src_sound_data->data_type_ )
+			switch( sound_data.data_type_ )
 			{
 			case ISoundData::DataType::Unsigned8:
-				{
-					const unsigned char* const src=
-						static_cast<const unsigned char*>( channel.src_sound_data->data_ ) + channel.position_samples;
-
-					for( unsigned int i= 0u; i < dst_samples_to_write; i++ )
-					{
-						const unsigned int sample_coord_f= i * freq_ratio_f;
-						const unsigned int sample_coord= sample_coord_f >> g_frac_bits;
-						const unsigned int part= sample_coord_f & ( g_frac - 1u );
-						PC_ASSERT( sample_coord + 1u < channel.src_sound_data->sample_count_ - channel.position_samples );
-
-						// Value in range [ 0; 255 * g_frac ]
-						const unsigned int mixed_src_sample=
-							src[ sample_coord ] * ( g_frac - part ) + src[ sample_coord + 1u ] * part;
-						const int signed_sample= int( mixed_src_sample ) - ( 128 << g_frac_bits );
-
-						dst[ i * 2u      ]+= ( signed_sample * volume[0] ) >> ( int(g_frac_bits) + g_volume_bits - 8 );
-						dst[ i * 2u + 1u ]+= ( signed_sample * volume[1] ) >> ( int(g_frac_bits) + g_volume_bits - 8  );
-					}
-				}
+				Resample(
+					static_cast<const unsigned char*>( sound_data.data_ ) + channel.position_samples,
+					freq_ratio_f, dst_samples_to_write, resampled_buffer_.data() );
 				break;
 
 			case ISoundData::DataType::Signed8:
-			{
-				const char* const src=
-					static_cast<const char*>( channel.src_sound_data->data_ ) + channel.position_samples;
-
-				for( unsigned int i= 0u; i < dst_samples_to_write; i++ )
-				{
-					const unsigned int sample_coord_f= i * freq_ratio_f;
-					const unsigned int sample_coord= sample_coord_f >> g_frac_bits;
-					const unsigned int part= sample_coord_f & ( g_frac - 1u );
-					PC_ASSERT( sample_coord + 1u < channel.src_sound_data->sample_count_ - channel.position_samples );
-
-					// Value in range [ -128 * g_frac; 127 * g_frac ]
-					const int signed_sample=
-						int( src[ sample_coord ] * ( g_frac - part ) ) + int( src[ sample_coord + 1u ] * part );
-
-					dst[ i * 2u      ]+= ( signed_sample * volume[0] ) >> ( int(g_frac_bits) + g_volume_bits - 8 );
-					dst[ i * 2u + 1u ]+= ( signed_sample * volume[1] ) >> ( int(g_frac_bits) + g_volume_bits - 8 );
-				}
-			}
-			break;
+				Resample(
+					static_cast<const signed char*>( sound_data.data_ ) + channel.position_samples,
+					freq_ratio_f, dst_samples_to_write, resampled_buffer_.data() );
+				break;
 
 			case ISoundData::DataType::Signed16:
 			case ISoundData::DataType::Unsigned16:
 				PC_ASSERT( false ); // TODO
+				std::fill( resampled_buffer_.begin(), resampled_buffer_.begin() + dst_samples_to_write, 0 );
 				break;
 			};
 
+			MixToStereo(
+				resampled_buffer_.data(), dst_samples_to_write,
+				channel.volume,
+				mix_buffer_.data() + channel_dst_samples_processed * g_left_and_right );
+
 			channel.position_samples+= ( ( sample_count - channel_dst_samples_processed ) * freq_ratio_f ) >> g_frac_bits;
-			channel.position_samples= std::min( channel.position_samples, channel.src_sound_data->sample_count_ );
+			channel.position_samples= std::min( channel.position_samples, sound_data.sample_count_ );
 			channel_dst_samples_processed+= dst_samples_to_write;
 
 			if( channel.looped &&
-				( channel.position_samples >= channel.src_sound_data->sample_count_ || dst_samples_to_write == 0u ) )
+				( channel.position_samples >= sound_data.sample_count_ || dst_samples_to_write == 0u ) )
+			{
 				channel.position_samples= 0u;
+				if( dst_samples_to_write == 0u && start_position == 0u )
+					break; // Sound is too short for looping.
+			}
+
+		} while( channel.looped && channel_dst_samples_processed < sample_count );
 
-			} while( channel.looped && channel_dst_samples_processed < sample_count );
+		if( !channel.looped && channel.position_samples >= sound_data.sample_count_ )
+		{
+			channel.is_active= false;
+			channel.src_sound_data= nullptr;
+			finished_play_ids_[c].store( channel.play_id, std::memory_order_release );
+		}
 	} // for channels
 
 	// Copy mix buffer to result buffer.
-	for( unsigned int i= 0u; i < sample_count * g_left_and_right; i++ )
+	unsigned int i= 0u;
+#ifdef PC_SSE2_INSTRUCTIONS
+	for( ; i + 8u <= sample_count * g_left_and_right; i+= 8u )
+	{
+		const __m128i packed=
+			_mm_packs_epi32(
+				_mm_loadu_si128( reinterpret_cast<const __m128i*>( mix_buffer_.data() + i      ) ),
+				_mm_loadu_si128( reinterpret_cast<const __m128i*>( mix_buffer_.data() + i + 4u ) ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i*>( buffer + i ), packed );
+	}
+#endif
+	for( ; i < sample_count * g_left_and_right; i++ )
 	{
 		int s= mix_buffer_[i];
 		if( s > +32767 ) s= +32767;
-		if( s < -32767 ) s= -32767;
+		if( s < -32768 ) s= -32768;
 		buffer[i]= s;
 	}
 }
@@ -1,9 +1,12 @@
 #pragma once
+#include <atomic>
+#include <cstdint>
 #include <vector>
 
 #include <SDL_audio.h>
 
 #include "channel.hpp"
+#include "spsc_queue.hpp"
 
 namespace PanzerChasm
 {
@@ -11,27 +14,73 @@ namespace PanzerChasm
 namespace Sound
 {
 
+// Mixes channels in audio thread.
+// Game thread controls channels via commands queue and never waits for audio thread, except StopAllChannels call.
 class Driver final
 {
+public:
+	struct Command
+	{
+		enum class Type
+		{
+			Play, // Start playing sound from beginning.
+			Stop,
+		};
+
+		Type type;
+		unsigned int channel;
+		unsigned int play_id; // For "Play" command. Must be nonzero.
+		bool looped;
+		const ISoundData* sound_data;
+	};
+
 public:
 	Driver();
 	~Driver();
 
-	void LockChannels();
-	void UnlockChannels();
-	Channels& GetChannels();
+	// Game thread methods.
+
+	// Sound data, referenced by command, must live until command processing and channel stopping.
+	// Returns command id.
+	uint64_t PostCommand( const Command& command );
+	// Push commands, which was not fit into commands queue.
+	void FlushCommands();
+
+	uint64_t GetPostedCommandsCount() const;
+	uint64_t GetProcessedCommandsCount() const;
+
+	void SetChannelVolume( unsigned int channel, const float* volume );
+
+	// Returns id of last not looped sound of channel, which is over.
+	unsigned int GetFinishedPlayId( unsigned int channel ) const;
+
+	// Stop all channels and discard pending commands. Waits for audio thread.
+	// After this call sound data, referenced by channels, may be freed.
+	void StopAllChannels();
 
 private:
 	static void SDLCALL AudioCallback( void* userdata, Uint8* stream, int len_bytes );
+	void ProcessCommands();
 	void FillAudioBuffer( SampleType* buffer, unsigned int sample_count );
 
 private:
+	// Audio thread data.
 	Channels channels_;
+	std::vector<int> mix_buffer_;
+	std::vector<SampleType> resampled_buffer_;
+
+	// Shared data.
+	SPSCQueue< Command, 8u > commands_queue_;
+	std::atomic<uint64_t> processed_commands_count_{ 0u };
+	std::array< std::atomic<uint32_t>, Channel::c_max_channels > channels_volumes_; // Left and right volumes, packed.
+	std::array< std::atomic<unsigned int>, Channel::c_max_channels > finished_play_ids_;
+
+	// Game thread data.
+	std::vector<Command> pending_commands_;
+	uint64_t posted_commands_count_= 0u;
 
 	SDL_AudioDeviceID device_id_= 0u;
 	unsigned int frequency_; // samples per second
-
-	std::vector<int> mix_buffer_;
 };
 
 } // namespace Sound
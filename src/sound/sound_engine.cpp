@@ -1,9 +1,12 @@
+#include <limits>
+
 #include <matrix.hpp>
 
 #include "../assert.hpp"
 #include "../client/map_state.hpp"
 #include "../log.hpp"
 #include "../math_utils.hpp"
+#include "../profiler.hpp"
 #include "../settings.hpp"
 #include "../shared_settings_keys.hpp"
 
@@ -82,50 +85,27 @@ SoundEngine::~SoundEngine()
 
 void SoundEngine::Tick()
 {
-	UpdateAmbientSoundState();
-	UpdateObjectSoundState();
-	UpdateOneTimeSoundSource();
-	CalculateSourcesVolume();
-
-	driver_.LockChannels();
-
-	Channels& channels= driver_.GetChannels();
+	PC_PROFILER_ZONE( "SoundEngine::Tick" );
 
+	// Free sources, which sounds are over.
 	for( unsigned int i= 0u; i < Channel::c_max_channels; i++ )
 	{
-		Channel& channel= channels[i];
 		Source& source= sources_[i];
-
-		if( source.is_free )
-			channel.is_active= false;
-		else
+		ChannelState& channel_state= channels_states_[i];
+		if( channel_state.is_playing && driver_.GetFinishedPlayId(i) == channel_state.play_id )
 		{
-			channel.volume[0]= source.volume[0];
-			channel.volume[1]= source.volume[1];
-
-			if( !channel.is_active )
-				channel.position_samples= 0u;
-
-			channel.is_active= true;
-			channel.looped= source.looped;
-
-			if( &source == one_time_sound_source_ )
-				channel.src_sound_data= one_time_sound_source_data_.get();
-			else
-				channel.src_sound_data= sounds_[ source.sound_id ].get();
-
-			// Source is over
-			if( channel.is_active &&
-				channel.src_sound_data != nullptr &&
-				( !channel.looped && channel.position_samples >= channel.src_sound_data->sample_count_ ) )
-			{
+			channel_state.is_playing= false;
+			if( !source.is_free && source.started && !source.looped )
 				source.is_free= true;
-				channel.is_active= false;
-			}
 		}
 	}
 
-	driver_.UnlockChannels();
+	UpdateAmbientSoundState();
+	UpdateObjectSoundState();
+	UpdateOneTimeSoundSource();
+	CalculateSourcesVolume();
+	UpdateChannels();
+	FreeRetiredSounds();
 }
 
 void SoundEngine::UpdateMapState( const MapState& map_state )
@@ -240,7 +220,7 @@ void SoundEngine::PlayWorldSound(
 	source->is_free= false;
 	source->looped= false;
 	source->sound_id= sound_number;
-	source->pos_samples= 0u;
+	source->started= false;
 	source->is_head_relative= false;
 	source->pos= position;
 	source->monster_id= 0u;
@@ -262,7 +242,7 @@ void SoundEngine::PlayMonsterLinkedSound(
 	source->is_free= false;
 	source->looped= false;
 	source->sound_id= sound_number;
-	source->pos_samples= 0u;
+	source->started= false;
 	source->is_head_relative= false;
 	source->pos= monster.pos; // TODO - correct z coordinate
 	source->monster_id= monster_value.first;
@@ -289,7 +269,7 @@ void SoundEngine::PlayMonsterSound(
 	source->is_free= false;
 	source->looped= false;
 	source->sound_id= sound_number;
-	source->pos_samples= 0u;
+	source->started= false;
 	source->is_head_relative= false;
 	source->pos= monster.pos; // TODO - correct z coordinate
 	source->monster_id= monster_value.first;
@@ -310,7 +290,7 @@ void SoundEngine::PlayHeadSound( const unsigned int sound_number )
 	source->is_free= false;
 	source->looped= false;
 	source->sound_id= sound_number;
-	source->pos_samples= 0u;
+	source->started= false;
 	source->is_head_relative= true;
 	source->monster_id= 0u;
 }
@@ -322,27 +302,17 @@ void SoundEngine::PlayOneTimeSound( const char* const sound_data_file )
 		return;
 
 	if( one_time_sound_source_ != nullptr ) // Free and kill old sound.
+	{
 		one_time_sound_source_->is_free= true;
+		one_time_sound_source_= nullptr;
+	}
+	if( one_time_sound_source_data_ != nullptr )
+		RetireSound( std::move( one_time_sound_source_data_ ) );
 
 	one_time_sound_source_= GetFreeSource();
 	if( one_time_sound_source_ == nullptr )
 		return;
 
-	{ // Stop channel, which can play now old OneTimeSoundSource.
-		driver_.LockChannels();
-		Channels& channels= driver_.GetChannels();
-		for( unsigned int i= 0u; i < Channel::c_max_channels; i++ )
-		{
-			if( &sources_[i] == one_time_sound_source_ )
-			{
-				channels[i].is_active= false;
-				channels[i].src_sound_data= nullptr;
-				break;
-			}
-		}
-		driver_.UnlockChannels();
-	}
-
 	one_time_sound_source_data_= std::move(sound_data);
 
 	one_time_sound_source_->is_free= false;
@@ -350,7 +320,7 @@ void SoundEngine::PlayOneTimeSound( const char* const sound_data_file )
 	one_time_sound_source_->looped= false;
 	one_time_sound_source_->monster_id= 0u;
 	one_time_sound_source_->sound_id= 0u;
-	one_time_sound_source_->pos_samples= 0u;
+	one_time_sound_source_->started= false;
 }
 
 SoundEngine::Source* SoundEngine::GetFreeSource()
@@ -386,7 +356,7 @@ void SoundEngine::UpdateAmbientSoundState()
 
 				ambient_sound_source_->looped= true;
 				ambient_sound_source_->is_head_relative= true;
-				ambient_sound_source_->pos_samples= 0u;
+				ambient_sound_source_->started= false;
 				ambient_sound_source_->sound_id= sound_number;
 				ambient_sound_source_->monster_id= 0u;
 			}
@@ -396,7 +366,7 @@ void SoundEngine::UpdateAmbientSoundState()
 			if( ambient_sound_source_->sound_id != sound_number )
 			{
 				ambient_sound_source_->sound_id= sound_number;
-				ambient_sound_source_->pos_samples= 0u;
+				ambient_sound_source_->started= false;
 			}
 		}
 	}
@@ -424,7 +394,7 @@ void SoundEngine::UpdateObjectSoundState()
 
 				object_sound_source_->looped= true;
 				object_sound_source_->is_head_relative= false;
-				object_sound_source_->pos_samples= 0u;
+				object_sound_source_->started= false;
 				object_sound_source_->pos= objects_sounds_processor_.GetCurrentSoundPosition();
 				object_sound_source_->sound_id= sound_number;
 				object_sound_source_->monster_id= 0u;
@@ -435,7 +405,7 @@ void SoundEngine::UpdateObjectSoundState()
 			if( object_sound_source_->sound_id != sound_number )
 			{
 				object_sound_source_->sound_id= sound_number;
-				object_sound_source_->pos_samples= 0u;
+				object_sound_source_->started= false;
 			}
 			object_sound_source_->pos= objects_sounds_processor_.GetCurrentSoundPosition();
 		}
@@ -450,7 +420,7 @@ void SoundEngine::UpdateOneTimeSoundSource()
 		if( one_time_sound_source_->is_free )
 		{
 			// Free expired sound source.
-			one_time_sound_source_data_= nullptr;
+			RetireSound( std::move( one_time_sound_source_data_ ) );
 			one_time_sound_source_= nullptr;
 		}
 	}
@@ -533,27 +503,104 @@ void SoundEngine::CalculateSourcesVolume()
 	}
 }
 
-void SoundEngine::ForceStopAllChannels()
+void SoundEngine::UpdateChannels()
 {
-	ambient_sound_source_= nullptr;
-	object_sound_source_= nullptr;
+	for( unsigned int i= 0u; i < Channel::c_max_channels; i++ )
+	{
+		Source& source= sources_[i];
+		ChannelState& channel_state= channels_states_[i];
 
-	one_time_sound_source_data_= nullptr;
-	one_time_sound_source_= nullptr;
+		const ISoundData* sound_data= nullptr;
+		if( !source.is_free )
+		{
+			if( &source == one_time_sound_source_ )
+				sound_data= one_time_sound_source_data_.get();
+			else
+				sound_data= sounds_[ source.sound_id ].get();
+		}
+
+		if( sound_data == nullptr )
+		{
+			if( channel_state.is_playing )
+			{
+				Driver::Command command;
+				command.type= Driver::Command::Type::Stop;
+				command.channel= i;
+				driver_.PostCommand( command );
+
+				channel_state.is_playing= false;
+			}
+			continue;
+		}
+
+		driver_.SetChannelVolume( i, source.volume );
+
+		if( !source.started )
+		{
+			Driver::Command command;
+			command.type= Driver::Command::Type::Play;
+			command.channel= i;
+			command.play_id= next_play_id_;
+			command.looped= source.looped;
+			command.sound_data= sound_data;
+			driver_.PostCommand( command );
+
+			channel_state.is_playing= true;
+			channel_state.play_id= next_play_id_;
+			source.started= true;
+
+			next_play_id_++;
+			if( next_play_id_ == 0u ) next_play_id_= 1u;
+		}
+	}
+
+	driver_.FlushCommands();
+}
+
+void SoundEngine::RetireSound( ISoundDataConstPtr sound )
+{
+	// Command id will be set after posting of commands, which stop usage of this sound.
+	RetiredSound retired_sound;
+	retired_sound.data= std::move( sound );
+	retired_sound.command_id= std::numeric_limits<uint64_t>::max();
+	retired_sounds_.push_back( std::move( retired_sound ) );
+}
+
+void SoundEngine::FreeRetiredSounds()
+{
+	const uint64_t posted_commands_count= driver_.GetPostedCommandsCount();
+	const uint64_t processed_commands_count= driver_.GetProcessedCommandsCount();
+
+	for( auto it= retired_sounds_.begin(); it != retired_sounds_.end(); )
+	{
+		if( it->command_id == std::numeric_limits<uint64_t>::max() )
+			it->command_id= posted_commands_count;
+
+		if( processed_commands_count >= it->command_id )
+			it= retired_sounds_.erase( it );
+		else
+			++it;
+	}
+}
 
+void SoundEngine::ForceStopAllChannels()
+{
 	// Force stop all channels.
 	// This need, because driver life is longer, than life of sound data (global or map).
+	driver_.StopAllChannels();
 
-	driver_.LockChannels();
+	ambient_sound_source_= nullptr;
+	object_sound_source_= nullptr;
 
-	Channels& channels= driver_.GetChannels();
-	for( Channel& channel : channels )
-		channel.is_active= false;
+	one_time_sound_source_data_= nullptr;
+	one_time_sound_source_= nullptr;
 
-	driver_.UnlockChannels();
+	retired_sounds_.clear();
 
 	for( Source& source : sources_ )
 		source.is_free= true;
+	for( ChannelState& channel_state : channels_states_ )
+		channel_state.is_playing= false;
 }
 
 } // namespace Sound
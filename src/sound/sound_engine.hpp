@@ -57,7 +57,7 @@ private:
 
 		bool looped;
 		unsigned int sound_id;
-		unsigned int pos_samples;
+		bool started; // False, if sound must be (re)started from beginning.
 		bool is_head_relative;
 		m_Vec3 pos;
 		EntityId monster_id;
@@ -65,6 +65,20 @@ private:
 		float volume[2]; // calculated each tick
 	};
 
+	// State of driver channel, as it known in game thread.
+	struct ChannelState
+	{
+		bool is_playing= false;
+		unsigned int play_id= 0u;
+	};
+
+	// Sound data, which may be still used by audio thread.
+	struct RetiredSound
+	{
+		ISoundDataConstPtr data;
+		uint64_t command_id; // Data may be freed after processing of this command.
+	};
+
 private:
 
 	Source* GetFreeSource();
@@ -72,6 +86,9 @@ private:
 	void UpdateObjectSoundState();
 	void UpdateOneTimeSoundSource();
 	void CalculateSourcesVolume();
+	void UpdateChannels();
+	void RetireSound( ISoundDataConstPtr sound );
+	void FreeRetiredSounds();
 	void ForceStopAllChannels();
 
 private:
@@ -99,6 +116,10 @@ private:
 		sounds_;
 
 	Source sources_[ Channel::c_max_channels ];
+	ChannelState channels_states_[ Channel::c_max_channels ];
+	unsigned int next_play_id_= 1u;
+
+	std::vector<RetiredSound> retired_sounds_;
 
 	m_Vec3 head_position_;
 	m_Vec3 ears_vectors_[2];
@@ -0,0 +1,53 @@
+#pragma once
+#include <atomic>
+
+namespace PanzerChasm
+{
+
+namespace Sound
+{
+
+// Lock-free queue with fixed capacity for one producer thread and one consumer thread.
+template< class T, unsigned int capacity_log2 >
+class SPSCQueue final
+{
+public:
+	static constexpr unsigned int c_capacity= 1u << capacity_log2;
+
+	// Producer method. Returns false, if queue is full.
+	bool Push( const T& value )
+	{
+		const unsigned int tail= tail_.load( std::memory_order_relaxed );
+		if( tail - head_.load( std::memory_order_acquire ) == c_capacity )
+			return false;
+
+		storage_[ tail & c_mask ]= value;
+		tail_.store( tail + 1u, std::memory_order_release );
+		return true;
+	}
+
+	// Consumer method. Returns false, if queue is empty.
+	bool Pop( T& out_value )
+	{
+		const unsigned int head= head_.load( std::memory_order_relaxed );
+		if( head == tail_.load( std::memory_order_acquire ) )
+			return false;
+
+		out_value= storage_[ head & c_mask ];
+		head_.store( head + 1u, std::memory_order_release );
+		return true;
+	}
+
+private:
+	static constexpr unsigned int c_mask= c_capacity - 1u;
+
+	T storage_[ c_capacity ];
+
+	// Counters are not wrapped to capacity, so full and empty queue are distinguishable.
+	std::atomic<unsigned int> head_{ 0u }; // Written only by consumer.
+	std::atomic<unsigned int> tail_{ 0u }; // Written only by producer.
+};
+
+} // namespace Sound
+
+} // namespace PanzerChasm
@@ -1,6 +1,11 @@
+#include <algorithm>
 #include <cmath>
 #include <cstring>
 
+#ifdef PC_SSE2_INSTRUCTIONS
+#include <emmintrin.h>
+#endif
+
 #include <panzer_ogl_lib.hpp>
 
 #include "assert.hpp"
@@ -9,6 +14,8 @@
 #include "settings.hpp"
 #include "shared_settings_keys.hpp"
 
+#include "workers_pool.hpp"
+
 #include "system_window.hpp"
 
 namespace PanzerChasm
@@ -116,44 +123,111 @@ static void APIENTRY GLDebugMessageCallback(
 #endif
 
 
-template<class ScaleGetter>
-void SystemWindow::CopyAndScaleViewportToSystemViewport( const ScaleGetter& scale_getter )
+typedef void (*ScaleRowFunc)( const uint32_t* src, uint32_t* dst, unsigned int width, unsigned int scale );
+
+static void ScaleRow( const uint32_t* const src, uint32_t* const dst, const unsigned int width, const unsigned int scale )
+{
+	for( unsigned int x= 0u; x < width; x++ )
+		std::fill_n( dst + x * scale, scale, src[x] );
+}
+
+// Optimization.
+// Generate different functions (via template parameter) for some useful scales.
+// Replicate pixels with SSE2 stores, if it is available.
+template<unsigned int c_scale>
+static void ScaleRowFixed( const uint32_t* const src, uint32_t* const dst, const unsigned int width, const unsigned int scale )
+{
+	PC_ASSERT( scale == c_scale );
+	PC_UNUSED( scale );
+
+	unsigned int x= 0u;
+
+	#ifdef PC_SSE2_INSTRUCTIONS
+	static_assert( c_scale >= 2u && c_scale <= 4u, "Unsupported scale" );
+	for( ; x + 4u <= width; x+= 4u )
+	{
+		const __m128i pixels= _mm_loadu_si128( reinterpret_cast<const __m128i*>( src + x ) );
+		__m128i* const out= reinterpret_cast<__m128i*>( dst + x * c_scale );
+		if( c_scale == 2u )
+		{
+			_mm_storeu_si128( out + 0, _mm_unpacklo_epi32( pixels, pixels ) );
+			_mm_storeu_si128( out + 1, _mm_unpackhi_epi32( pixels, pixels ) );
+		}
+		else if( c_scale == 3u )
+		{
+			_mm_storeu_si128( out + 0, _mm_shuffle_epi32( pixels, _MM_SHUFFLE( 1, 0, 0, 0 ) ) );
+			_mm_storeu_si128( out + 1, _mm_shuffle_epi32( pixels, _MM_SHUFFLE( 2, 2, 1, 1 ) ) );
+			_mm_storeu_si128( out + 2, _mm_shuffle_epi32( pixels, _MM_SHUFFLE( 3, 3, 3, 2 ) ) );
+		}
+		else
+		{
+			_mm_storeu_si128( out + 0, _mm_shuffle_epi32( pixels, _MM_SHUFFLE( 0, 0, 0, 0 ) ) );
+			_mm_storeu_si128( out + 1, _mm_shuffle_epi32( pixels, _MM_SHUFFLE( 1, 1, 1, 1 ) ) );
+			_mm_storeu_si128( out + 2, _mm_shuffle_epi32( pixels, _MM_SHUFFLE( 2, 2, 2, 2 ) ) );
+			_mm_storeu_si128( out + 3, _mm_shuffle_epi32( pixels, _MM_SHUFFLE( 3, 3, 3, 3 ) ) );
+		}
+	}
+	#endif
+
+	// Compiler may optimize this loop, if scale is constant.
+	for( ; x < width; x++ )
+	for( unsigned int dx= 0u; dx < c_scale; dx++ )
+		dst[ x * c_scale + dx ]= src[x];
+}
+
+void SystemWindow::CopyAndScaleViewportToSystemViewport( const uint32_t* const src_pixels )
 {
 	PC_ASSERT( !IsOpenGLRenderer() );
 	PC_ASSERT( pixel_size_ > 1u );
 
-	const unsigned int scale= scale_getter();
+	const unsigned int scale= pixel_size_;
 	const unsigned int dst_width= surface_->pitch / sizeof(uint32_t);
+	const unsigned int src_width= viewport_size_.Width();
+	const unsigned int src_height= viewport_size_.Height();
+	uint32_t* const dst_pixels= static_cast<uint32_t*>(surface_->pixels);
 
-	for( unsigned int y= 0u; y < viewport_size_.Height(); y++ )
+	ScaleRowFunc scale_row_func;
+	switch( scale )
 	{
-		const uint32_t* const src= scaled_viewport_color_buffer_.data() + y * scaled_viewport_buffer_width_;
-		uint32_t* const dst=  static_cast<uint32_t*>(surface_->pixels) + dst_width * y * scale ;
+	case 2u: scale_row_func= ScaleRowFixed<2u>; break;
+	case 3u: scale_row_func= ScaleRowFixed<3u>; break;
+	case 4u: scale_row_func= ScaleRowFixed<4u>; break;
+	default: scale_row_func= ScaleRow; break;
+	};
 
-		for( unsigned int x= 0u; x < viewport_size_.Width(); x++ )
+	// Scale first row of each scaled row group, than copy it to other rows of group.
+	const auto scale_rows=
+	[&]( const unsigned int first_row, const unsigned int end_row )
+	{
+		for( unsigned int y= first_row; y < end_row; y++ )
 		{
-			const uint32_t color= src[x];
-			for( unsigned int dy= 0u; dy < scale; dy++ )
-			for( unsigned int dx= 0u; dx < scale; dx++ )
-				dst[ x * scale + dx + dy * dst_width ]= color;
-		}
+			const uint32_t* const src= src_pixels + y * scaled_viewport_buffer_width_;
+			uint32_t* const dst= dst_pixels + dst_width * y * scale;
 
-		unsigned int pixels_left= dst_width - viewport_size_.Width() * scale;
-		if( pixels_left > 0u )
-		{
-			unsigned int x= viewport_size_.Width();
-			const uint32_t color= src[x];
+			scale_row_func( src, dst, src_width, scale );
 
-			for( unsigned int dy= 0u; dy < scale; dy++ )
-			for( unsigned int dx= 0u; dx < pixels_left; dx++ )
-				dst[ x * scale + dx + dy * dst_width ]= color;
+			const unsigned int pixels_left= dst_width - src_width * scale;
+			if( pixels_left > 0u )
+				std::fill_n( dst + src_width * scale, pixels_left, src[ src_width - 1u ] );
+
+			for( unsigned int dy= 1u; dy < scale; dy++ )
+				std::memcpy( dst + dy * dst_width, dst, sizeof(uint32_t) * dst_width );
 		}
-	}
+	};
+
+	// Split rows into bands for threads. Make several bands per thread for better balancing.
+	const unsigned int band_count= std::min( present_workers_->GetThreadCount() * 2u, src_height );
+	present_workers_->Run(
+		band_count,
+		[&]( const unsigned int band )
+		{
+			scale_rows( src_height * band / band_count, src_height * ( band + 1u ) / band_count );
+		} );
 
-	unsigned int rows_left= surface_->h - viewport_size_.Height() * scale;
+	const unsigned int rows_left= surface_->h - src_height * scale;
 	if( rows_left > 0u )
 	{
-		uint32_t* const dst= reinterpret_cast<uint32_t*>( static_cast<unsigned char*>(surface_->pixels) + dst_width * viewport_size_.Height() * scale );
+		uint32_t* const dst= dst_pixels + dst_width * src_height * scale;
 
 		for( unsigned int y= 0u; y < rows_left; y++ )
 			std::memcpy(
@@ -436,12 +510,21 @@ windowed:
 		{
 			scaled_viewport_buffer_width_= ( viewport_size_.Width () + 3u ) & (~3u);
 			scaled_viewport_color_buffer_.resize( scaled_viewport_buffer_width_ * viewport_size_.Height() );
+			present_workers_.reset( new WorkersPool() );
+
+			if( settings_.GetOrSetBool( "r_present_thread", true ) )
+			{
+				present_color_buffer_.resize( scaled_viewport_color_buffer_.size() );
+				present_thread_= std::thread( &SystemWindow::PresentThreadFunc, this );
+			}
 		}
 	}
 }
 
 SystemWindow::~SystemWindow()
 {
+	StopPresentThread();
+
 	if( software_renderer_gl_texture_ != ~0u )
 		glDeleteTextures( 1u, &software_renderer_gl_texture_ );
 
@@ -533,6 +616,9 @@ void SystemWindow::BeginFrame()
 	}
 	else
 	{
+		// Show previous frame as early as possible, if present thread already scaled it.
+		FlipPresentedFrame( false );
+
 		if( pixel_size_ == 1u && SDL_MUSTLOCK( surface_ ) )
 			SDL_LockSurface( surface_ );
 
@@ -582,21 +668,35 @@ void SystemWindow::EndFrame()
 		if( pixel_size_ == 1u && SDL_MUSTLOCK( surface_ ) )
 			SDL_UnlockSurface( surface_ );
 
-		if( pixel_size_ > 1u )
+		if( present_thread_.joinable() )
 		{
+			// Flip previous frame and give current frame to present thread.
+			FlipPresentedFrame( true );
+
+			std::memcpy(
+				present_color_buffer_.data(),
+				scaled_viewport_color_buffer_.data(),
+				scaled_viewport_color_buffer_.size() * sizeof(uint32_t) );
+
+			// Surface stays locked, until frame is flipped.
 			if( SDL_MUSTLOCK( surface_ ) )
 				SDL_LockSurface( surface_ );
 
-			// Optimization.
-			// Generate different functions (via template parameter) for some useful scales.
-			// Compiler may optimize inner loops, if scale is constant.
-			switch( pixel_size_ )
 			{
-			case 2u: CopyAndScaleViewportToSystemViewport( []{ return 2u; } ); break;
-			case 3u: CopyAndScaleViewportToSystemViewport( []{ return 3u; } ); break;
-			case 4u: CopyAndScaleViewportToSystemViewport( []{ return 4u; } ); break;
-			default: CopyAndScaleViewportToSystemViewport( [this]{ return pixel_size_; } );  break;
-			};
+				std::unique_lock<std::mutex> lock( present_mutex_ );
+				present_requested_= true;
+			}
+			present_condition_.notify_all();
+			presented_frame_pending_= true;
+			return;
+		}
+
+		if( pixel_size_ > 1u )
+		{
+			if( SDL_MUSTLOCK( surface_ ) )
+				SDL_LockSurface( surface_ );
+
+			CopyAndScaleViewportToSystemViewport( scaled_viewport_color_buffer_.data() );
 
 			if( SDL_MUSTLOCK( surface_ ) )
 				SDL_UnlockSurface( surface_ );
@@ -606,6 +706,59 @@ void SystemWindow::EndFrame()
 	}
 }
 
+void SystemWindow::PresentThreadFunc()
+{
+	std::unique_lock<std::mutex> lock( present_mutex_ );
+	while( true )
+	{
+		present_condition_.wait( lock, [this]{ return present_requested_ || present_thread_quit_; } );
+		if( present_thread_quit_ )
+			return;
+
+		lock.unlock();
+		CopyAndScaleViewportToSystemViewport( present_color_buffer_.data() );
+		lock.lock();
+
+		present_requested_= false;
+		present_condition_.notify_all();
+	}
+}
+
+void SystemWindow::FlipPresentedFrame( const bool wait )
+{
+	if( !presented_frame_pending_ )
+		return;
+
+	{
+		std::unique_lock<std::mutex> lock( present_mutex_ );
+		if( wait )
+			present_condition_.wait( lock, [this]{ return !present_requested_; } );
+		else if( present_requested_ )
+			return;
+	}
+
+	if( SDL_MUSTLOCK( surface_ ) )
+		SDL_UnlockSurface( surface_ );
+
+	SDL_UpdateWindowSurface( window_ );
+	presented_frame_pending_= false;
+}
+
+void SystemWindow::StopPresentThread()
+{
+	if( !present_thread_.joinable() )
+		return;
+
+	FlipPresentedFrame( true );
+
+	{
+		std::unique_lock<std::mutex> lock( present_mutex_ );
+		present_thread_quit_= true;
+	}
+	present_condition_.notify_all();
+	present_thread_.join();
+}
+
 void SystemWindow::SetTitle( const std::string& title )
 {
 	SDL_SetWindowTitle( window_, title.c_str() );
@@ -1,4 +1,8 @@
 #pragma once
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <SDL.h>
 
@@ -56,8 +60,12 @@ private:
 	void GetVideoModes();
 	void UpdateBrightness();
 
-	template<class ScaleGetter>
-	void CopyAndScaleViewportToSystemViewport( const ScaleGetter& scale_getter );
+	void CopyAndScaleViewportToSystemViewport( const uint32_t* src_pixels );
+
+	void PresentThreadFunc();
+	// Flips frame, scaled by present thread. If "wait" is false, flips only already finished frame.
+	void FlipPresentedFrame( bool wait );
+	void StopPresentThread();
 
 private:
 	Settings& settings_;
@@ -75,6 +83,17 @@ private:
 	unsigned int pixel_size_;
 	std::vector<uint32_t> scaled_viewport_color_buffer_;
 	unsigned int scaled_viewport_buffer_width_= 0u;
+	std::unique_ptr<WorkersPool> present_workers_; // For scaling of viewport.
+
+	// Present thread scales finished frame, while main thread prepares next frame.
+	// Frame is copied into own buffer, because drawers write directly into "scaled_viewport_color_buffer_".
+	std::thread present_thread_;
+	std::vector<uint32_t> present_color_buffer_;
+	std::mutex present_mutex_;
+	std::condition_variable present_condition_;
+	bool present_requested_= false; // Protected by mutex. Reset by present thread after scaling.
+	bool present_thread_quit_= false; // Protected by mutex.
+	bool presented_frame_pending_= false; // Frame is given to present thread, but not flipped yet.
 
 	bool mouse_captured_= false;
 
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstring>
 
 #include "assert.hpp"
@@ -10,6 +11,8 @@
 namespace PanzerChasm
 {
 
+static const int g_glyph_rows= FontParams::letter_place_height - FontParams::letter_v_offset;
+
 TextDrawerSoft::TextDrawerSoft(
 	const RenderingContextSoft& rendering_context,
 	const GameResources& game_resources )
@@ -62,14 +65,16 @@ void TextDrawerSoft::Print(
 	const FontColor color,
 	const Alignment alignment )
 {
-	const PaletteTransformed& palette= *rendering_context_.palette_transformed;
+	if( scale == 0u )
+		return;
+
 	uint32_t* const dst_pixels= rendering_context_.window_surface_data;
 	const int dst_row_pixels= rendering_context_.row_pixels;
 	const int max_x= int( rendering_context_.viewport_size.Width () );
 	const int max_y= int( rendering_context_.viewport_size.Height() );
 
+	const ScaledFont& font= GetScaledFont( scale, color );
 	const int scale_i= int(scale);
-	const int d_tc_v= int(color) * int(FontParams::atlas_height);
 
 	int current_y= y;
 
@@ -83,7 +88,7 @@ void TextDrawerSoft::Print(
 		const char* line_end_c= c;
 		while( ! ( *line_end_c == '\n' || *line_end_c == '\0' ) )
 		{
-			line_width+= letters_width_[ int(*line_end_c) ];
+			line_width+= letters_width_[ static_cast<unsigned char>(*line_end_c) ];
 			line_end_c++;
 		}
 
@@ -95,6 +100,8 @@ void TextDrawerSoft::Print(
 		else
 			current_x= x;
 
+		const bool line_is_visible= current_y < max_y && current_y + g_glyph_rows * scale_i > 0;
+
 		while( !( *c == '\n' || *c == '\0' ) )
 		{
 			// Convert to unsigned - allow chars with codes 128 - 255.
@@ -102,32 +109,37 @@ void TextDrawerSoft::Print(
 
 			const int letter_width= int( letters_width_[ code ] );
 
-			const int glyph_tc_u= FontParams::letter_place_width  * ( int(code) & 15 ) + FontParams::letter_u_offset;
-			const int glyph_tc_v= FontParams::letter_place_height * ( int(code) >> 4 ) + FontParams::letter_v_offset + d_tc_v;
-
-			for( int glyph_y= 0; glyph_y < FontParams::letter_place_height - FontParams::letter_v_offset; glyph_y++ )
-			for( int glyph_x= 0; glyph_x < letter_width; glyph_x++ )
+			if( line_is_visible && current_x < max_x && current_x + letter_width * scale_i > 0 )
 			{
-				const unsigned char color_index=
-					font_texture_data_[
-						( glyph_tc_u + glyph_x ) +
-						( glyph_tc_v + glyph_y ) * int(FontParams::atlas_width) ];
-				if( color_index == 255u )
-					continue;
-
-				const uint32_t color= palette[color_index];
-
-				for( int sy= 0; sy < scale_i; sy++ )
+				for( int glyph_y= 0; glyph_y < g_glyph_rows; glyph_y++ )
 				{
-					const int dst_y= current_y + glyph_y * scale_i + sy;
-					if( dst_y < 0 || dst_y >= max_y ) continue;
+					const uint32_t runs_begin= font.rows_first_run[ code * g_glyph_rows + glyph_y      ];
+					const uint32_t runs_end  = font.rows_first_run[ code * g_glyph_rows + glyph_y + 1u ];
+					if( runs_begin == runs_end )
+						continue;
 
-					for( int sx= 0; sx < scale_i; sx++ )
-					{
-						const int dst_x= current_x + glyph_x * scale_i + sx;
-						if( dst_x < 0 || dst_x >= max_x ) continue;
+					const int dst_y_start= std::max( current_y + glyph_y * scale_i, 0 );
+					const int dst_y_end  = std::min( current_y + ( glyph_y + 1 ) * scale_i, max_y );
 
-						dst_pixels[ dst_x + dst_y * dst_row_pixels ]= color;
+					for( uint32_t r= runs_begin; r < runs_end; r++ )
+					{
+						const GlyphRun& run= font.runs[r];
+						const int run_x_start= current_x + int(run.x);
+						const int run_x_end= run_x_start + int(run.length);
+						const int dst_x_start= std::max( run_x_start, 0 );
+						const int dst_x_end  = std::min( run_x_end, max_x );
+						if( dst_x_start >= dst_x_end )
+							continue;
+
+						// Runs are short, so, simple loop is faster, than "memcpy" call.
+						const uint32_t* const src= font.pixels.data() + run.pixels_offset + ( dst_x_start - run_x_start );
+						const int length= dst_x_end - dst_x_start;
+						for( int dst_y= dst_y_start; dst_y < dst_y_end; dst_y++ )
+						{
+							uint32_t* const dst= dst_pixels + dst_x_start + dst_y * dst_row_pixels;
+							for( int i= 0; i < length; i++ )
+								dst[i]= src[i];
+						}
 					}
 				}
 			}
@@ -141,4 +153,62 @@ void TextDrawerSoft::Print(
 	}
 }
 
+const TextDrawerSoft::ScaledFont& TextDrawerSoft::GetScaledFont( const unsigned int scale, const FontColor color )
+{
+	for( const ScaledFont& font : scaled_fonts_ )
+		if( font.scale == scale && font.color == color )
+			return font;
+
+	// Palette is not changed after rendering context creation, so, scaled fonts are never invalidated.
+	const PaletteTransformed& palette= *rendering_context_.palette_transformed;
+	const int d_tc_v= int(color) * int(FontParams::atlas_height);
+
+	scaled_fonts_.emplace_back();
+	ScaledFont& font= scaled_fonts_.back();
+	font.scale= scale;
+	font.color= color;
+	font.rows_first_run.reserve( 256u * g_glyph_rows + 1u );
+
+	for( unsigned int code= 0u; code < 256u; code++ )
+	{
+		const int letter_width= int( letters_width_[ code ] );
+
+		const int glyph_tc_u= FontParams::letter_place_width  * ( int(code) & 15 ) + FontParams::letter_u_offset;
+		const int glyph_tc_v= FontParams::letter_place_height * ( int(code) >> 4 ) + FontParams::letter_v_offset + d_tc_v;
+
+		for( int glyph_y= 0; glyph_y < g_glyph_rows; glyph_y++ )
+		{
+			font.rows_first_run.push_back( static_cast<uint32_t>( font.runs.size() ) );
+
+			const unsigned char* const src_row= font_texture_data_ + glyph_tc_u + ( glyph_tc_v + glyph_y ) * int(FontParams::atlas_width);
+			int glyph_x= 0;
+			while( glyph_x < letter_width )
+			{
+				if( src_row[ glyph_x ] == 255u )
+				{
+					glyph_x++;
+					continue;
+				}
+
+				GlyphRun run;
+				run.x= uint32_t( glyph_x ) * scale;
+				run.pixels_offset= static_cast<uint32_t>( font.pixels.size() );
+
+				const int run_start= glyph_x;
+				while( glyph_x < letter_width && src_row[ glyph_x ] != 255u )
+				{
+					font.pixels.insert( font.pixels.end(), scale, palette[ src_row[ glyph_x ] ] );
+					glyph_x++;
+				}
+
+				run.length= uint32_t( glyph_x - run_start ) * scale;
+				font.runs.push_back( run );
+			}
+		}
+	}
+	font.rows_first_run.push_back( static_cast<uint32_t>( font.runs.size() ) );
+
+	return font;
+}
+
 } // namespace PanzerChasm
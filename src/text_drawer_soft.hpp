@@ -1,4 +1,6 @@
 #pragma once
+#include <cstdint>
+#include <vector>
 
 #include "fwd.hpp"
 #include "i_text_drawer.hpp"
@@ -25,11 +27,37 @@ public:
 		FontColor color,
 		Alignment alignment ) override;
 
+private:
+	// Horizontal run of nontransparent glyph pixels.
+	struct GlyphRun
+	{
+		uint32_t x; // Offset from glyph start, in scaled pixels.
+		uint32_t length; // In scaled pixels.
+		uint32_t pixels_offset;
+	};
+
+	// Font, expanded for specific scale and color.
+	// Glyph rows are scaled only horizontally - each row is copied "scale" times to screen.
+	struct ScaledFont
+	{
+		unsigned int scale;
+		FontColor color;
+		std::vector<uint32_t> pixels;
+		std::vector<GlyphRun> runs;
+		std::vector<uint32_t> rows_first_run; // Index of first run of each row of each glyph, plus end index.
+	};
+
+private:
+	const ScaledFont& GetScaledFont( unsigned int scale, FontColor color );
+
 private:
 	const RenderingContextSoft rendering_context_;
 	unsigned char letters_width_[256];
 
 	unsigned char font_texture_data_[ FontParams::atlas_width * FontParams::atlas_height * FontParams::colors_variations ];
+
+	// Created on demand. Usually only few combinations of scale and color are used.
+	std::vector<ScaledFont> scaled_fonts_;
 };
 
 } // namespace PanzerChasm
@@ -0,0 +1,104 @@
+#include <algorithm>
+
+#include "assert.hpp"
+
+#include "workers_pool.hpp"
+
+namespace PanzerChasm
+{
+
+// More threads are useless for frame work, because memory bandwidth is the bottleneck.
+static constexpr unsigned int c_max_threads= 8u;
+
+WorkersPool::WorkersPool( unsigned int thread_count )
+{
+	if( thread_count == 0u )
+		thread_count= std::max( 1u, std::min( std::thread::hardware_concurrency(), c_max_threads ) );
+
+	// Calling thread is also worker.
+	for( unsigned int i= 1u; i < thread_count; i++ )
+		threads_.emplace_back( &WorkersPool::ThreadFunc, this );
+}
+
+WorkersPool::~WorkersPool()
+{
+	{
+		std::unique_lock<std::mutex> lock( mutex_ );
+		quit_= true;
+	}
+	work_started_condition_.notify_all();
+
+	for( std::thread& thread : threads_ )
+		thread.join();
+}
+
+unsigned int WorkersPool::GetThreadCount() const
+{
+	return static_cast<unsigned int>( threads_.size() ) + 1u;
+}
+
+void WorkersPool::Run( const unsigned int task_count, const TaskFunc& func )
+{
+	if( task_count == 0u )
+		return;
+
+	if( threads_.empty() || task_count == 1u )
+	{
+		for( unsigned int i= 0u; i < task_count; i++ )
+			func( i );
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock( mutex_ );
+	PC_ASSERT( func_ == nullptr );
+
+	func_= &func;
+	task_count_= task_count;
+	next_task_= 0u;
+	generation_++;
+	work_started_condition_.notify_all();
+
+	while( ExecuteTask( lock ) ){}
+
+	work_finished_condition_.wait( lock, [this]{ return tasks_in_progress_ == 0u; } );
+	func_= nullptr;
+}
+
+void WorkersPool::ThreadFunc()
+{
+	unsigned int last_generation= 0u;
+
+	std::unique_lock<std::mutex> lock( mutex_ );
+	while( true )
+	{
+		work_started_condition_.wait( lock, [&]{ return quit_ || generation_ != last_generation; } );
+		if( quit_ )
+			return;
+
+		last_generation= generation_;
+		while( ExecuteTask( lock ) ){}
+	}
+}
+
+bool WorkersPool::ExecuteTask( std::unique_lock<std::mutex>& lock )
+{
+	if( func_ == nullptr || next_task_ >= task_count_ )
+		return false;
+
+	const unsigned int task_index= next_task_;
+	next_task_++;
+	tasks_in_progress_++;
+	const TaskFunc& func= *func_;
+
+	lock.unlock();
+	func( task_index );
+	lock.lock();
+
+	tasks_in_progress_--;
+	if( tasks_in_progress_ == 0u && next_task_ >= task_count_ )
+		work_finished_condition_.notify_all();
+
+	return true;
+}
+
+} // namespace PanzerChasm
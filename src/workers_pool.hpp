@@ -0,0 +1,51 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace PanzerChasm
+{
+
+// Persistent threads for splitting of frame work into parallel tasks.
+// Threads sleep between calls, so, pool does not waste processor time.
+class WorkersPool final
+{
+public:
+	typedef std::function<void(unsigned int task_index)> TaskFunc;
+
+public:
+	// If thread_count is zero, it is selected by hardware concurrency.
+	explicit WorkersPool( unsigned int thread_count= 0u );
+	~WorkersPool();
+
+	// Number of threads, including calling thread.
+	unsigned int GetThreadCount() const;
+
+	// Calls func for each task index in range [0; task_count). Calling thread also executes tasks.
+	// Returns after finishing of all tasks.
+	void Run( unsigned int task_count, const TaskFunc& func );
+
+private:
+	void ThreadFunc();
+	// Returns false, if no tasks left. Must be called with locked mutex.
+	bool ExecuteTask( std::unique_lock<std::mutex>& lock );
+
+private:
+	std::vector<std::thread> threads_;
+
+	std::mutex mutex_;
+	std::condition_variable work_started_condition_;
+	std::condition_variable work_finished_condition_;
+
+	// Protected by mutex.
+	const TaskFunc* func_= nullptr;
+	unsigned int task_count_= 0u;
+	unsigned int next_task_= 0u;
+	unsigned int tasks_in_progress_= 0u;
+	unsigned int generation_= 0u;
+	bool quit_= false;
+};
+
+} // namespace PanzerChasm